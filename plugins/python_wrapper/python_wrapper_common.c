@@ -70,6 +70,7 @@ const char* ATTR_SSH_SETTING = "ssh_setting";
 const char* ATTR_EXPORT_HINTS = "export_hints";
 const char* ATTR_PREF_LABEL = "pref_label";
 const char* ATTR_INIT_ORDER = "init_order";
+const char* ATTR_THREADED = "threaded";
 
 /**
  * To prevent some memory related attacks or accidental allocation of an excessive amount of byes, this limit should
@@ -79,6 +79,7 @@ extern const char* ATTR_SSH_SETTING;
 extern const char* ATTR_EXPORT_HINTS;
 extern const char* ATTR_PREF_LABEL;
 extern const char* ATTR_INIT_ORDER;
+extern const char* ATTR_THREADED;
 
 // You can enable this for debuggin purposes or specify it in the build.
 // #define WITH_PYTHON_TRACE_CALLS
@@ -134,6 +135,7 @@ typedef struct
 	RemminaPlugin* generic_plugin;
 	PyRemminaProtocolWidget* gp;
 	PyObject* instance;
+	gboolean threaded;
 } PyPlugin;
 
 /**
@@ -155,6 +157,15 @@ typedef struct
         return NULL; \
     }
 
+/**
+ * @brief	Takes the GIL for a call from Remmina into Python.
+ *
+ * @details	The GIL is not held while Remmina runs, so every callback entering Python has to be enclosed by
+ * 			PYTHON_WRAPPER_GIL_ENTER() and PYTHON_WRAPPER_GIL_LEAVE() in the same block.
+ */
+#define PYTHON_WRAPPER_GIL_ENTER() PyGILState_STATE python_wrapper_gil_state = PyGILState_Ensure()
+#define PYTHON_WRAPPER_GIL_LEAVE() PyGILState_Release(python_wrapper_gil_state)
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // A P I
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -64,7 +64,9 @@ static void python_wrapper_entry_entry_func_wrapper(RemminaEntryPlugin* instance
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
 	if (plugin)
 	{
+		PYTHON_WRAPPER_GIL_ENTER();
 		CallPythonMethod(plugin->instance, "entry_func", NULL);
+		PYTHON_WRAPPER_GIL_LEAVE();
 	}
 }
 
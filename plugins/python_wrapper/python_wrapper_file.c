@@ -62,7 +62,9 @@ static gboolean python_wrapper_file_import_test_func_wrapper(RemminaFilePlugin*
 
 	if (plugin)
 	{
+		PYTHON_WRAPPER_GIL_ENTER();
 		result = CallPythonMethod(plugin->instance, "import_test_func", "s", from_file);
+		PYTHON_WRAPPER_GIL_LEAVE();
 	}
 
 	return result == Py_None || result != Py_False;
@@ -80,7 +82,9 @@ static RemminaFile* python_wrapper_file_import_func_wrapper(RemminaFilePlugin* i
 		return NULL;
 	}
 
+	PYTHON_WRAPPER_GIL_ENTER();
 	result = CallPythonMethod(plugin->instance, "import_func", "s", from_file);
+	PYTHON_WRAPPER_GIL_LEAVE();
 
 	if (result == Py_None || result == Py_False)
 	{
@@ -99,10 +103,12 @@ static gboolean python_wrapper_file_export_test_func_wrapper(RemminaFilePlugin*
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
 	if (plugin)
 	{
+		PYTHON_WRAPPER_GIL_ENTER();
 		result = CallPythonMethod(plugin->instance,
 			"export_test_func",
 			"O",
 			python_wrapper_remmina_file_to_python(file));
+		PYTHON_WRAPPER_GIL_LEAVE();
 	}
 
 	return result == Py_None || result != Py_False;
@@ -118,7 +124,9 @@ python_wrapper_file_export_func_wrapper(RemminaFilePlugin* instance, RemminaFile
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
 	if (plugin)
 	{
+		PYTHON_WRAPPER_GIL_ENTER();
 		result = CallPythonMethod(plugin->instance, "export_func", "s", to_file);
+		PYTHON_WRAPPER_GIL_LEAVE();
 	}
 
 	return result == Py_None || result != Py_False;
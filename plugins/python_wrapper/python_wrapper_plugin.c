@@ -118,33 +118,13 @@ static int basename_no_ext(const char* in, char** out)
 	return length;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// A P I
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-
-gboolean python_wrapper_init(RemminaLanguageWrapperPlugin* plugin)
-{
-	TRACE_CALL(__func__);
-	assert(plugin);
-	return TRUE;
-}
-
-gboolean python_wrapper_load(RemminaLanguageWrapperPlugin* plugin, const char* name)
+/**
+ * @brief	Imports the Python plugin file, the caller holds the GIL.
+ */
+static gboolean python_wrapper_import(const char* name, char* filename)
 {
 	TRACE_CALL(__func__);
 
-	assert(plugin);
-	assert(name);
-
-
-	char* filename = NULL;
-	if (basename_no_ext(name, &filename) == 0)
-	{
-		g_printerr("[%s:%d]: Can not extract filename from '%s'!\n", __FILE__, __LINE__, name);
-		return FALSE;
-	}
-
 	PyObject* plugin_name = PyUnicode_DecodeFSDefault(filename);
 
 	if (!plugin_name)
@@ -188,6 +168,40 @@ gboolean python_wrapper_load(RemminaLanguageWrapperPlugin* plugin, const char* n
 	return FALSE;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A P I
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+gboolean python_wrapper_init(RemminaLanguageWrapperPlugin* plugin)
+{
+	TRACE_CALL(__func__);
+	assert(plugin);
+	return TRUE;
+}
+
+gboolean python_wrapper_load(RemminaLanguageWrapperPlugin* plugin, const char* name)
+{
+	TRACE_CALL(__func__);
+
+	assert(plugin);
+	assert(name);
+
+
+	char* filename = NULL;
+	if (basename_no_ext(name, &filename) == 0)
+	{
+		g_printerr("[%s:%d]: Can not extract filename from '%s'!\n", __FILE__, __LINE__, name);
+		return FALSE;
+	}
+
+	PYTHON_WRAPPER_GIL_ENTER();
+	gboolean result = python_wrapper_import(name, filename);
+	PYTHON_WRAPPER_GIL_LEAVE();
+
+	return result;
+}
+
 
 G_MODULE_EXPORT gboolean remmina_plugin_entry(RemminaPluginService *service);
 
@@ -215,6 +229,9 @@ gboolean remmina_plugin_entry(RemminaPluginService *service) {
 
 	python_wrapper_protocol_widget_init();
 
+	/* From now on every call into Python takes the GIL, see PYTHON_WRAPPER_GIL_ENTER() */
+	PyEval_SaveThread();
+
 	service->register_plugin((RemminaPlugin*)&remmina_python_wrapper);
 
 	return TRUE;
@@ -61,13 +61,16 @@ static GtkWidget* python_wrapper_pref_get_pref_body_wrapper(RemminaPrefPlugin* i
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
 
+	PYTHON_WRAPPER_GIL_ENTER();
+	GtkWidget* widget = NULL;
 	PyObject* result = CallPythonMethod(plugin->instance, "get_pref_body", NULL, NULL);
-	if (result == Py_None || result == NULL)
+	if (result != Py_None && result != NULL)
 	{
-		return NULL;
+		widget = get_pywidget(result);
 	}
+	PYTHON_WRAPPER_GIL_LEAVE();
 
-	return get_pywidget(result);
+	return widget;
 }
 
 RemminaPlugin* python_wrapper_create_pref_plugin(PyPlugin* plugin)
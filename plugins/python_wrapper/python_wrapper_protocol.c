@@ -44,12 +44,295 @@
 
 #include "python_wrapper_common.h"
 #include "python_wrapper_protocol.h"
+#include "python_wrapper_protocol_widget.h"
 #include "python_wrapper_remmina.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // D E C L A R A T I O N S
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Calls from Remmina that are run by the worker of a connection.
+ */
+typedef enum
+{
+	PYTHON_WRAPPER_CALL_OPEN_CONNECTION,
+	PYTHON_WRAPPER_CALL_CLOSE_CONNECTION,
+	PYTHON_WRAPPER_CALL_CALL_FEATURE,
+	PYTHON_WRAPPER_CALL_SEND_KEYSTROKES,
+	PYTHON_WRAPPER_CALL_QUIT
+} PythonWrapperCallType;
+
+typedef struct
+{
+	PythonWrapperCallType type;
+	RemminaProtocolWidget* gp;
+	const RemminaProtocolFeature* feature;
+	guint* keystrokes;
+	gint keylen;
+} PythonWrapperCall;
+
+typedef struct
+{
+	RemminaProtocolWidget* gp;
+	PythonWrapperServiceFunc func;
+} PythonWrapperDeferredCall;
+
+/**
+ * @brief	The worker thread of a connection to a threaded Python protocol plugin.
+ *
+ * @details	Connecting, disconnecting, features and keystrokes can take a while in Python, so they are queued to a
+ * 			thread of the connection instead of being run on the GTK thread. The GIL is taken once for all calls
+ * 			found in the queue.
+ */
+typedef struct _PythonWrapperWorker
+{
+	GThread* thread;
+	GAsyncQueue* calls;
+	GPtrArray* deferred;
+	PyPlugin* py_plugin;
+	PyRemminaProtocolWidget* pygp;
+} PythonWrapperWorker;
+
+/**
+ * @brief	The Python side of a connection, attached to its RemminaProtocolWidget.
+ *
+ * @details	Every connection has its own PyRemminaProtocolWidget, and its own worker when the plugin is threaded, so
+ * 			connections of the same plugin neither share state nor wait for each other.
+ */
+typedef struct
+{
+	PyPlugin* py_plugin;
+	PyRemminaProtocolWidget* pygp;
+	PythonWrapperWorker* worker;
+} PythonWrapperConnection;
+
+static const gchar* python_wrapper_connection_key = "python-wrapper-connection";
+
+/**
+ * The worker running on the current thread, if any.
+ */
+static GPrivate python_wrapper_current_worker = G_PRIVATE_INIT(NULL);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// U T I L S
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static gboolean python_wrapper_protocol_unref_idle(gpointer data)
+{
+	TRACE_CALL(__func__);
+	g_object_unref(data);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean python_wrapper_protocol_run_deferred(gpointer data)
+{
+	TRACE_CALL(__func__);
+	GPtrArray* deferred = (GPtrArray*)data;
+
+	for (guint i = 0; i < deferred->len; ++i)
+	{
+		PythonWrapperDeferredCall* call = (PythonWrapperDeferredCall*)g_ptr_array_index(deferred, i);
+		call->func(call->gp);
+		g_object_unref(call->gp);
+		g_free(call);
+	}
+	g_ptr_array_free(deferred, TRUE);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void python_wrapper_protocol_run_call(PyPlugin* py_plugin, PyRemminaProtocolWidget* pygp,
+	PythonWrapperCall* call)
+{
+	TRACE_CALL(__func__);
+	PyObject* result;
+
+	switch (call->type)
+	{
+	case PYTHON_WRAPPER_CALL_OPEN_CONNECTION:
+		result = CallPythonMethod(py_plugin->instance, "open_connection", "O", pygp);
+		if (result != Py_True)
+		{
+			/* What remmina_protocol_widget_open_connection_real() does when the plugin returns FALSE */
+			python_wrapper_protocol_defer(call->gp, python_wrapper_get_service()->protocol_widget_close_connection);
+		}
+		break;
+	case PYTHON_WRAPPER_CALL_CLOSE_CONNECTION:
+		CallPythonMethod(py_plugin->instance, "close_connection", "O", pygp);
+		break;
+	case PYTHON_WRAPPER_CALL_CALL_FEATURE:
+	{
+		PyRemminaProtocolFeature* pyFeature = python_wrapper_protocol_feature_new();
+		pyFeature->type = (gint)call->feature->type;
+		pyFeature->id = call->feature->id;
+		pyFeature->opt1 = python_wrapper_generic_new();
+		pyFeature->opt1->raw = call->feature->opt1;
+		pyFeature->opt1->type_hint = call->feature->opt1_type_hint;
+		pyFeature->opt2 = python_wrapper_generic_new();
+		pyFeature->opt2->raw = call->feature->opt2;
+		pyFeature->opt2->type_hint = call->feature->opt2_type_hint;
+		pyFeature->opt3 = python_wrapper_generic_new();
+		pyFeature->opt3->raw = call->feature->opt3;
+		pyFeature->opt3->type_hint = call->feature->opt3_type_hint;
+
+		CallPythonMethod(py_plugin->instance, "call_feature", "OO", pygp, pyFeature);
+		Py_DecRef((PyObject*)pyFeature);
+		Py_DecRef((PyObject*)pyFeature->opt1);
+		Py_DecRef((PyObject*)pyFeature->opt2);
+		Py_DecRef((PyObject*)pyFeature->opt3);
+		break;
+	}
+	case PYTHON_WRAPPER_CALL_SEND_KEYSTROKES:
+	{
+		PyObject* obj = PyList_New(call->keylen);
+		Py_IncRef(obj);
+		for (int i = 0; i < call->keylen; ++i)
+		{
+			PyList_SetItem(obj, i, PyLong_FromLong(call->keystrokes[i]));
+		}
+		CallPythonMethod(py_plugin->instance, "send_keystrokes", "OO", pygp, obj);
+		Py_DecRef(obj);
+		break;
+	}
+	case PYTHON_WRAPPER_CALL_QUIT:
+		break;
+	}
+}
+
+static gpointer python_wrapper_protocol_worker(gpointer data)
+{
+	TRACE_CALL(__func__);
+	PythonWrapperWorker* worker = (PythonWrapperWorker*)data;
+	PythonWrapperCall* call;
+	gboolean quit = FALSE;
+
+	g_private_set(&python_wrapper_current_worker, worker);
+
+	while (!quit && (call = (PythonWrapperCall*)g_async_queue_pop(worker->calls)))
+	{
+		PYTHON_WRAPPER_GIL_ENTER();
+		do
+		{
+			if (call->type == PYTHON_WRAPPER_CALL_QUIT)
+			{
+				/* Queued when gp is finalized, nothing can follow */
+				quit = TRUE;
+				g_free(call);
+				break;
+			}
+			python_wrapper_protocol_run_call(worker->py_plugin, worker->pygp, call);
+			/* The last reference to gp must be dropped on the GTK thread */
+			IDLE_ADD(python_wrapper_protocol_unref_idle, call->gp);
+			g_free(call->keystrokes);
+			g_free(call);
+		} while ((call = (PythonWrapperCall*)g_async_queue_try_pop(worker->calls)));
+		if (quit)
+		{
+			Py_DecRef((PyObject*)worker->pygp);
+		}
+		PYTHON_WRAPPER_GIL_LEAVE();
+
+		python_wrapper_protocol_flush();
+	}
+
+	g_private_set(&python_wrapper_current_worker, NULL);
+	g_async_queue_unref(worker->calls);
+	g_ptr_array_free(worker->deferred, TRUE);
+	g_free(worker);
+
+	return NULL;
+}
+
+static void python_wrapper_protocol_connection_free(gpointer data)
+{
+	TRACE_CALL(__func__);
+	PythonWrapperConnection* connection = (PythonWrapperConnection*)data;
+
+	if (connection->worker)
+	{
+		/* The worker owns pygp and frees itself */
+		PythonWrapperCall* call = g_new0(PythonWrapperCall, 1);
+		call->type = PYTHON_WRAPPER_CALL_QUIT;
+		g_async_queue_push(connection->worker->calls, call);
+	}
+	else
+	{
+		PYTHON_WRAPPER_GIL_ENTER();
+		Py_DecRef((PyObject*)connection->pygp);
+		PYTHON_WRAPPER_GIL_LEAVE();
+	}
+	g_free(connection);
+}
+
+/**
+ * Gets the Python side of the connection of gp, creating it with the first call from Remmina.
+ */
+static PythonWrapperConnection* python_wrapper_protocol_connection(RemminaProtocolWidget* gp)
+{
+	TRACE_CALL(__func__);
+	PythonWrapperConnection* connection = g_object_get_data(G_OBJECT(gp), python_wrapper_connection_key);
+
+	if (connection)
+	{
+		return connection;
+	}
+
+	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	if (!py_plugin)
+	{
+		return NULL;
+	}
+
+	connection = g_new0(PythonWrapperConnection, 1);
+	connection->py_plugin = py_plugin;
+
+	PYTHON_WRAPPER_GIL_ENTER();
+	connection->pygp = python_wrapper_protocol_widget_create();
+	connection->pygp->gp = gp;
+	PYTHON_WRAPPER_GIL_LEAVE();
+
+	if (py_plugin->threaded)
+	{
+		PythonWrapperWorker* worker = g_new0(PythonWrapperWorker, 1);
+		worker->calls = g_async_queue_new();
+		worker->deferred = g_ptr_array_new();
+		worker->py_plugin = py_plugin;
+		worker->pygp = connection->pygp;
+		connection->worker = worker;
+		worker->thread = g_thread_new(py_plugin->generic_plugin->name, python_wrapper_protocol_worker, worker);
+		g_thread_unref(worker->thread);
+	}
+
+	g_object_set_data_full(G_OBJECT(gp), python_wrapper_connection_key, connection,
+		python_wrapper_protocol_connection_free);
+	return connection;
+}
+
+/**
+ * Runs a call for the connection: queued to its worker if the plugin is threaded, right away on the GTK thread
+ * otherwise.
+ */
+static void python_wrapper_protocol_run(PythonWrapperConnection* connection, RemminaProtocolWidget* gp,
+	PythonWrapperCall* call)
+{
+	TRACE_CALL(__func__);
+
+	if (connection->worker)
+	{
+		call->gp = g_object_ref(gp);
+		g_async_queue_push(connection->worker->calls, call);
+		return;
+	}
+
+	call->gp = gp;
+	PYTHON_WRAPPER_GIL_ENTER();
+	python_wrapper_protocol_run_call(connection->py_plugin, connection->pygp, call);
+	PYTHON_WRAPPER_GIL_LEAVE();
+	g_free(call->keystrokes);
+	g_free(call);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // A P I
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -59,42 +342,87 @@ void python_wrapper_protocol_init(void)
 	TRACE_CALL(__func__);
 }
 
+void python_wrapper_protocol_defer(RemminaProtocolWidget* gp, PythonWrapperServiceFunc func)
+{
+	TRACE_CALL(__func__);
+	PythonWrapperWorker* worker = (PythonWrapperWorker*)g_private_get(&python_wrapper_current_worker);
+
+	if (!worker)
+	{
+		func(gp);
+		return;
+	}
+
+	PythonWrapperDeferredCall* call = g_new(PythonWrapperDeferredCall, 1);
+	call->gp = g_object_ref(gp);
+	call->func = func;
+	g_ptr_array_add(worker->deferred, call);
+}
+
+void python_wrapper_protocol_flush(void)
+{
+	TRACE_CALL(__func__);
+	PythonWrapperWorker* worker = (PythonWrapperWorker*)g_private_get(&python_wrapper_current_worker);
+
+	if (!worker || worker->deferred->len == 0)
+	{
+		return;
+	}
+
+	IDLE_ADD(python_wrapper_protocol_run_deferred, worker->deferred);
+	worker->deferred = g_ptr_array_new();
+}
+
 static void remmina_protocol_init_wrapper(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	py_plugin->gp->gp = gp;
-	CallPythonMethod(py_plugin->instance, "init", "O", py_plugin->gp);
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
+	CallPythonMethod(connection->py_plugin->instance, "init", "O", connection->pygp);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 static gboolean remmina_protocol_open_connection_wrapper(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	if (py_plugin)
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	if (!connection)
 	{
-		PyObject* result = CallPythonMethod(py_plugin->instance, "open_connection", "O", py_plugin->gp);
-		return result == Py_True;
+		return gtk_false();
 	}
-	else
+
+	if (connection->worker)
 	{
-		return gtk_false();
+		/* The result is handled by the worker */
+		PythonWrapperCall* call = g_new0(PythonWrapperCall, 1);
+		call->type = PYTHON_WRAPPER_CALL_OPEN_CONNECTION;
+		python_wrapper_protocol_run(connection, gp, call);
+		return TRUE;
 	}
+
+	PYTHON_WRAPPER_GIL_ENTER();
+	PyObject* result = CallPythonMethod(connection->py_plugin->instance, "open_connection", "O", connection->pygp);
+	gboolean ret = result == Py_True;
+	PYTHON_WRAPPER_GIL_LEAVE();
+	return ret;
 }
 
 static gboolean remmina_protocol_close_connection_wrapper(RemminaProtocolWidget* gp)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	PyObject* result = CallPythonMethod(py_plugin->instance, "close_connection", "O", py_plugin->gp);
-	return result == Py_True;
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PythonWrapperCall* call = g_new0(PythonWrapperCall, 1);
+	call->type = PYTHON_WRAPPER_CALL_CLOSE_CONNECTION;
+	python_wrapper_protocol_run(connection, gp, call);
+	return TRUE;
 }
 
 static gboolean remmina_protocol_query_feature_wrapper(RemminaProtocolWidget* gp,
 	const RemminaProtocolFeature* feature)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyRemminaProtocolFeature* pyFeature = python_wrapper_protocol_feature_new();
 	pyFeature->type = (gint)feature->type;
 	pyFeature->id = feature->id;
@@ -105,36 +433,25 @@ static gboolean remmina_protocol_query_feature_wrapper(RemminaProtocolWidget* gp
 	pyFeature->opt3 = python_wrapper_generic_new();
 	pyFeature->opt3->raw = feature->opt3;
 
-	PyObject* result = CallPythonMethod(py_plugin->instance, "query_feature", "OO", py_plugin->gp, pyFeature);
+	PyObject* result = CallPythonMethod(connection->py_plugin->instance, "query_feature", "OO", connection->pygp,
+		pyFeature);
 	Py_DecRef((PyObject*)pyFeature);
 	Py_DecRef((PyObject*)pyFeature->opt1);
 	Py_DecRef((PyObject*)pyFeature->opt2);
 	Py_DecRef((PyObject*)pyFeature->opt3);
+	PYTHON_WRAPPER_GIL_LEAVE();
 	return result == Py_True;
 }
 
 static void remmina_protocol_call_feature_wrapper(RemminaProtocolWidget* gp, const RemminaProtocolFeature* feature)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	PyRemminaProtocolFeature* pyFeature = python_wrapper_protocol_feature_new();
-	pyFeature->type = (gint)feature->type;
-	pyFeature->id = feature->id;
-	pyFeature->opt1 = python_wrapper_generic_new();
-	pyFeature->opt1->raw = feature->opt1;
-	pyFeature->opt1->type_hint = feature->opt1_type_hint;
-	pyFeature->opt2 = python_wrapper_generic_new();
-	pyFeature->opt2->raw = feature->opt2;
-	pyFeature->opt2->type_hint = feature->opt2_type_hint;
-	pyFeature->opt3 = python_wrapper_generic_new();
-	pyFeature->opt3->raw = feature->opt3;
-	pyFeature->opt3->type_hint = feature->opt3_type_hint;
-
-	CallPythonMethod(py_plugin->instance, "call_feature", "OO", py_plugin->gp, pyFeature);
-	Py_DecRef((PyObject*)pyFeature);
-	Py_DecRef((PyObject*)pyFeature->opt1);
-	Py_DecRef((PyObject*)pyFeature->opt2);
-	Py_DecRef((PyObject*)pyFeature->opt3);
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	/* Features point into the features array of the plugin, which is never freed */
+	PythonWrapperCall* call = g_new0(PythonWrapperCall, 1);
+	call->type = PYTHON_WRAPPER_CALL_CALL_FEATURE;
+	call->feature = feature;
+	python_wrapper_protocol_run(connection, gp, call);
 }
 
 static void remmina_protocol_send_keytrokes_wrapper(RemminaProtocolWidget* gp,
@@ -142,15 +459,12 @@ static void remmina_protocol_send_keytrokes_wrapper(RemminaProtocolWidget* gp,
 	const gint keylen)
 {
 	TRACE_CALL(__func__);
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	PyObject* obj = PyList_New(keylen);
-	Py_IncRef(obj);
-	for (int i = 0; i < keylen; ++i)
-	{
-		PyList_SetItem(obj, i, PyLong_FromLong(keystrokes[i]));
-	}
-	CallPythonMethod(py_plugin->instance, "send_keystrokes", "OO", py_plugin->gp, obj);
-	Py_DecRef(obj);
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PythonWrapperCall* call = g_new0(PythonWrapperCall, 1);
+	call->type = PYTHON_WRAPPER_CALL_SEND_KEYSTROKES;
+	call->keystrokes = g_memdup2(keystrokes, sizeof(guint) * keylen);
+	call->keylen = keylen;
+	python_wrapper_protocol_run(connection, gp, call);
 }
 
 static gboolean remmina_protocol_get_plugin_screenshot_wrapper(RemminaProtocolWidget* gp,
@@ -158,15 +472,18 @@ static gboolean remmina_protocol_get_plugin_screenshot_wrapper(RemminaProtocolWi
 {
 	TRACE_CALL(__func__);
 
-	PyPlugin* py_plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyRemminaPluginScreenshotData* data = python_wrapper_screenshot_data_new();
 	Py_IncRef((PyObject*)data);
-	PyObject* result = CallPythonMethod(py_plugin->instance, "get_plugin_screenshot", "OO", py_plugin->gp, data);
+	PyObject* result = CallPythonMethod(connection->py_plugin->instance, "get_plugin_screenshot", "OO",
+		connection->pygp, data);
 	if (result == Py_True)
 	{
 		if (!PyByteArray_Check((PyObject*)data->buffer))
 		{
 			g_printerr("Unable to parse screenshot data. 'buffer' needs to be an byte array!");
+			PYTHON_WRAPPER_GIL_LEAVE();
 			return 0;
 		}
 		Py_ssize_t buffer_len = PyByteArray_Size((PyObject*)data->buffer);
@@ -175,6 +492,7 @@ static gboolean remmina_protocol_get_plugin_screenshot_wrapper(RemminaProtocolWi
 		rpsd->buffer = (unsigned char*)python_wrapper_malloc(sizeof(unsigned char) * buffer_len);
 		if (!rpsd->buffer)
 		{
+			PYTHON_WRAPPER_GIL_LEAVE();
 			return 0;
 		}
 		memcpy(rpsd->buffer, PyByteArray_AsString((PyObject*)data->buffer), sizeof(unsigned char) * buffer_len);
@@ -185,21 +503,28 @@ static gboolean remmina_protocol_get_plugin_screenshot_wrapper(RemminaProtocolWi
 	}
 	Py_DecRef((PyObject*)data->buffer);
 	Py_DecRef((PyObject*)data);
+	PYTHON_WRAPPER_GIL_LEAVE();
 	return result == Py_True;
 }
 
 static gboolean remmina_protocol_map_event_wrapper(RemminaProtocolWidget* gp)
 {
-	PyPlugin* plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	PyObject* result = CallPythonMethod(plugin->instance, "map_event", "O", plugin->gp);
-	return PyBool_Check(result) && result == Py_True;
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
+	PyObject* result = CallPythonMethod(connection->py_plugin->instance, "map_event", "O", connection->pygp);
+	gboolean ret = PyBool_Check(result) && result == Py_True;
+	PYTHON_WRAPPER_GIL_LEAVE();
+	return ret;
 }
 
 static gboolean remmina_protocol_unmap_event_wrapper(RemminaProtocolWidget* gp)
 {
-	PyPlugin* plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
-	PyObject* result = CallPythonMethod(plugin->instance, "unmap_event", "O", plugin->gp);
-	return PyBool_Check(result) && result == Py_True;
+	PythonWrapperConnection* connection = python_wrapper_protocol_connection(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
+	PyObject* result = CallPythonMethod(connection->py_plugin->instance, "unmap_event", "O", connection->pygp);
+	gboolean ret = PyBool_Check(result) && result == Py_True;
+	PYTHON_WRAPPER_GIL_LEAVE();
+	return ret;
 }
 
 RemminaPlugin* python_wrapper_create_protocol_plugin(PyPlugin* plugin)
@@ -293,6 +618,10 @@ RemminaPlugin* python_wrapper_create_protocol_plugin(PyPlugin* plugin)
 		ATTR_SSH_SETTING,
 		REMMINA_PROTOCOL_SSH_SETTING_NONE);
 
+	/* Optional, the methods of a connection run on its own worker thread */
+	plugin->threaded = PyObject_HasAttrString(instance, ATTR_THREADED)
+		&& python_wrapper_get_attribute_long(instance, ATTR_THREADED, 0) != 0;
+
 	remmina_plugin->init = remmina_protocol_init_wrapper;                             // Plugin initialization
 	remmina_plugin->open_connection = remmina_protocol_open_connection_wrapper;       // Plugin open connection
 	remmina_plugin->close_connection = remmina_protocol_close_connection_wrapper;     // Plugin close connection
@@ -106,4 +106,36 @@ PyRemminaProtocolFeature* python_wrapper_protocol_feature_new(void);
  */
 PyRemminaPluginScreenshotData* python_wrapper_screenshot_data_new(void);
 
+/**
+ * A call to Remmina that does not return anything and may be deferred.
+ */
+typedef void (*PythonWrapperServiceFunc)(RemminaProtocolWidget* gp);
+
+/**
+ * @brief	Calls func for gp now on the GTK thread, or adds the call to the batch of the current protocol worker.
+ *
+ * @details	Calls made from a protocol worker are collected and handed over to the GTK thread in a single idle
+ * 			callback when the worker has run the calls in its queue, or before a blocking call into Remmina.
+ */
+void python_wrapper_protocol_defer(RemminaProtocolWidget* gp, PythonWrapperServiceFunc func);
+
+/**
+ * Hands over the calls deferred by the current protocol worker to the GTK thread. Does nothing on other threads.
+ */
+void python_wrapper_protocol_flush(void);
+
+/**
+ * @brief	Runs a call into Remmina that may block, e.g. waiting for the user, without holding the GIL.
+ *
+ * @details	Deferred calls are flushed first, so Remmina sees them in the order the plugin made them. Profile and
+ * 			protocol widget accessors must use it as well: off the GTK thread they wait for the GTK thread, which
+ * 			may itself be waiting for the GIL in a plugin callback.
+ */
+#define PYTHON_WRAPPER_BLOCKING_CALL(call) G_STMT_START { \
+		python_wrapper_protocol_flush(); \
+		Py_BEGIN_ALLOW_THREADS \
+		call; \
+		Py_END_ALLOW_THREADS \
+	} G_STMT_END
+
 G_END_DECLS
@@ -77,6 +77,11 @@
  * remmina.register_plugin(plugin)
  * @endcode
  *
+ * A plugin setting 'self.threaded = True' gets open_connection, close_connection, call_feature and send_keystrokes
+ * called from a worker thread of each connection, so they may block on I/O without freezing Remmina. Such a plugin
+ * must not use GTK in these methods: widgets are created in init, which is called on the GTK thread like
+ * query_feature and get_plugin_screenshot. Without it, every method is called on the GTK thread.
+ *
  *
  *
  * @see http://www.remmina.org/wp for more information.
@@ -234,7 +239,6 @@ PyRemminaProtocolWidget* python_wrapper_protocol_widget_create(void)
 	assert(result);
 
 	PyErr_Print();
-	Py_INCREF(result);
 	result->gp = NULL;
 	return result;
 }
@@ -462,7 +466,9 @@ static PyObject* protocol_widget_start_direct_tunnel(PyRemminaProtocolWidget* se
 
 	if (PyArg_ParseTuple(args, "ii", &default_port, &port_plus))
 	{
-		return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_start_direct_tunnel(self->gp, default_port, port_plus));
+		gchar* tunnel;
+		PYTHON_WRAPPER_BLOCKING_CALL(tunnel = python_wrapper_get_service()->protocol_widget_start_direct_tunnel(self->gp, default_port, port_plus));
+		return Py_BuildValue("s", tunnel);
 	}
 	else
 	{
@@ -489,15 +495,21 @@ static PyObject* protocol_widget_start_reverse_tunnel(PyRemminaProtocolWidget* s
 		return NULL;
 	}
 
-	return Py_BuildValue("p", python_wrapper_get_service()->protocol_widget_start_reverse_tunnel(self->gp, (gint)PyLong_AsLong(var_local_port)));
+	gint local_port = (gint)PyLong_AsLong(var_local_port);
+	gboolean started;
+	PYTHON_WRAPPER_BLOCKING_CALL(started = python_wrapper_get_service()->protocol_widget_start_reverse_tunnel(self->gp, local_port));
+	return Py_BuildValue("p", started);
 }
 
 static gboolean xport_tunnel_init(RemminaProtocolWidget* gp, gint remotedisplay, const gchar* server, gint port)
 {
 	TRACE_CALL(__func__);
 	PyPlugin* plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject* result = PyObject_CallMethod(plugin->instance, "xport_tunnel_init", "Oisi", gp, remotedisplay, server, port);
-	return PyObject_IsTrue(result);
+	gboolean ret = PyObject_IsTrue(result);
+	PYTHON_WRAPPER_GIL_LEAVE();
+	return ret;
 }
 
 static PyObject* protocol_widget_start_xport_tunnel(PyRemminaProtocolWidget* self, PyObject* args)
@@ -505,7 +517,9 @@ static PyObject* protocol_widget_start_xport_tunnel(PyRemminaProtocolWidget* sel
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("p", python_wrapper_get_service()->protocol_widget_start_xport_tunnel(self->gp, xport_tunnel_init));
+	gboolean started;
+	PYTHON_WRAPPER_BLOCKING_CALL(started = python_wrapper_get_service()->protocol_widget_start_xport_tunnel(self->gp, xport_tunnel_init));
+	return Py_BuildValue("p", started);
 }
 
 static PyObject* protocol_widget_set_display(PyRemminaProtocolWidget* self, PyObject* var_display)
@@ -535,7 +549,7 @@ static PyObject* protocol_widget_signal_connection_closed(PyRemminaProtocolWidge
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_signal_connection_closed(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_signal_connection_closed);
 	return Py_None;
 }
 
@@ -544,7 +558,7 @@ static PyObject* protocol_widget_signal_connection_opened(PyRemminaProtocolWidge
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_signal_connection_opened(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_signal_connection_opened);
 	return Py_None;
 }
 
@@ -553,7 +567,7 @@ static PyObject* protocol_widget_update_align(PyRemminaProtocolWidget* self, PyO
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_update_align(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_update_align);
 	return Py_None;
 }
 
@@ -562,7 +576,7 @@ static PyObject* protocol_widget_unlock_dynres(PyRemminaProtocolWidget* self, Py
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_unlock_dynres(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_unlock_dynres);
 	return Py_None;
 }
 
@@ -571,7 +585,7 @@ static PyObject* protocol_widget_desktop_resize(PyRemminaProtocolWidget* self, P
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_desktop_resize(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_desktop_resize);
 	return Py_None;
 }
 
@@ -583,7 +597,7 @@ static PyObject* protocol_widget_panel_new_certificate(PyRemminaProtocolWidget*
 
 	if (PyArg_ParseTuple(args, "sss", &subject, &issuer, &fingerprint))
 	{
-		python_wrapper_get_service()->protocol_widget_panel_new_certificate(self->gp, subject, issuer, fingerprint);
+		PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->protocol_widget_panel_new_certificate(self->gp, subject, issuer, fingerprint));
 	}
 	else
 	{
@@ -601,7 +615,7 @@ static PyObject* protocol_widget_panel_changed_certificate(PyRemminaProtocolWidg
 
 	if (PyArg_ParseTuple(args, "sss", &subject, &issuer, &new_fingerprint, &old_fingerprint))
 	{
-		python_wrapper_get_service()->protocol_widget_panel_changed_certificate(self->gp, subject, issuer, new_fingerprint, old_fingerprint);
+		PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->protocol_widget_panel_changed_certificate(self->gp, subject, issuer, new_fingerprint, old_fingerprint));
 	}
 	else
 	{
@@ -616,7 +630,9 @@ static PyObject* protocol_widget_get_username(PyRemminaProtocolWidget* self, PyO
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_username(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_username(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_password(PyRemminaProtocolWidget* self, PyObject* args)
@@ -624,7 +640,9 @@ static PyObject* protocol_widget_get_password(PyRemminaProtocolWidget* self, PyO
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_password(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_password(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_domain(PyRemminaProtocolWidget* self, PyObject* args)
@@ -632,7 +650,9 @@ static PyObject* protocol_widget_get_domain(PyRemminaProtocolWidget* self, PyObj
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_domain(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_domain(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_savepassword(PyRemminaProtocolWidget* self, PyObject* args)
@@ -640,7 +660,9 @@ static PyObject* protocol_widget_get_savepassword(PyRemminaProtocolWidget* self,
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("p", python_wrapper_get_service()->protocol_widget_get_savepassword(self->gp));
+	gboolean value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_savepassword(self->gp));
+	return Py_BuildValue("p", value);
 }
 
 static PyObject* protocol_widget_panel_authx509(PyRemminaProtocolWidget* self, PyObject* args)
@@ -648,7 +670,9 @@ static PyObject* protocol_widget_panel_authx509(PyRemminaProtocolWidget* self, P
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("i", python_wrapper_get_service()->protocol_widget_panel_authx509(self->gp));
+	gint ret;
+	PYTHON_WRAPPER_BLOCKING_CALL(ret = python_wrapper_get_service()->protocol_widget_panel_authx509(self->gp));
+	return Py_BuildValue("i", ret);
 }
 
 static PyObject* protocol_widget_get_cacert(PyRemminaProtocolWidget* self, PyObject* args)
@@ -656,7 +680,9 @@ static PyObject* protocol_widget_get_cacert(PyRemminaProtocolWidget* self, PyObj
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_cacert(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_cacert(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_cacrl(PyRemminaProtocolWidget* self, PyObject* args)
@@ -664,7 +690,9 @@ static PyObject* protocol_widget_get_cacrl(PyRemminaProtocolWidget* self, PyObje
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_cacrl(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_cacrl(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_clientcert(PyRemminaProtocolWidget* self, PyObject* args)
@@ -672,7 +700,9 @@ static PyObject* protocol_widget_get_clientcert(PyRemminaProtocolWidget* self, P
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_clientcert(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_clientcert(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_get_clientkey(PyRemminaProtocolWidget* self, PyObject* args)
@@ -680,7 +710,9 @@ static PyObject* protocol_widget_get_clientkey(PyRemminaProtocolWidget* self, Py
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	return Py_BuildValue("s", python_wrapper_get_service()->protocol_widget_get_clientkey(self->gp));
+	gchar* value;
+	PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->protocol_widget_get_clientkey(self->gp));
+	return Py_BuildValue("s", value);
 }
 
 static PyObject* protocol_widget_save_cred(PyRemminaProtocolWidget* self, PyObject* args)
@@ -688,7 +720,7 @@ static PyObject* protocol_widget_save_cred(PyRemminaProtocolWidget* self, PyObje
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_save_cred(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_save_cred);
 	return Py_None;
 }
 
@@ -700,7 +732,7 @@ static PyObject* protocol_widget_panel_show_listen(PyRemminaProtocolWidget* self
 
 	if (PyArg_ParseTuple(args, "i", &port))
 	{
-		python_wrapper_get_service()->protocol_widget_panel_show_listen(self->gp, port);
+		PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->protocol_widget_panel_show_listen(self->gp, port));
 	}
 	else
 	{
@@ -715,7 +747,7 @@ static PyObject* protocol_widget_panel_show_retry(PyRemminaProtocolWidget* self,
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_panel_show_retry(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_panel_show_retry);
 	return Py_None;
 }
 
@@ -724,7 +756,7 @@ static PyObject* protocol_widget_panel_show(PyRemminaProtocolWidget* self, PyObj
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_panel_show(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_panel_show);
 	return Py_None;
 }
 
@@ -733,7 +765,7 @@ static PyObject* protocol_widget_panel_hide(PyRemminaProtocolWidget* self, PyObj
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_panel_hide(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_panel_hide);
 	return Py_None;
 }
 
@@ -746,7 +778,7 @@ static PyObject* protocol_widget_ssh_exec(PyRemminaProtocolWidget* self, PyObjec
 
 	if (PyArg_ParseTuple(args, "ps", &wait, &cmd))
 	{
-		python_wrapper_get_service()->protocol_widget_ssh_exec(self->gp, wait, cmd);
+		PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->protocol_widget_ssh_exec(self->gp, wait, cmd));
 	}
 	else
 	{
@@ -759,13 +791,17 @@ static PyObject* protocol_widget_ssh_exec(PyRemminaProtocolWidget* self, PyObjec
 static void _on_send_callback_wrapper(RemminaProtocolWidget* gp, const gchar* text)
 {
 	PyPlugin* plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject_CallMethod(plugin->instance, "on_send", "Os", gp, text);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 static void _on_destroy_callback_wrapper(RemminaProtocolWidget* gp)
 {
 	PyPlugin* plugin = python_wrapper_get_plugin_by_protocol_widget(gp);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject_CallMethod(plugin->instance, "on_destroy", "O", gp);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 static PyObject* protocol_widget_chat_open(PyRemminaProtocolWidget* self, PyObject* var_name)
@@ -791,7 +827,7 @@ static PyObject* protocol_widget_chat_close(PyRemminaProtocolWidget* self, PyObj
 	TRACE_CALL(__func__);
 	SELF_CHECK()
 
-	python_wrapper_get_service()->protocol_widget_panel_hide(self->gp);
+	python_wrapper_protocol_defer(self->gp, python_wrapper_get_service()->protocol_widget_panel_hide);
 	return Py_None;
 }
 
@@ -803,7 +839,7 @@ static PyObject* protocol_widget_chat_receive(PyRemminaProtocolWidget* self, PyO
 
 	if (PyArg_ParseTuple(args, "s", &text))
 	{
-		python_wrapper_get_service()->protocol_widget_chat_receive(self->gp, text);
+		PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->protocol_widget_chat_receive(self->gp, text));
 	}
 	else
 	{
@@ -787,6 +787,7 @@ static PyObject* remmina_register_plugin_wrapper(PyObject* self, PyObject* plugi
 		plugin->pref_plugin = NULL;
 		plugin->secret_plugin = NULL;
 		plugin->tool_plugin = NULL;
+		plugin->threaded = FALSE;
 		g_print("New Python plugin registered: %ld\n", PyObject_Hash(plugin_instance));
 
 		if (g_str_equal(pluginType, "protocol"))
@@ -1214,7 +1215,8 @@ static PyObject* remmina_protocol_plugin_signal_connection_closed_wrapper(PyObje
 		return Py_None;
 	}
 
-	python_wrapper_get_service()->protocol_plugin_signal_connection_closed(((PyRemminaProtocolWidget*)pygp)->gp);
+	python_wrapper_protocol_defer(((PyRemminaProtocolWidget*)pygp)->gp,
+		python_wrapper_get_service()->protocol_plugin_signal_connection_closed);
 	return Py_None;
 }
 
@@ -1242,8 +1244,10 @@ static PyObject* remmina_protocol_plugin_init_auth_wrapper(PyObject* module, PyO
 		}
 		else
 		{
-			return Py_BuildValue("i", python_wrapper_get_service()->protocol_widget_panel_auth(self
+			gint ret;
+			PYTHON_WRAPPER_BLOCKING_CALL(ret = python_wrapper_get_service()->protocol_widget_panel_auth(self
 				->gp, pflags, title, default_username, default_password, default_domain, password_prompt));
+			return Py_BuildValue("i", ret);
 		}
 	}
 	else
@@ -1263,6 +1267,7 @@ static PyObject* remmina_protocol_plugin_signal_connection_opened_wrapper(PyObje
 		return Py_None;
 	}
 
-	python_wrapper_get_service()->protocol_plugin_signal_connection_opened(((PyRemminaProtocolWidget*)pygp)->gp);
+	python_wrapper_protocol_defer(((PyRemminaProtocolWidget*)pygp)->gp,
+		python_wrapper_get_service()->protocol_plugin_signal_connection_opened);
 	return Py_None;
 }
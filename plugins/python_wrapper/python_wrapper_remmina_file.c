@@ -39,6 +39,7 @@
 #include "remmina/remmina_trace_calls.h"
 #include "python_wrapper_common.h"
 #include "python_wrapper_remmina_file.h"
+#include "python_wrapper_protocol.h"
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // D E C L A R A T I O N S
@@ -116,7 +117,8 @@ static PyObject* file_set_setting(PyRemminaFile* self, PyObject* args, PyObject*
 	{
 		if (PyUnicode_Check(value))
 		{
-			python_wrapper_get_service()->file_set_string(self->file, key, PyUnicode_AsUTF8(value));
+			const gchar* str = PyUnicode_AsUTF8(value);
+			PYTHON_WRAPPER_BLOCKING_CALL(python_wrapper_get_service()->file_set_string(self->file, key, str));
 		}
 		else if (PyLong_Check(value))
 		{
@@ -148,7 +150,9 @@ static PyObject* file_get_setting(PyRemminaFile* self, PyObject* args, PyObject*
 	{
 		if (PyUnicode_Check(def))
 		{
-			return Py_BuildValue("s", python_wrapper_get_service()->file_get_string(self->file, key));
+			const gchar* value;
+			PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->file_get_string(self->file, key));
+			return Py_BuildValue("s", value);
 		}
 		else if (PyBool_Check(def))
 		{
@@ -178,7 +182,12 @@ static PyObject* file_get_secret(PyRemminaFile* self, PyObject* key)
 
 	if (key && PyUnicode_Check(key))
 	{
-		return Py_BuildValue("s", python_wrapper_get_service()->file_get_secret(self->file, PyUnicode_AsUTF8(key)));
+		const gchar* setting = PyUnicode_AsUTF8(key);
+		gchar* value;
+		PYTHON_WRAPPER_BLOCKING_CALL(value = python_wrapper_get_service()->file_get_secret(self->file, setting));
+		PyObject* result = Py_BuildValue("s", value);
+		g_free(value);
+		return result;
 	}
 	else
 	{
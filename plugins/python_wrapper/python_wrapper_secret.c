@@ -53,7 +53,9 @@ static gboolean python_wrapper_secret_init_wrapper(RemminaSecretPlugin* instance
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject* result = CallPythonMethod(plugin->instance, "init", NULL);
+	PYTHON_WRAPPER_GIL_LEAVE();
 	return result == Py_None || result != Py_False;
 }
 
@@ -62,7 +64,9 @@ static gboolean python_wrapper_secret_is_service_available_wrapper(RemminaSecret
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject* result = CallPythonMethod(plugin->instance, "is_service_available", NULL);
+	PYTHON_WRAPPER_GIL_LEAVE();
 	return result == Py_None || result != Py_False;
 }
 
@@ -72,8 +76,10 @@ python_wrapper_secret_store_password_wrapper(RemminaSecretPlugin* instance, Remm
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	PYTHON_WRAPPER_GIL_ENTER();
 	CallPythonMethod(plugin
 		->instance, "store_password", "Oss", (PyObject*)python_wrapper_remmina_file_to_python(file), key, password);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 static gchar*
@@ -82,15 +88,18 @@ python_wrapper_secret_get_password_wrapper(RemminaSecretPlugin* instance, Remmin
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	gchar* password = NULL;
+	PYTHON_WRAPPER_GIL_ENTER();
 	PyObject* result = CallPythonMethod(plugin
 		->instance, "get_password", "Os", (PyObject*)python_wrapper_remmina_file_to_python(file), key);
 	Py_ssize_t len = PyUnicode_GetLength(result);
-	if (len == 0)
+	if (len != 0)
 	{
-		return NULL;
+		password = python_wrapper_copy_string_from_python(result, len);
 	}
+	PYTHON_WRAPPER_GIL_LEAVE();
 
-	return python_wrapper_copy_string_from_python(result, len);
+	return password;
 }
 
 static void
@@ -99,8 +108,10 @@ python_wrapper_secret_delete_password_wrapper(RemminaSecretPlugin* instance, Rem
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	PYTHON_WRAPPER_GIL_ENTER();
 	CallPythonMethod(plugin
 		->instance, "delete_password", "Os", (PyObject*)python_wrapper_remmina_file_to_python(file), key);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 RemminaPlugin* python_wrapper_create_secret_plugin(PyPlugin* plugin)
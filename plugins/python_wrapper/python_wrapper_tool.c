@@ -52,7 +52,9 @@ static void python_wrapper_tool_exec_func_wrapper(GtkMenuItem* self, RemminaTool
 	TRACE_CALL(__func__);
 
 	PyPlugin* plugin = python_wrapper_get_plugin(instance->name);
+	PYTHON_WRAPPER_GIL_ENTER();
 	CallPythonMethod(plugin->instance, "exec_func", NULL);
+	PYTHON_WRAPPER_GIL_LEAVE();
 }
 
 RemminaPlugin* python_wrapper_create_tool_plugin(PyPlugin* plugin)
@@ -36,12 +36,13 @@
 
 #include "rdp_plugin.h"
 #include "rdp_cliprdr.h"
+#include "rdp_cliprdr_text.h"
+#include "rdp_cliprdr_file.h"
 #include "rdp_event.h"
 
 #include <freerdp/freerdp.h>
 #include <freerdp/channels/channels.h>
 #include <freerdp/client/cliprdr.h>
-#include <sys/time.h>
 
 #define CLIPBOARD_TRANSFER_WAIT_TIME 6
 
@@ -95,71 +96,17 @@ void remmina_rdp_cliprdr_get_target_types(UINT32 **formats, UINT16 *size, GdkAto
 	*formats = realloc(*formats, sizeof(UINT32) * (*size));
 }
 
-static UINT8 *lf2crlf(UINT8 *data, int *size)
+static UINT remmina_rdp_cliprdr_server_file_contents_request(CliprdrClientContext *context, const CLIPRDR_FILE_CONTENTS_REQUEST *fileContentsRequest)
 {
 	TRACE_CALL(__func__);
-	UINT8 c;
-	UINT8 *outbuf;
-	UINT8 *out;
-	UINT8 *in_end;
-	UINT8 *in;
-	int out_size;
-
-	out_size = (*size) * 2 + 1;
-	outbuf = (UINT8 *)malloc(out_size);
-	out = outbuf;
-	in = data;
-	in_end = data + (*size);
-
-	while (in < in_end) {
-		c = *in++;
-		if (c == '\n') {
-			*out++ = '\r';
-			*out++ = '\n';
-		} else {
-			*out++ = c;
-		}
-	}
-
-	*out++ = 0;
-	*size = out - outbuf;
-
-	return outbuf;
-}
-
-static void crlf2lf(UINT8 *data, size_t *size)
-{
-	TRACE_CALL(__func__);
-	UINT8 c;
-	UINT8 *out;
-	UINT8 *in;
-	UINT8 *in_end;
-
-	out = data;
-	in = data;
-	in_end = data + (*size);
-
-	while (in < in_end) {
-		c = *in++;
-		if (c != '\r')
-			*out++ = c;
-	}
-
-	*size = out - data;
+	/* The server is pasting files we offered: answered from disk on this thread */
+	return remmina_rdp_cliprdr_file_contents_request((rfClipboard *)context->custom, fileContentsRequest);
 }
 
-/* Never used? */
-int remmina_rdp_cliprdr_server_file_contents_request(CliprdrClientContext *context, CLIPRDR_FILE_CONTENTS_REQUEST *fileContentsRequest)
+static UINT remmina_rdp_cliprdr_server_file_contents_response(CliprdrClientContext *context, const CLIPRDR_FILE_CONTENTS_RESPONSE *fileContentsResponse)
 {
 	TRACE_CALL(__func__);
-	return -1;
-}
-
-/* Never used? */
-int remmina_rdp_cliprdr_server_file_contents_response(CliprdrClientContext *context, CLIPRDR_FILE_CONTENTS_RESPONSE *fileContentsResponse)
-{
-	TRACE_CALL(__func__);
-	return 1;
+	return remmina_rdp_cliprdr_file_contents_response((rfClipboard *)context->custom, fileContentsResponse);
 }
 
 void remmina_rdp_cliprdr_send_client_format_list(RemminaProtocolWidget *gp)
@@ -168,23 +115,19 @@ void remmina_rdp_cliprdr_send_client_format_list(RemminaProtocolWidget *gp)
 	RemminaPluginRdpUiObject *ui;
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
 	rfClipboard *clipboard;
-	CLIPRDR_FORMAT_LIST *pFormatList;
-	RemminaPluginRdpEvent rdp_event = { 0 };
 
 	if (!rfi || !rfi->connected || rfi->is_reconnecting)
 		return;
 
 	clipboard = &(rfi->clipboard);
 
+	/* The GTK thread asks the local targets and sends the format list
+	 * when they arrive, see remmina_rdp_cliprdr_request_client_format_list() */
 	ui = g_new0(RemminaPluginRdpUiObject, 1);
 	ui->type = REMMINA_RDP_UI_CLIPBOARD;
 	ui->clipboard.clipboard = clipboard;
 	ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_FORMATLIST;
-	pFormatList = remmina_rdp_event_queue_ui_sync_retptr(gp, ui);
-
-	rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_LIST;
-	rdp_event.clipboard_formatlist.pFormatList = pFormatList;
-	remmina_rdp_event_event_push(gp, &rdp_event);
+	remmina_rdp_event_queue_ui_async(gp, ui);
 }
 
 static void remmina_rdp_cliprdr_send_client_capabilities(rfClipboard *clipboard)
@@ -200,7 +143,8 @@ static void remmina_rdp_cliprdr_send_client_capabilities(rfClipboard *clipboard)
 	generalCapabilitySet.capabilitySetLength = 12;
 
 	generalCapabilitySet.version = CB_CAPS_VERSION_2;
-	generalCapabilitySet.generalFlags = CB_USE_LONG_FORMAT_NAMES;
+	generalCapabilitySet.generalFlags = CB_USE_LONG_FORMAT_NAMES | CB_STREAM_FILECLIP_ENABLED |
+					    CB_FILECLIP_NO_FILE_PATHS | CB_HUGE_FILE_SUPPORT_ENABLED;
 
 	clipboard->context->ClientCapabilities(clipboard->context, &capabilities);
 }
@@ -221,6 +165,22 @@ static UINT remmina_rdp_cliprdr_monitor_ready(CliprdrClientContext *context, con
 static UINT remmina_rdp_cliprdr_server_capabilities(CliprdrClientContext *context, const CLIPRDR_CAPABILITIES *capabilities)
 {
 	TRACE_CALL(__func__);
+	rfClipboard *clipboard = (rfClipboard *)context->custom;
+	const CLIPRDR_CAPABILITY_SET *caps;
+	const BYTE *p = (const BYTE *)capabilities->capabilitySets;
+	UINT32 i;
+
+	clipboard->server_caps_flags = 0;
+	for (i = 0; i < capabilities->cCapabilitiesSets; i++) {
+		caps = (const CLIPRDR_CAPABILITY_SET *)p;
+		if (caps->capabilitySetType == CB_CAPSTYPE_GENERAL) {
+			clipboard->server_caps_flags = ((const CLIPRDR_GENERAL_CAPABILITY_SET *)caps)->generalFlags;
+			break;
+		}
+		p += caps->capabilitySetLength;
+	}
+	REMMINA_PLUGIN_DEBUG("server clipboard capabilities flags: 0x%x", clipboard->server_caps_flags);
+
 	return CHANNEL_RC_OK;
 }
 
@@ -278,6 +238,8 @@ static UINT remmina_rdp_cliprdr_server_format_list(CliprdrClientContext *context
 
 	remmina_rdp_cliprdr_cached_clipboard_free(clipboard);
 	clipboard->server_html_format_id = 0;
+	clipboard->server_file_format_id = 0;
+	remmina_rdp_cliprdr_file_download_cancel(clipboard);
 
 	REMMINA_PLUGIN_DEBUG("gp=%p: format list from the server:", gp);
 	for (i = 0; i < formatList->numFormats; i++) {
@@ -337,6 +299,14 @@ static UINT remmina_rdp_cliprdr_server_format_list(CliprdrClientContext *context
 			GdkAtom atom = gdk_atom_intern(gtkFormatName, TRUE);
 			gtk_target_list_add(list, atom, 0, format->formatId);
 			clipboard->server_html_format_id = format->formatId;
+		} else if (serverFormatName != NULL && strcmp(serverFormatName, CB_FORMAT_FILEGROUPDESCRIPTORW_NAME) == 0) {
+			/* Files are downloaded when a local application pastes them */
+			gtkFormatName = "text/uri-list";
+			GdkAtom atom = gdk_atom_intern(gtkFormatName, TRUE);
+			gtk_target_list_add(list, atom, 0, format->formatId);
+			atom = gdk_atom_intern("x-special/gnome-copied-files", FALSE);
+			gtk_target_list_add(list, atom, 0, format->formatId);
+			clipboard->server_file_format_id = format->formatId;
 		}
 		REMMINA_PLUGIN_DEBUG("the server has clipboard format %d: %s -> GTK %s", format->formatId, serverFormatName, gtkFormatName);
 	}
@@ -405,6 +375,335 @@ static UINT remmina_rdp_cliprdr_server_format_list_response(CliprdrClientContext
 	return CHANNEL_RC_OK;
 }
 
+static void remmina_rdp_cliprdr_send_format_data_response(rfClipboard *clipboard, GBytes *data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpEvent rdp_event = { 0 };
+
+	/* Ownership of data is transferred to the libfreerdp thread, NULL sends CB_RESPONSE_FAIL */
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_RESPONSE;
+	rdp_event.clipboard_formatdataresponse.data = data;
+	remmina_rdp_event_event_push(clipboard->rfi->protocol_widget, &rdp_event);
+}
+
+static RemminaPluginRdpCliprdrImageType remmina_rdp_cliprdr_image_type_from_format(UINT32 format)
+{
+	switch (format) {
+	case CB_FORMAT_PNG:
+		return REMMINA_RDP_CLIPRDR_IMAGE_PNG;
+	case CB_FORMAT_JPEG:
+		return REMMINA_RDP_CLIPRDR_IMAGE_JPEG;
+	case CF_DIB:
+	case CF_DIBV5:
+		return REMMINA_RDP_CLIPRDR_IMAGE_DIB;
+	default:
+		return REMMINA_RDP_CLIPRDR_IMAGE_N;
+	}
+}
+
+/* Must be called with image_cache.mutex held */
+static void remmina_rdp_cliprdr_image_cache_reset(struct rf_clipboard_image_cache *cache, gint serial)
+{
+	TRACE_CALL(__func__);
+	int i;
+
+	if (cache->pixbuf) {
+		g_object_unref(cache->pixbuf);
+		cache->pixbuf = NULL;
+	}
+	for (i = 0; i < REMMINA_RDP_CLIPRDR_IMAGE_N; i++) {
+		if (cache->encoded[i]) {
+			g_bytes_unref(cache->encoded[i]);
+			cache->encoded[i] = NULL;
+		}
+	}
+	cache->serial = serial;
+}
+
+static GBytes *remmina_rdp_cliprdr_image_cache_lookup(rfClipboard *clipboard, RemminaPluginRdpCliprdrImageType type, gint serial)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_image_cache *cache = &clipboard->image_cache;
+	GBytes *data = NULL;
+
+	pthread_mutex_lock(&cache->mutex);
+	if (cache->serial == serial && cache->encoded[type])
+		data = g_bytes_ref(cache->encoded[type]);
+	pthread_mutex_unlock(&cache->mutex);
+	return data;
+}
+
+typedef struct {
+	GdkPixbuf *				pixbuf;
+	gint					serial;
+	RemminaPluginRdpCliprdrImageType	type;
+} RemminaPluginRdpCliprdrImageJob;
+
+static void remmina_rdp_cliprdr_image_encode(gpointer data, gpointer user_data)
+{
+	/* Runs on the clipboard image encoder thread */
+	TRACE_CALL(__func__);
+	static const gchar *const encoders[REMMINA_RDP_CLIPRDR_IMAGE_N] = { "png", "jpeg", "bmp" };
+	RemminaPluginRdpCliprdrImageJob *job = (RemminaPluginRdpCliprdrImageJob *)data;
+	rfClipboard *clipboard = (rfClipboard *)user_data;
+	struct rf_clipboard_image_cache *cache = &clipboard->image_cache;
+	GBytes *encoded, *file;
+	gchar *buffer;
+	gsize buffersize;
+
+	/* A previous job may already have encoded the same format */
+	encoded = remmina_rdp_cliprdr_image_cache_lookup(clipboard, job->type, job->serial);
+	if (!encoded && gdk_pixbuf_save_to_buffer(job->pixbuf, &buffer, &buffersize, encoders[job->type], NULL, NULL)) {
+		file = g_bytes_new_take(buffer, buffersize);
+		if (job->type == REMMINA_RDP_CLIPRDR_IMAGE_DIB) {
+			/* CF_DIB is a BMP file without its 14 bytes BITMAPFILEHEADER,
+			 * share the encoded buffer instead of copying it */
+			if (buffersize > 14)
+				encoded = g_bytes_new_from_bytes(file, 14, buffersize - 14);
+			g_bytes_unref(file);
+		} else {
+			encoded = file;
+		}
+
+		pthread_mutex_lock(&cache->mutex);
+		if (encoded && cache->serial == job->serial && !cache->encoded[job->type])
+			cache->encoded[job->type] = g_bytes_ref(encoded);
+		pthread_mutex_unlock(&cache->mutex);
+	}
+
+	REMMINA_PLUGIN_DEBUG("sending %zu bytes of %s clipboard image to the server",
+			     encoded ? g_bytes_get_size(encoded) : 0, encoders[job->type]);
+	remmina_rdp_cliprdr_send_format_data_response(clipboard, encoded);
+
+	g_object_unref(job->pixbuf);
+	g_free(job);
+}
+
+static void remmina_rdp_cliprdr_encode_clipboard_image(rfClipboard *clipboard, GdkPixbuf *image, gint serial, RemminaPluginRdpCliprdrImageType type)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_image_cache *cache = &clipboard->image_cache;
+	RemminaPluginRdpCliprdrImageJob *job;
+
+	/* Encoding large images may take a while, keep it out of the GTK thread */
+	if (!cache->encoder)
+		cache->encoder = g_thread_pool_new(remmina_rdp_cliprdr_image_encode, clipboard, 1, FALSE, NULL);
+
+	job = g_new0(RemminaPluginRdpCliprdrImageJob, 1);
+	job->pixbuf = g_object_ref(image);
+	job->serial = serial;
+	job->type = type;
+	g_thread_pool_push(cache->encoder, job, NULL);
+}
+
+/* A server FormatDataRequest waiting for the local clipboard owner.
+ * The structure is owned by the gtk_clipboard_request_*() callback, which
+ * GTK always calls, while clipboard.pending_requests only references it
+ * until it has been answered, by the callback or by the timeout. */
+typedef struct {
+	RemminaProtocolWidget *			gp;
+	guint					id;
+	UINT32					format;
+	gint					serial;
+	gint64					start_time;
+	guint					timeout_source;
+	gboolean				answered;
+} RemminaPluginRdpCliprdrRequest;
+
+static gboolean remmina_rdp_cliprdr_pending_request_timeout(gpointer data);
+
+static RemminaPluginRdpCliprdrRequest *remmina_rdp_cliprdr_pending_request_new(RemminaProtocolWidget *gp, UINT32 format)
+{
+	TRACE_CALL(__func__);
+	rfContext *rfi = GET_PLUGIN_DATA(gp);
+	rfClipboard *clipboard = &rfi->clipboard;
+	RemminaPluginRdpCliprdrRequest *req;
+
+	if (!clipboard->pending_requests)
+		clipboard->pending_requests = g_hash_table_new(NULL, NULL);
+
+	req = g_new0(RemminaPluginRdpCliprdrRequest, 1);
+	req->gp = g_object_ref(gp);
+	req->id = ++clipboard->pending_request_seq;
+	req->format = format;
+	req->serial = g_atomic_int_get(&clipboard->local_serial);
+	req->start_time = g_get_monotonic_time();
+	req->timeout_source = g_timeout_add_seconds(CLIPBOARD_TRANSFER_WAIT_TIME, remmina_rdp_cliprdr_pending_request_timeout, req);
+	g_hash_table_insert(clipboard->pending_requests, GUINT_TO_POINTER(req->id), req);
+
+	return req;
+}
+
+/* Returns the clipboard the request belongs to, or NULL when the request
+ * has already been answered or the connection has gone away */
+static rfClipboard *remmina_rdp_cliprdr_pending_request_complete(RemminaPluginRdpCliprdrRequest *req)
+{
+	TRACE_CALL(__func__);
+	rfContext *rfi;
+
+	if (req->answered)
+		return NULL;
+	req->answered = TRUE;
+
+	if (req->timeout_source) {
+		g_source_remove(req->timeout_source);
+		req->timeout_source = 0;
+	}
+
+	rfi = GET_PLUGIN_DATA(req->gp);
+	if (!rfi)
+		return NULL;
+	g_hash_table_remove(rfi->clipboard.pending_requests, GUINT_TO_POINTER(req->id));
+
+	REMMINA_PLUGIN_DEBUG("gp=%p: local clipboard request %u for format %u completed in %d ms",
+			     req->gp, req->id, req->format, (int)((g_get_monotonic_time() - req->start_time) / 1000));
+	return &rfi->clipboard;
+}
+
+static void remmina_rdp_cliprdr_pending_request_free(RemminaPluginRdpCliprdrRequest *req)
+{
+	TRACE_CALL(__func__);
+	g_object_unref(req->gp);
+	g_free(req);
+}
+
+static gboolean remmina_rdp_cliprdr_pending_request_timeout(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrRequest *req = (RemminaPluginRdpCliprdrRequest *)data;
+	rfClipboard *clipboard;
+
+	req->timeout_source = 0;
+	clipboard = remmina_rdp_cliprdr_pending_request_complete(req);
+	if (clipboard) {
+		g_warning("[RDP] gp=%p the local clipboard owner did not provide data for format %u in %d seconds.",
+			  req->gp, req->format, CLIPBOARD_TRANSFER_WAIT_TIME);
+		remmina_rdp_cliprdr_send_format_data_response(clipboard, NULL);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void remmina_rdp_cliprdr_pending_requests_cancel(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	GHashTableIter iter;
+	RemminaPluginRdpCliprdrRequest *req;
+
+	if (!clipboard->pending_requests)
+		return;
+
+	/* Callbacks still to come will just free their request */
+	g_hash_table_iter_init(&iter, clipboard->pending_requests);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&req)) {
+		req->answered = TRUE;
+		if (req->timeout_source) {
+			g_source_remove(req->timeout_source);
+			req->timeout_source = 0;
+		}
+	}
+	g_hash_table_destroy(clipboard->pending_requests);
+	clipboard->pending_requests = NULL;
+}
+
+static void remmina_rdp_cliprdr_text_received(GtkClipboard *gtkClipboard, const gchar *text, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrRequest *req = (RemminaPluginRdpCliprdrRequest *)data;
+	rfClipboard *clipboard;
+	UINT8 *outbuf = NULL;
+	size_t size = 0;
+
+	clipboard = remmina_rdp_cliprdr_pending_request_complete(req);
+	if (clipboard) {
+		if (text != NULL) {
+			switch (req->format) {
+			case CF_TEXT:
+			case CB_FORMAT_HTML:
+				outbuf = remmina_rdp_cliprdr_text_lf2crlf((const UINT8 *)text, strlen(text), &size);
+				break;
+			case CF_UNICODETEXT:
+				/* LF to CRLF and UTF-8 to UTF-16 in a single pass */
+				outbuf = (UINT8 *)remmina_rdp_cliprdr_text_utf8_to_utf16_crlf((const UINT8 *)text, strlen(text), &size);
+				break;
+			}
+		}
+		remmina_rdp_cliprdr_send_format_data_response(clipboard,
+			outbuf ? g_bytes_new_with_free_func(outbuf, size, free, outbuf) : NULL);
+	}
+	remmina_rdp_cliprdr_pending_request_free(req);
+}
+
+static void remmina_rdp_cliprdr_image_received(GtkClipboard *gtkClipboard, GdkPixbuf *image, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrRequest *req = (RemminaPluginRdpCliprdrRequest *)data;
+	rfClipboard *clipboard;
+	struct rf_clipboard_image_cache *cache;
+
+	clipboard = remmina_rdp_cliprdr_pending_request_complete(req);
+	if (clipboard) {
+		if (req->serial != g_atomic_int_get(&clipboard->local_serial)) {
+			/* The local clipboard changed meanwhile, the server got a new
+			 * format list and the cache may already hold the new content */
+			REMMINA_PLUGIN_DEBUG("gp=%p: dropping the image of an outdated clipboard content", req->gp);
+			remmina_rdp_cliprdr_send_format_data_response(clipboard, NULL);
+		} else if (image) {
+			cache = &clipboard->image_cache;
+			pthread_mutex_lock(&cache->mutex);
+			if (cache->serial != req->serial)
+				remmina_rdp_cliprdr_image_cache_reset(cache, req->serial);
+			if (!cache->pixbuf)
+				cache->pixbuf = g_object_ref(image);
+			pthread_mutex_unlock(&cache->mutex);
+			/* The encoder thread will send the response */
+			remmina_rdp_cliprdr_encode_clipboard_image(clipboard, image, req->serial,
+								   remmina_rdp_cliprdr_image_type_from_format(req->format));
+		} else {
+			remmina_rdp_cliprdr_send_format_data_response(clipboard, NULL);
+		}
+	}
+	remmina_rdp_cliprdr_pending_request_free(req);
+}
+
+static void remmina_rdp_cliprdr_uris_received(GtkClipboard *gtkClipboard, gchar **uris, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrRequest *req = (RemminaPluginRdpCliprdrRequest *)data;
+	rfClipboard *clipboard;
+
+	clipboard = remmina_rdp_cliprdr_pending_request_complete(req);
+	if (clipboard)
+		remmina_rdp_cliprdr_send_format_data_response(clipboard, uris ? remmina_rdp_cliprdr_file_set_local_uris(clipboard, uris) : NULL);
+	remmina_rdp_cliprdr_pending_request_free(req);
+}
+
+static void remmina_rdp_cliprdr_get_clipboard_image(RemminaProtocolWidget *gp, GtkClipboard *gtkClipboard, UINT32 format)
+{
+	TRACE_CALL(__func__);
+	rfContext *rfi = GET_PLUGIN_DATA(gp);
+	rfClipboard *clipboard = &rfi->clipboard;
+	struct rf_clipboard_image_cache *cache = &clipboard->image_cache;
+	GdkPixbuf *image = NULL;
+	gint serial;
+
+	serial = g_atomic_int_get(&clipboard->local_serial);
+
+	pthread_mutex_lock(&cache->mutex);
+	if (cache->serial == serial && cache->pixbuf)
+		image = g_object_ref(cache->pixbuf);
+	pthread_mutex_unlock(&cache->mutex);
+
+	if (image) {
+		remmina_rdp_cliprdr_encode_clipboard_image(clipboard, image, serial, remmina_rdp_cliprdr_image_type_from_format(format));
+		g_object_unref(image);
+	} else if (gtkClipboard) {
+		gtk_clipboard_request_image(gtkClipboard, remmina_rdp_cliprdr_image_received,
+					    remmina_rdp_cliprdr_pending_request_new(gp, format));
+	} else {
+		remmina_rdp_cliprdr_send_format_data_response(clipboard, NULL);
+	}
+}
+
 static UINT remmina_rdp_cliprdr_server_format_data_request(CliprdrClientContext *context, const CLIPRDR_FORMAT_DATA_REQUEST *formatDataRequest)
 {
 	TRACE_CALL(__func__);
@@ -412,29 +711,52 @@ static UINT remmina_rdp_cliprdr_server_format_data_request(CliprdrClientContext
 	RemminaPluginRdpUiObject *ui;
 	RemminaProtocolWidget *gp;
 	rfClipboard *clipboard;
+	RemminaPluginRdpCliprdrImageType type;
+	GBytes *data;
 
 	clipboard = (rfClipboard *)context->custom;
 	gp = clipboard->rfi->protocol_widget;
 
+	/* Images already encoded for the current local clipboard content
+	 * are sent directly, without waking up the GTK thread */
+	type = remmina_rdp_cliprdr_image_type_from_format(formatDataRequest->requestedFormatId);
+	if (type != REMMINA_RDP_CLIPRDR_IMAGE_N) {
+		data = remmina_rdp_cliprdr_image_cache_lookup(clipboard, type, g_atomic_int_get(&clipboard->local_serial));
+		if (data) {
+			REMMINA_PLUGIN_DEBUG("gp=%p: answering FormatDataRequest from the clipboard image cache", gp);
+			remmina_rdp_cliprdr_send_format_data_response(clipboard, data);
+			return CHANNEL_RC_OK;
+		}
+	}
+
 	ui = g_new0(RemminaPluginRdpUiObject, 1);
 	ui->type = REMMINA_RDP_UI_CLIPBOARD;
 	ui->clipboard.clipboard = clipboard;
 	ui->clipboard.type = REMMINA_RDP_UI_CLIPBOARD_GET_DATA;
 	ui->clipboard.format = formatDataRequest->requestedFormatId;
-	remmina_rdp_event_queue_ui_sync_retint(gp, ui);
+	/* Do not wait for the local clipboard owner here: the response is sent
+	 * when its data arrives, or with CB_RESPONSE_FAIL after a timeout */
+	remmina_rdp_event_queue_ui_async(gp, ui);
 
 	return CHANNEL_RC_OK;
 }
 
-int timeval_diff(struct timeval *start, struct timeval *end)
+static gboolean remmina_rdp_cliprdr_srv_data_loop_quit(gpointer data)
 {
-	/* Returns the time elapsed from start to end, in ms */
-	int64_t ms_end = (end->tv_sec * 1000) + (end->tv_usec / 1000);
-	int64_t ms_start = (start->tv_sec * 1000) + (start->tv_usec / 1000);
-
-	return (int)(ms_end - ms_start);
+	TRACE_CALL(__func__);
+	g_main_loop_quit((GMainLoop *)data);
+	return G_SOURCE_REMOVE;
 }
 
+/* Must be called with transfer_clip_mutex held. The loop is quit from the
+ * GTK thread itself, so it works even if the loop did not start running yet */
+static void remmina_rdp_cliprdr_srv_data_loop_wakeup(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	if (clipboard->srv_data_loop)
+		g_idle_add_full(G_PRIORITY_DEFAULT, remmina_rdp_cliprdr_srv_data_loop_quit,
+				g_main_loop_ref(clipboard->srv_data_loop), (GDestroyNotify)g_main_loop_unref);
+}
 
 static UINT remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext *context, const CLIPRDR_FORMAT_DATA_RESPONSE *formatDataResponse)
 {
@@ -446,7 +768,6 @@ static UINT remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext
 	RemminaProtocolWidget *gp;
 	rfClipboard *clipboard;
 	gpointer output = NULL;
-	struct timeval now;
 	int mstrans;
 
 	clipboard = (rfClipboard *)context->custom;
@@ -461,35 +782,30 @@ static UINT remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext
 #endif
 
 	REMMINA_PLUGIN_DEBUG("gp=%p server FormatDataResponse received: clipboard data arrived form server.", gp);
-	gettimeofday(&now, NULL);
 	remmina_rdp_cliprdr_cached_clipboard_free(clipboard);
 
 	/* Calculate stats */
-	mstrans = timeval_diff(&(clipboard->clientformatdatarequest_tv), &now);
+	mstrans = (int)((g_get_monotonic_time() - clipboard->clientformatdatarequest_time) / 1000);
 	REMMINA_PLUGIN_DEBUG("gp=%p %zu bytes transferred from server in %d ms. Speed is %d bytes/sec",
 		gp, (size_t)size, mstrans, mstrans != 0 ? (int)((int64_t)size * 1000 / mstrans) : 0);
 
-	if (size > 0) {
+	if (size > 0 && clipboard->server_file_format_id != 0 && rfi->clipboard.format == clipboard->server_file_format_id) {
+		/* The file list arrived: the paste completes when all files
+		 * have been received, see remmina_rdp_cliprdr_file_contents_response() */
+		if (remmina_rdp_cliprdr_file_download_start(clipboard, data, size))
+			return CHANNEL_RC_OK;
+	} else if (size > 0) {
 		switch (rfi->clipboard.format) {
 		case CF_UNICODETEXT:
 		{
-			output =
-			g_utf16_to_utf8((const WCHAR *)data, size / sizeof(WCHAR), NULL, NULL, NULL);
-			if (output) {
-				size = strlen(output) + 1;
-				crlf2lf(output, &size);
-			}
+			output = remmina_rdp_cliprdr_text_utf16_to_utf8_lf((const WCHAR *)data, size / sizeof(WCHAR), &size);
 			break;
 		}
 
 		case CF_TEXT:
 		case CB_FORMAT_HTML:
 		{
-			output = (gpointer)calloc(1, size + 1);
-			if (output) {
-				memcpy(output, data, size);
-				crlf2lf(output, &size);
-			}
+			output = remmina_rdp_cliprdr_text_crlf2lf(data, size, &size);
 			break;
 		}
 
@@ -583,20 +899,33 @@ static UINT remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext
 		}
 	}
 
+	if (output == NULL)
+		REMMINA_PLUGIN_DEBUG("gp=%p: data from server is not valid (size=%zu format=%d), cannot load into cache", gp, size, rfi->clipboard.format);
+
+	remmina_rdp_cliprdr_set_srv_data(clipboard, output);
+
+	return CHANNEL_RC_OK;
+}
+
+/* Stores the data received from the server and wakes up the local application
+ * waiting for it in remmina_rdp_cliprdr_request_data() */
+void remmina_rdp_cliprdr_set_srv_data(rfClipboard *clipboard, gpointer output)
+{
+	TRACE_CALL(__func__);
+	RemminaProtocolWidget *gp = clipboard->rfi->protocol_widget;
+
 	pthread_mutex_lock(&clipboard->srv_data_mutex);
 	clipboard->srv_data = output;
 	pthread_mutex_unlock(&clipboard->srv_data_mutex);
 
 	if (output != NULL)
 		REMMINA_PLUGIN_DEBUG("gp=%p: clipboard local cache data has been loaded", gp);
-	else
-		REMMINA_PLUGIN_DEBUG("gp=%p: data from server is not valid (size=%zu format=%d), cannot load into cache", gp, size, rfi->clipboard.format);
 
 
 	REMMINA_PLUGIN_DEBUG("gp=%p: signalling main GTK thread that we have some clipboard data.", gp);
 
 	pthread_mutex_lock(&clipboard->transfer_clip_mutex);
-	pthread_cond_signal(&clipboard->transfer_clip_cond);
+	remmina_rdp_cliprdr_srv_data_loop_wakeup(clipboard);
 	if (clipboard->srv_clip_data_wait == SCDW_BUSY_WAIT) {
 		REMMINA_PLUGIN_DEBUG("gp=%p: clipboard transfer from server completed.", gp);
 	} else {
@@ -606,8 +935,17 @@ static UINT remmina_rdp_cliprdr_server_format_data_response(CliprdrClientContext
 	}
 	clipboard->srv_clip_data_wait = SCDW_NONE;
 	pthread_mutex_unlock(&clipboard->transfer_clip_mutex);
+}
 
-	return CHANNEL_RC_OK;
+static gboolean remmina_rdp_cliprdr_srv_data_watchdog(gpointer data)
+{
+	TRACE_CALL(__func__);
+	rfClipboard *clipboard = (rfClipboard *)data;
+
+	if (g_get_monotonic_time() - clipboard->srv_data_activity_time < CLIPBOARD_TRANSFER_WAIT_TIME * G_USEC_PER_SEC)
+		return G_SOURCE_CONTINUE;
+	g_main_loop_quit(clipboard->srv_data_loop);
+	return G_SOURCE_REMOVE;
 }
 
 
@@ -622,10 +960,10 @@ void remmina_rdp_cliprdr_request_data(GtkClipboard *gtkClipboard, GtkSelectionDa
 	rfClipboard *clipboard;
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
 	RemminaPluginRdpEvent rdp_event = { 0 };
-	struct timespec to;
-	struct timeval tv;
-	int rc;
-	time_t tlimit, tlimit1s, tnow, tstart;
+	GMainLoop *loop;
+	GSource *watchdog;
+	gchar **uris;
+	gchar *text;
 
 	REMMINA_PLUGIN_DEBUG("gp=%p: A local application has requested remote clipboard data for remote format id %d", gp, info);
 
@@ -641,61 +979,46 @@ void remmina_rdp_cliprdr_request_data(GtkClipboard *gtkClipboard, GtkSelectionDa
 
 		clipboard->format = info;
 
-		pthread_mutex_lock(&clipboard->transfer_clip_mutex);
-
 		pFormatDataRequest = (CLIPRDR_FORMAT_DATA_REQUEST *)malloc(sizeof(CLIPRDR_FORMAT_DATA_REQUEST));
 		ZeroMemory(pFormatDataRequest, sizeof(CLIPRDR_FORMAT_DATA_REQUEST));
 		pFormatDataRequest->requestedFormatId = clipboard->format;
 
+		loop = g_main_loop_new(NULL, FALSE);
+		pthread_mutex_lock(&clipboard->transfer_clip_mutex);
 		clipboard->srv_clip_data_wait = SCDW_BUSY_WAIT;	// Annotate that we are waiting for ServerFormatDataResponse
+		clipboard->srv_data_loop = loop;
+		clipboard->srv_data_activity_time = g_get_monotonic_time();
+		pthread_mutex_unlock(&clipboard->transfer_clip_mutex);
 
 		REMMINA_PLUGIN_DEBUG("gp=%p Requesting clipboard data with format %d from the server via ServerFormatDataRequest", gp, clipboard->format);
 		rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_REQUEST;
 		rdp_event.clipboard_formatdatarequest.pFormatDataRequest = pFormatDataRequest;
 		remmina_rdp_event_event_push(gp, &rdp_event);
 
-		/* Busy wait clipboard data for CLIPBOARD_TRANSFER_WAIT_TIME seconds.
-		*      In the meanwhile allow GTK event loop to proceed */
-
-		tstart = time(NULL);
-		tlimit = tstart + CLIPBOARD_TRANSFER_WAIT_TIME;
-		rc = 100000;
-		tlimit1s = tstart + 1;
-		while ((tnow = time(NULL)) < tlimit && rc != 0 && clipboard->srv_clip_data_wait == SCDW_BUSY_WAIT) {
+		/* GTK wants the selection data before we return, so wait for it in a
+		 * nested main loop. The loop sleeps until the libfreerdp thread wakes
+		 * it up when the ServerFormatDataResponse arrives or the transfer is
+		 * aborted. Files may take long, so we give up only after
+		 * CLIPBOARD_TRANSFER_WAIT_TIME seconds without any data. */
+		watchdog = g_timeout_source_new_seconds(1);
+		g_source_set_callback(watchdog, remmina_rdp_cliprdr_srv_data_watchdog, clipboard, NULL);
+		g_source_attach(watchdog, NULL);
+		g_main_loop_run(loop);
+		g_source_destroy(watchdog);
+		g_source_unref(watchdog);
 
-			if (tnow >= tlimit1s) {
-				REMMINA_PLUGIN_DEBUG("gp=%p, clipboard data is still not here after %u seconds", gp, (unsigned)(tnow - tstart));
-				tlimit1s = time(NULL) + 1;
-			}
-
-			gettimeofday(&tv, NULL);
-			to.tv_sec = tv.tv_sec;
-			to.tv_nsec = tv.tv_usec * 1000 + 5000000;      // wait for data for 5ms
-			if (to.tv_nsec >= 1000000000) {
-				to.tv_nsec -= 1000000000;
-				to.tv_sec++;
-			}
-			rc = pthread_cond_timedwait(&clipboard->transfer_clip_cond, &clipboard->transfer_clip_mutex, &to);
-			if (rc == 0)
-				break;
-
-			gtk_main_iteration_do(FALSE);
-		}
-
-		if (rc != 0) {
+		pthread_mutex_lock(&clipboard->transfer_clip_mutex);
+		clipboard->srv_data_loop = NULL;
+		if (clipboard->srv_clip_data_wait == SCDW_ABORTING) {
+			g_warning("[RDP] gp=%p Clipboard data wait aborted.", gp);
+			clipboard->srv_clip_data_wait = SCDW_NONE;
+		} else if (clipboard->srv_clip_data_wait == SCDW_BUSY_WAIT) {
 			/* Timeout, just log it and hope that data will arrive later */
-			if (clipboard->srv_clip_data_wait == SCDW_ABORTING) {
-				g_warning("[RDP] gp=%p Clipboard data wait aborted.",gp);
-			} else {
-				if (rc == ETIMEDOUT)
-					g_warning("[RDP] gp=%p Clipboard data from the server is not available in %d seconds. No data will be available to user.",
-						gp, CLIPBOARD_TRANSFER_WAIT_TIME);
-				else
-					g_warning("[RDP] gp=%p internal error: pthread_cond_timedwait() returned %d\n", gp, rc);
-			}
+			g_warning("[RDP] gp=%p Clipboard data from the server is not available in %d seconds. No data will be available to user.",
+				  gp, CLIPBOARD_TRANSFER_WAIT_TIME);
 		}
 		pthread_mutex_unlock(&clipboard->transfer_clip_mutex);
-
+		g_main_loop_unref(loop);
 	}
 
 	pthread_mutex_lock(&clipboard->srv_data_mutex);
@@ -704,6 +1027,17 @@ void remmina_rdp_cliprdr_request_data(GtkClipboard *gtkClipboard, GtkSelectionDa
 		/* We have data in cache, just paste it */
 		if (info == CB_FORMAT_PNG || info == CF_DIB || info == CF_DIBV5 || info == CB_FORMAT_JPEG) {
 			gtk_selection_data_set_pixbuf(selection_data, clipboard->srv_data);
+		} else if (clipboard->server_file_format_id != 0 && info == clipboard->server_file_format_id) {
+			GdkAtom target = gtk_selection_data_get_target(selection_data);
+			if (target == gdk_atom_intern("x-special/gnome-copied-files", FALSE)) {
+				text = g_strconcat("copy\n", (gchar *)clipboard->srv_data, NULL);
+				gtk_selection_data_set(selection_data, target, 8, (const guchar *)text, strlen(text));
+				g_free(text);
+			} else {
+				uris = g_strsplit(clipboard->srv_data, "\n", -1);
+				gtk_selection_data_set_uris(selection_data, uris);
+				g_strfreev(uris);
+			}
 		} else if (info == CB_FORMAT_HTML || info == clipboard->server_html_format_id) {
 			REMMINA_PLUGIN_DEBUG("gp=%p returning %zu bytes of HTML in clipboard to requesting application", gp, strlen(clipboard->srv_data));
 			GdkAtom atom = gdk_atom_intern("text/html", TRUE);
@@ -726,15 +1060,12 @@ void remmina_rdp_cliprdr_empty_clipboard(GtkClipboard *gtkClipboard, rfClipboard
 	/* No need to do anything here */
 }
 
-CLIPRDR_FORMAT_LIST *remmina_rdp_cliprdr_get_client_format_list(RemminaProtocolWidget *gp)
+static CLIPRDR_FORMAT_LIST *remmina_rdp_cliprdr_build_client_format_list(RemminaProtocolWidget *gp, GdkAtom *targets, gint loccount)
 {
 	TRACE_CALL(__func__);
 
-	GtkClipboard *gtkClipboard;
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
-	GdkAtom *targets;
-	gboolean result = 0;
-	gint loccount, srvcount;
+	gint srvcount;
 	gint formatId, i;
 	CLIPRDR_FORMAT *formats;
 	struct retp_t {
@@ -744,23 +1075,22 @@ CLIPRDR_FORMAT_LIST *remmina_rdp_cliprdr_get_client_format_list(RemminaProtocolW
 
 	formats = NULL;
 	retp = NULL;
-	loccount = 0;
 
-	gtkClipboard = gtk_widget_get_clipboard(rfi->drawing_area, GDK_SELECTION_CLIPBOARD);
-	if (gtkClipboard)
-		result = gtk_clipboard_wait_for_targets(gtkClipboard, &targets, &loccount);
 	REMMINA_PLUGIN_DEBUG("gp=%p sending to server the following local clipboard content formats", gp);
-	if (result && loccount > 0) {
+	if (targets && loccount > 0) {
 		formats = (CLIPRDR_FORMAT *)malloc(loccount * sizeof(CLIPRDR_FORMAT));
 		srvcount = 0;
 		for (i = 0; i < loccount; i++) {
 			formatId = remmina_rdp_cliprdr_get_format_from_gdkatom(targets[i]);
+			/* Files can be pasted only if the server can stream them */
+			if (formatId == CB_FORMAT_TEXTURILIST && !(rfi->clipboard.server_caps_flags & CB_STREAM_FILECLIP_ENABLED))
+				formatId = 0;
 			if (formatId != 0) {
 				gchar *name = gdk_atom_name(targets[i]);
 				REMMINA_PLUGIN_DEBUG("     local clipboard format %s will be sent to remote as %d", name, formatId);
 				g_free(name);
 				formats[srvcount].formatId = formatId;
-				formats[srvcount].formatName = NULL;
+				formats[srvcount].formatName = formatId == CB_FORMAT_TEXTURILIST ? (char *)CB_FORMAT_FILEGROUPDESCRIPTORW_NAME : NULL;
 				srvcount++;
 			}
 		}
@@ -781,9 +1111,6 @@ CLIPRDR_FORMAT_LIST *remmina_rdp_cliprdr_get_client_format_list(RemminaProtocolW
 		retp->pFormatList.numFormats = 0;
 	}
 
-	if (result)
-		g_free(targets);
-
 #if FREERDP_VERSION_MAJOR >= 3
 	retp->pFormatList.common.msgType = CB_FORMAT_LIST;
 	retp->pFormatList.common.msgFlags = 0;
@@ -795,135 +1122,90 @@ CLIPRDR_FORMAT_LIST *remmina_rdp_cliprdr_get_client_format_list(RemminaProtocolW
 	return (CLIPRDR_FORMAT_LIST *)retp;
 }
 
+static void remmina_rdp_cliprdr_push_client_format_list(RemminaProtocolWidget *gp, GdkAtom *targets, gint loccount)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpEvent rdp_event = { 0 };
+
+	rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_LIST;
+	rdp_event.clipboard_formatlist.pFormatList = remmina_rdp_cliprdr_build_client_format_list(gp, targets, loccount);
+	remmina_rdp_event_event_push(gp, &rdp_event);
+}
+
+static void remmina_rdp_cliprdr_targets_received(GtkClipboard *gtkClipboard, GdkAtom *targets, gint n_targets, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaProtocolWidget *gp = (RemminaProtocolWidget *)data;
+
+	/* The connection may have been closed while waiting for the clipboard owner */
+	if (GET_PLUGIN_DATA(gp))
+		remmina_rdp_cliprdr_push_client_format_list(gp, targets, n_targets);
+	g_object_unref(gp);
+}
+
+void remmina_rdp_cliprdr_request_client_format_list(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+	GtkClipboard *gtkClipboard;
+	rfContext *rfi = GET_PLUGIN_DATA(gp);
+
+	if (!rfi || !rfi->drawing_area)
+		return;
+
+	/* The format list is sent to the server when the local clipboard owner
+	 * answers, without blocking the GTK thread meanwhile */
+	gtkClipboard = gtk_widget_get_clipboard(rfi->drawing_area, GDK_SELECTION_CLIPBOARD);
+	if (gtkClipboard)
+		gtk_clipboard_request_targets(gtkClipboard, remmina_rdp_cliprdr_targets_received, g_object_ref(gp));
+	else
+		remmina_rdp_cliprdr_push_client_format_list(gp, NULL, 0);
+}
+
 static void remmina_rdp_cliprdr_mt_get_format_list(RemminaProtocolWidget *gp, RemminaPluginRdpUiObject *ui)
 {
 	TRACE_CALL(__func__);
-	ui->retptr = (void *)remmina_rdp_cliprdr_get_client_format_list(gp);
+	remmina_rdp_cliprdr_request_client_format_list(gp);
 }
 
 void remmina_rdp_cliprdr_get_clipboard_data(RemminaProtocolWidget *gp, RemminaPluginRdpUiObject *ui)
 {
 	TRACE_CALL(__func__);
 	GtkClipboard *gtkClipboard;
-	UINT8 *inbuf = NULL;
-	UINT8 *outbuf = NULL;
-#if FREERDP_VERSION_MAJOR >= 3
-	WCHAR *outbuf_wchar = NULL;
-#endif
-	GdkPixbuf *image = NULL;
-	size_t size = 0;
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
-	RemminaPluginRdpEvent rdp_event = { 0 };
 
+	/* Ask the local clipboard owner without waiting for it: the response
+	 * to the server is sent by the callbacks, or by the request timeout */
 	gtkClipboard = gtk_widget_get_clipboard(rfi->drawing_area, GDK_SELECTION_CLIPBOARD);
-	if (gtkClipboard) {
-		switch (ui->clipboard.format) {
-		case CF_TEXT:
-		case CF_UNICODETEXT:
-		case CB_FORMAT_HTML:
-		{
-			inbuf = (UINT8 *)gtk_clipboard_wait_for_text(gtkClipboard);
-			break;
+	switch (ui->clipboard.format) {
+	case CF_TEXT:
+	case CF_UNICODETEXT:
+	case CB_FORMAT_HTML:
+		if (gtkClipboard) {
+			gtk_clipboard_request_text(gtkClipboard, remmina_rdp_cliprdr_text_received,
+						   remmina_rdp_cliprdr_pending_request_new(gp, ui->clipboard.format));
+			return;
 		}
+		break;
 
-		case CB_FORMAT_PNG:
-		case CB_FORMAT_JPEG:
-		case CF_DIB:
-		case CF_DIBV5:
-		{
-			image = gtk_clipboard_wait_for_image(gtkClipboard);
-			break;
-		}
-		}
-	}
+	case CB_FORMAT_PNG:
+	case CB_FORMAT_JPEG:
+	case CF_DIB:
+	case CF_DIBV5:
+		remmina_rdp_cliprdr_get_clipboard_image(gp, gtkClipboard, ui->clipboard.format);
+		return;
 
-	/* No data received, send nothing */
-	if (inbuf != NULL || image != NULL) {
-		switch (ui->clipboard.format) {
-			case CF_TEXT:
-			case CB_FORMAT_HTML:
-			{
-				size = strlen((char *)inbuf);
-				outbuf = lf2crlf(inbuf, (int *) &size);
-				break;
-			}
-			case CF_UNICODETEXT:
-			{
-				size = strlen((const char *)inbuf);
-				inbuf = lf2crlf(inbuf, (int *) &size);
-#if FREERDP_VERSION_MAJOR >= 3
-				size_t len = 0;
-				outbuf_wchar = ConvertUtf8NToWCharAlloc((const char *)inbuf, (size_t)size, &len);
-				size = (len + 1) * sizeof(WCHAR);
-#else
-				const int rc = (ConvertToUnicode(CP_UTF8, 0, (CHAR *)inbuf, -1, (WCHAR **)&outbuf, 0)) * sizeof(WCHAR);
-				size = 0;
-				if (rc >= 0) {
-					size = (size_t)rc;
-				}
-#endif
-				g_free(inbuf);
-				break;
-			}
-			case CB_FORMAT_PNG:
-			{
-				gchar *data;
-				gsize buffersize;
-				if (gdk_pixbuf_save_to_buffer(image, &data, &buffersize, "png", NULL, NULL) == FALSE){
-					break;
-				}
-				outbuf = (UINT8 *)malloc(buffersize);
-				memcpy(outbuf, data, buffersize);
-				size = buffersize;
-				g_object_unref(image);
-				break;
-			}
-			case CB_FORMAT_JPEG:
-			{
-				gchar *data;
-				gsize buffersize;
-				if (gdk_pixbuf_save_to_buffer(image, &data, &buffersize, "jpeg", NULL, NULL) == FALSE){
-					break;
-				}
-				outbuf = (UINT8 *)malloc(buffersize);
-				memcpy(outbuf, data, buffersize);
-				size = buffersize;
-				g_object_unref(image);
-				break;
-			}
-			case CF_DIB:
-			case CF_DIBV5:
-			{
-				gchar *data;
-				gsize buffersize;
-				if (gdk_pixbuf_save_to_buffer(image, &data, &buffersize, "bmp", NULL, NULL) == FALSE){
-					break;
-				}
-				size = buffersize - 14;
-				outbuf = (UINT8 *)malloc(size);
-				memcpy(outbuf, data + 14, size);
-				g_object_unref(image);
-				break;
-			}
+	case CB_FORMAT_TEXTURILIST:
+		/* The file list only, contents are requested later by the server */
+		if (gtkClipboard) {
+			gtk_clipboard_request_uris(gtkClipboard, remmina_rdp_cliprdr_uris_received,
+						   remmina_rdp_cliprdr_pending_request_new(gp, ui->clipboard.format));
+			return;
 		}
+		break;
 	}
 
-	rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_RESPONSE;
-	rdp_event.clipboard_formatdataresponse.size = (int)MIN(size, INT32_MAX);
-
-#if FREERDP_VERSION_MAJOR >= 3
-	// For unicode, use the wchar buffer
-	if (outbuf == NULL && outbuf_wchar != NULL) {
-		rdp_event.clipboard_formatdataresponse.data = (unsigned char *)outbuf_wchar;
-	}
-	else {
-		rdp_event.clipboard_formatdataresponse.data = (unsigned char *)outbuf;
-	}
-#else
-	rdp_event.clipboard_formatdataresponse.data = (unsigned char *)outbuf;
-#endif
-
-	remmina_rdp_event_event_push(gp, &rdp_event);
+	/* No data available, send nothing */
+	remmina_rdp_cliprdr_send_format_data_response(&rfi->clipboard, NULL);
 }
 
 void remmina_rdp_cliprdr_set_clipboard_data(RemminaProtocolWidget *gp, RemminaPluginRdpUiObject *ui)
@@ -996,18 +1278,32 @@ void remmina_rdp_clipboard_free(rfContext *rfi)
 {
 	TRACE_CALL(__func__);
 
+	struct rf_clipboard_image_cache *cache = &rfi->clipboard.image_cache;
+
 	remmina_rdp_cliprdr_cached_clipboard_free(&(rfi->clipboard));
+	remmina_rdp_cliprdr_pending_requests_cancel(&(rfi->clipboard));
+	remmina_rdp_cliprdr_file_free(&(rfi->clipboard));
 
+	/* Wait for pending image encodings, they reference rfi->clipboard */
+	if (cache->encoder) {
+		g_thread_pool_free(cache->encoder, FALSE, TRUE);
+		cache->encoder = NULL;
+	}
+	pthread_mutex_lock(&cache->mutex);
+	remmina_rdp_cliprdr_image_cache_reset(cache, 0);
+	pthread_mutex_unlock(&cache->mutex);
 }
 
 void remmina_rdp_clipboard_abort_client_format_data_request(rfContext *rfi)
 {
 	TRACE_CALL(__func__);
 	if (rfi && rfi->clipboard.srv_clip_data_wait == SCDW_BUSY_WAIT) {
-		REMMINA_PLUGIN_DEBUG("requesting clipboard data transfer from server to be ignored and busywait loop to exit");
+		REMMINA_PLUGIN_DEBUG("requesting clipboard data transfer from server to be ignored and wait loop to exit");
 		/* Allow clipboard transfer from server to terminate */
+		pthread_mutex_lock(&rfi->clipboard.transfer_clip_mutex);
 		rfi->clipboard.srv_clip_data_wait = SCDW_ABORTING;
-		usleep(100000);
+		remmina_rdp_cliprdr_srv_data_loop_wakeup(&rfi->clipboard);
+		pthread_mutex_unlock(&rfi->clipboard.transfer_clip_mutex);
 	}
 }
 
@@ -1023,10 +1319,11 @@ void remmina_rdp_cliprdr_init(rfContext *rfi, CliprdrClientContext *cliprdr)
 
 	clipboard->context = cliprdr;
 	pthread_mutex_init(&clipboard->transfer_clip_mutex, NULL);
-	pthread_cond_init(&clipboard->transfer_clip_cond, NULL);
 	clipboard->srv_clip_data_wait = SCDW_NONE;
 
 	pthread_mutex_init(&clipboard->srv_data_mutex, NULL);
+	pthread_mutex_init(&clipboard->image_cache.mutex, NULL);
+	pthread_mutex_init(&clipboard->file_mutex, NULL);
 
 	cliprdr->MonitorReady = remmina_rdp_cliprdr_monitor_ready;
 	cliprdr->ServerCapabilities = remmina_rdp_cliprdr_server_capabilities;
@@ -1034,4 +1331,6 @@ void remmina_rdp_cliprdr_init(rfContext *rfi, CliprdrClientContext *cliprdr)
 	cliprdr->ServerFormatListResponse = remmina_rdp_cliprdr_server_format_list_response;
 	cliprdr->ServerFormatDataRequest = remmina_rdp_cliprdr_server_format_data_request;
 	cliprdr->ServerFormatDataResponse = remmina_rdp_cliprdr_server_format_data_response;
+	cliprdr->ServerFileContentsRequest = remmina_rdp_cliprdr_server_file_contents_request;
+	cliprdr->ServerFileContentsResponse = remmina_rdp_cliprdr_server_file_contents_response;
 }
@@ -0,0 +1,747 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "rdp_plugin.h"
+#include "rdp_cliprdr.h"
+#include "rdp_cliprdr_file.h"
+#include "rdp_cliprdr_text.h"
+
+#include <winpr/file.h>
+#include <winpr/shell.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Serialized size of a FILEDESCRIPTORW, see MS-RDPECLIP 2.2.5.2.3.1 */
+#define CLIPRDR_FILE_DESCRIPTOR_SIZE 592
+#define CLIPRDR_FILE_NAME_LENGTH 260
+#define CLIPRDR_FILE_MAX_DEPTH 64
+
+/* Each file is downloaded with CLIPRDR_FILE_DOWNLOAD_INFLIGHT range requests
+ * of CLIPRDR_FILE_DOWNLOAD_CHUNK bytes outstanding at the same time */
+#define CLIPRDR_FILE_DOWNLOAD_CHUNK (1024 * 1024)
+#define CLIPRDR_FILE_DOWNLOAD_INFLIGHT 4
+/* Largest range read from disk to answer a single server request */
+#define CLIPRDR_FILE_UPLOAD_CHUNK_MAX (8 * 1024 * 1024)
+
+/* Seconds between the FILETIME epoch (1601-01-01) and the Unix epoch */
+#define CLIPRDR_FILETIME_UNIX_OFFSET G_GUINT64_CONSTANT(11644473600)
+
+#if FREERDP_VERSION_MAJOR >= 3
+#define CLIPRDR_PDU_HEADER(pdu) ((pdu)->common)
+#else
+#define CLIPRDR_PDU_HEADER(pdu) (*(pdu))
+#endif
+
+typedef struct {
+	guint		index;          /* position in the descriptor list */
+	gchar *		path;           /* local path, relative to the staging directory for downloads */
+	WCHAR *		name;           /* remote name, uploads only */
+	size_t		name_length;    /* in WCHARs, without terminator */
+	guint64		size;
+	gboolean	has_size;
+	guint32		attributes;
+	guint64		write_time;
+} RemminaPluginRdpCliprdrFile;
+
+struct rf_clipboard_local_files {
+	GPtrArray *	files;
+	int		fd;
+	guint		fd_index;
+	guint8 *	buffer;
+	gsize		buffer_size;
+};
+
+typedef struct {
+	gboolean	used;
+	UINT32		stream_id;
+	UINT32		flags;
+	guint64		offset;
+	UINT32		length;
+} RemminaPluginRdpCliprdrRange;
+
+struct rf_clipboard_download {
+	GPtrArray *			files;
+	GString *			uris;
+	guint				current;
+	int				fd;
+	guint64				size;
+	guint64				next_offset;
+	guint64				received;
+	guint				inflight;
+	UINT32				next_stream_id;
+	RemminaPluginRdpCliprdrRange	ranges[CLIPRDR_FILE_DOWNLOAD_INFLIGHT];
+};
+
+static void remmina_rdp_cliprdr_file_entry_free(gpointer data)
+{
+	RemminaPluginRdpCliprdrFile *file = (RemminaPluginRdpCliprdrFile *)data;
+
+	g_free(file->path);
+	free(file->name);
+	g_free(file);
+}
+
+static void remmina_rdp_cliprdr_file_remove_tree(const gchar *path)
+{
+	TRACE_CALL(__func__);
+	GDir *dir;
+	const gchar *name;
+	gchar *child;
+
+	dir = g_dir_open(path, 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name(dir)) != NULL) {
+			child = g_build_filename(path, name, NULL);
+			if (g_file_test(child, G_FILE_TEST_IS_DIR) && !g_file_test(child, G_FILE_TEST_IS_SYMLINK))
+				remmina_rdp_cliprdr_file_remove_tree(child);
+			else
+				g_unlink(child);
+			g_free(child);
+		}
+		g_dir_close(dir);
+	}
+	g_rmdir(path);
+}
+
+/*
+ * Local files offered to the server (client "Copy", server "Paste")
+ */
+
+static void remmina_rdp_cliprdr_file_add_local(GPtrArray *files, const gchar *path, const gchar *name, int depth)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrFile *file;
+	GStatBuf st;
+	GDir *dir;
+	const gchar *child;
+	gchar *child_path, *child_name;
+	size_t size;
+
+	if (depth > CLIPRDR_FILE_MAX_DEPTH || g_stat(path, &st) != 0)
+		return;
+	if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))
+		return;
+
+	file = g_new0(RemminaPluginRdpCliprdrFile, 1);
+	file->name = remmina_rdp_cliprdr_text_utf8_to_utf16_crlf((const UINT8 *)name, strlen(name), &size);
+	if (!file->name || size / sizeof(WCHAR) > CLIPRDR_FILE_NAME_LENGTH) {
+		REMMINA_PLUGIN_DEBUG("skipping %s, its name cannot be sent to the server", path);
+		remmina_rdp_cliprdr_file_entry_free(file);
+		return;
+	}
+	file->name_length = size / sizeof(WCHAR) - 1;
+	file->index = files->len;
+	file->path = g_strdup(path);
+	file->write_time = ((guint64)st.st_mtime + CLIPRDR_FILETIME_UNIX_OFFSET) * 10000000;
+	file->has_size = TRUE;
+	g_ptr_array_add(files, file);
+
+	if (S_ISREG(st.st_mode)) {
+		file->attributes = FILE_ATTRIBUTE_NORMAL;
+		file->size = st.st_size;
+		return;
+	}
+
+	file->attributes = FILE_ATTRIBUTE_DIRECTORY;
+	dir = g_dir_open(path, 0, NULL);
+	if (!dir)
+		return;
+	while ((child = g_dir_read_name(dir)) != NULL) {
+		child_path = g_build_filename(path, child, NULL);
+		child_name = g_strconcat(name, "\\", child, NULL);
+		remmina_rdp_cliprdr_file_add_local(files, child_path, child_name, depth + 1);
+		g_free(child_path);
+		g_free(child_name);
+	}
+	g_dir_close(dir);
+}
+
+static GBytes *remmina_rdp_cliprdr_file_serialize(GPtrArray *files)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrFile *file;
+	wStream *s;
+	BYTE *buffer;
+	size_t length;
+	guint i;
+
+	s = Stream_New(NULL, 4 + (size_t)files->len * CLIPRDR_FILE_DESCRIPTOR_SIZE);
+	if (!s)
+		return NULL;
+
+	Stream_Write_UINT32(s, files->len);
+	for (i = 0; i < files->len; i++) {
+		file = g_ptr_array_index(files, i);
+		Stream_Write_UINT32(s, FD_ATTRIBUTES | FD_FILESIZE | FD_WRITESTIME | FD_PROGRESSUI);
+		Stream_Zero(s, 32);             /* clsid, sizel, pointl */
+		Stream_Write_UINT32(s, file->attributes);
+		Stream_Zero(s, 16);             /* ftCreationTime, ftLastAccessTime */
+		Stream_Write_UINT64(s, file->write_time);
+		Stream_Write_UINT32(s, (UINT32)(file->size >> 32));
+		Stream_Write_UINT32(s, (UINT32)(file->size & 0xFFFFFFFF));
+		Stream_Write(s, file->name, file->name_length * sizeof(WCHAR));
+		Stream_Zero(s, (CLIPRDR_FILE_NAME_LENGTH - file->name_length) * sizeof(WCHAR));
+	}
+	Stream_SealLength(s);
+
+	buffer = Stream_Buffer(s);
+	length = Stream_Length(s);
+	Stream_Free(s, FALSE);
+	return g_bytes_new_with_free_func(buffer, length, free, buffer);
+}
+
+static void remmina_rdp_cliprdr_file_local_free(struct rf_clipboard_local_files *local)
+{
+	TRACE_CALL(__func__);
+	if (!local)
+		return;
+	if (local->fd >= 0)
+		close(local->fd);
+	g_ptr_array_unref(local->files);
+	g_free(local->buffer);
+	g_free(local);
+}
+
+GBytes *remmina_rdp_cliprdr_file_set_local_uris(rfClipboard *clipboard, gchar **uris)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_local_files *local;
+	GPtrArray *files;
+	GBytes *data;
+	gchar *path, *name;
+	guint i;
+
+	files = g_ptr_array_new_with_free_func(remmina_rdp_cliprdr_file_entry_free);
+	for (i = 0; uris && uris[i]; i++) {
+		/* Only local files can be streamed */
+		path = g_filename_from_uri(uris[i], NULL, NULL);
+		if (!path)
+			continue;
+		name = g_path_get_basename(path);
+		remmina_rdp_cliprdr_file_add_local(files, path, name, 0);
+		g_free(name);
+		g_free(path);
+	}
+	REMMINA_PLUGIN_DEBUG("offering %u local files and directories to the server", files->len);
+
+	data = remmina_rdp_cliprdr_file_serialize(files);
+
+	local = g_new0(struct rf_clipboard_local_files, 1);
+	local->files = files;
+	local->fd = -1;
+
+	pthread_mutex_lock(&clipboard->file_mutex);
+	remmina_rdp_cliprdr_file_local_free(clipboard->local_files);
+	clipboard->local_files = local;
+	pthread_mutex_unlock(&clipboard->file_mutex);
+
+	return data;
+}
+
+UINT remmina_rdp_cliprdr_file_contents_request(rfClipboard *clipboard, const CLIPRDR_FILE_CONTENTS_REQUEST *request)
+{
+	TRACE_CALL(__func__);
+	CLIPRDR_FILE_CONTENTS_RESPONSE response = { 0 };
+	struct rf_clipboard_local_files *local;
+	RemminaPluginRdpCliprdrFile *file = NULL;
+	guint64 offset, size;
+	gsize length, done = 0;
+	ssize_t n = 0;
+	UINT rc;
+
+	CLIPRDR_PDU_HEADER(&response).msgType = CB_FILECONTENTS_RESPONSE;
+	CLIPRDR_PDU_HEADER(&response).msgFlags = CB_RESPONSE_FAIL;
+	response.streamId = request->streamId;
+
+	pthread_mutex_lock(&clipboard->file_mutex);
+
+	local = clipboard->local_files;
+	if (local && request->listIndex < local->files->len)
+		file = g_ptr_array_index(local->files, request->listIndex);
+
+	if (file && (file->attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+		if (request->dwFlags & FILECONTENTS_SIZE) {
+			size = GUINT64_TO_LE(file->size);
+			response.cbRequested = sizeof(size);
+			response.requestedData = (const BYTE *)&size;
+			CLIPRDR_PDU_HEADER(&response).msgFlags = CB_RESPONSE_OK;
+		} else if (request->dwFlags & FILECONTENTS_RANGE) {
+			/* The server usually reads one file at a time, keep it open */
+			if (local->fd < 0 || local->fd_index != request->listIndex) {
+				if (local->fd >= 0)
+					close(local->fd);
+				local->fd = g_open(file->path, O_RDONLY, 0);
+				local->fd_index = request->listIndex;
+			}
+
+			offset = ((guint64)request->nPositionHigh << 32) | request->nPositionLow;
+			length = MIN(request->cbRequested, CLIPRDR_FILE_UPLOAD_CHUNK_MAX);
+			if (local->buffer_size < length) {
+				local->buffer = g_realloc(local->buffer, length);
+				local->buffer_size = length;
+			}
+
+			if (local->fd >= 0) {
+				while (done < length && (n = pread(local->fd, local->buffer + done, length - done, offset + done)) > 0)
+					done += n;
+				if (n >= 0) {
+					response.cbRequested = done;
+					response.requestedData = local->buffer;
+					CLIPRDR_PDU_HEADER(&response).msgFlags = CB_RESPONSE_OK;
+				}
+			}
+		}
+	}
+
+	if (CLIPRDR_PDU_HEADER(&response).msgFlags != CB_RESPONSE_OK)
+		REMMINA_PLUGIN_DEBUG("cannot answer FileContentsRequest for list index %u", request->listIndex);
+
+	CLIPRDR_PDU_HEADER(&response).dataLen = 4 + response.cbRequested;
+	rc = clipboard->context->ClientFileContentsResponse(clipboard->context, &response);
+
+	pthread_mutex_unlock(&clipboard->file_mutex);
+	return rc;
+}
+
+/*
+ * Server files pasted locally (server "Copy", client "Paste")
+ */
+
+static guint32 remmina_rdp_cliprdr_file_read_u32(const BYTE *p)
+{
+	guint32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return GUINT32_FROM_LE(v);
+}
+
+static guint64 remmina_rdp_cliprdr_file_read_u64(const BYTE *p)
+{
+	guint64 v;
+
+	memcpy(&v, p, sizeof(v));
+	return GUINT64_FROM_LE(v);
+}
+
+/* Converts a remote relative name into a path below the staging directory,
+ * refusing anything which could escape from it */
+static gchar *remmina_rdp_cliprdr_file_sanitize_name(const gchar *name)
+{
+	gchar **parts;
+	GString *path;
+	int i;
+
+	path = g_string_new(NULL);
+	parts = g_strsplit_set(name, "\\/", -1);
+	for (i = 0; parts[i]; i++) {
+		if (parts[i][0] == 0)
+			continue;
+		if (strcmp(parts[i], ".") == 0 || strcmp(parts[i], "..") == 0) {
+			g_string_truncate(path, 0);
+			break;
+		}
+		if (path->len > 0)
+			g_string_append_c(path, G_DIR_SEPARATOR);
+		g_string_append(path, parts[i]);
+	}
+	g_strfreev(parts);
+
+	if (path->len == 0) {
+		g_string_free(path, TRUE);
+		return NULL;
+	}
+	return g_string_free(path, FALSE);
+}
+
+static GPtrArray *remmina_rdp_cliprdr_file_parse(const BYTE *data, size_t size)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginRdpCliprdrFile *file;
+	GPtrArray *files;
+	const BYTE *p;
+	guint32 count, flags, i;
+	UINT8 *name;
+	size_t name_size;
+
+	if (size < 4)
+		return NULL;
+	count = remmina_rdp_cliprdr_file_read_u32(data);
+	if ((size - 4) / CLIPRDR_FILE_DESCRIPTOR_SIZE < count)
+		return NULL;
+
+	files = g_ptr_array_new_with_free_func(remmina_rdp_cliprdr_file_entry_free);
+	for (i = 0; i < count; i++) {
+		p = data + 4 + (size_t)i * CLIPRDR_FILE_DESCRIPTOR_SIZE;
+		name = remmina_rdp_cliprdr_text_utf16_to_utf8_lf((const WCHAR *)(p + 72), CLIPRDR_FILE_NAME_LENGTH, &name_size);
+		if (!name)
+			continue;
+
+		file = g_new0(RemminaPluginRdpCliprdrFile, 1);
+		file->index = i;
+		file->path = remmina_rdp_cliprdr_file_sanitize_name((const gchar *)name);
+		free(name);
+		if (!file->path) {
+			remmina_rdp_cliprdr_file_entry_free(file);
+			continue;
+		}
+
+		flags = remmina_rdp_cliprdr_file_read_u32(p);
+		if (flags & FD_ATTRIBUTES)
+			file->attributes = remmina_rdp_cliprdr_file_read_u32(p + 36);
+		if (flags & FD_WRITESTIME)
+			file->write_time = remmina_rdp_cliprdr_file_read_u64(p + 56);
+		if (flags & FD_FILESIZE) {
+			file->size = ((guint64)remmina_rdp_cliprdr_file_read_u32(p + 64) << 32) | remmina_rdp_cliprdr_file_read_u32(p + 68);
+			file->has_size = TRUE;
+		}
+		g_ptr_array_add(files, file);
+	}
+	return files;
+}
+
+static void remmina_rdp_cliprdr_file_download_free(struct rf_clipboard_download *download)
+{
+	TRACE_CALL(__func__);
+	if (!download)
+		return;
+	if (download->fd >= 0)
+		close(download->fd);
+	g_ptr_array_unref(download->files);
+	g_string_free(download->uris, TRUE);
+	g_free(download);
+}
+
+/* All the following download functions must be called with file_mutex held */
+
+static void remmina_rdp_cliprdr_file_download_complete(rfClipboard *clipboard, gboolean success)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download = clipboard->download;
+	gchar *output = NULL;
+
+	if (success) {
+		REMMINA_PLUGIN_DEBUG("clipboard files from the server are ready in %s", clipboard->staging_dir);
+		output = strdup(download->uris->str);
+	} else {
+		g_warning("[RDP] clipboard file transfer from the server failed");
+		remmina_rdp_cliprdr_file_remove_tree(clipboard->staging_dir);
+		g_free(clipboard->staging_dir);
+		clipboard->staging_dir = NULL;
+	}
+
+	remmina_rdp_cliprdr_file_download_free(download);
+	clipboard->download = NULL;
+	remmina_rdp_cliprdr_set_srv_data(clipboard, output);
+}
+
+static gboolean remmina_rdp_cliprdr_file_download_request(rfClipboard *clipboard, UINT32 flags, guint64 offset, UINT32 length)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download = clipboard->download;
+	RemminaPluginRdpCliprdrFile *file = g_ptr_array_index(download->files, download->current);
+	RemminaPluginRdpCliprdrRange *range = NULL;
+	CLIPRDR_FILE_CONTENTS_REQUEST request = { 0 };
+	int i;
+
+	for (i = 0; i < CLIPRDR_FILE_DOWNLOAD_INFLIGHT && !range; i++)
+		if (!download->ranges[i].used)
+			range = &download->ranges[i];
+	if (!range)
+		return FALSE;
+
+	range->used = TRUE;
+	range->stream_id = ++download->next_stream_id;
+	range->flags = flags;
+	range->offset = offset;
+	range->length = length;
+	download->inflight++;
+
+	CLIPRDR_PDU_HEADER(&request).msgType = CB_FILECONTENTS_REQUEST;
+	CLIPRDR_PDU_HEADER(&request).dataLen = 24;
+	request.streamId = range->stream_id;
+	request.listIndex = file->index;
+	request.dwFlags = flags;
+	request.nPositionLow = (UINT32)(offset & 0xFFFFFFFF);
+	request.nPositionHigh = (UINT32)(offset >> 32);
+	request.cbRequested = length;
+
+	return clipboard->context->ClientFileContentsRequest(clipboard->context, &request) == CHANNEL_RC_OK;
+}
+
+/* Keeps CLIPRDR_FILE_DOWNLOAD_INFLIGHT requests outstanding for the current file */
+static gboolean remmina_rdp_cliprdr_file_download_fill(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download = clipboard->download;
+	UINT32 length;
+
+	while (download->inflight < CLIPRDR_FILE_DOWNLOAD_INFLIGHT && download->next_offset < download->size) {
+		length = (UINT32)MIN((guint64)CLIPRDR_FILE_DOWNLOAD_CHUNK, download->size - download->next_offset);
+		if (!remmina_rdp_cliprdr_file_download_request(clipboard, FILECONTENTS_RANGE, download->next_offset, length))
+			return FALSE;
+		download->next_offset += length;
+	}
+	return TRUE;
+}
+
+static void remmina_rdp_cliprdr_file_download_next(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download = clipboard->download;
+	RemminaPluginRdpCliprdrFile *file;
+	gchar *path, *dir;
+
+	while (download->current < download->files->len) {
+		file = g_ptr_array_index(download->files, download->current);
+		path = g_build_filename(clipboard->staging_dir, file->path, NULL);
+		if (file->attributes & FILE_ATTRIBUTE_DIRECTORY) {
+			g_mkdir_with_parents(path, 0700);
+			g_free(path);
+			download->current++;
+			continue;
+		}
+
+		dir = g_path_get_dirname(path);
+		g_mkdir_with_parents(dir, 0700);
+		g_free(dir);
+		download->fd = g_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		g_free(path);
+		if (download->fd < 0) {
+			remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			return;
+		}
+
+		download->next_offset = 0;
+		download->received = 0;
+		if (!file->has_size) {
+			if (!remmina_rdp_cliprdr_file_download_request(clipboard, FILECONTENTS_SIZE, 0, 8))
+				remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			return;
+		}
+
+		download->size = file->size;
+		if (download->size > 0) {
+			if (!remmina_rdp_cliprdr_file_download_fill(clipboard))
+				remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			return;
+		}
+
+		close(download->fd);
+		download->fd = -1;
+		download->current++;
+	}
+
+	remmina_rdp_cliprdr_file_download_complete(clipboard, TRUE);
+}
+
+gboolean remmina_rdp_cliprdr_file_download_start(rfClipboard *clipboard, const BYTE *data, size_t size)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download;
+	RemminaPluginRdpCliprdrFile *file;
+	GPtrArray *files;
+	gchar *parent, *staging_dir, *path, *uri;
+	guint i;
+
+	files = remmina_rdp_cliprdr_file_parse(data, size);
+	if (!files || files->len == 0) {
+		if (files)
+			g_ptr_array_unref(files);
+		return FALSE;
+	}
+
+	parent = g_build_filename(g_get_user_cache_dir(), "remmina", "clipboard", NULL);
+	g_mkdir_with_parents(parent, 0700);
+	staging_dir = g_build_filename(parent, "files-XXXXXX", NULL);
+	g_free(parent);
+	if (!g_mkdtemp(staging_dir)) {
+		g_warning("[RDP] cannot create a directory for clipboard files: %s", g_strerror(errno));
+		g_free(staging_dir);
+		g_ptr_array_unref(files);
+		return FALSE;
+	}
+
+	download = g_new0(struct rf_clipboard_download, 1);
+	download->files = files;
+	download->fd = -1;
+	download->uris = g_string_new(NULL);
+	for (i = 0; i < files->len; i++) {
+		file = g_ptr_array_index(files, i);
+		if (strchr(file->path, G_DIR_SEPARATOR))
+			continue;
+		path = g_build_filename(staging_dir, file->path, NULL);
+		uri = g_filename_to_uri(path, NULL, NULL);
+		if (uri)
+			g_string_append_printf(download->uris, "%s\n", uri);
+		g_free(uri);
+		g_free(path);
+	}
+
+	REMMINA_PLUGIN_DEBUG("receiving %u clipboard files from the server into %s", files->len, staging_dir);
+
+	pthread_mutex_lock(&clipboard->file_mutex);
+	/* Only the files of the last server clipboard are kept */
+	remmina_rdp_cliprdr_file_download_free(clipboard->download);
+	if (clipboard->staging_dir) {
+		remmina_rdp_cliprdr_file_remove_tree(clipboard->staging_dir);
+		g_free(clipboard->staging_dir);
+	}
+	clipboard->staging_dir = staging_dir;
+	clipboard->download = download;
+	remmina_rdp_cliprdr_file_download_next(clipboard);
+	pthread_mutex_unlock(&clipboard->file_mutex);
+
+	return TRUE;
+}
+
+static gboolean remmina_rdp_cliprdr_file_write(int fd, const BYTE *data, size_t length, guint64 offset)
+{
+	ssize_t n;
+
+	while (length > 0) {
+		n = pwrite(fd, data, length, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+		data += n;
+		length -= n;
+		offset += n;
+	}
+	return TRUE;
+}
+
+UINT remmina_rdp_cliprdr_file_contents_response(rfClipboard *clipboard, const CLIPRDR_FILE_CONTENTS_RESPONSE *response)
+{
+	TRACE_CALL(__func__);
+	struct rf_clipboard_download *download;
+	RemminaPluginRdpCliprdrRange range = { 0 };
+	UINT32 length;
+	int i;
+
+	pthread_mutex_lock(&clipboard->file_mutex);
+
+	/* Responses to a cancelled download are just dropped */
+	download = clipboard->download;
+	for (i = 0; download && i < CLIPRDR_FILE_DOWNLOAD_INFLIGHT; i++) {
+		if (download->ranges[i].used && download->ranges[i].stream_id == response->streamId) {
+			range = download->ranges[i];
+			download->ranges[i].used = FALSE;
+			download->inflight--;
+			break;
+		}
+	}
+	if (!range.used) {
+		pthread_mutex_unlock(&clipboard->file_mutex);
+		return CHANNEL_RC_OK;
+	}
+
+	clipboard->srv_data_activity_time = g_get_monotonic_time();
+
+	if (CLIPRDR_PDU_HEADER(response).msgFlags != CB_RESPONSE_OK) {
+		remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+	} else if (range.flags & FILECONTENTS_SIZE) {
+		if (response->cbRequested < 8) {
+			remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+		} else {
+			download->size = remmina_rdp_cliprdr_file_read_u64(response->requestedData);
+			if (download->size == 0) {
+				close(download->fd);
+				download->fd = -1;
+				download->current++;
+				remmina_rdp_cliprdr_file_download_next(clipboard);
+			} else if (!remmina_rdp_cliprdr_file_download_fill(clipboard)) {
+				remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			}
+		}
+	} else {
+		/* Written straight to disk, nothing is accumulated in memory */
+		length = MIN(response->cbRequested, range.length);
+		if (length == 0 || !remmina_rdp_cliprdr_file_write(download->fd, response->requestedData, length, range.offset)) {
+			remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+		} else {
+			download->received += length;
+			if (download->received >= download->size) {
+				close(download->fd);
+				download->fd = -1;
+				download->current++;
+				remmina_rdp_cliprdr_file_download_next(clipboard);
+			} else if (length < range.length &&
+				   !remmina_rdp_cliprdr_file_download_request(clipboard, FILECONTENTS_RANGE, range.offset + length, range.length - length)) {
+				/* Short read: ask again for the missing part */
+				remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			} else if (!remmina_rdp_cliprdr_file_download_fill(clipboard)) {
+				remmina_rdp_cliprdr_file_download_complete(clipboard, FALSE);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&clipboard->file_mutex);
+	return CHANNEL_RC_OK;
+}
+
+void remmina_rdp_cliprdr_file_download_cancel(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	pthread_mutex_lock(&clipboard->file_mutex);
+	if (clipboard->download) {
+		REMMINA_PLUGIN_DEBUG("cancelling clipboard file transfer from the server");
+		remmina_rdp_cliprdr_file_download_free(clipboard->download);
+		clipboard->download = NULL;
+		remmina_rdp_cliprdr_file_remove_tree(clipboard->staging_dir);
+		g_free(clipboard->staging_dir);
+		clipboard->staging_dir = NULL;
+		/* Wake up the paste waiting for the files, it gets nothing */
+		remmina_rdp_cliprdr_set_srv_data(clipboard, NULL);
+	}
+	pthread_mutex_unlock(&clipboard->file_mutex);
+}
+
+void remmina_rdp_cliprdr_file_free(rfClipboard *clipboard)
+{
+	TRACE_CALL(__func__);
+	remmina_rdp_cliprdr_file_download_cancel(clipboard);
+
+	pthread_mutex_lock(&clipboard->file_mutex);
+	remmina_rdp_cliprdr_file_local_free(clipboard->local_files);
+	clipboard->local_files = NULL;
+	if (clipboard->staging_dir) {
+		remmina_rdp_cliprdr_file_remove_tree(clipboard->staging_dir);
+		g_free(clipboard->staging_dir);
+		clipboard->staging_dir = NULL;
+	}
+	pthread_mutex_unlock(&clipboard->file_mutex);
+}
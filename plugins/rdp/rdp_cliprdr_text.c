@@ -0,0 +1,334 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "rdp_plugin.h"
+#include "rdp_cliprdr_text.h"
+
+#ifdef WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+/* UTF-16 code unit used for invalid or unpaired surrogates */
+#define CLIPRDR_TEXT_REPLACEMENT_CHAR 0xFFFD
+
+static size_t remmina_rdp_cliprdr_text_count_byte(const UINT8 *data, size_t size, UINT8 c)
+{
+	/* memchr() is vectorized by the C library, so counting by
+	 * jumping from match to match is much faster than a byte loop */
+	const UINT8 *p = data;
+	const UINT8 *end = data + size;
+	size_t n = 0;
+
+	while (p < end && (p = memchr(p, c, end - p)) != NULL) {
+		n++;
+		p++;
+	}
+	return n;
+}
+
+UINT8 *remmina_rdp_cliprdr_text_lf2crlf(const UINT8 *data, size_t size, size_t *out_size)
+{
+	TRACE_CALL(__func__);
+	const UINT8 *in = data;
+	const UINT8 *in_end = data + size;
+	const UINT8 *lf;
+	UINT8 *outbuf;
+	UINT8 *out;
+	size_t run;
+
+	*out_size = size + remmina_rdp_cliprdr_text_count_byte(data, size, '\n') + 1;
+	outbuf = (UINT8 *)malloc(*out_size);
+	if (!outbuf) {
+		*out_size = 0;
+		return NULL;
+	}
+	out = outbuf;
+
+	while (in < in_end && (lf = memchr(in, '\n', in_end - in)) != NULL) {
+		run = lf - in;
+		memcpy(out, in, run);
+		out += run;
+		*out++ = '\r';
+		*out++ = '\n';
+		in = lf + 1;
+	}
+	memcpy(out, in, in_end - in);
+	out += in_end - in;
+	*out = 0;
+
+	return outbuf;
+}
+
+UINT8 *remmina_rdp_cliprdr_text_crlf2lf(const UINT8 *data, size_t size, size_t *out_size)
+{
+	TRACE_CALL(__func__);
+	const UINT8 *in = data;
+	const UINT8 *in_end = data + size;
+	const UINT8 *cr;
+	UINT8 *outbuf;
+	UINT8 *out;
+	size_t run;
+
+	*out_size = size - remmina_rdp_cliprdr_text_count_byte(data, size, '\r') + 1;
+	outbuf = (UINT8 *)malloc(*out_size);
+	if (!outbuf) {
+		*out_size = 0;
+		return NULL;
+	}
+	out = outbuf;
+
+	while (in < in_end && (cr = memchr(in, '\r', in_end - in)) != NULL) {
+		run = cr - in;
+		memcpy(out, in, run);
+		out += run;
+		in = cr + 1;
+	}
+	memcpy(out, in, in_end - in);
+	out += in_end - in;
+	*out = 0;
+
+	return outbuf;
+}
+
+WCHAR *remmina_rdp_cliprdr_text_utf8_to_utf16_crlf(const UINT8 *data, size_t size, size_t *out_size)
+{
+	TRACE_CALL(__func__);
+	const UINT8 *in = data;
+	const UINT8 *in_end = data + size;
+	UINT16 *outbuf;
+	UINT16 *out;
+	UINT16 *out_end;
+	size_t units = 0;
+	size_t i;
+	UINT32 cp;
+	UINT32 cp_min;
+	UINT8 c;
+	int extra;
+
+	/* First pass: every non continuation byte starts one UTF-16 unit,
+	 * 4 bytes sequences need a surrogate pair and each LF becomes CRLF.
+	 * The loop has no branches and is auto vectorized by the compiler. */
+	for (i = 0; i < size; i++) {
+		c = data[i];
+		units += ((c & 0xC0) != 0x80) + (c >= 0xF0) + (c == '\n');
+	}
+
+	outbuf = (UINT16 *)malloc((units + 1) * sizeof(UINT16));
+	if (!outbuf) {
+		*out_size = 0;
+		return NULL;
+	}
+	out = outbuf;
+	out_end = outbuf + units;
+
+	while (in < in_end) {
+#ifdef WITH_SSE2
+		/* Widen 16 plain ASCII bytes at a time, stop at the first
+		 * byte which is not ASCII or is a LF */
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i zero = _mm_setzero_si128();
+		while (in_end - in >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)in);
+			int mask = _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+			if (mask != 0) {
+				int n = __builtin_ctz(mask);
+				for (i = 0; i < (size_t)n; i++)
+					out[i] = in[i];
+				in += n;
+				out += n;
+				break;
+			}
+			_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(v, zero));
+			_mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi8(v, zero));
+			in += 16;
+			out += 16;
+		}
+		if (in >= in_end)
+			break;
+#endif
+		c = *in++;
+		if (c < 0x80) {
+			if (c == '\n')
+				*out++ = '\r';
+			*out++ = c;
+			continue;
+		}
+
+		if (c >= 0xC2 && c <= 0xDF) {
+			cp = c & 0x1F;
+			cp_min = 0x80;
+			extra = 1;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			cp = c & 0x0F;
+			cp_min = 0x800;
+			extra = 2;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			cp = c & 0x07;
+			cp_min = 0x10000;
+			extra = 3;
+		} else {
+			goto invalid;
+		}
+		if (in_end - in < extra)
+			goto invalid;
+		while (extra-- > 0) {
+			c = *in++;
+			if ((c & 0xC0) != 0x80)
+				goto invalid;
+			cp = (cp << 6) | (c & 0x3F);
+		}
+		/* Reject overlong forms, surrogates and out of range code points */
+		if (cp < cp_min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+			goto invalid;
+
+		if (cp >= 0x10000) {
+			if (out_end - out < 2)
+				goto invalid;
+			cp -= 0x10000;
+			*out++ = (UINT16)(0xD800 | (cp >> 10));
+			*out++ = (UINT16)(0xDC00 | (cp & 0x3FF));
+		} else {
+			if (out >= out_end)
+				goto invalid;
+			*out++ = (UINT16)cp;
+		}
+	}
+
+	*out = 0;
+	*out_size = (out - outbuf + 1) * sizeof(UINT16);
+	return (WCHAR *)outbuf;
+
+invalid:
+	free(outbuf);
+	*out_size = 0;
+	return NULL;
+}
+
+UINT8 *remmina_rdp_cliprdr_text_utf16_to_utf8_lf(const WCHAR *data, size_t nchars, size_t *out_size)
+{
+	TRACE_CALL(__func__);
+	const UINT16 *in = (const UINT16 *)data;
+	const UINT16 *in_end;
+	UINT8 *outbuf;
+	UINT8 *out;
+	size_t bytes = 0;
+	size_t i;
+	UINT32 cp;
+	UINT16 u;
+
+	/* The server may send a NUL terminated string shorter than the
+	 * announced data length: ignore everything after the terminator */
+	for (i = 0; i < nchars && in[i] != 0; i++) {
+		u = in[i];
+		if (u == '\r')
+			continue;
+		if (u < 0x80)
+			bytes += 1;
+		else if (u < 0x800)
+			bytes += 2;
+		else if (u >= 0xD800 && u <= 0xDBFF && i + 1 < nchars && in[i + 1] >= 0xDC00 && in[i + 1] <= 0xDFFF) {
+			bytes += 4;
+			i++;
+		} else
+			bytes += 3;
+	}
+	in_end = in + i;
+
+	outbuf = (UINT8 *)malloc(bytes + 1);
+	if (!outbuf) {
+		*out_size = 0;
+		return NULL;
+	}
+	out = outbuf;
+
+	while (in < in_end) {
+#ifdef WITH_SSE2
+		/* Narrow 8 plain ASCII units at a time, stop at the first
+		 * unit which is not ASCII or is a CR */
+		const __m128i hi = _mm_set1_epi16((short)0xFF80);
+		const __m128i cr = _mm_set1_epi16('\r');
+		const __m128i zero = _mm_setzero_si128();
+		while (in_end - in >= 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)in);
+			__m128i bad = _mm_or_si128(
+				_mm_xor_si128(_mm_cmpeq_epi16(_mm_and_si128(v, hi), zero), _mm_set1_epi16(-1)),
+				_mm_cmpeq_epi16(v, cr));
+			int mask = _mm_movemask_epi8(bad);
+			if (mask != 0) {
+				int n = __builtin_ctz(mask) / 2;
+				for (i = 0; i < (size_t)n; i++)
+					out[i] = (UINT8)in[i];
+				in += n;
+				out += n;
+				break;
+			}
+			_mm_storel_epi64((__m128i *)out, _mm_packus_epi16(v, v));
+			in += 8;
+			out += 8;
+		}
+		if (in >= in_end)
+			break;
+#endif
+		u = *in++;
+		if (u == '\r')
+			continue;
+		if (u < 0x80) {
+			*out++ = (UINT8)u;
+			continue;
+		}
+		if (u < 0x800) {
+			*out++ = (UINT8)(0xC0 | (u >> 6));
+			*out++ = (UINT8)(0x80 | (u & 0x3F));
+			continue;
+		}
+		if (u >= 0xD800 && u <= 0xDBFF && in < in_end && *in >= 0xDC00 && *in <= 0xDFFF) {
+			cp = 0x10000 + (((UINT32)(u - 0xD800)) << 10) + (*in++ - 0xDC00);
+			*out++ = (UINT8)(0xF0 | (cp >> 18));
+			*out++ = (UINT8)(0x80 | ((cp >> 12) & 0x3F));
+			*out++ = (UINT8)(0x80 | ((cp >> 6) & 0x3F));
+			*out++ = (UINT8)(0x80 | (cp & 0x3F));
+			continue;
+		}
+		/* Unpaired surrogates become U+FFFD instead of failing the whole transfer */
+		if (u >= 0xD800 && u <= 0xDFFF)
+			u = CLIPRDR_TEXT_REPLACEMENT_CHAR;
+		*out++ = (UINT8)(0xE0 | (u >> 12));
+		*out++ = (UINT8)(0x80 | ((u >> 6) & 0x3F));
+		*out++ = (UINT8)(0x80 | (u & 0x3F));
+	}
+
+	*out = 0;
+	*out_size = out - outbuf + 1;
+	return outbuf;
+}
@@ -147,6 +147,22 @@ static gboolean remmina_rdp_event_on_focus_in(GtkWidget *widget, GdkEventKey *ev
 	return FALSE;
 }
 
+/* Releases what an event owns when it never reaches the libfreerdp thread */
+static void remmina_rdp_event_event_release(const RemminaPluginRdpEvent *e)
+{
+	TRACE_CALL(__func__);
+	if (e->type == REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_RESPONSE &&
+	    e->clipboard_formatdataresponse.data)
+		g_bytes_unref(e->clipboard_formatdataresponse.data);
+}
+
+static void remmina_rdp_event_event_free(gpointer data)
+{
+	TRACE_CALL(__func__);
+	remmina_rdp_event_event_release((RemminaPluginRdpEvent *)data);
+	g_free(data);
+}
+
 void remmina_rdp_event_event_push(RemminaProtocolWidget *gp, const RemminaPluginRdpEvent *e)
 {
 	TRACE_CALL(__func__);
@@ -155,19 +171,19 @@ void remmina_rdp_event_event_push(RemminaProtocolWidget *gp, const RemminaPlugin
 
 	/* Called by the main GTK thread to send an event to the libfreerdp thread */
 
-	if (!rfi || !rfi->connected || rfi->is_reconnecting)
+	if (!rfi || !rfi->connected || rfi->is_reconnecting || !rfi->event_queue) {
+		remmina_rdp_event_event_release(e);
 		return;
+	}
 
-	if (rfi->event_queue) {
 #if GLIB_CHECK_VERSION(2,67,3)
-		event = g_memdup2(e, sizeof(RemminaPluginRdpEvent));
+	event = g_memdup2(e, sizeof(RemminaPluginRdpEvent));
 #else
-		event = g_memdup(e, sizeof(RemminaPluginRdpEvent));
+	event = g_memdup(e, sizeof(RemminaPluginRdpEvent));
 #endif
-		g_async_queue_push(rfi->event_queue, event);
+	g_async_queue_push(rfi->event_queue, event);
 
-		if (write(rfi->event_pipe[1], "\0", 1)) {
-		}
+	if (write(rfi->event_pipe[1], "\0", 1)) {
 	}
 }
 
@@ -957,8 +973,6 @@ gboolean remmina_rdp_event_on_clipboard(GtkClipboard *gtkClipboard, GdkEvent *ev
 {
 	/* Signal handler for GTK clipboard owner-change */
 	TRACE_CALL(__func__);
-	RemminaPluginRdpEvent rdp_event = { 0 };
-	CLIPRDR_FORMAT_LIST *pFormatList;
 	GObject *new_owner;
 
 	/* Usually "owner-change" is fired when a user presses "COPY" on the client
@@ -970,8 +984,11 @@ gboolean remmina_rdp_event_on_clipboard(GtkClipboard *gtkClipboard, GdkEvent *ev
 
 	rfContext *rfi = GET_PLUGIN_DATA(gp);
 
-	if (rfi)
+	if (rfi) {
+		/* Invalidates the clipboard image cache */
+		g_atomic_int_inc(&rfi->clipboard.local_serial);
 		remmina_rdp_clipboard_abort_client_format_data_request(rfi);
+	}
 
 	new_owner = gtk_clipboard_get_owner(gtkClipboard);
 	if (new_owner != (GObject *)gp) {
@@ -982,10 +999,7 @@ gboolean remmina_rdp_event_on_clipboard(GtkClipboard *gtkClipboard, GdkEvent *ev
 
 		REMMINA_PLUGIN_DEBUG("gp=%p owner-change: new owner is not me: Sending local clipboard format list to server.",
 			gp, new_owner, gp);
-		pFormatList = remmina_rdp_cliprdr_get_client_format_list(gp);
-		rdp_event.type = REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_LIST;
-		rdp_event.clipboard_formatlist.pFormatList = pFormatList;
-		remmina_rdp_event_event_push(gp, &rdp_event);
+		remmina_rdp_cliprdr_request_client_format_list(gp);
 	} else {
 		REMMINA_PLUGIN_DEBUG("    ... but I'm the owner!");
 	}
@@ -1078,7 +1092,8 @@ void remmina_rdp_event_init(RemminaProtocolWidget *gp)
 	}
 
 	rfi->pressed_keys = g_array_new(FALSE, TRUE, sizeof(RemminaPluginRdpEvent));
-	rfi->event_queue = g_async_queue_new_full(g_free);
+	/* Events left over at disconnection may still own clipboard data */
+	rfi->event_queue = g_async_queue_new_full(remmina_rdp_event_event_free);
 	rfi->ui_queue = g_async_queue_new();
 	pthread_mutex_init(&rfi->ui_queue_mutex, NULL);
 
@@ -308,22 +308,28 @@ static BOOL rf_process_event_queue(RemminaProtocolWidget *gp)
 
 		case REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_RESPONSE:
 		{
-			UINT32 msgFlags = (event->clipboard_formatdataresponse.data) ? CB_RESPONSE_OK : CB_RESPONSE_FAIL;
+			/* The data is shared with the clipboard cache: libfreerdp copies it
+			 * into the outgoing PDU, so we only drop our reference afterwards */
+			GBytes *data = event->clipboard_formatdataresponse.data;
+			gsize size = 0;
+			UINT32 msgFlags = data ? CB_RESPONSE_OK : CB_RESPONSE_FAIL;
+			response.requestedFormatData = data ? g_bytes_get_data(data, &size) : NULL;
 #if FREERDP_VERSION_MAJOR >= 3
 			response.common.msgFlags = msgFlags;
-			response.common.dataLen = event->clipboard_formatdataresponse.size;
+			response.common.dataLen = (UINT32)MIN(size, INT32_MAX);
 #else
 			response.msgFlags = msgFlags;
-			response.dataLen = event->clipboard_formatdataresponse.size;
+			response.dataLen = (UINT32)MIN(size, INT32_MAX);
 #endif
-			response.requestedFormatData = event->clipboard_formatdataresponse.data;
 			rfi->clipboard.context->ClientFormatDataResponse(rfi->clipboard.context, &response);
+			if (data)
+				g_bytes_unref(data);
 		}
 			break;
 
 		case REMMINA_RDP_EVENT_TYPE_CLIPBOARD_SEND_CLIENT_FORMAT_DATA_REQUEST:
 			REMMINA_PLUGIN_DEBUG("Sending client FormatDataRequest to server");
-			gettimeofday(&(rfi->clipboard.clientformatdatarequest_tv), NULL);
+			rfi->clipboard.clientformatdatarequest_time = g_get_monotonic_time();
 			rfi->clipboard.context->ClientFormatDataRequest(rfi->clipboard.context, event->clipboard_formatdatarequest.pFormatDataRequest);
 			free(event->clipboard_formatdatarequest.pFormatDataRequest);
 			break;
@@ -2888,8 +2894,7 @@ static gboolean remmina_rdp_close_connection(RemminaProtocolWidget *gp)
 	if (rfi && rfi->clipboard.srv_clip_data_wait == SCDW_BUSY_WAIT) {
 		REMMINA_PLUGIN_DEBUG("[RDP] requesting clipboard transfer to abort");
 		/* Allow clipboard transfer from server to terminate */
-		rfi->clipboard.srv_clip_data_wait = SCDW_ABORTING;
-		usleep(100000);
+		remmina_rdp_clipboard_abort_client_format_data_request(rfi);
 	}
 
 	if (rfi->is_reconnecting) {
@@ -130,6 +130,23 @@ extern RemminaPluginService *remmina_plugin_service;
 #define REMMINA_PLUGIN_AUDIT(fmt, ...) \
 		remmina_plugin_service->_remmina_audit(__func__, fmt, ##__VA_ARGS__)
 
+typedef enum {
+	REMMINA_RDP_CLIPRDR_IMAGE_PNG,
+	REMMINA_RDP_CLIPRDR_IMAGE_JPEG,
+	REMMINA_RDP_CLIPRDR_IMAGE_DIB,
+	REMMINA_RDP_CLIPRDR_IMAGE_N
+} RemminaPluginRdpCliprdrImageType;
+
+/* Local clipboard image and the formats already encoded for the server.
+ * Valid only while serial matches rf_clipboard.local_serial */
+struct rf_clipboard_image_cache {
+	pthread_mutex_t		mutex;
+	gint			serial;
+	GdkPixbuf *		pixbuf;
+	GBytes *		encoded[REMMINA_RDP_CLIPRDR_IMAGE_N];
+	GThreadPool *		encoder;
+};
+
 struct rf_clipboard {
 	rfContext *		rfi;
 	CliprdrClientContext *	context;
@@ -140,15 +157,37 @@ struct rf_clipboard {
 	gulong			clipboard_handler;
 
 	pthread_mutex_t		transfer_clip_mutex;
-	pthread_cond_t		transfer_clip_cond;
 	enum  { SCDW_NONE, SCDW_BUSY_WAIT, SCDW_ABORTING } srv_clip_data_wait;
 	gpointer		srv_data;
 	pthread_mutex_t	srv_data_mutex;
 
 	UINT32			server_html_format_id;
 
+	/* Incremented at every owner-change of the local clipboard */
+	gint			local_serial;
+	struct rf_clipboard_image_cache	image_cache;
+
+	/* Nested main loop waiting for server data while a local application pastes */
+	GMainLoop *		srv_data_loop;
+
+	/* Server FormatDataRequests waiting for the local clipboard owner, by
+	 * request id. Only used by the GTK thread */
+	GHashTable *		pending_requests;
+	guint			pending_request_seq;
+
 	/* Stats for clipboard download */
-	struct timeval clientformatdatarequest_tv;
+	gint64			clientformatdatarequest_time;
+	/* Last time server data arrived, the paste is aborted after
+	 * CLIPBOARD_TRANSFER_WAIT_TIME seconds without any progress */
+	gint64			srv_data_activity_time;
+
+	/* File copy and paste, see rdp_cliprdr_file.c */
+	UINT32			server_caps_flags;
+	UINT32			server_file_format_id;
+	pthread_mutex_t		file_mutex;
+	struct rf_clipboard_local_files *local_files;
+	struct rf_clipboard_download *	download;
+	gchar *			staging_dir;
 };
 typedef struct rf_clipboard rfClipboard;
 
@@ -207,8 +246,7 @@ struct remmina_plugin_rdp_event {
 			CLIPRDR_FORMAT_LIST *pFormatList;
 		} clipboard_formatlist;
 		struct {
-			BYTE *	data;
-			int	size;
+			GBytes *data;
 		} clipboard_formatdataresponse;
 		struct {
 			CLIPRDR_FORMAT_DATA_REQUEST *pFormatDataRequest;
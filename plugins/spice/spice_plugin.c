@@ -58,6 +58,8 @@ static void remmina_plugin_spice_channel_open_fd_cb(SpiceChannel *channel, gint
 static gboolean send_key_strokes(gpointer data);
 
 void remmina_plugin_spice_select_usb_devices(RemminaProtocolWidget *);
+const RemminaPluginSpiceCaps *remmina_plugin_spice_caps_get(void);
+void remmina_plugin_spice_caps_display_channel_event_cb(SpiceChannel *, SpiceChannelEvent, RemminaProtocolWidget *);
 #ifdef SPICE_GTK_CHECK_VERSION
 #  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
 void remmina_plugin_spice_file_transfer_new_cb(SpiceMainChannel *, SpiceFileTransferTask *, RemminaProtocolWidget *);
@@ -299,6 +301,10 @@ static void remmina_plugin_spice_channel_new_cb(SpiceSession *session, SpiceChan
 
 	if (SPICE_IS_DISPLAY_CHANNEL(channel)) {
 		gpdata->display_channel = SPICE_DISPLAY_CHANNEL(channel);
+		g_signal_connect(channel,
+			"channel-event",
+			G_CALLBACK(remmina_plugin_spice_caps_display_channel_event_cb),
+			gp);
 		gpdata->display = spice_display_new(gpdata->session, id);
 		g_signal_connect(gpdata->display,
 			"notify::ready",
@@ -830,45 +836,6 @@ static void remmina_plugin_spice_remove_list_option(gpointer *option_list, const
 	*dst = NULL;
 }
 
-#ifdef SPICE_GTK_CHECK_VERSION
-#  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
-static gboolean remmina_plugin_spice_is_lz4_supported(void) {
-	gboolean result = FALSE;
-	GOptionContext *context;
-	GOptionGroup *spiceGroup;
-	gchar *spiceHelp;
-
-	TRACE_CALL(__func__);
-
-	spiceGroup = spice_get_option_group();
-	context = g_option_context_new("- SPICE client test application");
-	g_option_context_add_group(context, spiceGroup);
-
-	spiceHelp = g_option_context_get_help(context, FALSE, spiceGroup);
-	if (g_strcmp0(spiceHelp, "") != 0) {
-		gchar **spiceHelpLines, **line;
-		spiceHelpLines = g_strsplit(spiceHelp, "\n", -1);
-
-		for (line = spiceHelpLines; *line != NULL; ++line) {
-			if (g_strstr_len(*line, -1, "spice-preferred-compression")) {
-				if (g_strstr_len(*line, -1, ",lz4,")) {
-					result = TRUE;
-				}
-
-				break;
-			}
-		}
-
-		g_strfreev(spiceHelpLines);
-	}
-	g_option_context_free(context);
-	g_free(spiceHelp);
-
-	return result;
-}
-#  endif
-#endif
-
 G_MODULE_EXPORT gboolean remmina_plugin_entry(RemminaPluginService *service);
 
 gboolean remmina_plugin_entry(RemminaPluginService *service)
@@ -881,7 +848,7 @@ gboolean remmina_plugin_entry(RemminaPluginService *service)
 
 #ifdef SPICE_GTK_CHECK_VERSION
 #  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
-	if (!remmina_plugin_spice_is_lz4_supported()) {
+	if (!remmina_plugin_spice_caps_get()->lz4) {
 		char key_str[10];
 		sprintf(key_str, "%d", SPICE_IMAGE_COMPRESSION_LZ4);
 		remmina_plugin_spice_remove_list_option(imagecompression_list, key_str);
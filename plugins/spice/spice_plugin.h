@@ -86,6 +86,12 @@ typedef struct _RemminaPluginSpiceData {
 	GAsyncQueue *		keys_queue;
 	gboolean 		is_sending_keys;
 
+	/* What both ends support, filled in when the display channel opens */
+	gboolean		caps_negotiated;
+	guint			video_codecs;           /* Bitmask of SpiceVideoCodecType */
+	guint			image_compressions;     /* Bitmask of SpiceImageCompression */
+	gboolean		gl_scanout;
+
 #ifdef SPICE_GTK_CHECK_VERSION
 #  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
 	/* key: SpiceFileTransferTask, value: RemminaPluginSpiceXferWidgets */
@@ -95,6 +101,12 @@ typedef struct _RemminaPluginSpiceData {
 #endif          /* SPICE_GTK_CHECK_VERSION */
 } RemminaPluginSpiceData;
 
+/* Features of the spice-gtk library, see remmina_plugin_spice_caps_get() */
+typedef struct _RemminaPluginSpiceCaps {
+	gboolean	lz4;
+	gboolean	gl_scanout;
+} RemminaPluginSpiceCaps;
+
 typedef struct {
 	gint	keylen;
 	guint *	keystrokes;
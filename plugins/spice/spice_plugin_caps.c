@@ -0,0 +1,288 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+#include "spice_plugin.h"
+
+/* What the spice-gtk library we run against can do. Probed once per spice-gtk
+ * version and remembered on disk, so that startup does not parse options. */
+static RemminaPluginSpiceCaps spice_caps;
+static gsize spice_caps_probed = 0;
+
+#define SPICE_CAPS_CACHE_GROUP "spice-gtk"
+
+static const gchar *video_codec_names[] = {
+	NULL, "mjpeg", "vp8", "h264", "vp9", "h265"
+};
+
+static const gchar *image_compression_names[] = {
+	NULL, "off", "auto-glz", "auto-lz", "quic", "glz", "lz", "lz4"
+};
+
+#ifdef SPICE_GTK_CHECK_VERSION
+#  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
+/* Let the spice-gtk option parser tell whether it accepts an argument: options
+ * and values for features left out at build time are rejected. */
+static gboolean remmina_plugin_spice_caps_accepts_option(const gchar *option)
+{
+	TRACE_CALL(__func__);
+
+	GOptionContext *context;
+	GError *err = NULL;
+	gchar *argv[] = { "remmina", (gchar *)option, NULL };
+	gchar **args = argv;
+	gint argc = 2;
+	gboolean result;
+
+	context = g_option_context_new(NULL);
+	g_option_context_set_help_enabled(context, FALSE);
+	g_option_context_add_group(context, spice_get_option_group());
+
+	result = g_option_context_parse(context, &argc, &args, &err);
+	if (!result) {
+		REMMINA_PLUGIN_DEBUG("spice-gtk rejects %s: %s", option, err->message);
+		g_error_free(err);
+	}
+	g_option_context_free(context);
+
+	return result;
+}
+#  endif
+#endif
+
+static gchar *remmina_plugin_spice_caps_cache_filename(void)
+{
+	return g_build_path("/", g_get_user_cache_dir(), "remmina", "spice_caps", NULL);
+}
+
+/* Reads the capabilities recorded for the given spice-gtk version */
+static gboolean remmina_plugin_spice_caps_load(const gchar *version)
+{
+	TRACE_CALL(__func__);
+
+	GKeyFile *kf = g_key_file_new();
+	gchar *filename = remmina_plugin_spice_caps_cache_filename();
+	gchar *cached_version = NULL;
+	gboolean loaded = FALSE;
+
+	if (g_key_file_load_from_file(kf, filename, G_KEY_FILE_NONE, NULL)) {
+		cached_version = g_key_file_get_string(kf, SPICE_CAPS_CACHE_GROUP, "version", NULL);
+		if (g_strcmp0(cached_version, version) == 0) {
+			spice_caps.lz4 = g_key_file_get_boolean(kf, SPICE_CAPS_CACHE_GROUP, "lz4", NULL);
+			spice_caps.gl_scanout = g_key_file_get_boolean(kf, SPICE_CAPS_CACHE_GROUP, "gl-scanout", NULL);
+			loaded = TRUE;
+		}
+	}
+
+	g_free(cached_version);
+	g_free(filename);
+	g_key_file_free(kf);
+	return loaded;
+}
+
+static void remmina_plugin_spice_caps_save(const gchar *version)
+{
+	TRACE_CALL(__func__);
+
+	GKeyFile *kf = g_key_file_new();
+	gchar *dir, *filename;
+	GError *err = NULL;
+
+	g_key_file_set_string(kf, SPICE_CAPS_CACHE_GROUP, "version", version);
+	g_key_file_set_boolean(kf, SPICE_CAPS_CACHE_GROUP, "lz4", spice_caps.lz4);
+	g_key_file_set_boolean(kf, SPICE_CAPS_CACHE_GROUP, "gl-scanout", spice_caps.gl_scanout);
+
+	dir = g_build_path("/", g_get_user_cache_dir(), "remmina", NULL);
+	g_mkdir_with_parents(dir, 0750);
+	filename = remmina_plugin_spice_caps_cache_filename();
+
+	if (!g_key_file_save_to_file(kf, filename, &err)) {
+		REMMINA_PLUGIN_WARNING("Could not save spice-gtk capabilities '%s': %s",
+			filename, err->message);
+		g_error_free(err);
+	}
+
+	g_free(filename);
+	g_free(dir);
+	g_key_file_free(kf);
+}
+
+const RemminaPluginSpiceCaps *remmina_plugin_spice_caps_get(void)
+{
+	TRACE_CALL(__func__);
+
+	if (g_once_init_enter(&spice_caps_probed)) {
+		const gchar *version = spice_util_get_version_string();
+
+		if (!remmina_plugin_spice_caps_load(version)) {
+#ifdef SPICE_GTK_CHECK_VERSION
+#  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
+			spice_caps.lz4 = remmina_plugin_spice_caps_accepts_option("--spice-preferred-compression=lz4");
+			spice_caps.gl_scanout = remmina_plugin_spice_caps_accepts_option("--spice-gl-scanout");
+#  endif
+#endif
+			remmina_plugin_spice_caps_save(version);
+		}
+		REMMINA_PLUGIN_DEBUG("spice-gtk %s: lz4 %s, GL scanout %s", version,
+			spice_caps.lz4 ? "yes" : "no",
+			spice_caps.gl_scanout ? "yes" : "no");
+		g_once_init_leave(&spice_caps_probed, 1);
+	}
+
+	return &spice_caps;
+}
+
+static void remmina_plugin_spice_caps_append(GString *str, const gchar *label, guint mask, const gchar **names, guint n_names)
+{
+	guint i;
+	gboolean first = TRUE;
+
+	g_string_append_printf(str, "%s: ", label);
+	for (i = 1; i < n_names; ++i) {
+		if (mask & (1 << i)) {
+			g_string_append_printf(str, "%s%s", first ? "" : ", ", names[i]);
+			first = FALSE;
+		}
+	}
+	if (first)
+		g_string_append(str, "none");
+}
+
+/* Human readable summary of what was negotiated with the server, or NULL
+ * when the display channel is not open yet. */
+static gchar *remmina_plugin_spice_caps_describe(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+
+	RemminaPluginSpiceData *gpdata = GET_PLUGIN_DATA(gp);
+	GString *str;
+
+	if (!gpdata || !gpdata->caps_negotiated)
+		return NULL;
+
+	str = g_string_new(NULL);
+	remmina_plugin_spice_caps_append(str, "video codecs", gpdata->video_codecs,
+		video_codec_names, G_N_ELEMENTS(video_codec_names));
+	g_string_append(str, "; ");
+	remmina_plugin_spice_caps_append(str, "image compressions", gpdata->image_compressions,
+		image_compression_names, G_N_ELEMENTS(image_compression_names));
+	g_string_append_printf(str, "; GL scanout: %s", gpdata->gl_scanout ? "yes" : "no");
+
+	return g_string_free(str, FALSE);
+}
+
+/* The server announces its display capabilities while the channel is being
+ * opened; intersect them with ours once that is done. spice-gtk does not tell
+ * which video codecs its GStreamer decoder handles, so the codecs recorded are
+ * the ones the server offers among those this spice-gtk knows. */
+static void remmina_plugin_spice_caps_negotiate(SpiceChannel *channel, RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+
+	RemminaPluginSpiceData *gpdata = GET_PLUGIN_DATA(gp);
+	RemminaFile *remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+	const RemminaPluginSpiceCaps *caps = remmina_plugin_spice_caps_get();
+	gchar *description;
+	gint preferred;
+	guint i;
+
+	gpdata->video_codecs = 0;
+	gpdata->image_compressions = 0;
+
+#ifdef SPICE_GTK_CHECK_VERSION
+#  if SPICE_GTK_CHECK_VERSION(0, 34, 0)
+	static const struct {
+		SpiceVideoCodecType	type;
+		guint			cap;
+	} codec_caps[] = {
+		{ SPICE_VIDEO_CODEC_TYPE_MJPEG, SPICE_DISPLAY_CAP_CODEC_MJPEG },
+		{ SPICE_VIDEO_CODEC_TYPE_VP8,	SPICE_DISPLAY_CAP_CODEC_VP8   },
+		{ SPICE_VIDEO_CODEC_TYPE_H264,	SPICE_DISPLAY_CAP_CODEC_H264  },
+#    if SPICE_GTK_CHECK_VERSION(0, 35, 0)
+		{ SPICE_VIDEO_CODEC_TYPE_VP9,	SPICE_DISPLAY_CAP_CODEC_VP9   },
+		{ SPICE_VIDEO_CODEC_TYPE_H265,	SPICE_DISPLAY_CAP_CODEC_H265  },
+#    endif
+	};
+
+	for (i = 0; i < G_N_ELEMENTS(codec_caps); ++i) {
+		if (spice_channel_test_capability(channel, codec_caps[i].cap))
+			gpdata->video_codecs |= 1 << codec_caps[i].type;
+	}
+#  endif
+#endif
+
+	/* Every server decodes the historical algorithms, LZ4 needs both ends */
+	for (i = 1; i < G_N_ELEMENTS(image_compression_names) - 1; ++i)
+		gpdata->image_compressions |= 1 << i;
+#ifdef SPICE_GTK_CHECK_VERSION
+#  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
+	if (caps->lz4 && spice_channel_test_capability(channel, SPICE_DISPLAY_CAP_LZ4_COMPRESSION))
+		gpdata->image_compressions |= 1 << SPICE_IMAGE_COMPRESSION_LZ4;
+
+	gpdata->gl_scanout = caps->gl_scanout &&
+			     spice_channel_test_capability(channel, SPICE_DISPLAY_CAP_GL_SCANOUT);
+#  endif
+#endif
+	gpdata->caps_negotiated = TRUE;
+
+	description = remmina_plugin_spice_caps_describe(gp);
+	REMMINA_PLUGIN_DEBUG("Negotiated %s", description);
+	g_free(description);
+
+	preferred = remmina_plugin_service->file_get_int(remminafile, "videocodec", 0);
+	if (preferred > 0 && preferred < (gint)G_N_ELEMENTS(video_codec_names) &&
+	    !(gpdata->video_codecs & (1 << preferred)))
+		REMMINA_PLUGIN_INFO("The SPICE server does not offer the preferred video codec %s",
+			video_codec_names[preferred]);
+
+	preferred = remmina_plugin_service->file_get_int(remminafile, "imagecompression", 0);
+	if (preferred > 0 && preferred < (gint)G_N_ELEMENTS(image_compression_names) &&
+	    !(gpdata->image_compressions & (1 << preferred)))
+		REMMINA_PLUGIN_INFO("The SPICE server does not offer the preferred image compression %s",
+			image_compression_names[preferred]);
+#ifdef SPICE_GTK_CHECK_VERSION
+#  if SPICE_GTK_CHECK_VERSION(0, 31, 0)
+	else if (preferred > 0 && !spice_channel_test_capability(channel, SPICE_DISPLAY_CAP_PREF_COMPRESSION))
+		REMMINA_PLUGIN_INFO("The SPICE server ignores the preferred image compression");
+#  endif
+#endif
+}
+
+void remmina_plugin_spice_caps_display_channel_event_cb(SpiceChannel *channel, SpiceChannelEvent event, RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+
+	if (event == SPICE_CHANNEL_OPENED)
+		remmina_plugin_spice_caps_negotiate(channel, gp);
+}
@@ -69,6 +69,9 @@ typedef struct _RemminaPluginWWWData {
 	gchar *				url;
 	gboolean			authenticated;
 	gboolean			formauthenticated;
+
+	gboolean			snapshot_pending;
+	gboolean			snapshot_again;
 } RemminaPluginWWWData;
 
 RemminaPluginService *remmina_plugin_service = NULL;
@@ -758,11 +761,30 @@ static gboolean remmina_plugin_www_open_connection(RemminaProtocolWidget *gp)
 
 	RemminaPluginWWWData *gpdata;
 	RemminaFile *remminafile;
+	gint socks_port;
 
 	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
 
 	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
 
+	/* With an SSH tunnel, browse through the SOCKS proxy it serves */
+	if (!remmina_plugin_service->protocol_widget_start_dynamic_tunnel(gp, &socks_port))
+		return FALSE;
+	if (socks_port > 0) {
+		gchar *proxyurl = g_strdup_printf("socks5://127.0.0.1:%d", socks_port);
+		WebKitNetworkProxySettings *proxy_settings = webkit_network_proxy_settings_new(proxyurl, NULL);
+		REMMINA_PLUGIN_DEBUG("Using the SSH tunnel as proxy: %s", proxyurl);
+#if WEBKIT_CHECK_VERSION(2, 32, 0)
+		webkit_website_data_manager_set_network_proxy_settings(
+			gpdata->data_mgr, WEBKIT_NETWORK_PROXY_MODE_CUSTOM, proxy_settings);
+#else
+		webkit_web_context_set_network_proxy_settings(
+			gpdata->context, WEBKIT_NETWORK_PROXY_MODE_CUSTOM, proxy_settings);
+#endif
+		webkit_network_proxy_settings_free(proxy_settings);
+		g_free(proxyurl);
+	}
+
 	gpdata->box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 	gtk_container_add(GTK_CONTAINER(gp), gpdata->box);
 
@@ -803,76 +825,222 @@ static gboolean remmina_plugin_www_open_connection(RemminaProtocolWidget *gp)
 	return TRUE;
 }
 
-static void remmina_plugin_www_save_snapshot(GObject *object, GAsyncResult *result, RemminaProtocolWidget *gp)
+/* A full page snapshot being saved. Encoding long pages takes a while, so
+ * it is done on a worker thread with the format and level of remmina.pref */
+typedef struct _RemminaPluginWWWSnapshot {
+	RemminaProtocolWidget * gp;
+	cairo_surface_t *	surface;
+	gchar *			filename;
+	gchar *			format;
+	gint			level;
+} RemminaPluginWWWSnapshot;
+
+static void remmina_plugin_www_take_snapshot(RemminaProtocolWidget *gp);
+
+static void remmina_plugin_www_snapshot_free(RemminaPluginWWWSnapshot *snapshot)
 {
 	TRACE_CALL(__func__);
+	if (snapshot->surface)
+		cairo_surface_destroy(snapshot->surface);
+	g_free(snapshot->filename);
+	g_free(snapshot->format);
+	g_free(snapshot);
+}
 
-	WebKitWebView *webview = WEBKIT_WEB_VIEW(object);
+static gint remmina_plugin_www_pref_get_int(const gchar *key, gint def, gint min, gint max)
+{
+	TRACE_CALL(__func__);
+	gchar *value;
+	gint ret = def;
+
+	value = remmina_plugin_service->pref_get_value(key);
+	if (value && value[0] != '\0')
+		ret = CLAMP(atoi(value), min, max);
+	g_free(value);
+	return ret;
+}
 
+static gchar *remmina_plugin_www_snapshot_filename(RemminaProtocolWidget *gp, const gchar *extension)
+{
+	TRACE_CALL(__func__);
 	RemminaFile *remminafile;
-
-	GError *err = NULL;
-	cairo_surface_t *surface;
-	int width;
-	int height;
-	GdkPixbuf *screenshot;
-	GString *pngstr;
-	gchar *pngname;
-	GDateTime *date = g_date_time_new_now_utc();
+	GDateTime *date;
+	GString *str;
+	gchar *path, *name, *value;
 
 	remminafile = remmina_plugin_service->protocol_plugin_get_file(gp);
+	path = remmina_plugin_service->pref_get_value("screenshot_path");
+	if (!path || path[0] == '\0') {
+		g_free(path);
+		path = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES) ? : g_get_home_dir());
+	}
+	name = remmina_plugin_service->pref_get_value("screenshot_name");
+	if (!name || name[0] == '\0') {
+		g_free(name);
+		name = g_strdup("remmina_%p_%h_%Y%m%d-%H%M%S");
+	}
 
-	surface = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(webview), result, &err);
-	if (err)
-		REMMINA_PLUGIN_DEBUG("An error happened generating the snapshot: %s\n", err->message);
-	width = cairo_image_surface_get_width(surface);
-	height = cairo_image_surface_get_height(surface);
-
-	screenshot = gdk_pixbuf_get_from_surface(surface, 0, 0, width, height);
-	if (screenshot == NULL)
-		REMMINA_PLUGIN_DEBUG("WWW: gdk_pixbuf_get_from_surface failed");
-
-	pngstr = g_string_new(g_strdup_printf("%s/%s.png",
-					      remmina_plugin_service->pref_get_value("screenshot_path"),
-					      remmina_plugin_service->pref_get_value("screenshot_name")));
-	www_utils_string_replace_all(pngstr, "%p",
-				     remmina_plugin_service->file_get_string(remminafile, "name"));
-	www_utils_string_replace_all(pngstr, "%h", "URL");
-	www_utils_string_replace_all(pngstr, "%Y",
-				     g_strdup_printf("%d", g_date_time_get_year(date)));
-	www_utils_string_replace_all(pngstr, "%m", g_strdup_printf("%d",
-								   g_date_time_get_month(date)));
-	www_utils_string_replace_all(pngstr, "%d",
-				     g_strdup_printf("%d", g_date_time_get_day_of_month(date)));
-	www_utils_string_replace_all(pngstr, "%H",
-				     g_strdup_printf("%d", g_date_time_get_hour(date)));
-	www_utils_string_replace_all(pngstr, "%M",
-				     g_strdup_printf("%d", g_date_time_get_minute(date)));
-	www_utils_string_replace_all(pngstr, "%S",
-				     g_strdup_printf("%f", g_date_time_get_seconds(date)));
+	str = g_string_new(NULL);
+	g_string_printf(str, "%s/%s.%s", path, name, extension);
+	g_free(path);
+	g_free(name);
+
+	date = g_date_time_new_now_utc();
+	www_utils_string_replace_all(str, "%p", remmina_plugin_service->file_get_string(remminafile, "name"));
+	www_utils_string_replace_all(str, "%h", "URL");
+	value = g_strdup_printf("%d", g_date_time_get_year(date));
+	www_utils_string_replace_all(str, "%Y", value);
+	g_free(value);
+	value = g_strdup_printf("%d", g_date_time_get_month(date));
+	www_utils_string_replace_all(str, "%m", value);
+	g_free(value);
+	value = g_strdup_printf("%d", g_date_time_get_day_of_month(date));
+	www_utils_string_replace_all(str, "%d", value);
+	g_free(value);
+	value = g_strdup_printf("%d", g_date_time_get_hour(date));
+	www_utils_string_replace_all(str, "%H", value);
+	g_free(value);
+	value = g_strdup_printf("%d", g_date_time_get_minute(date));
+	www_utils_string_replace_all(str, "%M", value);
+	g_free(value);
+	value = g_strdup_printf("%f", g_date_time_get_seconds(date));
+	www_utils_string_replace_all(str, "%S", value);
+	g_free(value);
 	g_date_time_unref(date);
-	pngname = g_string_free(pngstr, FALSE);
-	REMMINA_PLUGIN_DEBUG("Saving screenshot as %s", pngname);
 
-	cairo_surface_write_to_png(surface, pngname);
-	if (g_file_test(pngname, G_FILE_TEST_EXISTS))
-		www_utils_send_notification("www-plugin-screenshot-is-ready-id", _("Screenshot taken"), pngname);
+	return g_string_free(str, FALSE);
+}
+
+/* Runs on a worker thread: the surface belongs to the snapshot alone */
+static void remmina_plugin_www_snapshot_encode(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWSnapshot *snapshot = (RemminaPluginWWWSnapshot *)task_data;
+	GdkPixbuf *pixbuf;
+	GError *err = NULL;
+	gchar *level;
+	gboolean ret;
+
+	pixbuf = gdk_pixbuf_get_from_surface(snapshot->surface, 0, 0,
+					     cairo_image_surface_get_width(snapshot->surface),
+					     cairo_image_surface_get_height(snapshot->surface));
+	cairo_surface_destroy(snapshot->surface);
+	snapshot->surface = NULL;
+	if (!pixbuf) {
+		g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "gdk_pixbuf_get_from_surface failed");
+		return;
+	}
 
-	cairo_surface_destroy(surface);
+	level = g_strdup_printf("%d", snapshot->level);
+	if (g_strcmp0(snapshot->format, "jpeg") == 0)
+		ret = gdk_pixbuf_save(pixbuf, snapshot->filename, "jpeg", &err, "quality", level, NULL);
+	else
+		ret = gdk_pixbuf_save(pixbuf, snapshot->filename, "png", &err, "compression", level, NULL);
+	g_free(level);
+	g_object_unref(pixbuf);
+
+	if (ret)
+		g_task_return_boolean(task, TRUE);
+	else
+		g_task_return_error(task, err);
 }
-static gboolean remmina_plugin_www_get_snapshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd)
+
+/* Back on the GTK thread. Snapshots requested while this one was being taken
+ * are coalesced into a single new one */
+static void remmina_plugin_www_snapshot_done(RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
-	RemminaPluginWWWData *gpdata;
+	RemminaPluginWWWData *gpdata = GET_PLUGIN_DATA(gp);
 
-	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
+	if (gpdata) {
+		gpdata->snapshot_pending = FALSE;
+		if (gpdata->snapshot_again && !remmina_plugin_service->protocol_plugin_is_closed(gp)) {
+			gpdata->snapshot_again = FALSE;
+			remmina_plugin_www_take_snapshot(gp);
+		}
+	}
+	g_object_unref(gp);
+}
 
+static void remmina_plugin_www_snapshot_saved(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWSnapshot *snapshot = g_task_get_task_data(G_TASK(res));
+	GError *err = NULL;
+
+	if (g_task_propagate_boolean(G_TASK(res), &err)) {
+		www_utils_send_notification("www-plugin-screenshot-is-ready-id", _("Screenshot taken"), snapshot->filename);
+	} else {
+		REMMINA_PLUGIN_DEBUG("Unable to save the screenshot to %s: %s", snapshot->filename, err->message);
+		g_error_free(err);
+	}
+	remmina_plugin_www_snapshot_done(snapshot->gp);
+}
+
+static void remmina_plugin_www_save_snapshot(GObject *object, GAsyncResult *result, RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWSnapshot *snapshot;
+	cairo_surface_t *surface;
+	GError *err = NULL;
+	gchar *format;
+	GTask *task;
+
+	surface = webkit_web_view_get_snapshot_finish(WEBKIT_WEB_VIEW(object), result, &err);
+	if (err) {
+		REMMINA_PLUGIN_DEBUG("An error happened generating the snapshot: %s\n", err->message);
+		g_error_free(err);
+		remmina_plugin_www_snapshot_done(gp);
+		return;
+	}
+
+	snapshot = g_new0(RemminaPluginWWWSnapshot, 1);
+	snapshot->gp = gp;
+	snapshot->surface = surface;
+	format = remmina_plugin_service->pref_get_value("screenshot_format");
+	if (g_strcmp0(format, "jpeg") == 0) {
+		snapshot->format = g_strdup("jpeg");
+		snapshot->level = remmina_plugin_www_pref_get_int("screenshot_jpeg_quality", 90, 0, 100);
+		snapshot->filename = remmina_plugin_www_snapshot_filename(gp, "jpg");
+	} else {
+		snapshot->format = g_strdup("png");
+		snapshot->level = remmina_plugin_www_pref_get_int("screenshot_png_compression", 6, 0, 9);
+		snapshot->filename = remmina_plugin_www_snapshot_filename(gp, "png");
+	}
+	g_free(format);
+	REMMINA_PLUGIN_DEBUG("Saving screenshot as %s", snapshot->filename);
+
+	task = g_task_new(NULL, NULL, remmina_plugin_www_snapshot_saved, NULL);
+	g_task_set_task_data(task, snapshot, (GDestroyNotify)remmina_plugin_www_snapshot_free);
+	g_task_run_in_thread(task, remmina_plugin_www_snapshot_encode);
+	g_object_unref(task);
+}
+
+static void remmina_plugin_www_take_snapshot(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWData *gpdata = GET_PLUGIN_DATA(gp);
+
+	gpdata->snapshot_pending = TRUE;
 	webkit_web_view_get_snapshot(gpdata->webview,
 				     WEBKIT_SNAPSHOT_REGION_FULL_DOCUMENT,
 				     WEBKIT_SNAPSHOT_OPTIONS_NONE,
 				     NULL,
 				     (GAsyncReadyCallback)remmina_plugin_www_save_snapshot,
-				     gp);
+				     g_object_ref(gp));
+}
+
+static gboolean remmina_plugin_www_get_snapshot(RemminaProtocolWidget *gp, RemminaPluginScreenshotData *rpsd)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginWWWData *gpdata;
+
+	gpdata = (RemminaPluginWWWData *)g_object_get_data(G_OBJECT(gp), "plugin-data");
+
+	if (gpdata->snapshot_pending)
+		gpdata->snapshot_again = TRUE;
+	else
+		remmina_plugin_www_take_snapshot(gp);
 	return FALSE;
 }
 
@@ -950,7 +1118,7 @@ static RemminaProtocolPlugin remmina_plugin =
 	NULL,                                   // Icon for SSH connection
 	remmina_plugin_www_basic_settings,      // Array for basic settings
 	remmina_plugin_www_advanced_settings,   // Array for advanced settings
-	REMMINA_PROTOCOL_SSH_SETTING_NONE,      // SSH settings type
+	REMMINA_PROTOCOL_SSH_SETTING_TUNNEL,    // SSH settings type
 	remmina_www_features,                   // Array for available features
 	remmina_plugin_www_init,                // Plugin initialization
 	remmina_plugin_www_open_connection,     // Plugin open connection
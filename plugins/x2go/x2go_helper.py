@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+#     Project: Remmina Plugin X2Go
+# Description: Long-lived python-x2go helper used by the X2Go plugin to list
+#              and terminate sessions without starting pyhoca-cli each time.
+#   Copyright: 2016-2023 Antenore Gatta, Giovanni Panozzo
+#     License: GPL-2+
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Protocol: one JSON object per line on stdin (requests) and stdout (replies).
+#
+#   startup:  {"id": 0, "ready": true}  or  {"id": 0, "error": "..."}
+#   request:  {"id": N, "op": "list" | "terminate", "server": "...",
+#              "username": "...", "password": "...", "ssh_privkey": "...",
+#              "ssh_passphrase": "...", "session": "..."}
+#   replies:  {"id": N, "session": {...}}   zero or more, "list" only
+#             {"id": N, "done": true}       or  {"id": N, "error": "..."}
+#
+# Requests are served concurrently. Authenticated connections are kept per
+# server, user and key, so further requests to the same server skip the
+# SSH handshake and authentication.
+
+import json
+import sys
+
+try:
+    import gevent
+    import gevent.lock
+    from gevent.fileobject import FileObject
+    import x2go
+except ImportError as e:
+    sys.stdout.write(json.dumps({"id": 0, "error": "python-x2go is not available: %s" % e}) + "\n")
+    sys.stdout.flush()
+    sys.exit(1)
+
+SESSION_ATTRIBUTES = {
+    "name": "name",
+    "cookie": "cookie",
+    "agent_pid": "agent_pid",
+    "display": "display",
+    "status": "status",
+    "graphic_port": "graphics_port",
+    "snd_port": "snd_port",
+    "sshfs_port": "sshfs_port",
+    "username": "username",
+    "hostname": "hostname",
+    "create_date": "date_created",
+    "suspended_since": "date_suspended",
+}
+
+write_lock = gevent.lock.Semaphore()
+connect_locks = {}
+connections = {}
+client = None
+
+
+def reply(message):
+    with write_lock:
+        sys.stdout.write(json.dumps(message) + "\n")
+        sys.stdout.flush()
+
+
+def connection(request):
+    key = (request["server"], request.get("username") or "", request.get("ssh_privkey") or "")
+    lock = connect_locks.setdefault(key, gevent.lock.Semaphore())
+
+    with lock:
+        session_uuid = connections.get(key)
+        if session_uuid is not None:
+            try:
+                if client.session_ok(session_uuid):
+                    return session_uuid
+            except Exception:
+                pass
+            del connections[key]
+            try:
+                client.unregister_session(session_uuid)
+            except Exception:
+                pass
+
+        session_uuid = client.register_session(
+            request["server"],
+            username=request.get("username") or None,
+            key_filename=request.get("ssh_privkey") or None,
+            profile_name="Remmina-X2Go-Helper",
+        )
+        password = request.get("password") or None
+        client.connect_session(
+            session_uuid,
+            username=request.get("username") or None,
+            password=password,
+            passphrase=request.get("ssh_passphrase") or None,
+            force_password_auth=password is not None,
+        )
+        connections[key] = session_uuid
+        return session_uuid
+
+
+def serve(request):
+    request_id = request.get("id")
+    try:
+        session_uuid = connection(request)
+        op = request.get("op")
+
+        if op == "list":
+            sessions = client.list_sessions(session_uuid, refresh_cache=True) or {}
+            for info in sessions.values():
+                session = {}
+                for member, attribute in SESSION_ATTRIBUTES.items():
+                    value = getattr(info, attribute, None)
+                    if value is not None and value != "":
+                        session[member] = str(value)
+                reply({"id": request_id, "session": session})
+        elif op == "terminate":
+            if not client.terminate_session(session_uuid, session_name=request["session"]):
+                raise RuntimeError("the server refused to terminate session '%s'" % request["session"])
+        else:
+            raise ValueError("unknown operation '%s'" % op)
+
+        reply({"id": request_id, "done": True})
+    except Exception as e:
+        reply({"id": request_id, "error": str(e) or e.__class__.__name__})
+
+
+def main():
+    global client
+
+    try:
+        client = x2go.X2GoClient(start_xserver=False, start_pulseaudio=False,
+                                 use_cache=False, loglevel=x2go.log.loglevel_ERROR)
+    except Exception as e:
+        reply({"id": 0, "error": "could not initialise python-x2go: %s" % e})
+        return 1
+
+    reply({"id": 0, "ready": True})
+
+    stdin = FileObject(sys.stdin.buffer, "rb")
+    for line in stdin:
+        try:
+            request = json.loads(line)
+        except ValueError:
+            continue
+        if isinstance(request, dict) and "id" in request and "server" in request:
+            gevent.spawn(serve, request)
+
+    # Remmina went away.
+    for session_uuid in list(connections.values()):
+        try:
+            client.disconnect_session(session_uuid)
+        except Exception:
+            pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -59,6 +59,12 @@
 #include <signal.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <json-glib/json-glib.h>
+#include <glib/gstdio.h>
 
 #define FEATURE_AVAILABLE(gpdata, feature) \
 		gpdata->available_features ? (g_list_find_custom( \
@@ -85,13 +91,19 @@
 
 // A session is selected if the returning value is something other than 0.
 #define IS_SESSION_SELECTED(gp) \
-		g_object_get_data(G_OBJECT(gp), "session-selected") ? TRUE : FALSE
+		(g_object_get_data(G_OBJECT(gp), "session-selected") ? TRUE : FALSE)
 
 // We don't use the function as a real pointer but rather as a boolean value.
+// Wakes up the connection thread waiting in rmplugin_x2go_ask_session().
 #define SET_SESSION_SELECTED(gp, is_session_selected) \
-		g_object_set_data_full(G_OBJECT(gp), "session-selected", \
-				       is_session_selected, \
-				       NULL)
+		G_STMT_START { \
+			g_mutex_lock(&remmina_x2go_session_selected_mutex); \
+			g_object_set_data_full(G_OBJECT(gp), "session-selected", \
+					       is_session_selected, \
+					       NULL); \
+			g_cond_broadcast(&remmina_x2go_session_selected_cond); \
+			g_mutex_unlock(&remmina_x2go_session_selected_mutex); \
+		} G_STMT_END
 // -------------------
 
 #define REMMINA_PLUGIN_INFO(fmt, ...) \
@@ -146,8 +158,14 @@ typedef struct _RemminaPluginX2GoData {
 	int (*orig_handler)(Display *, XErrorEvent *);
 
 	GPid pidx2go;
+	/* Written to by the child watch when pyhoca-cli exits, so that the
+	 * connection thread stops waiting for the agent window at once. */
+	gint exit_pipe[2];
 
 	gboolean disconnected;
+	/* Set by rmplugin_x2go_cleanup() under remmina_x2go_session_selected_mutex,
+	 * so that the connection thread stops waiting for a session to be chosen. */
+	gboolean cancelled;
 
 	GList* available_features;
 } RemminaPluginX2GoData;
@@ -164,6 +182,10 @@ typedef struct _X2GoCustomUserData {
 	gpointer opt2;
 } X2GoCustomUserData;
 
+/* Protects "session-selected" and is signalled by SET_SESSION_SELECTED(). */
+static GMutex remmina_x2go_session_selected_mutex;
+static GCond remmina_x2go_session_selected_cond;
+
 /**
  * @brief Used for the session chooser dialog (GtkListStore)
  *	  See the example at: https://docs.gtk.org/gtk3/class.ListStore.html
@@ -1076,6 +1098,440 @@ static gboolean rmplugin_x2go_verify_connection_data(struct _ConnectionData *con
 	return FALSE;
 }
 
+/*
+ * Persistent X2Go helper
+ *
+ * pyhoca-cli starts a new interpreter, SSH connection and authentication
+ * for every --list-sessions or --terminate. remmina-x2go-helper is started
+ * once per process instead and keeps authenticated connections per server.
+ * It speaks one JSON object per line over stdin and stdout, see
+ * x2go_helper.py. Requests are sent from the connection and terminate
+ * threads. A reader thread streams the replies back to whoever waits for them.
+ * If the helper can't be started (e.g. python-x2go is missing), callers
+ * fall back to spawning pyhoca-cli.
+ */
+#define X2GO_HELPER_PATH REMMINA_RUNTIME_DATADIR "/remmina/x2go/remmina-x2go-helper"
+// Startup only. Requests wait as long as the server needs to authenticate.
+#define X2GO_HELPER_STARTUP_TIMEOUT (15 * G_TIME_SPAN_SECOND)
+
+typedef void (*RemminaX2GoHelperSessionFunc)(gchar **session, gpointer user_data);
+
+typedef struct _RemminaX2GoHelperRequest {
+	gint64 id;
+	gboolean done;
+	gchar *error;
+	RemminaX2GoHelperSessionFunc session_func;
+	gpointer user_data;
+} RemminaX2GoHelperRequest;
+
+static struct {
+	GMutex mutex;
+	GCond cond;
+	GPid pid;
+	gint stdin_fd;
+	gboolean ready;
+	// Could not be started once, don't try again.
+	gboolean broken;
+	gint64 next_id;
+	// gint64 id -> RemminaX2GoHelperRequest*
+	GHashTable *requests;
+} x2go_helper;
+
+static const struct {
+	const gchar *member;
+	guint property;
+} x2go_helper_session_members[] = {
+	{ "name",		SESSION_SESSION_ID	},
+	{ "cookie",		SESSION_COOKIE		},
+	{ "agent_pid",		SESSION_AGENT_PID	},
+	{ "display",		SESSION_DISPLAY		},
+	{ "status",		SESSION_STATUS		},
+	{ "graphic_port",	SESSION_GRAPHIC_PORT	},
+	{ "snd_port",		SESSION_SND_PORT	},
+	{ "sshfs_port",		SESSION_SSHFS_PORT	},
+	{ "username",		SESSION_USERNAME	},
+	{ "hostname",		SESSION_HOSTNAME	},
+	{ "create_date",	SESSION_CREATE_DATE	},
+	{ "suspended_since",	SESSION_SUSPENDED_SINCE	},
+};
+
+/**
+ * @brief Converts a "session" reply of the helper into the same string array
+ *	  rmplugin_x2go_parse_pyhoca_sessions() builds from pyhoca-cli's output.
+ */
+static gchar **rmplugin_x2go_helper_session_from_json(JsonObject *object)
+{
+	gchar **session = g_new0(gchar*, SESSION_NUM_PROPERTIES + 1);
+
+	for (guint i = 0; i < G_N_ELEMENTS(x2go_helper_session_members); i++) {
+		const gchar *value;
+		guint property = x2go_helper_session_members[i].property;
+
+		if (!json_object_has_member(object, x2go_helper_session_members[i].member))
+			continue;
+		value = json_object_get_string_member(object, x2go_helper_session_members[i].member);
+		if (!value)
+			continue;
+
+		if (property == SESSION_STATUS) {
+			if (g_strcmp0(value, "S") == 0) {
+				// TRANSLATORS: Please stick to X2GoClient's translation.
+				value = _("Suspended");
+			} else if (g_strcmp0(value, "R") == 0) {
+				// TRANSLATORS: Please stick to X2GoClient's translation.
+				value = _("Running");
+			} else if (g_strcmp0(value, "T") == 0) {
+				// TRANSLATORS: Please stick to X2GoClient's translation.
+				value = _("Terminated");
+			}
+		}
+		session[property] = g_strdup(value);
+	}
+
+	return session;
+}
+
+static void rmplugin_x2go_helper_fail_requests(gpointer key, gpointer value, gpointer user_data)
+{
+	RemminaX2GoHelperRequest *request = (RemminaX2GoHelperRequest*) value;
+
+	request->error = g_strdup(_("The X2Go helper process exited unexpectedly."));
+	request->done = TRUE;
+}
+
+static gpointer rmplugin_x2go_helper_reader(gpointer data)
+{
+	FILE *out = (FILE*) data;
+	JsonParser *parser = json_parser_new();
+	gchar *line = NULL;
+	size_t len = 0;
+
+	while (getline(&line, &len, out) > 0) {
+		JsonNode *root;
+		JsonObject *object;
+		RemminaX2GoHelperRequest *request;
+		gint64 id;
+
+		if (!json_parser_load_from_data(parser, line, -1, NULL))
+			continue;
+		root = json_parser_get_root(parser);
+		if (!root || !JSON_NODE_HOLDS_OBJECT(root))
+			continue;
+		object = json_node_get_object(root);
+		if (!json_object_has_member(object, "id"))
+			continue;
+		id = json_object_get_int_member(object, "id");
+
+		g_mutex_lock(&x2go_helper.mutex);
+
+		if (id == 0) {
+			if (json_object_has_member(object, "ready")) {
+				x2go_helper.ready = TRUE;
+			} else {
+				REMMINA_PLUGIN_WARNING("X2Go helper could not start: %s",
+						       json_object_has_member(object, "error") ?
+						       json_object_get_string_member(object, "error") : "?");
+				x2go_helper.broken = TRUE;
+			}
+			g_cond_broadcast(&x2go_helper.cond);
+			g_mutex_unlock(&x2go_helper.mutex);
+			continue;
+		}
+
+		request = g_hash_table_lookup(x2go_helper.requests, &id);
+		if (request) {
+			if (json_object_has_member(object, "session")) {
+				// Called with the lock held, so an abandoned request is never used.
+				JsonObject *session = json_object_get_object_member(object, "session");
+				if (session && request->session_func)
+					request->session_func(rmplugin_x2go_helper_session_from_json(session),
+							      request->user_data);
+			} else {
+				if (json_object_has_member(object, "error"))
+					request->error = g_strdup(json_object_get_string_member(object, "error"));
+				request->done = TRUE;
+				g_hash_table_remove(x2go_helper.requests, &id);
+				g_cond_broadcast(&x2go_helper.cond);
+			}
+		}
+
+		g_mutex_unlock(&x2go_helper.mutex);
+	}
+
+	REMMINA_PLUGIN_DEBUG("X2Go helper closed its output, it will be restarted on demand.");
+
+	g_mutex_lock(&x2go_helper.mutex);
+	g_hash_table_foreach(x2go_helper.requests, rmplugin_x2go_helper_fail_requests, NULL);
+	g_hash_table_remove_all(x2go_helper.requests);
+	close(x2go_helper.stdin_fd);
+	x2go_helper.stdin_fd = -1;
+	kill(x2go_helper.pid, SIGTERM);
+	waitpid(x2go_helper.pid, NULL, 0);
+	g_spawn_close_pid(x2go_helper.pid);
+	x2go_helper.pid = 0;
+	x2go_helper.ready = FALSE;
+	g_cond_broadcast(&x2go_helper.cond);
+	g_mutex_unlock(&x2go_helper.mutex);
+
+	free(line);
+	fclose(out);
+	g_object_unref(parser);
+	return NULL;
+}
+
+/**
+ * @brief Starts the helper if needed and waits until it is ready.
+ *	  Must be called with x2go_helper.mutex held.
+ * @returns FALSE if the helper is not usable, callers then use pyhoca-cli.
+ */
+static gboolean rmplugin_x2go_helper_start_locked()
+{
+	gchar *argv[] = { X2GO_HELPER_PATH, NULL };
+	GError *error = NULL;
+	gint stdout_fd;
+	gint64 end_time;
+	FILE *out;
+
+	if (x2go_helper.broken)
+		return FALSE;
+
+	if (!x2go_helper.pid) {
+		if (!g_file_test(X2GO_HELPER_PATH, G_FILE_TEST_IS_EXECUTABLE)) {
+			REMMINA_PLUGIN_DEBUG("X2Go helper '%s' is not installed.", X2GO_HELPER_PATH);
+			x2go_helper.broken = TRUE;
+			return FALSE;
+		}
+
+		if (!g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+					      NULL, NULL, &x2go_helper.pid,
+					      &x2go_helper.stdin_fd, &stdout_fd, NULL, &error)) {
+			REMMINA_PLUGIN_WARNING("Could not start the X2Go helper: %s", error->message);
+			g_error_free(error);
+			x2go_helper.broken = TRUE;
+			return FALSE;
+		}
+
+		if (!x2go_helper.requests)
+			x2go_helper.requests = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+		out = fdopen(stdout_fd, "r");
+		g_thread_unref(g_thread_new("x2go-helper-reader",
+					    rmplugin_x2go_helper_reader, out));
+		REMMINA_PLUGIN_DEBUG("Started X2Go helper with PID %d.", x2go_helper.pid);
+	}
+
+	end_time = g_get_monotonic_time() + X2GO_HELPER_STARTUP_TIMEOUT;
+	while (x2go_helper.pid && !x2go_helper.ready && !x2go_helper.broken) {
+		if (!g_cond_wait_until(&x2go_helper.cond, &x2go_helper.mutex, end_time)) {
+			REMMINA_PLUGIN_WARNING("%s", "X2Go helper did not start in time.");
+			x2go_helper.broken = TRUE;
+			kill(x2go_helper.pid, SIGTERM);
+		}
+	}
+
+	return x2go_helper.ready && !x2go_helper.broken;
+}
+
+/**
+ * @brief Writes @line to the helper without risking a SIGPIPE if it just died.
+ *	  Must be called with x2go_helper.mutex held.
+ */
+static gboolean rmplugin_x2go_helper_write_locked(const gchar *line)
+{
+	sigset_t pipe_set, old_set;
+	gsize len = strlen(line), written = 0;
+	gboolean ret = TRUE;
+
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+	while (written < len) {
+		ssize_t n = write(x2go_helper.stdin_fd, line + written, len - written);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EPIPE) {
+				struct timespec zero = { 0, 0 };
+				sigtimedwait(&pipe_set, NULL, &zero);
+			}
+			ret = FALSE;
+			break;
+		}
+		written += n;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+	return ret;
+}
+
+/**
+ * @returns the newline terminated JSON line for a request to the helper.
+ */
+static gchar *rmplugin_x2go_helper_build_request(gint64 id, const gchar *op,
+						 struct _ConnectionData *connect_data,
+						 const gchar *session_id)
+{
+	JsonBuilder *builder = json_builder_new();
+	JsonGenerator *generator;
+	JsonNode *root;
+	gchar *json, *line;
+
+	json_builder_begin_object(builder);
+	json_builder_set_member_name(builder, "id");
+	json_builder_add_int_value(builder, id);
+	json_builder_set_member_name(builder, "op");
+	json_builder_add_string_value(builder, op);
+	json_builder_set_member_name(builder, "server");
+	json_builder_add_string_value(builder, connect_data->host);
+	json_builder_set_member_name(builder, "username");
+	json_builder_add_string_value(builder, connect_data->username ?
+				      connect_data->username : g_get_user_name());
+	if (connect_data->password && strlen(connect_data->password) > 0) {
+		json_builder_set_member_name(builder, "password");
+		json_builder_add_string_value(builder, connect_data->password);
+	}
+	if (connect_data->ssh_privatekey && strlen(connect_data->ssh_privatekey) > 0) {
+		json_builder_set_member_name(builder, "ssh_privkey");
+		json_builder_add_string_value(builder, connect_data->ssh_privatekey);
+		if (connect_data->ssh_passphrase && strlen(connect_data->ssh_passphrase) > 0) {
+			json_builder_set_member_name(builder, "ssh_passphrase");
+			json_builder_add_string_value(builder, connect_data->ssh_passphrase);
+		}
+	}
+	if (session_id) {
+		json_builder_set_member_name(builder, "session");
+		json_builder_add_string_value(builder, session_id);
+	}
+	json_builder_end_object(builder);
+
+	root = json_builder_get_root(builder);
+	generator = json_generator_new();
+	json_generator_set_root(generator, root);
+	json = json_generator_to_data(generator, NULL);
+	line = g_strconcat(json, "\n", NULL);
+
+	// Contains the password.
+	memset(json, 0, strlen(json));
+	g_free(json);
+	json_node_free(root);
+	g_object_unref(generator);
+	g_object_unref(builder);
+
+	return line;
+}
+
+static void rmplugin_x2go_helper_abandon(gpointer data)
+{
+	RemminaX2GoHelperRequest *request = (RemminaX2GoHelperRequest*) data;
+
+	g_mutex_lock(&x2go_helper.mutex);
+	if (!request->done)
+		g_hash_table_remove(x2go_helper.requests, &request->id);
+	g_mutex_unlock(&x2go_helper.mutex);
+
+	g_free(request->error);
+	g_free(request);
+}
+
+/**
+ * @brief Sends a request to the helper and waits for it to complete.
+ *	  Meant to be called from a thread other than the main one.
+ *
+ * @param op "list" or "terminate".
+ * @param session_id Session to terminate, NULL for "list".
+ * @param session_func Called for each session as soon as it is received,
+ *		       it takes ownership of the string array.
+ * @returns FALSE with @error set if the request failed.
+ */
+static gboolean rmplugin_x2go_helper_request(const gchar *op,
+					     struct _ConnectionData *connect_data,
+					     const gchar *session_id,
+					     RemminaX2GoHelperSessionFunc session_func,
+					     gpointer user_data,
+					     GError **error)
+{
+	RemminaX2GoHelperRequest *request = g_new0(RemminaX2GoHelperRequest, 1);
+	gchar *line;
+	gboolean sent, ret;
+	int old_type, old_state;
+
+	request->session_func = session_func;
+	request->user_data = user_data;
+
+	// The thread must never be cancelled while holding the mutex, the
+	// cleanup handler takes it again. Cancellation is only enabled around
+	// pthread_testcancel() below.
+	pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, &old_type);
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+	pthread_cleanup_push(rmplugin_x2go_helper_abandon, request);
+
+	g_mutex_lock(&x2go_helper.mutex);
+	request->id = ++x2go_helper.next_id;
+
+	// It may have exited since rmplugin_x2go_helper_available().
+	if (rmplugin_x2go_helper_start_locked()) {
+		line = rmplugin_x2go_helper_build_request(request->id, op, connect_data,
+							  session_id);
+		g_hash_table_insert(x2go_helper.requests, &request->id, request);
+		sent = rmplugin_x2go_helper_write_locked(line);
+		// Contains the password.
+		memset(line, 0, strlen(line));
+		g_free(line);
+		if (!sent)
+			g_hash_table_remove(x2go_helper.requests, &request->id);
+	} else {
+		sent = FALSE;
+	}
+
+	if (!sent) {
+		request->error = g_strdup(_("Could not send the request to the X2Go helper."));
+		request->done = TRUE;
+	}
+
+	while (!request->done) {
+		// Wake up every second to honour pthread_cancel().
+		g_cond_wait_until(&x2go_helper.cond, &x2go_helper.mutex,
+				  g_get_monotonic_time() + G_TIME_SPAN_SECOND);
+		if (!request->done) {
+			g_mutex_unlock(&x2go_helper.mutex);
+			pthread_setcancelstate(old_state, NULL);
+			pthread_testcancel();
+			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+			g_mutex_lock(&x2go_helper.mutex);
+		}
+	}
+	g_mutex_unlock(&x2go_helper.mutex);
+
+	ret = request->error == NULL;
+	if (!ret)
+		g_set_error(error, 1, 1, "%s", request->error);
+
+	pthread_cleanup_pop(1);
+	pthread_setcancelstate(old_state, NULL);
+	pthread_setcanceltype(old_type, NULL);
+
+	return ret;
+}
+
+/**
+ * @returns TRUE if the helper is running or could be started.
+ */
+static gboolean rmplugin_x2go_helper_available()
+{
+	gboolean available;
+	int old_state;
+
+	// Starting the helper reaches cancellation points with the mutex held.
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_state);
+	g_mutex_lock(&x2go_helper.mutex);
+	available = rmplugin_x2go_helper_start_locked();
+	g_mutex_unlock(&x2go_helper.mutex);
+	pthread_setcancelstate(old_state, NULL);
+
+	return available;
+}
+
 /**
  * @brief Terminates a specific X2Go session using pyhoca-cli.
  *
@@ -1139,6 +1595,13 @@ static gboolean rmplugin_x2go_pyhoca_terminate_session(X2GoCustomUserData *custo
 	// error message was handled already.
 	if (!G_VALUE_HOLDS_STRING(&value)) return G_SOURCE_REMOVE;
 	const gchar *session_id = g_value_get_string(&value);
+	GError* error = NULL;
+
+	if (rmplugin_x2go_helper_available()) {
+		rmplugin_x2go_helper_request("terminate", connect_data, session_id,
+					     NULL, NULL, &error);
+		goto terminated;
+	}
 
 	// We will now start pyhoca-cli with only the '--terminate $SESSION_ID' option.
 	// (and of course auth related stuff)
@@ -1213,11 +1676,11 @@ static gboolean rmplugin_x2go_pyhoca_terminate_session(X2GoCustomUserData *custo
 
 	argv[argc++] = NULL;
 
-	GError* error = NULL;
 	gchar** envp = g_get_environ();
 	rmplugin_x2go_spawn_pyhoca_process(argc, argv, &error, envp);
 	g_strfreev(envp);
 
+terminated:
 	if (error) {
 		gchar *err_msg = g_strdup_printf(
 			_("Could not terminate X2Go session '%s':\n%s"),
@@ -1534,6 +1997,12 @@ static gboolean rmplugin_x2go_cleanup(RemminaProtocolWidget *gp)
 
 	if (gpdata->thread) {
 		pthread_cancel(gpdata->thread);
+		// Wake up rmplugin_x2go_ask_session(), it then reaches
+		// pthread_testcancel() without waiting for its timeout.
+		g_mutex_lock(&remmina_x2go_session_selected_mutex);
+		gpdata->cancelled = TRUE;
+		g_cond_broadcast(&remmina_x2go_session_selected_cond);
+		g_mutex_unlock(&remmina_x2go_session_selected_mutex);
 		if (gpdata->thread) pthread_join(gpdata->thread, NULL);
 	}
 
@@ -1547,6 +2016,12 @@ static gboolean rmplugin_x2go_cleanup(RemminaProtocolWidget *gp)
 		gpdata->pidx2go = 0;
 	}
 
+	if (gpdata->exit_pipe[0] >= 0) {
+		close(gpdata->exit_pipe[0]);
+		close(gpdata->exit_pipe[1]);
+		gpdata->exit_pipe[0] = gpdata->exit_pipe[1] = -1;
+	}
+
 	if (gpdata->display) {
 		XSetErrorHandler(gpdata->orig_handler);
 		XCloseDisplay(gpdata->display);
@@ -1577,6 +2052,16 @@ static gboolean rmplugin_x2go_close_connection(RemminaProtocolWidget *gp)
 	return G_SOURCE_CONTINUE;
 }
 
+static gboolean rmplugin_x2go_close_connection_idle(RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+
+	if (GET_PLUGIN_DATA(gp))
+		rmplugin_x2go_close_connection(gp);
+
+	return G_SOURCE_REMOVE;
+}
+
 static void rmplugin_x2go_pyhoca_cli_exited(GPid pid,
 					    gint status,
 					    RemminaProtocolWidget *gp)
@@ -1590,6 +2075,13 @@ static void rmplugin_x2go_pyhoca_cli_exited(GPid pid,
 		return;
 	}
 
+	// Wake up rmplugin_x2go_monitor_create_notify() if it is still waiting.
+	if (gpdata->exit_pipe[1] >= 0) {
+		char c = 0;
+		if (write(gpdata->exit_pipe[1], &c, 1) < 0)
+			REMMINA_PLUGIN_DEBUG("Could not notify the connection thread.");
+	}
+
 	if (gpdata->pidx2go <= 0) {
 		REMMINA_PLUGIN_DEBUG("Doing nothing since pyhoca-cli was expected to stop.");
 		return;
@@ -1628,10 +2120,9 @@ static void rmplugin_x2go_pyhoca_cli_exited(GPid pid,
 
 	IDLE_ADD((GSourceFunc) rmplugin_x2go_open_dialog, custom_data);
 
-	// 1 Second. Give `Dialog` chance to open.
-	usleep(1000 * 1000);
-
-	rmplugin_x2go_close_connection(gp);
+	// Idle sources of the same priority run in order, so the dialog
+	// is shown before the connection goes away.
+	IDLE_ADD((GSourceFunc) rmplugin_x2go_close_connection_idle, gp);
 }
 
 /**
@@ -1949,6 +2440,18 @@ static gchar* rmplugin_x2go_get_pyhoca_sessions(RemminaProtocolWidget* gp, GErro
 	return std_out;
 }
 
+static void rmplugin_x2go_helper_add_session(gchar **session, gpointer user_data)
+{
+	GList **sessions = (GList**) user_data;
+
+	REMMINA_PLUGIN_INFO("%s", g_strdup_printf(
+		_("Found already existing X2Go session with ID: '%s'"),
+		session[SESSION_SESSION_ID])
+	);
+
+	*sessions = g_list_append(*sessions, session);
+}
+
 /**
  * @brief This function is used to parse the output of
  * 	  rmplugin_x2go_get_pyhoca_sessions().
@@ -1972,6 +2475,27 @@ static GList* rmplugin_x2go_parse_pyhoca_sessions(RemminaProtocolWidget* gp,
 
 	gchar *pyhoca_output = NULL;
 
+	if (rmplugin_x2go_verify_connection_data(connect_data) &&
+	    rmplugin_x2go_helper_available()) {
+		GList *sessions = NULL;
+
+		if (!rmplugin_x2go_helper_request("list", connect_data, NULL,
+						  rmplugin_x2go_helper_add_session,
+						  &sessions, error)) {
+			g_list_free_full(sessions, (GDestroyNotify) g_strfreev);
+			return NULL;
+		}
+
+		if (!sessions) {
+			g_set_error(error, 1, 1,
+				"%s", _("Could not find any sessions on remote machine. Creating a new "
+				  "session now.")
+			);
+		}
+
+		return sessions;
+	}
+
 	pyhoca_output = rmplugin_x2go_get_pyhoca_sessions(gp, error, connect_data);
 	if (!pyhoca_output || *error) {
 		// If no error is set but pyhoca_output is NULL
@@ -2203,17 +2727,29 @@ static gchar* rmplugin_x2go_ask_session(RemminaProtocolWidget *gp, GError **erro
 	// should set SET_RESUME_SESSION.
 	IDLE_ADD((GSourceFunc)rmplugin_x2go_open_dialog, custom_data);
 
-	guint counter = 0;
+	RemminaPluginX2GoData *gpdata = GET_PLUGIN_DATA(gp);
+
+	// The thread must never be cancelled while holding the mutex.
+	CANCEL_DEFER
+
+	g_mutex_lock(&remmina_x2go_session_selected_mutex);
 	while (!IS_SESSION_SELECTED(gp)) {
-		// 0.5 Seconds. Give dialog chance to open.
-		usleep(500 * 1000);
+		g_mutex_unlock(&remmina_x2go_session_selected_mutex);
+		REMMINA_PLUGIN_MESSAGE("%s", _("Waiting for user to select a session…"));
+		pthread_testcancel();
+		g_mutex_lock(&remmina_x2go_session_selected_mutex);
 
-		// Every 5 seconds
-		if (counter % 10 == 0 || counter == 0) {
-			REMMINA_PLUGIN_MESSAGE("%s", _("Waiting for user to select a session…"));
-		}
-		counter++;
+		// Wakes up as soon as a session is selected or the connection
+		// is cancelled, otherwise every 5 seconds to print the above.
+		gint64 end_time = g_get_monotonic_time() + 5 * G_TIME_SPAN_SECOND;
+		while (!IS_SESSION_SELECTED(gp) && !gpdata->cancelled &&
+		       g_cond_wait_until(&remmina_x2go_session_selected_cond,
+					 &remmina_x2go_session_selected_mutex,
+					 end_time));
 	}
+	g_mutex_unlock(&remmina_x2go_session_selected_mutex);
+
+	CANCEL_ASYNC
 
 	gchar* chosen_resume_session = GET_RESUME_SESSION(gp);
 
@@ -2540,18 +3076,7 @@ static gboolean rmplugin_x2go_exec_x2go(gchar *host,
 		return FALSE;
 	}
 
-	// Prevent a race condition where pyhoca-cli is not
-	// started yet (pidx2go == 0) but a watcher is added.
-
-	struct timespec ts;
-	// 0.001 seconds.
-	ts.tv_nsec = 1 * 1000 * 1000;
-	ts.tv_sec = 0;
-	while (gpdata->pidx2go == 0) {
-		nanosleep(&ts, NULL);
-		REMMINA_PLUGIN_DEBUG("Waiting for PyHoca-CLI to start…");
-	};
-
+	// g_spawn_async_with_pipes() has set pidx2go by the time it returns.
 	REMMINA_PLUGIN_DEBUG("Watching child 'pyhoca-cli' process now…");
 	g_child_watch_add(gpdata->pidx2go,
 			  (GChildWatchFunc) rmplugin_x2go_pyhoca_cli_exited,
@@ -2589,7 +3114,8 @@ static GList* rmplugin_x2go_old_pyhoca_features()
 }
 
 /**
- *  @returns a GList* which includes all pyhoca-cli command line features we can use.
+ *  @returns a GList* which includes all pyhoca-cli command line features we can use,
+ *           NULL if they could not be queried.
  */
 static GList* rmplugin_x2go_populate_available_features_list()
 {
@@ -2627,7 +3153,7 @@ static GList* rmplugin_x2go_populate_available_features_list()
 			  "indicates it is either too old, or not installed. "
 			  "An old limited set of features will be used for now."));
 
-		return rmplugin_x2go_old_pyhoca_features();
+		return NULL;
 	} else {
 		gchar **features_list = g_strsplit(features_string, "\n", 0);
 
@@ -2635,7 +3161,7 @@ static GList* rmplugin_x2go_populate_available_features_list()
 			gchar *error_msg = _("Could not parse PyHoca-CLI's command-line "
 					     "features. Using a limited feature-set for now.");
 			REMMINA_PLUGIN_WARNING("%s", error_msg);
-			return rmplugin_x2go_old_pyhoca_features();
+			return NULL;
 		}
 
 		REMMINA_PLUGIN_INFO("%s", _("Retrieved the following PyHoca-CLI "
@@ -2654,6 +3180,333 @@ static GList* rmplugin_x2go_populate_available_features_list()
 	}
 }
 
+/*
+ * pyhoca-cli is a Python script: probing its features costs a full
+ * interpreter start-up on every connection. The result only changes
+ * when pyhoca-cli itself is replaced, so it is kept in memory for the
+ * lifetime of the process and on disk between runs, keyed by the path,
+ * modification time and size of the binary found in $PATH.
+ * A disk hit is used immediately and revalidated once per process in
+ * a background thread, which also records pyhoca-cli's version.
+ */
+#define X2GO_FEATURES_CACHE_GROUP "pyhoca-cli"
+
+typedef struct _RemminaX2GoFeaturesCache {
+	gchar *path;
+	gint64 mtime;
+	gint64 size;
+	gchar *version;
+	/* Owned strings. Never freed once handed out: connections
+	 * keep a pointer to the list for their whole lifetime. */
+	GList *features;
+	gboolean refreshing;
+} RemminaX2GoFeaturesCache;
+
+static RemminaX2GoFeaturesCache x2go_features_cache;
+G_LOCK_DEFINE_STATIC(x2go_features_cache);
+
+static gchar *rmplugin_x2go_features_cache_filename()
+{
+	return g_build_path("/", g_get_user_cache_dir(), "remmina", "x2go_features", NULL);
+}
+
+/**
+ * Locates pyhoca-cli in $PATH and fills in the identity used as cache key.
+ * @returns FALSE if pyhoca-cli can't be found or stat'ed.
+ */
+static gboolean rmplugin_x2go_pyhoca_identity(gchar **path, gint64 *mtime, gint64 *size)
+{
+	GStatBuf st;
+
+	*path = g_find_program_in_path("pyhoca-cli");
+	if (!*path)
+		return FALSE;
+
+	if (g_stat(*path, &st) != 0) {
+		g_free(*path), *path = NULL;
+		return FALSE;
+	}
+
+	*mtime = (gint64)st.st_mtime;
+	*size = (gint64)st.st_size;
+	return TRUE;
+}
+
+/**
+ * @returns pyhoca-cli's version string or NULL. Only called off the main thread.
+ */
+static gchar *rmplugin_x2go_pyhoca_version()
+{
+	gchar *argv[] = { "pyhoca-cli", "--version", NULL };
+	gchar *std_out = NULL;
+	gint exit_code = 0;
+
+	if (!g_spawn_sync(NULL, argv, NULL,
+			  G_SPAWN_SEARCH_PATH | G_SPAWN_STDERR_TO_DEV_NULL,
+			  NULL, NULL, &std_out, NULL, &exit_code, NULL))
+		return NULL;
+
+	if (exit_code != 0 || !std_out || !*g_strstrip(std_out)) {
+		g_free(std_out);
+		return NULL;
+	}
+
+	return std_out;
+}
+
+/**
+ * Makes an owned, filtered copy of the list returned by
+ * rmplugin_x2go_populate_available_features_list().
+ * @returns NULL if pyhoca-cli could not be probed.
+ */
+static GList *rmplugin_x2go_probe_features()
+{
+	GList *probed = rmplugin_x2go_populate_available_features_list();
+	GList *features = NULL;
+
+	for (GList *l = probed; l; l = l->next) {
+		if (l->data && *(gchar *)l->data)
+			features = g_list_prepend(features, g_strdup(l->data));
+	}
+	g_list_free(probed);
+
+	return g_list_reverse(features);
+}
+
+/**
+ * @returns the old feature set, used while pyhoca-cli cannot be probed. It is
+ *          never cached: the next connection probes again. Must be called with
+ *          the cache lock held.
+ */
+static GList *rmplugin_x2go_fallback_features()
+{
+	static GList *features = NULL;
+
+	if (!features)
+		features = rmplugin_x2go_old_pyhoca_features();
+	return features;
+}
+
+static gboolean rmplugin_x2go_features_equal(GList *a, GList *b)
+{
+	for (; a && b; a = a->next, b = b->next) {
+		if (g_strcmp0(a->data, b->data) != 0)
+			return FALSE;
+	}
+	return a == NULL && b == NULL;
+}
+
+/**
+ * Loads the on-disk cache into @x2go_features_cache if it matches the
+ * given pyhoca-cli identity. Must be called with the cache lock held.
+ */
+static gboolean rmplugin_x2go_features_cache_load(const gchar *path, gint64 mtime, gint64 size)
+{
+	GKeyFile *kf = g_key_file_new();
+	gchar *filename = rmplugin_x2go_features_cache_filename();
+	gchar *cached_path = NULL;
+	gchar **features = NULL;
+	gsize n_features = 0;
+	gboolean loaded = FALSE;
+
+	if (!g_key_file_load_from_file(kf, filename, G_KEY_FILE_NONE, NULL))
+		goto out;
+
+	cached_path = g_key_file_get_string(kf, X2GO_FEATURES_CACHE_GROUP, "path", NULL);
+	if (g_strcmp0(cached_path, path) != 0 ||
+	    g_key_file_get_int64(kf, X2GO_FEATURES_CACHE_GROUP, "mtime", NULL) != mtime ||
+	    g_key_file_get_int64(kf, X2GO_FEATURES_CACHE_GROUP, "size", NULL) != size)
+		goto out;
+
+	features = g_key_file_get_string_list(kf, X2GO_FEATURES_CACHE_GROUP, "features",
+					      &n_features, NULL);
+	if (!features || n_features == 0)
+		goto out;
+
+	x2go_features_cache.features = NULL;
+	for (gsize i = 0; i < n_features; i++) {
+		if (*features[i])
+			x2go_features_cache.features = g_list_prepend(x2go_features_cache.features,
+								      g_strdup(features[i]));
+	}
+	x2go_features_cache.features = g_list_reverse(x2go_features_cache.features);
+
+	g_free(x2go_features_cache.path);
+	x2go_features_cache.path = g_strdup(path);
+	x2go_features_cache.mtime = mtime;
+	x2go_features_cache.size = size;
+	g_free(x2go_features_cache.version);
+	x2go_features_cache.version = g_key_file_get_string(kf, X2GO_FEATURES_CACHE_GROUP,
+							    "version", NULL);
+	loaded = TRUE;
+
+out:
+	g_strfreev(features);
+	g_free(cached_path);
+	g_free(filename);
+	g_key_file_free(kf);
+	return loaded;
+}
+
+/**
+ * Writes @x2go_features_cache to disk. Must be called with the cache lock held.
+ */
+static void rmplugin_x2go_features_cache_save()
+{
+	GKeyFile *kf;
+	gchar *dir, *filename;
+	const gchar **features;
+	GError *error = NULL;
+	guint n = 0;
+
+	if (!x2go_features_cache.path)
+		return;
+
+	kf = g_key_file_new();
+	g_key_file_set_string(kf, X2GO_FEATURES_CACHE_GROUP, "path", x2go_features_cache.path);
+	g_key_file_set_int64(kf, X2GO_FEATURES_CACHE_GROUP, "mtime", x2go_features_cache.mtime);
+	g_key_file_set_int64(kf, X2GO_FEATURES_CACHE_GROUP, "size", x2go_features_cache.size);
+	if (x2go_features_cache.version)
+		g_key_file_set_string(kf, X2GO_FEATURES_CACHE_GROUP, "version",
+				      x2go_features_cache.version);
+
+	features = g_new0(const gchar *, g_list_length(x2go_features_cache.features) + 1);
+	for (GList *l = x2go_features_cache.features; l; l = l->next)
+		features[n++] = l->data;
+	g_key_file_set_string_list(kf, X2GO_FEATURES_CACHE_GROUP, "features", features, n);
+	g_free(features);
+
+	dir = g_build_path("/", g_get_user_cache_dir(), "remmina", NULL);
+	g_mkdir_with_parents(dir, 0750);
+	filename = rmplugin_x2go_features_cache_filename();
+
+	if (!g_key_file_save_to_file(kf, filename, &error)) {
+		REMMINA_PLUGIN_WARNING("Could not save PyHoca-CLI features cache '%s': %s",
+				       filename, error->message);
+		g_error_free(error);
+	}
+
+	g_free(filename);
+	g_free(dir);
+	g_key_file_free(kf);
+}
+
+static gpointer rmplugin_x2go_features_cache_refresh(gpointer unused)
+{
+	gchar *path = NULL;
+	gint64 mtime = 0, size = 0;
+	GList *features;
+	gchar *version;
+
+	REMMINA_PLUGIN_DEBUG("Revalidating cached PyHoca-CLI features in the background.");
+
+	if (!rmplugin_x2go_pyhoca_identity(&path, &mtime, &size)) {
+		G_LOCK(x2go_features_cache);
+		x2go_features_cache.refreshing = FALSE;
+		G_UNLOCK(x2go_features_cache);
+		return NULL;
+	}
+
+	features = rmplugin_x2go_probe_features();
+	if (!features) {
+		// A failed probe says nothing about pyhoca-cli, keep the cache.
+		G_LOCK(x2go_features_cache);
+		x2go_features_cache.refreshing = FALSE;
+		G_UNLOCK(x2go_features_cache);
+		g_free(path);
+		return NULL;
+	}
+	version = rmplugin_x2go_pyhoca_version();
+
+	G_LOCK(x2go_features_cache);
+	if (!rmplugin_x2go_features_equal(features, x2go_features_cache.features)) {
+		REMMINA_PLUGIN_INFO("%s", _("PyHoca-CLI's command-line features have changed, "
+					    "new connections will use the updated set."));
+		// The previous list is still referenced by open connections.
+		x2go_features_cache.features = features;
+	} else {
+		g_list_free_full(features, g_free);
+	}
+	g_free(x2go_features_cache.path);
+	x2go_features_cache.path = path;
+	x2go_features_cache.mtime = mtime;
+	x2go_features_cache.size = size;
+	g_free(x2go_features_cache.version);
+	x2go_features_cache.version = version;
+	rmplugin_x2go_features_cache_save();
+	x2go_features_cache.refreshing = FALSE;
+	G_UNLOCK(x2go_features_cache);
+
+	return NULL;
+}
+
+/**
+ * @returns the pyhoca-cli command line features, probing pyhoca-cli only when
+ *          neither the in-memory nor the on-disk cache matches the installed binary.
+ *          The list is shared and must not be freed by the caller.
+ */
+static GList* rmplugin_x2go_get_available_features()
+{
+	REMMINA_PLUGIN_DEBUG("Function entry.");
+
+	static gboolean revalidated = FALSE;
+	gchar *path = NULL;
+	gint64 mtime = 0, size = 0;
+	GList *features;
+
+	if (!rmplugin_x2go_pyhoca_identity(&path, &mtime, &size)) {
+		// Not in $PATH: nothing to key a cache on, the probe reports
+		// the problem and the old feature set is used.
+		features = rmplugin_x2go_probe_features();
+		if (features)
+			return features;
+		G_LOCK(x2go_features_cache);
+		features = rmplugin_x2go_fallback_features();
+		G_UNLOCK(x2go_features_cache);
+		return features;
+	}
+
+	G_LOCK(x2go_features_cache);
+
+	if (x2go_features_cache.features &&
+	    g_strcmp0(x2go_features_cache.path, path) == 0 &&
+	    x2go_features_cache.mtime == mtime && x2go_features_cache.size == size) {
+		REMMINA_PLUGIN_DEBUG("Using PyHoca-CLI features cached in memory.");
+	} else if (rmplugin_x2go_features_cache_load(path, mtime, size)) {
+		REMMINA_PLUGIN_DEBUG("Using PyHoca-CLI features cached on disk (version '%s').",
+				     x2go_features_cache.version ? x2go_features_cache.version : "unknown");
+		if (!revalidated && !x2go_features_cache.refreshing) {
+			revalidated = TRUE;
+			x2go_features_cache.refreshing = TRUE;
+			g_thread_unref(g_thread_new("x2go-features-refresh",
+						    rmplugin_x2go_features_cache_refresh, NULL));
+		}
+	} else if (!(features = rmplugin_x2go_probe_features())) {
+		// Only for this connection, neither in memory nor on disk.
+		features = rmplugin_x2go_fallback_features();
+		G_UNLOCK(x2go_features_cache);
+		g_free(path);
+		return features;
+	} else {
+		x2go_features_cache.features = features;
+		g_free(x2go_features_cache.path);
+		x2go_features_cache.path = g_strdup(path);
+		x2go_features_cache.mtime = mtime;
+		x2go_features_cache.size = size;
+		g_free(x2go_features_cache.version), x2go_features_cache.version = NULL;
+		// Just probed, no need to revalidate in this process. The version
+		// is only informational and is recorded by the next revalidation.
+		revalidated = TRUE;
+		rmplugin_x2go_features_cache_save();
+	}
+
+	features = x2go_features_cache.features;
+	G_UNLOCK(x2go_features_cache);
+
+	g_free(path);
+	return features;
+}
+
 static void rmplugin_x2go_on_plug_added(GtkSocket *socket, RemminaProtocolWidget *gp)
 {
 	TRACE_CALL(__func__);
@@ -2699,7 +3552,7 @@ static void rmplugin_x2go_init(RemminaProtocolWidget *gp)
 		return;
 	}
 
-	GList* available_features = rmplugin_x2go_populate_available_features_list();
+	GList* available_features = rmplugin_x2go_get_available_features();
 
 	// available_features can't be NULL cause if it fails, it gets populated with an
 	// old standard feature set.
@@ -2711,6 +3564,7 @@ static void rmplugin_x2go_init(RemminaProtocolWidget *gp)
 	gpdata->display = NULL;
 	gpdata->window_id = 0;
 	gpdata->pidx2go = 0;
+	gpdata->exit_pipe[0] = gpdata->exit_pipe[1] = -1;
 	gpdata->orig_handler = NULL;
 
 	gpdata->socket = gtk_socket_new();
@@ -2775,6 +3629,12 @@ static gboolean rmplugin_x2go_start_create_notify(RemminaProtocolWidget *gp, gch
 		     XDefaultRootWindow(gpdata->display),
 		     SubstructureNotifyMask);
 
+	if (pipe(gpdata->exit_pipe)) {
+		REMMINA_PLUGIN_WARNING("%s", "Could not create the pyhoca-cli exit pipe, "
+				       "an early exit will only be noticed on timeout.");
+		gpdata->exit_pipe[0] = gpdata->exit_pipe[1] = -1;
+	}
+
 	REMMINA_PLUGIN_DEBUG("X11 event-watcher created.");
 
 	return TRUE;
@@ -2788,6 +3648,7 @@ static gboolean rmplugin_x2go_monitor_create_notify(RemminaProtocolWidget *gp,
 	RemminaPluginX2GoData *gpdata;
 
 	gboolean agent_window_found = FALSE;
+	gboolean pyhoca_exited = FALSE;
 	Atom atom;
 	XEvent xev;
 	Window w;
@@ -2795,14 +3656,11 @@ static gboolean rmplugin_x2go_monitor_create_notify(RemminaProtocolWidget *gp,
 	int format;
 	unsigned long nitems, rest;
 	unsigned char *data = NULL;
+	struct pollfd fds[2];
+	gint64 deadline, remaining;
 
 	guint16 non_createnotify_count = 0;
 
-	struct timespec ts;
-	// wait_amount * ts.tv_nsec = 20s
-	// 100 * 0.2s = 20s
-	int wait_amount = 100;
-
 	CANCEL_DEFER
 
 	REMMINA_PLUGIN_DEBUG("%s", _("Waiting for window of X2Go Agent to appear…"));
@@ -2814,26 +3672,38 @@ static gboolean rmplugin_x2go_monitor_create_notify(RemminaProtocolWidget *gp,
 		return FALSE;
 	}
 
-	ts.tv_sec = 0;
-	// 0.2s = 200000000ns
-	ts.tv_nsec = 200000000;
+	// Sleep on the X connection and on pyhoca-cli's exit, up to 20s.
+	fds[0].fd = ConnectionNumber(gpdata->display);
+	fds[0].events = POLLIN;
+	fds[1].fd = gpdata->exit_pipe[0];
+	fds[1].events = POLLIN;
+	deadline = g_get_monotonic_time() + 20 * G_TIME_SPAN_SECOND;
 
-	while (wait_amount > 0) {
+	// pidx2go is only reset after this thread has been joined, the
+	// exit of pyhoca-cli is signalled through exit_pipe instead.
+	while (TRUE) {
 		pthread_testcancel();
-		if (!(gpdata->pidx2go > 0)) {
-			nanosleep(&ts, NULL);
-			REMMINA_PLUGIN_DEBUG("Waiting for X2Go session to start…");
-			continue;
-		}
 
-		while (!XPending(gpdata->display)) {
-			nanosleep(&ts, NULL);
-			wait_amount--;
-			// Don't spam the console. Print every second though.
-			if (wait_amount % 5 == 0) {
+		if (!XPending(gpdata->display)) {
+			remaining = (deadline - g_get_monotonic_time()) / 1000;
+			if (remaining <= 0)
+				break;
+
+			// Wake up at least every second to not stay silent.
+			int ret = poll(fds, 2, (int)MIN(remaining, 1000));
+			if (ret < 0 && errno != EINTR) {
+				REMMINA_PLUGIN_WARNING("Could not poll the X11 connection: %s",
+						       g_strerror(errno));
+				break;
+			}
+			if (ret == 0) {
 				REMMINA_PLUGIN_INFO("%s", _("Waiting for PyHoca-CLI to "
 							    "show the session's window…"));
 			}
+			if (ret > 0 && fds[1].revents) {
+				pyhoca_exited = TRUE;
+				break;
+			}
 			continue;
 		}
 
@@ -2882,8 +3752,12 @@ static gboolean rmplugin_x2go_monitor_create_notify(RemminaProtocolWidget *gp,
 	CANCEL_ASYNC
 
 	if (!agent_window_found) {
-		g_strlcpy(errmsg, _("No X2Go session window appeared. "
-				    "Something went wrong…"), 512);
+		if (pyhoca_exited)
+			g_strlcpy(errmsg, _("PyHoca-CLI exited before the X2Go session "
+					    "window appeared."), 512);
+		else
+			g_strlcpy(errmsg, _("No X2Go session window appeared. "
+					    "Something went wrong…"), 512);
 		return FALSE;
 	}
 
@@ -321,6 +321,9 @@ typedef struct _RemminaPluginService {
 	GtkWindow *(*get_window)(void);
 	gint (*plugin_unlock_new)(GtkWindow* parent);
 	void (*add_network_state)(gchar* key, gchar* value);
+	gint (*tcp_connect)(const gchar *host, gint port, gint timeout_ms, gchar **error);
+	void (*protocol_widget_close_connection)(RemminaProtocolWidget *gp);
+	gboolean (*protocol_widget_start_dynamic_tunnel)(RemminaProtocolWidget *gp, gint *local_port);
 } RemminaPluginService;
 
 /* "Prototype" of the plugin entry function */
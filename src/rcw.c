@@ -61,6 +61,7 @@
 #include "remmina_pref.h"
 #include "remmina_protocol_widget.h"
 #include "remmina_public.h"
+#include "remmina_screenshot.h"
 #include "remmina_scrolled_viewport.h"
 #include "remmina_unlock.h"
 #include "remmina_utils.h"
@@ -2183,72 +2184,76 @@ static void rcw_toolbar_duplicate(GtkToolItem *toggle, RemminaConnectionWindow *
 	remmina_exec_command(REMMINA_COMMAND_CONNECT, cnnobj->remmina_file->filename);
 }
 
+static void rcw_screenshot_replace_int(GString *str, const gchar *needle, const gchar *fmt, gint value)
+{
+	gchar *s = g_strdup_printf(fmt, value);
+
+	remmina_utils_string_replace_all(str, needle, s);
+	g_free(s);
+}
+
+static gchar *rcw_screenshot_filename(RemminaConnectionObject *cnnobj)
+{
+	TRACE_CALL(__func__);
+	GDateTime *date = g_date_time_new_now_utc();
+	GString *pngstr;
+
+	pngstr = g_string_new(NULL);
+	g_string_printf(pngstr, "%s/%s.%s", remmina_pref.screenshot_path, remmina_pref.screenshot_name,
+			remmina_screenshot_get_extension());
+	remmina_utils_string_replace_all(pngstr, "%p",
+					 remmina_file_get_string(cnnobj->remmina_file, "name"));
+	remmina_utils_string_replace_all(pngstr, "%h",
+					 remmina_file_get_string(cnnobj->remmina_file, "server"));
+	rcw_screenshot_replace_int(pngstr, "%Y", "%d", g_date_time_get_year(date));
+	rcw_screenshot_replace_int(pngstr, "%m", "%02d", g_date_time_get_month(date));
+	rcw_screenshot_replace_int(pngstr, "%d", "%02d", g_date_time_get_day_of_month(date));
+	rcw_screenshot_replace_int(pngstr, "%H", "%02d", g_date_time_get_hour(date));
+	rcw_screenshot_replace_int(pngstr, "%M", "%02d", g_date_time_get_minute(date));
+	rcw_screenshot_replace_int(pngstr, "%S", "%02d", g_date_time_get_second(date));
+	g_date_time_unref(date);
+
+	return g_string_free(pngstr, FALSE);
+}
+
 static void rcw_toolbar_screenshot(GtkToolItem *toggle, RemminaConnectionWindow *cnnwin)
 {
 	TRACE_CALL(__func__);
 
 	GdkPixbuf *screenshot;
 	GdkWindow *active_window;
-	cairo_t *cr;
 	gint width, height;
-	GString *pngstr;
 	gchar *pngname;
 	GtkWidget *dialog;
 	RemminaProtocolWidget *gp;
 	RemminaPluginScreenshotData rpsd;
 	RemminaConnectionObject *cnnobj;
-	cairo_surface_t *srcsurface;
-	cairo_format_t cairo_format;
-	cairo_surface_t *surface;
-	int stride;
+	gboolean to_clipboard;
 
 	if (cnnwin->priv->toolbar_is_reconfiguring)
 		return;
 	if (!(cnnobj = rcw_get_visible_cnnobj(cnnwin))) return;
 
-	GDateTime *date = g_date_time_new_now_utc();
-
 	// We will take a screenshot of the currently displayed RemminaProtocolWidget.
 	gp = REMMINA_PROTOCOL_WIDGET(cnnobj->proto);
 
 	gchar *denyclip = remmina_pref_get_value("deny_screenshot_clipboard");
 
 	REMMINA_DEBUG("deny_screenshot_clipboard is set to %s", denyclip);
+	to_clipboard = denyclip && g_strcmp0(denyclip, "true");
+	g_free(denyclip);
 
-	GtkClipboard *c = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
+	pngname = rcw_screenshot_filename(cnnobj);
 
-	// Ask the plugin if it can give us a screenshot
+	/* Only the capture happens here: conversion, encoding and the
+	 * notification are done by remmina_screenshot off the GTK thread */
 	if (remmina_protocol_widget_plugin_screenshot(gp, &rpsd)) {
 		// Good, we have a screenshot from the plugin !
 
 		REMMINA_DEBUG("Screenshot from plugin: w=%d h=%d bpp=%d bytespp=%d\n",
 			      rpsd.width, rpsd.height, rpsd.bitsPerPixel, rpsd.bytesPerPixel);
 
-		width = rpsd.width;
-		height = rpsd.height;
-
-		if (rpsd.bitsPerPixel == 32)
-			cairo_format = CAIRO_FORMAT_ARGB32;
-		else if (rpsd.bitsPerPixel == 24)
-			cairo_format = CAIRO_FORMAT_RGB24;
-		else
-			cairo_format = CAIRO_FORMAT_RGB16_565;
-
-		stride = cairo_format_stride_for_width(cairo_format, width);
-
-		srcsurface = cairo_image_surface_create_for_data(rpsd.buffer, cairo_format, width, height, stride);
-		// Transfer the PixBuf in the main clipboard selection
-		if (denyclip && (g_strcmp0(denyclip, "true")))
-			gtk_clipboard_set_image(c, gdk_pixbuf_get_from_surface(
-							srcsurface, 0, 0, width, height));
-		surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-		cr = cairo_create(surface);
-		cairo_set_source_surface(cr, srcsurface, 0, 0);
-		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-		cairo_paint(cr);
-		cairo_surface_destroy(srcsurface);
-
-		free(rpsd.buffer);
+		remmina_screenshot_save_buffer(&rpsd, pngname, to_clipboard);
 	} else {
 		// The plugin is not releasing us a screenshot, just try to catch one via GTK
 
@@ -2267,58 +2272,18 @@ static void rcw_toolbar_screenshot(GtkToolItem *toggle, RemminaConnectionWindow
 		height = gdk_window_get_height(active_window);
 
 		screenshot = gdk_pixbuf_get_from_window(active_window, 0, 0, width, height);
-		if (screenshot == NULL)
+		if (screenshot == NULL) {
 			g_print("gdk_pixbuf_get_from_window failed\n");
-
-		// Transfer the PixBuf in the main clipboard selection
-		if (denyclip && (g_strcmp0(denyclip, "true")))
-			gtk_clipboard_set_image(c, screenshot);
-		// Prepare the destination Cairo surface.
-		surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
-		cr = cairo_create(surface);
-
-		// Copy the source pixbuf to the surface and paint it.
-		gdk_cairo_set_source_pixbuf(cr, screenshot, 0, 0);
-		cairo_paint(cr);
-
-		// Deallocate screenshot pixbuf
-		g_object_unref(screenshot);
+		} else {
+			// Transfer the PixBuf in the main clipboard selection
+			if (to_clipboard)
+				gtk_clipboard_set_image(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), screenshot);
+			remmina_screenshot_save_pixbuf(screenshot, pngname);
+			g_object_unref(screenshot);
+		}
 	}
 
-	//home/antenore/Pictures/remmina_%p_%h_%Y  %m %d-%H%M%S.png pngname
-	//home/antenore/Pictures/remmina_st_  _2018 9 24-151958.240374.png
-
-	pngstr = g_string_new(g_strdup_printf("%s/%s.png",
-					      remmina_pref.screenshot_path,
-					      remmina_pref.screenshot_name));
-	remmina_utils_string_replace_all(pngstr, "%p",
-					 remmina_file_get_string(cnnobj->remmina_file, "name"));
-	remmina_utils_string_replace_all(pngstr, "%h",
-					 remmina_file_get_string(cnnobj->remmina_file, "server"));
-	remmina_utils_string_replace_all(pngstr, "%Y",
-					 g_strdup_printf("%d", g_date_time_get_year(date)));
-	remmina_utils_string_replace_all(pngstr, "%m", g_strdup_printf("%02d",
-								       g_date_time_get_month(date)));
-	remmina_utils_string_replace_all(pngstr, "%d",
-					 g_strdup_printf("%02d", g_date_time_get_day_of_month(date)));
-	remmina_utils_string_replace_all(pngstr, "%H",
-					 g_strdup_printf("%02d", g_date_time_get_hour(date)));
-	remmina_utils_string_replace_all(pngstr, "%M",
-					 g_strdup_printf("%02d", g_date_time_get_minute(date)));
-	remmina_utils_string_replace_all(pngstr, "%S",
-					 g_strdup_printf("%02d", g_date_time_get_second(date)));
-	g_date_time_unref(date);
-	pngname = g_string_free(pngstr, FALSE);
-
-	cairo_surface_write_to_png(surface, pngname);
-
-	/* send a desktop notification */
-	if (g_file_test(pngname, G_FILE_TEST_EXISTS))
-		remmina_public_send_notification("remmina-screenshot-is-ready-id", _("Screenshot taken"), pngname);
-
-	//Clean up and return.
-	cairo_destroy(cr);
-	cairo_surface_destroy(surface);
+	g_free(pngname);
 }
 
 static void rcw_toolbar_minimize(GtkToolItem *toggle, RemminaConnectionWindow *cnnwin)
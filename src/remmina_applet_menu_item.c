@@ -137,8 +137,8 @@ GtkWidget* remmina_applet_menu_item_new(RemminaAppletMenuItemType item_type, ...
 	/* Get the icon based on the protocol */
 	gchar* icon_name;
 	RemminaProtocolPlugin *plugin;
-	plugin  = (RemminaProtocolPlugin *)remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL,
-									    item->protocol);
+	plugin  = (RemminaProtocolPlugin *)remmina_plugin_manager_peek_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL,
+									     item->protocol);
 	if (!plugin) {
 		icon_name = g_strconcat(REMMINA_APP_ID, "-symbolic", NULL);
 	} else {
@@ -386,7 +386,7 @@ remmina_file_load(const gchar *filename)
 	/* Identify the protocol plugin and get pointers to its RemminaProtocolSetting structs */
 	gchar *proto = g_key_file_get_string(gkeyfile, KEYFILE_GROUP_REMMINA, "protocol", NULL);
 	if (proto) {
-		protocol_plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, proto);
+		protocol_plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_peek_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, proto);
 		g_free(proto);
 	}
 
@@ -743,7 +743,7 @@ void remmina_file_save(RemminaFile *remminafile)
 	/* Identify the protocol plugin and get pointers to its RemminaProtocolSetting structs */
 	proto = (gchar *)g_hash_table_lookup(remminafile->settings, "protocol");
 	if (proto) {
-		protocol_plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, proto);
+		protocol_plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_peek_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, proto);
 	} else {
 		REMMINA_CRITICAL("Saving settings for unknown protocol:", proto);
 		protocol_plugin = NULL;
@@ -873,8 +873,8 @@ remmina_file_get_icon_name(RemminaFile *remminafile)
 	TRACE_CALL(__func__);
 	RemminaProtocolPlugin *plugin;
 
-	plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL,
-									    remmina_file_get_string(remminafile, "protocol"));
+	plugin = (RemminaProtocolPlugin *)remmina_plugin_manager_peek_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL,
+									     remmina_file_get_string(remminafile, "protocol"));
 	if (!plugin)
 		return g_strconcat(REMMINA_APP_ID, "-symbolic", NULL);
 
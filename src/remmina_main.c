@@ -66,6 +66,7 @@
 #include "remmina_mpchange.h"
 #include "remmina_external_tools.h"
 #include "remmina_unlock.h"
+#include "remmina_ssh.h"
 #include "remmina/remmina_trace_calls.h"
 
 static RemminaMain *remminamain;
@@ -200,6 +201,11 @@ void remmina_main_destroy(void)
 	TRACE_CALL(__func__);
 
 	if (remminamain) {
+		if (remminamain->monitor)
+			remmina_monitor_stop_scan(remminamain->monitor);
+		if (remminamain->priv->status_tick_id && remminamain->window)
+			gtk_widget_remove_tick_callback(GTK_WIDGET(remminamain->tree_files_list),
+							remminamain->priv->status_tick_id);
 		if (remminamain->window)
 			gtk_widget_destroy(GTK_WIDGET(remminamain->window));
 
@@ -211,6 +217,8 @@ void remmina_main_destroy(void)
 		g_object_unref(G_OBJECT(remminamain->priv->file_model_filter));
 		g_free(remminamain->priv->selected_filename);
 		g_free(remminamain->priv->selected_name);
+		g_hash_table_destroy(remminamain->priv->file_rows);
+		g_hash_table_destroy(remminamain->priv->pending_states);
 		g_free(remminamain->priv);
 		g_free(remminamain);
 		remminamain = NULL;
@@ -357,18 +365,15 @@ static gboolean remmina_main_selection_func(GtkTreeSelection *selection, GtkTree
 	return TRUE;
 }
 
-static void remmina_main_load_file_list_callback(RemminaFile *remminafile, gpointer user_data)
+static const gchar *remmina_main_status_icon(const gchar *filename)
 {
 	TRACE_CALL(__func__);
-	GtkTreeIter iter;
-	GtkListStore *store;
-	gchar* status_icon = "";
-	store = GTK_LIST_STORE(user_data);
-	gchar *datetime;
+	const gchar *status_icon = "";
+
 	if (remmina_pref_get_boolean("status_check")){
 		status_icon = "org.remmina.Remmina-status-grey";
-		if (g_hash_table_contains(remminamain->network_states, remminafile->filename)){
-			gchar* result = (gchar*)g_hash_table_lookup(remminamain->network_states, remminafile->filename);
+		if (g_hash_table_contains(remminamain->network_states, filename)){
+			gchar* result = (gchar*)g_hash_table_lookup(remminamain->network_states, filename);
 			if (result != NULL){
 				if (strncmp("Yes", result, strlen("Yes")) == 0){
 					status_icon = "org.remmina.Remmina-status-green";
@@ -379,7 +384,26 @@ static void remmina_main_load_file_list_callback(RemminaFile *remminafile, gpoin
 			}
 		}
 	}
-	
+	return status_icon;
+}
+
+/* Remember where the row of a file is, list and tree stores keep their iters valid */
+static void remmina_main_index_file_row(RemminaFile *remminafile, GtkTreeIter *iter)
+{
+	TRACE_CALL(__func__);
+	g_hash_table_insert(remminamain->priv->file_rows, g_strdup(remmina_file_get_filename(remminafile)),
+			    gtk_tree_iter_copy(iter));
+}
+
+static void remmina_main_load_file_list_callback(RemminaFile *remminafile, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	GtkTreeIter iter;
+	GtkListStore *store;
+	const gchar* status_icon = remmina_main_status_icon(remminafile->filename);
+	store = GTK_LIST_STORE(user_data);
+	gchar *datetime;
+
 	datetime = remmina_file_get_datetime(remminafile);
 	gtk_list_store_append(store, &iter);
 	gtk_list_store_set(store, &iter,
@@ -395,6 +419,7 @@ static void remmina_main_load_file_list_callback(RemminaFile *remminafile, gpoin
 			   STATUS_COLUMN, status_icon,
 			   -1);
 	g_free(datetime);
+	remmina_main_index_file_row(remminafile, &iter);
 }
 
 static gboolean remmina_main_load_file_tree_traverse(GNode *node, GtkTreeStore *store, GtkTreeIter *parent)
@@ -507,21 +532,7 @@ static void remmina_main_load_file_tree_callback(RemminaFile *remminafile, gpoin
 	GtkTreeStore *store;
 	gboolean found;
 	gchar *datetime = NULL;
-	gchar* status_icon = "";
-	if (remmina_pref_get_boolean("status_check")){
-		status_icon = "org.remmina.Remmina-status-grey";
-		if (g_hash_table_contains(remminamain->network_states, remminafile->filename)){
-			gchar* result = (gchar*)g_hash_table_lookup(remminamain->network_states, remminafile->filename);
-			if (result != NULL){
-				if (strncmp("Yes", result, strlen("Yes")) == 0){
-					status_icon = "org.remmina.Remmina-status-green";
-				}
-				else if (strncmp("No", result, strlen("No")) == 0){
-					status_icon = "org.remmina.Remmina-status-red";
-				}
-			}
-		}
-	}
+	const gchar* status_icon = remmina_main_status_icon(remminafile->filename);
 
 	store = GTK_TREE_STORE(user_data);
 
@@ -545,6 +556,7 @@ static void remmina_main_load_file_tree_callback(RemminaFile *remminafile, gpoin
 			   STATUS_COLUMN, status_icon,
 			   -1);
 	g_free(datetime);
+	remmina_main_index_file_row(remminafile, &child);
 }
 
 static void remmina_main_file_model_on_sort(GtkTreeSortable *sortable, gpointer user_data)
@@ -708,6 +720,9 @@ static void remmina_main_load_files(void)
 		break;
 	}
 
+	/* Rows are indexed again as the new model is filled */
+	g_hash_table_remove_all(remminamain->priv->file_rows);
+
 	switch (view_file_mode) {
 	case REMMINA_VIEW_FILE_TREE:
 		/* Create new GtkTreeStore model */
@@ -1069,6 +1084,38 @@ void remmina_main_on_action_connection_delete(GSimpleAction *action, GVariant *p
 }
 
 
+#ifdef HAVE_LIBSSH
+/* Start the SSH sessions of the selected profiles in the background, so
+ * each connection finds its session connected, or even authenticated, while
+ * the prompts of the other ones are still open */
+static void remmina_main_prefetch_ssh_sessions(GtkTreeModel *model, GList *list)
+{
+	TRACE_CALL(__func__);
+	GtkTreeIter iter;
+	gchar *filename;
+	RemminaFile *remminafile;
+	gboolean locked;
+
+	for (; list; list = g_list_next(list)) {
+		if (!gtk_tree_model_get_iter(model, &iter, (GtkTreePath *)list->data))
+			continue;
+		filename = NULL;
+		gtk_tree_model_get(model, &iter, FILENAME_COLUMN, &filename, -1);
+		if (!filename)
+			continue;
+		remminafile = remmina_file_load(filename);
+		g_free(filename);
+		if (!remminafile)
+			continue;
+		/* Secrets of locked profiles wait for the unlock */
+		locked = (remmina_pref_get_boolean("lock_connect") && remmina_pref_get_boolean("use_primary_password"))
+			 || remmina_file_get_int(remminafile, "profile-lock", FALSE);
+		remmina_ssh_prefetch(remminafile, !locked);
+		remmina_file_free(remminafile);
+	}
+}
+#endif
+
 void remmina_main_on_action_connection_connect_multiple(GSimpleAction *action, GVariant *param, gpointer data)
 {
 	TRACE_CALL(__func__);
@@ -1077,6 +1124,10 @@ void remmina_main_on_action_connection_connect_multiple(GSimpleAction *action, G
 	GList *list = gtk_tree_selection_get_selected_rows(sel, &model);
 	gchar *file_to_load = NULL;
 
+#ifdef HAVE_LIBSSH
+	remmina_main_prefetch_ssh_sessions(model, list);
+#endif
+
 
 	while (list) {
 		GtkTreePath *path = list->data;
@@ -1797,6 +1848,7 @@ static void remmina_main_init(void)
 
 	REMMINA_DEBUG ("Initializing monitor");
 	remminamain->monitor = remmina_network_monitor_new();
+	remmina_monitor_start_scan(remminamain->monitor);
 
 	remminamain->priv->expanded_group = remmina_string_array_new_from_string(remmina_pref.expanded_group);
 	if (!kioskmode && kioskmode == FALSE)
@@ -1819,7 +1871,7 @@ static void remmina_main_init(void)
 	qcp_idx = qcp_actidx = 0;
 	for (i = 0; i < sizeof(quick_connect_plugin_list) / sizeof(quick_connect_plugin_list[0]); i++) {
 		name = quick_connect_plugin_list[i];
-		if (remmina_plugin_manager_get_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, name)) {
+		if (remmina_plugin_manager_peek_plugin(REMMINA_PLUGIN_TYPE_PROTOCOL, name)) {
 			gtk_combo_box_text_append(remminamain->combo_quick_connect_protocol, name, name);
 			if (remmina_pref.last_quickconnect_protocol != NULL && strcmp(name, remmina_pref.last_quickconnect_protocol) == 0)
 				qcp_actidx = qcp_idx;
@@ -1861,13 +1913,47 @@ void remmina_main_on_show(GtkWidget *w, gpointer user_data)
 #endif
 }
 
+/* Apply the status changes received since the last frame to their rows */
+static gboolean remmina_main_update_network_status(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	GHashTableIter pending;
+	GtkTreeIter *iter;
+	gpointer filename;
+
+	g_hash_table_iter_init(&pending, remminamain->priv->pending_states);
+	while (g_hash_table_iter_next(&pending, &filename, NULL)) {
+		iter = g_hash_table_lookup(remminamain->priv->file_rows, filename);
+		if (!iter)
+			continue;
+		if (GTK_IS_TREE_STORE(remminamain->priv->file_model))
+			gtk_tree_store_set(GTK_TREE_STORE(remminamain->priv->file_model), iter,
+					   STATUS_COLUMN, remmina_main_status_icon(filename), -1);
+		else
+			gtk_list_store_set(GTK_LIST_STORE(remminamain->priv->file_model), iter,
+					   STATUS_COLUMN, remmina_main_status_icon(filename), -1);
+	}
+	g_hash_table_remove_all(remminamain->priv->pending_states);
+
+	remminamain->priv->status_tick_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
 void remmina_main_add_network_status(gchar* key, gchar* value)
 {
+	TRACE_CALL(__func__);
 	if (remminamain != NULL){
+		g_hash_table_add(remminamain->priv->pending_states, g_strdup(key));
 		g_hash_table_insert(remminamain->network_states, key, value);
-		remmina_main_load_files();
+		/* A status check sweep reports many hosts, repaint them together */
+		if (!remminamain->priv->status_tick_id)
+			remminamain->priv->status_tick_id = gtk_widget_add_tick_callback(GTK_WIDGET(remminamain->tree_files_list),
+											 remmina_main_update_network_status, NULL, NULL);
+	} else {
+		/* No connection list to show them, we still own both strings */
+		g_free(key);
+		g_free(value);
 	}
-	
 }
 
 /* RemminaMain instance */
@@ -1880,6 +1966,8 @@ GtkWidget *remmina_main_new(void)
 	remminamain = g_new0(RemminaMain, 1);
 	remminamain->priv = g_new0(RemminaMainPriv, 1);
 	remminamain->network_states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	remminamain->priv->file_rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)gtk_tree_iter_free);
+	remminamain->priv->pending_states = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 	/* Assign UI widgets to the private members */
 	remminamain->builder = remmina_public_gtk_builder_new_from_resource("/org/remmina/Remmina/src/../data/ui/remmina_main.glade");
 	remminamain->window = GTK_WINDOW(RM_GET_OBJECT("RemminaMain"));
@@ -99,6 +99,12 @@ struct _RemminaMainPriv {
 	gchar *			selected_name;
 	gboolean		override_view_file_mode_to_list;
 	RemminaStringArray *	expanded_group;
+
+	/* Filename -> GtkTreeIter of its row in file_model */
+	GHashTable *		file_rows;
+	/* Filenames whose network status changed since the last frame */
+	GHashTable *		pending_states;
+	guint			status_tick_id;
 };
 
 G_BEGIN_DECLS
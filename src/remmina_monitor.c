@@ -33,140 +33,421 @@
  */
 
 #include "config.h"
+#include "remmina_file_manager.h"
+#include "remmina_main.h"
 #include "remmina_monitor.h"
 #include "remmina_log.h"
+#include "remmina_pref.h"
 #include "remmina_public.h"
 #include "remmina/remmina_trace_calls.h"
 
+/* Probes running at the same time, the others wait in the queue */
+#define REMMINA_MONITOR_MAX_PROBES 16
+/* Seconds a probe may take to connect and read the banner */
+#define REMMINA_MONITOR_PROBE_TIMEOUT 5
+/* Seconds between two scans of the profiles, plus up to a fifth as jitter
+ * so that several Remmina instances do not probe in lockstep */
+#define REMMINA_MONITOR_RESCAN_INTERVAL 300
+
 RemminaMonitor *rm_monitor;
 
-static void remmina_monitor_can_reach_cb (GNetworkMonitor *netmonitor, GAsyncResult *result, RemminaMonitor *monitor)
+/* What a probe checks once the TCP connection is up */
+typedef enum {
+	REMMINA_MONITOR_CHECK_CONNECT,
+	REMMINA_MONITOR_CHECK_SSH,
+	REMMINA_MONITOR_CHECK_RFB,
+	REMMINA_MONITOR_CHECK_RDP
+} RemminaMonitorCheck;
+
+typedef struct _RemminaMonitorResult {
+	gboolean	reachable;
+	gint64		checked_at;
+} RemminaMonitorResult;
+
+typedef struct _RemminaMonitorProbe {
+	RemminaMonitor *	monitor;
+	gchar *			key;
+	gchar *			host;
+	guint16			port;
+	RemminaMonitorCheck	check;
+	/* Profiles to report the result to */
+	GSList *		filenames;
+
+	GCancellable *		cancellable;
+	GSocketClient *		client;
+	GSocketConnection *	connection;
+	guint			timeout_id;
+	guchar			buffer[64];
+	gsize			len;
+} RemminaMonitorProbe;
+
+/* X.224 Connection Request with an RDP Negotiation Request, as sent by mstsc */
+static const guchar rdp_connection_request[] = {
+	0x03, 0x00, 0x00, 0x13, 0x0e, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x01, 0x00, 0x08, 0x00, 0x03, 0x00, 0x00, 0x00
+};
+
+static void remmina_monitor_probe_next(RemminaMonitor *monitor);
+
+static void remmina_monitor_probe_free(RemminaMonitorProbe *probe)
 {
-	g_autoptr (GError) error = NULL;
+	TRACE_CALL(__func__);
+	if (probe->timeout_id)
+		g_source_remove(probe->timeout_id);
+	if (probe->connection) {
+		g_io_stream_close(G_IO_STREAM(probe->connection), NULL, NULL);
+		g_object_unref(probe->connection);
+	}
+	g_clear_object(&probe->client);
+	g_object_unref(probe->cancellable);
+	g_slist_free_full(probe->filenames, g_free);
+	g_free(probe->host);
+	g_free(probe->key);
+	g_free(probe);
+}
 
-	gchar *status = NULL;
+static void remmina_monitor_probe_finish(RemminaMonitorProbe *probe, gboolean reachable)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitor *monitor = probe->monitor;
+	RemminaMonitorResult *result;
+	GSList *l;
 
-	gboolean is_reachable = g_network_monitor_can_reach_finish (netmonitor, result, &error);
+	REMMINA_DEBUG("Network object %s is %s", probe->key, reachable ? "reachable" : "not reachable");
 
-	const gchar *addr_tostr = g_strdup(g_socket_connectable_to_string (monitor->addr));
+	result = g_new0(RemminaMonitorResult, 1);
+	result->reachable = reachable;
+	result->checked_at = g_get_monotonic_time();
+	g_hash_table_replace(monitor->results, g_strdup(probe->key), result);
+	g_hash_table_replace(monitor->server_status, g_strdup(probe->key),
+			     g_strdup(reachable ? "online" : "offline"));
 
-	if (is_reachable) {
+	/* Feed the connection list, it takes ownership of both strings */
+	for (l = probe->filenames; l; l = l->next)
+		remmina_main_add_network_status(g_strdup((gchar *)l->data), g_strdup(reachable ? "Yes" : "No"));
 
-		REMMINA_DEBUG ("Network object %s is reachable", g_socket_connectable_to_string (monitor->addr));
-		status = g_strdup ("online");
+	g_hash_table_remove(monitor->probes, probe->key);
+	remmina_monitor_probe_free(probe);
 
-	} else {
+	monitor->active_probes--;
+	remmina_monitor_probe_next(monitor);
+}
+
+static gboolean remmina_monitor_probe_timeout(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorProbe *probe = (RemminaMonitorProbe *)data;
+
+	/* The pending operation completes with G_IO_ERROR_CANCELLED */
+	probe->timeout_id = 0;
+	g_cancellable_cancel(probe->cancellable);
+	return G_SOURCE_REMOVE;
+}
+
+/* TRUE when the bytes received so far prove the expected service, FALSE
+ * when they disprove it. More bytes are needed while *complete is FALSE */
+static gboolean remmina_monitor_probe_banner(RemminaMonitorProbe *probe, gboolean *complete)
+{
+	TRACE_CALL(__func__);
+	const gchar *prefix = NULL;
+	gsize need;
+
+	switch (probe->check) {
+	case REMMINA_MONITOR_CHECK_SSH:
+		prefix = "SSH-";
+		break;
+	case REMMINA_MONITOR_CHECK_RFB:
+		prefix = "RFB ";
+		break;
+	case REMMINA_MONITOR_CHECK_RDP:
+		/* TPKT version 3, then an X.224 Connection Confirm */
+		*complete = probe->len >= 6;
+		return !*complete || (probe->buffer[0] == 0x03 && probe->buffer[1] == 0x00 &&
+				      (probe->buffer[5] & 0xf0) == 0xd0);
+	case REMMINA_MONITOR_CHECK_CONNECT:
+	default:
+		*complete = TRUE;
+		return TRUE;
+	}
 
-		REMMINA_DEBUG ("Network object %s is not reachable", g_socket_connectable_to_string (monitor->addr));
-		status = g_strdup ("offline");
+	need = strlen(prefix);
+	*complete = probe->len >= need;
+	return memcmp(probe->buffer, prefix, MIN(probe->len, need)) == 0;
+}
+
+static void remmina_monitor_probe_read_cb(GObject *source, GAsyncResult *res, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorProbe *probe = (RemminaMonitorProbe *)data;
+	gboolean complete = FALSE;
+	gboolean valid;
+	gssize len;
+
+	len = g_input_stream_read_finish(G_INPUT_STREAM(source), res, NULL);
+	if (len <= 0) {
+		remmina_monitor_probe_finish(probe, FALSE);
+		return;
 	}
 
-	if (g_hash_table_replace (monitor->server_status, g_strdup(addr_tostr), g_strdup(status))) {
-		REMMINA_DEBUG ("Inserting %s -> %s", addr_tostr, status);
-	} else {
-		REMMINA_DEBUG ("Replacing %s -> %s", addr_tostr, status);
+	probe->len += len;
+	valid = remmina_monitor_probe_banner(probe, &complete);
+	if (!valid || complete || probe->len == sizeof(probe->buffer)) {
+		remmina_monitor_probe_finish(probe, valid && complete);
+		return;
 	}
 
-	g_free (status);
+	g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(probe->connection)),
+				  probe->buffer + probe->len, sizeof(probe->buffer) - probe->len,
+				  G_PRIORITY_LOW, probe->cancellable, remmina_monitor_probe_read_cb, probe);
 }
 
-gchar *remmina_monitor_can_reach(RemminaFile *remminafile, RemminaMonitor *monitor)
+static void remmina_monitor_probe_read(RemminaMonitorProbe *probe)
 {
 	TRACE_CALL(__func__);
+	g_input_stream_read_async(g_io_stream_get_input_stream(G_IO_STREAM(probe->connection)),
+				  probe->buffer, sizeof(probe->buffer),
+				  G_PRIORITY_LOW, probe->cancellable, remmina_monitor_probe_read_cb, probe);
+}
 
-	const gchar *server;
-	const gchar *ssh_tunnel_server;
-	const gchar *addr_tostr = NULL;
-	gchar *status = NULL;
-	gchar *ssh_tunnel_host, *srv_host;
-	gint netmonit, srv_port, ssh_tunnel_port;
+static void remmina_monitor_probe_write_cb(GObject *source, GAsyncResult *res, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorProbe *probe = (RemminaMonitorProbe *)data;
+
+	if (g_output_stream_write_finish(G_OUTPUT_STREAM(source), res, NULL) != sizeof(rdp_connection_request)) {
+		remmina_monitor_probe_finish(probe, FALSE);
+		return;
+	}
+	remmina_monitor_probe_read(probe);
+}
+
+static void remmina_monitor_probe_connect_cb(GObject *source, GAsyncResult *res, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorProbe *probe = (RemminaMonitorProbe *)data;
+
+	probe->connection = g_socket_client_connect_finish(G_SOCKET_CLIENT(source), res, NULL);
+	if (!probe->connection) {
+		remmina_monitor_probe_finish(probe, FALSE);
+		return;
+	}
+
+	switch (probe->check) {
+	case REMMINA_MONITOR_CHECK_SSH:
+	case REMMINA_MONITOR_CHECK_RFB:
+		/* These servers talk first */
+		remmina_monitor_probe_read(probe);
+		break;
+	case REMMINA_MONITOR_CHECK_RDP:
+		g_output_stream_write_async(g_io_stream_get_output_stream(G_IO_STREAM(probe->connection)),
+					    rdp_connection_request, sizeof(rdp_connection_request),
+					    G_PRIORITY_LOW, probe->cancellable, remmina_monitor_probe_write_cb, probe);
+		break;
+	case REMMINA_MONITOR_CHECK_CONNECT:
+	default:
+		remmina_monitor_probe_finish(probe, TRUE);
+		break;
+	}
+}
+
+static void remmina_monitor_probe_start(RemminaMonitorProbe *probe)
+{
+	TRACE_CALL(__func__);
+	GSocketConnectable *addr;
+
+	probe->monitor->active_probes++;
+	probe->timeout_id = g_timeout_add_seconds(REMMINA_MONITOR_PROBE_TIMEOUT, remmina_monitor_probe_timeout, probe);
+
+	probe->client = g_socket_client_new();
+	addr = g_network_address_new(probe->host, probe->port);
+	g_socket_client_connect_async(probe->client, addr, probe->cancellable,
+				      remmina_monitor_probe_connect_cb, probe);
+	g_object_unref(addr);
+}
+
+static void remmina_monitor_probe_next(RemminaMonitor *monitor)
+{
+	TRACE_CALL(__func__);
+	while (monitor->active_probes < REMMINA_MONITOR_MAX_PROBES && !g_queue_is_empty(monitor->queue))
+		remmina_monitor_probe_start((RemminaMonitorProbe *)g_queue_pop_head(monitor->queue));
+}
+
+/* Queue a probe of host:port for the profile filename, probes of the same
+ * service are shared by all the profiles pointing to it */
+static void remmina_monitor_probe_enqueue(RemminaMonitor *monitor, const gchar *key, const gchar *host, gint port,
+					  RemminaMonitorCheck check, const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorProbe *probe;
+
+	probe = g_hash_table_lookup(monitor->probes, key);
+	if (!probe) {
+		probe = g_new0(RemminaMonitorProbe, 1);
+		probe->monitor = monitor;
+		probe->key = g_strdup(key);
+		probe->host = g_strdup(host);
+		probe->port = port;
+		probe->check = check;
+		probe->cancellable = g_cancellable_new();
+		g_hash_table_insert(monitor->probes, probe->key, probe);
+		g_queue_push_tail(monitor->queue, probe);
+	}
+	if (filename && !g_slist_find_custom(probe->filenames, filename, (GCompareFunc)g_strcmp0))
+		probe->filenames = g_slist_prepend(probe->filenames, g_strdup(filename));
+
+	remmina_monitor_probe_next(monitor);
+}
+
+/* Service to probe for a profile, FALSE if it cannot be monitored */
+static gboolean remmina_monitor_probe_target(RemminaFile *remminafile, gchar **key, gchar **host, gint *port,
+					     RemminaMonitorCheck *check)
+{
+	TRACE_CALL(__func__);
 	const gchar *protocol;
 	gint default_port = 0;
 
+	protocol = remmina_file_get_string(remminafile, "protocol");
+	if (!protocol || protocol[0] == '\0')
+		return FALSE;
+
+	REMMINA_DEBUG("Evaluating protocol %s for monitoring", protocol);
+	*check = REMMINA_MONITOR_CHECK_CONNECT;
+	if (g_strcmp0("RDP", protocol) == 0) {
+		default_port = 3389;
+		*check = REMMINA_MONITOR_CHECK_RDP;
+	}
+	if (g_strcmp0("VNC", protocol) == 0 || g_strcmp0("GVNC", protocol) == 0) {
+		default_port = 5900;
+		*check = REMMINA_MONITOR_CHECK_RFB;
+	}
+	if (g_strcmp0("SPICE", protocol) == 0)
+		default_port = 5900;
+	if (g_strcmp0("WWW", protocol) == 0)
+		default_port = 443;
+	if (g_strcmp0("X2GO", protocol) == 0 || g_strcmp0("SSH", protocol) == 0 || g_strcmp0("SFTP", protocol) == 0) {
+		default_port = 22;
+		*check = REMMINA_MONITOR_CHECK_SSH;
+	}
+	if (g_strcmp0("EXEC", protocol) == 0)
+		default_port = -1;
+
+	if (default_port == 0) {
+		REMMINA_DEBUG("Unknown protocol");
+		return FALSE;
+	}
+	if (default_port < 0) {
+		REMMINA_DEBUG("Cannot monitor");
+		return FALSE;
+	}
+
+	if (remmina_file_get_int(remminafile, "ssh_tunnel_enabled", FALSE)) {
+		/* Only the SSH server is reachable from here */
+		remmina_public_get_server_port(remmina_file_get_string(remminafile, "ssh_tunnel_server"), 22, host, port);
+		*check = REMMINA_MONITOR_CHECK_SSH;
+	} else {
+		remmina_public_get_server_port(remmina_file_get_string(remminafile, "server"), default_port, host, port);
+	}
+	if (!*host || (*host)[0] == '\0') {
+		g_free(*host);
+		return FALSE;
+	}
+
+	*key = g_strdup_printf("[%s]:%d/%d", *host, *port, *check);
+	return TRUE;
+}
+
+/* Returns the last known status of the server of remminafile as a newly
+ * allocated string, and probes it again when that status is stale */
+gchar *remmina_monitor_can_reach(RemminaFile *remminafile, RemminaMonitor *monitor)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorResult *result;
+	RemminaMonitorCheck check;
+	gchar *key, *host, *status;
+	gint port;
 
 	if (!remminafile) {
-		status = g_strdup ("I/O Error");
-		REMMINA_DEBUG (status);
+		REMMINA_DEBUG("I/O Error");
 		return NULL;
 	}
 
-	netmonit = remmina_file_get_int(remminafile, "enable-netmonit", FALSE);
+	if (!remmina_file_get_int(remminafile, "enable-netmonit", FALSE)) {
+		REMMINA_DEBUG("Monitoring disabled");
+		return NULL;
+	}
 
-	if (!netmonit) {
-		status = g_strdup ("Monitoring disabled");
-		REMMINA_DEBUG (status);
+	if (!remmina_monitor_probe_target(remminafile, &key, &host, &port, &check))
 		return NULL;
+
+	REMMINA_DEBUG("addr is %s", key);
+	result = g_hash_table_lookup(monitor->results, key);
+	if (monitor->connected &&
+	    (!result || g_get_monotonic_time() - result->checked_at > REMMINA_MONITOR_RESCAN_INTERVAL * G_USEC_PER_SEC)) {
+		REMMINA_DEBUG("Testing for %s", key);
+		remmina_monitor_probe_enqueue(monitor, key, host, port, check, remmina_file_get_filename(remminafile));
+	}
+
+	if (result)
+		status = g_strdup(result->reachable ? "online" : "offline");
+	else
+		status = g_strdup(key);
+
+	g_free(host);
+	g_free(key);
+	return status;
+}
+
+static void remmina_monitor_scan_file(RemminaFile *remminafile, RemminaMonitor *monitor)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitorCheck check;
+	gchar *key, *host;
+	gint port;
+
+	if (!remmina_file_get_int(remminafile, "enable-netmonit", FALSE))
+		return;
+	if (!remmina_monitor_probe_target(remminafile, &key, &host, &port, &check))
+		return;
+
+	remmina_monitor_probe_enqueue(monitor, key, host, port, check, remmina_file_get_filename(remminafile));
+	g_free(host);
+	g_free(key);
+}
+
+static gboolean remmina_monitor_scan(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaMonitor *monitor = (RemminaMonitor *)data;
+	guint interval;
+
+	if (remmina_pref_get_boolean("status_check")) {
+		remmina_network_monitor_status(monitor);
+		if (monitor->connected)
+			remmina_file_manager_iterate((GFunc)remmina_monitor_scan_file, monitor);
 	}
 
-	protocol = remmina_file_get_string (remminafile, "protocol");
-
-	if (protocol && protocol[0] != '\0') {
-		REMMINA_DEBUG ("Evaluating protocol %s for monitoring", protocol);
-		if (g_strcmp0("RDP", protocol) == 0)
-			default_port = 3389;
-		if (g_strcmp0("VNC", protocol) == 0)
-			default_port = 5900;
-		if (g_strcmp0("GVNC", protocol) == 0)
-			default_port = 5900;
-		if (g_strcmp0("SPICE", protocol) == 0)
-			default_port = 5900;
-		if (g_strcmp0("WWW", protocol) == 0)
-			default_port = 443;
-		if (g_strcmp0("X2GO", protocol) == 0)
-			default_port = 22;
-		if (g_strcmp0("SSH", protocol) == 0)
-			default_port = 22;
-		if (g_strcmp0("SFTP", protocol) == 0)
-			default_port = 22;
-		if (g_strcmp0("EXEC", protocol) == 0)
-			default_port = -1;
-
-		if (default_port == 0) {
-			status = g_strdup ("Unknown protocol");
-			REMMINA_DEBUG (status);
-			return NULL;
-		}
-		if (default_port < 0) {
-			status = g_strdup ("Cannot monitor");
-			REMMINA_DEBUG (status);
-			return NULL;
-		}
-
-		ssh_tunnel_server = remmina_file_get_string(remminafile, "ssh_tunnel_server");
-		if (remmina_file_get_int(remminafile, "ssh_tunnel_enabled", FALSE)) {
-			remmina_public_get_server_port(ssh_tunnel_server, 22, &ssh_tunnel_host, &ssh_tunnel_port);
-			monitor->addr = g_network_address_new (ssh_tunnel_host, ssh_tunnel_port);
-			g_free(ssh_tunnel_host), ssh_tunnel_host = NULL;
-		} else {
-			server = remmina_file_get_string(remminafile, "server");
-			remmina_public_get_server_port(server, default_port, &srv_host, &srv_port);
-			monitor->addr = g_network_address_new (srv_host, srv_port);
-			g_free(srv_host), srv_host = NULL;
-		}
-		addr_tostr = g_strdup(g_socket_connectable_to_string (monitor->addr));
-
-		REMMINA_DEBUG ("addr is %s", addr_tostr);
-		if (monitor->connected && netmonit) {
-			REMMINA_DEBUG ("Testing for %s", addr_tostr);
-			g_network_monitor_can_reach_async (
-					monitor->netmonitor,
-					monitor->addr,
-					NULL,
-					(GAsyncReadyCallback) remmina_monitor_can_reach_cb,
-					monitor);
-		}
-
-
-		status = (gchar *)g_hash_table_lookup (monitor->server_status, addr_tostr);
-
-	}
-
-	if (!status) {
-		return g_strdup(addr_tostr);
-	} else
-		return status;
+	interval = REMMINA_MONITOR_RESCAN_INTERVAL + g_random_int_range(0, REMMINA_MONITOR_RESCAN_INTERVAL / 5);
+	monitor->scan_source = g_timeout_add_seconds(interval, remmina_monitor_scan, monitor);
+	return G_SOURCE_REMOVE;
+}
 
+/* Probe all monitored profiles now and then periodically */
+void remmina_monitor_start_scan(RemminaMonitor *monitor)
+{
+	TRACE_CALL(__func__);
+	if (monitor->scan_source)
+		g_source_remove(monitor->scan_source);
+	monitor->scan_source = g_idle_add(remmina_monitor_scan, monitor);
+}
 
+/* Stop the periodic scans, the probes already running complete on their own */
+void remmina_monitor_stop_scan(RemminaMonitor *monitor)
+{
+	TRACE_CALL(__func__);
+	if (monitor->scan_source) {
+		g_source_remove(monitor->scan_source);
+		monitor->scan_source = 0;
+	}
 }
 
 gboolean remmina_network_monitor_status (RemminaMonitor *rm_monitor)
@@ -175,12 +456,6 @@ gboolean remmina_network_monitor_status (RemminaMonitor *rm_monitor)
 
 	gboolean status = g_network_monitor_get_connectivity (rm_monitor->netmonitor);
 
-	rm_monitor->server_status = g_hash_table_new_full(
-			g_str_hash,
-			g_str_equal,
-			(GDestroyNotify)g_free,
-			(GDestroyNotify)g_free);
-
 	switch (status)
 	{
 		case G_NETWORK_CONNECTIVITY_LOCAL:
@@ -212,9 +487,22 @@ RemminaMonitor *remmina_network_monitor_new (void)
 {
 	TRACE_CALL(__func__);
 
+	/* The probes and their cache outlive the main window */
+	if (rm_monitor)
+		return rm_monitor;
+
 	rm_monitor = g_new0(RemminaMonitor, 1);
 
 	rm_monitor->netmonitor = g_network_monitor_get_default ();
 
+	rm_monitor->server_status = g_hash_table_new_full(
+			g_str_hash,
+			g_str_equal,
+			(GDestroyNotify)g_free,
+			(GDestroyNotify)g_free);
+	rm_monitor->results = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	rm_monitor->probes = g_hash_table_new(g_str_hash, g_str_equal);
+	rm_monitor->queue = g_queue_new();
+
 	return rm_monitor;
 }
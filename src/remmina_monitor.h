@@ -43,9 +43,13 @@
 typedef struct _RemminaMonitor {
     GNetworkMonitor *		netmonitor;
     gboolean			connected;
-    GSocketConnectable *	addr;
-    gboolean			reachable;
     GHashTable *		server_status;
+    /* Probe engine: cached results and running or queued probes by service */
+    GHashTable *		results;
+    GHashTable *		probes;
+    GQueue *			queue;
+    guint			active_probes;
+    guint			scan_source;
 } RemminaMonitor;
 
 G_BEGIN_DECLS
@@ -53,5 +57,7 @@ G_BEGIN_DECLS
 gboolean remmina_network_monitor_status (RemminaMonitor *rm_monitor);
 RemminaMonitor *remmina_network_monitor_new (void);
 gchar *remmina_monitor_can_reach(RemminaFile *remminafile, RemminaMonitor *monitor);
+void remmina_monitor_start_scan(RemminaMonitor *monitor);
+void remmina_monitor_stop_scan(RemminaMonitor *monitor);
 
 G_END_DECLS
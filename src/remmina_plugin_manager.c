@@ -40,6 +40,7 @@
 
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <json-glib/json-glib.h>
 #ifdef GDK_WINDOWING_X11
@@ -81,6 +82,14 @@ static GHashTable *encrypted_settings_cache = NULL;
 /* There can be only one secret plugin loaded */
 static RemminaSecretPlugin *remmina_secret_plugin = NULL;
 
+/* Manifest of the plugins registered by each module, see remmina_plugin_manager_register_stubs() */
+static GKeyFile *plugin_manifest = NULL;
+static gboolean plugin_manifest_dirty = FALSE;
+/* Stub RemminaPlugin* -> RemminaPluginModule* still to be opened */
+static GHashTable *plugin_stubs = NULL;
+/* Plugins registered by the module being opened */
+static GPtrArray *plugin_registering = NULL;
+
 
 
 // TRANSLATORS: "Language Wrapper" is a wrapper for plugins written in other programmin languages (Python in this context)
@@ -161,6 +170,21 @@ static gboolean remmina_plugin_manager_register_plugin(RemminaPlugin *plugin)
 	}
 	init_settings_cache(plugin);
 
+	if (plugin_registering)
+		g_ptr_array_add(plugin_registering, plugin);
+
+	/* Take the place of the stub registered from the manifest, if any */
+	if (plugin_stubs) {
+		for (guint i = 0; i < remmina_plugin_table->len; i++) {
+			RemminaPlugin *p = (RemminaPlugin*)g_ptr_array_index(remmina_plugin_table, i);
+			if (p->type == plugin->type && g_strcmp0(p->name, plugin->name) == 0 &&
+			    g_hash_table_contains(plugin_stubs, p)) {
+				remmina_plugin_table->pdata[i] = plugin;
+				return TRUE;
+			}
+		}
+	}
+
 	g_ptr_array_add(remmina_plugin_table, plugin);
 	g_ptr_array_sort(remmina_plugin_table, (GCompareFunc)remmina_plugin_manager_compare_func);
 	return TRUE;
@@ -325,6 +349,9 @@ RemminaPluginService remmina_plugin_manager_service =
 	remmina_main_get_window,
 	remmina_unlock_new,
 	remmina_main_add_network_status,
+	remmina_public_tcp_connect,
+	remmina_protocol_widget_close_connection,
+	remmina_protocol_widget_start_dynamic_tunnel,
 };
 
 static const char *get_filename_ext(const char *filename) {
@@ -348,6 +375,367 @@ static gint compare_secret_plugin_init_order(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
+/* Lazy plugin loading
+ *
+ * Opening every module at startup pulls in FreeRDP, libvncclient, spice-gtk,
+ * WebKitGTK and a Python interpreter even if only SSH is used. Modules whose
+ * plugins are all of a lazy type (see remmina_plugin_manager_type_is_lazy())
+ * are recorded in a manifest the first time they are opened. On later starts
+ * a stub with the cached name, description, icons and encrypted settings is
+ * registered instead, and the module is opened the first time one of its
+ * plugins is really needed. The manifest is keyed by module path, mtime and
+ * size, and is dropped as a whole when the Remmina version changes. */
+
+#define REMMINA_PLUGIN_MANIFEST_GROUP "Manifest"
+
+typedef struct _RemminaPluginModule {
+	gchar *path;
+	GPtrArray *stubs;
+	gboolean opening;
+} RemminaPluginModule;
+
+static gboolean remmina_plugin_manager_type_is_lazy(RemminaPluginType type)
+{
+	switch (type) {
+	case REMMINA_PLUGIN_TYPE_PROTOCOL:
+	case REMMINA_PLUGIN_TYPE_FILE:
+	case REMMINA_PLUGIN_TYPE_PREF:
+	case REMMINA_PLUGIN_TYPE_LANGUAGE_WRAPPER:
+		return TRUE;
+	default:
+		/* Tools, entries and secret plugins are used right at startup */
+		return FALSE;
+	}
+}
+
+static gchar *remmina_plugin_manager_manifest_filename(void)
+{
+	return g_build_path("/", g_get_user_cache_dir(), "remmina", "plugins.manifest", NULL);
+}
+
+static void remmina_plugin_manager_manifest_load(void)
+{
+	TRACE_CALL(__func__);
+	gchar *filename, *version;
+
+	plugin_manifest = g_key_file_new();
+	filename = remmina_plugin_manager_manifest_filename();
+	if (g_key_file_load_from_file(plugin_manifest, filename, G_KEY_FILE_NONE, NULL)) {
+		version = g_key_file_get_string(plugin_manifest, REMMINA_PLUGIN_MANIFEST_GROUP, "version", NULL);
+		if (g_strcmp0(version, VERSION) != 0) {
+			REMMINA_DEBUG("Plugin manifest was written by Remmina %s, discarding it", version);
+			g_key_file_free(plugin_manifest);
+			plugin_manifest = g_key_file_new();
+		}
+		g_free(version);
+	}
+	g_key_file_set_string(plugin_manifest, REMMINA_PLUGIN_MANIFEST_GROUP, "version", VERSION);
+	g_free(filename);
+}
+
+static void remmina_plugin_manager_manifest_save(void)
+{
+	TRACE_CALL(__func__);
+	gchar *filename, *dir;
+	GError *error = NULL;
+
+	if (!plugin_manifest || !plugin_manifest_dirty)
+		return;
+
+	dir = g_build_path("/", g_get_user_cache_dir(), "remmina", NULL);
+	g_mkdir_with_parents(dir, 0750);
+	filename = remmina_plugin_manager_manifest_filename();
+	if (!g_key_file_save_to_file(plugin_manifest, filename, &error)) {
+		REMMINA_WARNING("Could not save the plugin manifest %s: %s", filename, error->message);
+		g_error_free(error);
+	}
+	plugin_manifest_dirty = FALSE;
+	g_free(filename);
+	g_free(dir);
+}
+
+static gboolean remmina_plugin_manager_module_stat(const gchar *path, gint64 *mtime, gint64 *size)
+{
+	GStatBuf st;
+
+	if (g_stat(path, &st) != 0)
+		return FALSE;
+	*mtime = (gint64)st.st_mtime;
+	*size = (gint64)st.st_size;
+	return TRUE;
+}
+
+static void remmina_plugin_manager_manifest_forget(const gchar *path)
+{
+	gchar **names;
+	gchar *group;
+
+	if (!g_key_file_has_group(plugin_manifest, path))
+		return;
+
+	names = g_key_file_get_string_list(plugin_manifest, path, "plugins", NULL, NULL);
+	for (gchar **n = names; n && *n; n++) {
+		group = g_strconcat(path, "#", *n, NULL);
+		g_key_file_remove_group(plugin_manifest, group, NULL);
+		g_free(group);
+	}
+	g_strfreev(names);
+	g_key_file_remove_group(plugin_manifest, path, NULL);
+	plugin_manifest_dirty = TRUE;
+}
+
+/* Records what a module registered when it was opened */
+static void remmina_plugin_manager_manifest_record(const gchar *path, GPtrArray *plugins)
+{
+	TRACE_CALL(__func__);
+	RemminaPlugin *plugin;
+	GHashTable *pht;
+	GPtrArray *names;
+	gchar *group;
+	gint64 mtime, size;
+	gboolean lazy;
+	guint i;
+
+	remmina_plugin_manager_manifest_forget(path);
+	if (!remmina_plugin_manager_module_stat(path, &mtime, &size))
+		return;
+
+	lazy = plugins->len > 0;
+	names = g_ptr_array_new();
+	for (i = 0; i < plugins->len; i++) {
+		plugin = (RemminaPlugin*)g_ptr_array_index(plugins, i);
+		lazy = lazy && remmina_plugin_manager_type_is_lazy(plugin->type);
+		g_ptr_array_add(names, (gpointer)plugin->name);
+
+		group = g_strconcat(path, "#", plugin->name, NULL);
+		g_key_file_set_integer(plugin_manifest, group, "type", plugin->type);
+		g_key_file_set_string(plugin_manifest, group, "description", plugin->description ? plugin->description : "");
+		g_key_file_set_string(plugin_manifest, group, "domain", plugin->domain ? plugin->domain : "");
+		g_key_file_set_string(plugin_manifest, group, "version", plugin->version ? plugin->version : "");
+
+		if (plugin->type == REMMINA_PLUGIN_TYPE_PROTOCOL) {
+			RemminaProtocolPlugin *pp = (RemminaProtocolPlugin*)plugin;
+			GList *keys = NULL;
+
+			g_key_file_set_string(plugin_manifest, group, "icon_name", pp->icon_name ? pp->icon_name : "");
+			g_key_file_set_string(plugin_manifest, group, "icon_name_ssh", pp->icon_name_ssh ? pp->icon_name_ssh : "");
+			g_key_file_set_integer(plugin_manifest, group, "ssh_setting", pp->ssh_setting);
+
+			if (encrypted_settings_cache && (pht = g_hash_table_lookup(encrypted_settings_cache, plugin->name)))
+				keys = g_hash_table_get_keys(pht);
+			GPtrArray *encrypted = g_ptr_array_new();
+			for (GList *k = keys; k; k = k->next)
+				g_ptr_array_add(encrypted, k->data);
+			g_key_file_set_string_list(plugin_manifest, group, "encrypted_settings",
+						   (const gchar * const *)encrypted->pdata, encrypted->len);
+			g_ptr_array_free(encrypted, TRUE);
+			g_list_free(keys);
+		} else if (plugin->type == REMMINA_PLUGIN_TYPE_LANGUAGE_WRAPPER) {
+			RemminaLanguageWrapperPlugin *wp = (RemminaLanguageWrapperPlugin*)plugin;
+			if (wp->supported_extensions)
+				g_key_file_set_string_list(plugin_manifest, group, "supported_extensions",
+							   wp->supported_extensions, g_strv_length((gchar **)wp->supported_extensions));
+		}
+		g_free(group);
+	}
+
+	g_key_file_set_int64(plugin_manifest, path, "mtime", mtime);
+	g_key_file_set_int64(plugin_manifest, path, "size", size);
+	g_key_file_set_boolean(plugin_manifest, path, "lazy", lazy);
+	g_key_file_set_string_list(plugin_manifest, path, "plugins", (const gchar * const *)names->pdata, names->len);
+	g_ptr_array_free(names, TRUE);
+	plugin_manifest_dirty = TRUE;
+}
+
+static RemminaPlugin *remmina_plugin_manager_new_stub(GKeyFile *kf, const gchar *group, const gchar *name)
+{
+	RemminaPluginType type;
+	RemminaPlugin *plugin;
+	GError *error = NULL;
+
+	type = g_key_file_get_integer(kf, group, "type", &error);
+	if (error) {
+		g_error_free(error);
+		return NULL;
+	}
+
+	switch (type) {
+	case REMMINA_PLUGIN_TYPE_PROTOCOL: {
+		RemminaProtocolPlugin *pp = g_new0(RemminaProtocolPlugin, 1);
+		pp->icon_name = g_key_file_get_string(kf, group, "icon_name", NULL);
+		pp->icon_name_ssh = g_key_file_get_string(kf, group, "icon_name_ssh", NULL);
+		pp->ssh_setting = g_key_file_get_integer(kf, group, "ssh_setting", NULL);
+		plugin = (RemminaPlugin*)pp;
+		break;
+	}
+	case REMMINA_PLUGIN_TYPE_FILE:
+		plugin = (RemminaPlugin*)g_new0(RemminaFilePlugin, 1);
+		break;
+	case REMMINA_PLUGIN_TYPE_PREF:
+		plugin = (RemminaPlugin*)g_new0(RemminaPrefPlugin, 1);
+		break;
+	case REMMINA_PLUGIN_TYPE_LANGUAGE_WRAPPER: {
+		RemminaLanguageWrapperPlugin *wp = g_new0(RemminaLanguageWrapperPlugin, 1);
+		wp->supported_extensions = (const gchar **)g_key_file_get_string_list(kf, group, "supported_extensions", NULL, NULL);
+		plugin = (RemminaPlugin*)wp;
+		break;
+	}
+	default:
+		return NULL;
+	}
+
+	plugin->type = type;
+	plugin->name = g_strdup(name);
+	plugin->description = g_key_file_get_string(kf, group, "description", NULL);
+	plugin->domain = g_key_file_get_string(kf, group, "domain", NULL);
+	plugin->version = g_key_file_get_string(kf, group, "version", NULL);
+	return plugin;
+}
+
+/* Registers stubs for a module known to the manifest instead of opening it.
+ * @returns FALSE if the module has to be opened now. */
+static gboolean remmina_plugin_manager_register_stubs(const gchar *path)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginModule *module;
+	RemminaPlugin *stub;
+	GHashTable *pht;
+	gchar **names, **encrypted;
+	gchar *group;
+	gint64 mtime, size;
+	guint i;
+
+	if (!plugin_manifest || !g_key_file_has_group(plugin_manifest, path))
+		return FALSE;
+	if (!g_key_file_get_boolean(plugin_manifest, path, "lazy", NULL))
+		return FALSE;
+	if (!remmina_plugin_manager_module_stat(path, &mtime, &size) ||
+	    g_key_file_get_int64(plugin_manifest, path, "mtime", NULL) != mtime ||
+	    g_key_file_get_int64(plugin_manifest, path, "size", NULL) != size)
+		return FALSE;
+
+	names = g_key_file_get_string_list(plugin_manifest, path, "plugins", NULL, NULL);
+	if (!names || !names[0]) {
+		g_strfreev(names);
+		return FALSE;
+	}
+
+	module = g_new0(RemminaPluginModule, 1);
+	module->path = g_strdup(path);
+	module->stubs = g_ptr_array_new();
+	for (i = 0; names[i]; i++) {
+		group = g_strconcat(path, "#", names[i], NULL);
+		stub = remmina_plugin_manager_new_stub(plugin_manifest, group, names[i]);
+		if (stub && stub->type == REMMINA_PLUGIN_TYPE_PROTOCOL) {
+			encrypted = g_key_file_get_string_list(plugin_manifest, group, "encrypted_settings", NULL, NULL);
+			if (encrypted_settings_cache == NULL)
+				encrypted_settings_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, htdestroy);
+			if (!(pht = g_hash_table_lookup(encrypted_settings_cache, stub->name))) {
+				pht = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+				g_hash_table_insert(encrypted_settings_cache, g_strdup(stub->name), pht);
+			}
+			for (gchar **e = encrypted; e && *e; e++)
+				g_hash_table_insert(pht, g_strdup(*e), (gpointer)TRUE);
+			g_strfreev(encrypted);
+		}
+		g_free(group);
+		if (!stub) {
+			/* Incomplete entry: forget it and open the module */
+			REMMINA_DEBUG("Plugin manifest entry for %s is incomplete", path);
+			remmina_plugin_manager_manifest_forget(path);
+			g_ptr_array_free(module->stubs, TRUE);
+			g_free(module->path);
+			g_free(module);
+			g_strfreev(names);
+			return FALSE;
+		}
+		g_ptr_array_add(module->stubs, stub);
+	}
+	g_strfreev(names);
+
+	if (plugin_stubs == NULL)
+		plugin_stubs = g_hash_table_new(NULL, NULL);
+	for (i = 0; i < module->stubs->len; i++) {
+		stub = (RemminaPlugin*)g_ptr_array_index(module->stubs, i);
+		g_hash_table_insert(plugin_stubs, stub, module);
+		g_ptr_array_add(remmina_plugin_table, stub);
+	}
+	g_ptr_array_sort(remmina_plugin_table, (GCompareFunc)remmina_plugin_manager_compare_func);
+
+	REMMINA_DEBUG("Deferred loading of %s", path);
+	return TRUE;
+}
+
+/* Opens a module and records what it registers in the manifest */
+static gboolean remmina_plugin_manager_open_module(const gchar *path)
+{
+	TRACE_CALL(__func__);
+	gboolean ret;
+
+	plugin_registering = g_ptr_array_new();
+	ret = remmina_plugin_native_load(&remmina_plugin_manager_service, path);
+	if (ret && plugin_manifest)
+		remmina_plugin_manager_manifest_record(path, plugin_registering);
+	else if (plugin_manifest)
+		remmina_plugin_manager_manifest_forget(path);
+	g_ptr_array_free(plugin_registering, TRUE);
+	plugin_registering = NULL;
+
+	return ret;
+}
+
+/* Opens the module behind a stub. Its plugins take the place of its stubs */
+static void remmina_plugin_manager_load_stub(RemminaPlugin *stub)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginModule *module;
+	RemminaPlugin *p;
+	guint i;
+
+	if (!plugin_stubs || !(module = g_hash_table_lookup(plugin_stubs, stub)) || module->opening)
+		return;
+
+	REMMINA_DEBUG("Loading %s on demand for plugin %s", module->path, stub->name);
+	module->opening = TRUE;
+	remmina_plugin_manager_open_module(module->path);
+
+	/* Stubs not replaced by the real plugins go away. They are not freed,
+	 * their strings may still be referenced. */
+	for (i = 0; i < module->stubs->len; i++) {
+		p = (RemminaPlugin*)g_ptr_array_index(module->stubs, i);
+		g_hash_table_remove(plugin_stubs, p);
+		if (g_ptr_array_remove(remmina_plugin_table, p))
+			REMMINA_WARNING("Plugin %s is no longer provided by %s", p->name, module->path);
+	}
+	g_ptr_array_free(module->stubs, TRUE);
+	g_free(module->path);
+	g_free(module);
+
+	remmina_plugin_manager_manifest_save();
+}
+
+static void remmina_plugin_manager_load_stubs_of_type(RemminaPluginType type)
+{
+	TRACE_CALL(__func__);
+	RemminaPlugin *plugin;
+	GPtrArray *stubs;
+	guint i;
+
+	if (!plugin_stubs || g_hash_table_size(plugin_stubs) == 0)
+		return;
+
+	/* Loading modifies remmina_plugin_table, collect the stubs first */
+	stubs = g_ptr_array_new();
+	for (i = 0; i < remmina_plugin_table->len; i++) {
+		plugin = (RemminaPlugin*)g_ptr_array_index(remmina_plugin_table, i);
+		if (plugin->type == type && g_hash_table_contains(plugin_stubs, plugin))
+			g_ptr_array_add(stubs, plugin);
+	}
+	for (i = 0; i < stubs->len; i++)
+		remmina_plugin_manager_load_stub((RemminaPlugin*)g_ptr_array_index(stubs, i));
+	g_ptr_array_free(stubs, TRUE);
+}
+
 static gchar* remmina_plugin_manager_create_alt_plugin_dir(void)
 {
 	gchar *plugin_dir;
@@ -405,7 +793,8 @@ static void remmina_plugin_manager_load_plugins(GPtrArray *plugin_dirs, int arra
 					continue;
 				}
 				if (!g_ptr_array_find_with_equal_func(loaded_plugins, name, g_str_equal, NULL)){
-					if (remmina_plugin_native_load(&remmina_plugin_manager_service, fullpath)){
+					if (remmina_plugin_manager_register_stubs(fullpath) ||
+					    remmina_plugin_manager_open_module(fullpath)){
 						g_ptr_array_add(loaded_plugins, g_strdup(name));
 					}
 				}
@@ -417,6 +806,10 @@ static void remmina_plugin_manager_load_plugins(GPtrArray *plugin_dirs, int arra
 	}
 	
 
+	/* Language wrappers are needed only if there is something to wrap */
+	if (alternative_language_plugins->len > 0)
+		remmina_plugin_manager_load_stubs_of_type(REMMINA_PLUGIN_TYPE_LANGUAGE_WRAPPER);
+
 	while (alternative_language_plugins->len > 0) {
 		gboolean has_loaded = FALSE;
 		gchar* name = (gchar*)g_ptr_array_remove_index(alternative_language_plugins, 0);
@@ -457,6 +850,8 @@ static void remmina_plugin_manager_load_plugins(GPtrArray *plugin_dirs, int arra
 		g_free(name);
 	}
 
+	remmina_plugin_manager_manifest_save();
+
 	if (reload == TRUE){
 		g_ptr_array_free(alternative_language_plugins, TRUE);
 		return;
@@ -508,6 +903,7 @@ void remmina_plugin_manager_init(void)
 		return;
 	}
 	alternative_dir = remmina_plugin_manager_create_alt_plugin_dir();
+	remmina_plugin_manager_manifest_load();
 
 	if(alternative_dir != NULL){
 		g_ptr_array_add(plugin_dirs, alternative_dir);
@@ -678,7 +1074,11 @@ gboolean remmina_plugin_manager_loader_supported(const char *filetype) {
 	return g_str_equal(G_MODULE_SUFFIX, filetype);
 }
 
-RemminaPlugin* remmina_plugin_manager_get_plugin(RemminaPluginType type, const gchar *name)
+/* Like remmina_plugin_manager_get_plugin(), but may return a stub of a plugin
+ * whose module has not been opened yet. Only type, name, description, domain,
+ * version, icon names and ssh_setting of a stub are valid, together with
+ * remmina_plugin_manager_is_encrypted_setting(). */
+RemminaPlugin* remmina_plugin_manager_peek_plugin(RemminaPluginType type, const gchar *name)
 {
 	TRACE_CALL(__func__);
 	RemminaPlugin *plugin;
@@ -693,6 +1093,19 @@ RemminaPlugin* remmina_plugin_manager_get_plugin(RemminaPluginType type, const g
 	return NULL;
 }
 
+RemminaPlugin* remmina_plugin_manager_get_plugin(RemminaPluginType type, const gchar *name)
+{
+	TRACE_CALL(__func__);
+	RemminaPlugin *plugin;
+
+	plugin = remmina_plugin_manager_peek_plugin(type, name);
+	if (plugin && plugin_stubs && g_hash_table_contains(plugin_stubs, plugin)) {
+		remmina_plugin_manager_load_stub(plugin);
+		plugin = remmina_plugin_manager_peek_plugin(type, name);
+	}
+	return plugin;
+}
+
 const gchar *remmina_plugin_manager_get_canonical_setting_name(const RemminaProtocolSetting* setting)
 {
 	if (setting->name == NULL) {
@@ -715,6 +1128,10 @@ void remmina_plugin_manager_for_each_plugin(RemminaPluginType type, RemminaPlugi
 	RemminaPlugin *plugin;
 	guint i;
 
+	/* Protocol stubs are enough to list protocols, other callers use the plugin */
+	if (type != REMMINA_PLUGIN_TYPE_PROTOCOL)
+		remmina_plugin_manager_load_stubs_of_type(type);
+
 	for (i = 0; i < remmina_plugin_table->len; i++) {
 		plugin = (RemminaPlugin*)g_ptr_array_index(remmina_plugin_table, i);
 		if (plugin->type == type) {
@@ -1509,6 +1926,8 @@ RemminaFilePlugin* remmina_plugin_manager_get_import_file_handler(const gchar *f
 	RemminaFilePlugin *plugin;
 	gsize i;
 
+	remmina_plugin_manager_load_stubs_of_type(REMMINA_PLUGIN_TYPE_FILE);
+
 	for (i = 0; i < remmina_plugin_table->len; i++) {
 		plugin = (RemminaFilePlugin*)g_ptr_array_index(remmina_plugin_table, i);
 
@@ -1528,6 +1947,8 @@ RemminaFilePlugin* remmina_plugin_manager_get_export_file_handler(RemminaFile *r
 	RemminaFilePlugin *plugin;
 	guint i;
 
+	remmina_plugin_manager_load_stubs_of_type(REMMINA_PLUGIN_TYPE_FILE);
+
 	for (i = 0; i < remmina_plugin_table->len; i++) {
 		plugin = (RemminaFilePlugin*)g_ptr_array_index(remmina_plugin_table, i);
 		if (plugin->type != REMMINA_PLUGIN_TYPE_FILE)
@@ -59,6 +59,7 @@ typedef gboolean (*RemminaPluginFunc)(gchar *name, RemminaPlugin *plugin, gpoint
 void remmina_plugin_manager_init(void);
 JsonNode *remmina_plugin_manager_get_installed_plugins(void);
 RemminaPlugin *remmina_plugin_manager_get_plugin(RemminaPluginType type, const gchar *name);
+RemminaPlugin *remmina_plugin_manager_peek_plugin(RemminaPluginType type, const gchar *name);
 gboolean remmina_plugin_manager_query_feature_by_type(RemminaPluginType ptype, const gchar *name, RemminaProtocolFeatureType ftype);
 void remmina_plugin_manager_for_each_plugin(RemminaPluginType type, RemminaPluginFunc func, gpointer data);
 void remmina_plugin_manager_show(GtkWindow *parent);
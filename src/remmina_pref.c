@@ -555,6 +555,21 @@ void remmina_pref_init(void)
 	else
 		remmina_pref.screenshot_name = g_strdup("remmina_%p_%h_%Y%m%d-%H%M%S");
 
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "screenshot_format", NULL))
+		remmina_pref.screenshot_format = g_key_file_get_string(gkeyfile, "remmina_pref", "screenshot_format", NULL);
+	else
+		remmina_pref.screenshot_format = g_strdup(DEFAULT_SCREENSHOT_FORMAT);
+
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "screenshot_png_compression", NULL))
+		remmina_pref.screenshot_png_compression = g_key_file_get_integer(gkeyfile, "remmina_pref", "screenshot_png_compression", NULL);
+	else
+		remmina_pref.screenshot_png_compression = DEFAULT_SCREENSHOT_PNG_COMPRESSION;
+
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "screenshot_jpeg_quality", NULL))
+		remmina_pref.screenshot_jpeg_quality = g_key_file_get_integer(gkeyfile, "remmina_pref", "screenshot_jpeg_quality", NULL);
+	else
+		remmina_pref.screenshot_jpeg_quality = DEFAULT_SCREENSHOT_JPEG_QUALITY;
+
 	if (g_key_file_has_key(gkeyfile, "remmina_pref", "ssh_parseconfig", NULL))
 		remmina_pref.ssh_parseconfig = g_key_file_get_boolean(gkeyfile, "remmina_pref", "ssh_parseconfig", NULL);
 	else
@@ -585,6 +600,11 @@ void remmina_pref_init(void)
 	else
 		remmina_pref.ssh_tcp_usrtimeout = SSH_SOCKET_TCP_USER_TIMEOUT;
 
+	if (g_key_file_has_key(gkeyfile, "remmina_pref", "ssh_session_reuse_timeout", NULL))
+		remmina_pref.ssh_session_reuse_timeout = g_key_file_get_integer(gkeyfile, "remmina_pref", "ssh_session_reuse_timeout", NULL);
+	else
+		remmina_pref.ssh_session_reuse_timeout = DEFAULT_SSH_SESSION_REUSE_TIMEOUT;
+
 	if (g_key_file_has_key(gkeyfile, "remmina_pref", "applet_new_ontop", NULL))
 		remmina_pref.applet_new_ontop = g_key_file_get_boolean(gkeyfile, "remmina_pref", "applet_new_ontop", NULL);
 	else
@@ -932,6 +952,9 @@ gboolean remmina_pref_save(void)
 	g_key_file_set_string(gkeyfile, "remmina_pref", "screenshot_path", remmina_pref.screenshot_path);
 	g_key_file_set_string(gkeyfile, "remmina_pref", "screenshot_name", remmina_pref.screenshot_name);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "deny_screenshot_clipboard", remmina_pref.deny_screenshot_clipboard);
+	g_key_file_set_string(gkeyfile, "remmina_pref", "screenshot_format", remmina_pref.screenshot_format);
+	g_key_file_set_integer(gkeyfile, "remmina_pref", "screenshot_png_compression", remmina_pref.screenshot_png_compression);
+	g_key_file_set_integer(gkeyfile, "remmina_pref", "screenshot_jpeg_quality", remmina_pref.screenshot_jpeg_quality);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "save_view_mode", remmina_pref.save_view_mode);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "confirm_close", remmina_pref.confirm_close);
 	if (g_key_file_remove_key(gkeyfile, "remmina_pref", "use_master_password", NULL))
@@ -991,6 +1014,7 @@ gboolean remmina_pref_save(void)
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_keepintvl", remmina_pref.ssh_tcp_keepintvl);
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_keepcnt", remmina_pref.ssh_tcp_keepcnt);
 	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_tcp_usrtimeout", remmina_pref.ssh_tcp_usrtimeout);
+	g_key_file_set_integer(gkeyfile, "remmina_pref", "ssh_session_reuse_timeout", remmina_pref.ssh_session_reuse_timeout);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_new_ontop", remmina_pref.applet_new_ontop);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_hide_count", remmina_pref.applet_hide_count);
 	g_key_file_set_boolean(gkeyfile, "remmina_pref", "applet_enable_avahi", remmina_pref.applet_enable_avahi);
@@ -181,6 +181,7 @@ typedef struct _RemminaPref {
 	gint			ssh_tcp_keepintvl;
 	gint			ssh_tcp_keepcnt;
 	gint			ssh_tcp_usrtimeout;
+	gint			ssh_session_reuse_timeout;
 	/* In RemminaPrefDialog keyboard tab */
 	guint			hostkey;
 	guint			shortcutkey_fullscreen;
@@ -258,6 +259,11 @@ typedef struct _RemminaPref {
 
 	gboolean 		disable_tip;
 
+	/* Screenshot encoding, not in RemminaPrefDialog */
+	gchar *			screenshot_format;
+	gint			screenshot_png_compression;
+	gint			screenshot_jpeg_quality;
+
 } RemminaPref;
 
 #define DEFAULT_SSH_PARSECONFIG TRUE
@@ -268,6 +274,10 @@ typedef struct _RemminaPref {
 #define SSH_SOCKET_TCP_KEEPINTVL 10
 #define SSH_SOCKET_TCP_KEEPCNT 3
 #define SSH_SOCKET_TCP_USER_TIMEOUT 60000 // 60 seconds
+#define DEFAULT_SSH_SESSION_REUSE_TIMEOUT 60 // seconds, 0 disables reuse
+#define DEFAULT_SCREENSHOT_FORMAT "png"
+#define DEFAULT_SCREENSHOT_PNG_COMPRESSION 6
+#define DEFAULT_SCREENSHOT_JPEG_QUALITY 90
 
 extern const gchar *default_resolutions;
 extern gchar *remmina_pref_file;
@@ -162,7 +162,7 @@ static void remmina_protocol_widget_close_all_tunnels(RemminaProtocolWidget *gp)
 	if (gp->priv && gp->priv->ssh_tunnels) {
 		for (i = 0; i < gp->priv->ssh_tunnels->len; i++) {
 #ifdef HAVE_LIBSSH
-			remmina_ssh_tunnel_free((RemminaSSHTunnel *)gp->priv->ssh_tunnels->pdata[i]);
+			remmina_ssh_tunnel_release((RemminaSSHTunnel *)gp->priv->ssh_tunnels->pdata[i], gp);
 #else
 			REMMINA_DEBUG("LibSSH support turned off, no need to free SSH tunnel data");
 #endif
@@ -407,7 +407,7 @@ static gboolean conn_opened(gpointer data)
 #ifdef HAVE_LIBSSH
 	if (gp->priv->ssh_tunnels) {
 		for (guint i = 0; i < gp->priv->ssh_tunnels->len; i++)
-			remmina_ssh_tunnel_cancel_accept((RemminaSSHTunnel *)gp->priv->ssh_tunnels->pdata[i]);
+			remmina_ssh_tunnel_cancel_accept((RemminaSSHTunnel *)gp->priv->ssh_tunnels->pdata[i], gp);
 	}
 #endif
 	if (gp->priv->listen_message_panel) {
@@ -1084,7 +1084,7 @@ static gboolean remmina_protocol_widget_tunnel_destroy(RemminaSSHTunnel *tunnel,
 	if (found) {
 #ifdef HAVE_LIBSSH
 		REMMINA_DEBUG("[Tunnel with idx %u has been disconnected", idx);
-		remmina_ssh_tunnel_free(tunnel);
+		remmina_ssh_tunnel_release(tunnel, gp);
 #endif
 		g_ptr_array_remove(gp->priv->ssh_tunnels, tunnel);
 	}
@@ -1131,6 +1131,7 @@ gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 	gchar *msg;
 	RemminaMessagePanel *mp;
 	RemminaSSHTunnel *tunnel;
+	gint local_port = remmina_pref.sshtunnel_port;
 
 	if (!remmina_file_get_int(gp->priv->remmina_file, "ssh_tunnel_enabled", FALSE)) {
 		dest = g_strdup_printf("[%s]:%i", srv_host, srv_port);
@@ -1139,6 +1140,28 @@ gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 		return dest;
 	}
 
+	if (remmina_file_get_int(gp->priv->remmina_file, "ssh_tunnel_loopback", FALSE)) {
+		g_free(srv_host);
+		g_free(ssh_tunnel_host);
+		ssh_tunnel_host = NULL;
+		srv_host = g_strdup("127.0.0.1");
+	}
+
+	const gchar* tunnel_command = remmina_file_get_string(gp->priv->remmina_file, "ssh_tunnel_command");
+
+	/* Another connection may already be authenticated to the same SSH server.
+	 * Its session is pumped by the tunnel thread, so a startup command, which
+	 * needs a channel of its own, gets a tunnel of its own as well */
+	if (tunnel_command == NULL) {
+		tunnel = remmina_ssh_tunnel_attach(gp->priv->remmina_file, srv_host, srv_port, (gpointer)gp, &local_port);
+		if (tunnel) {
+			g_free(srv_host);
+			g_free(ssh_tunnel_host);
+			g_ptr_array_add(gp->priv->ssh_tunnels, tunnel);
+			return g_strdup_printf("127.0.0.1:%i", local_port);
+		}
+	}
+
 	tunnel = remmina_protocol_widget_init_tunnel(gp);
 	if (!tunnel) {
 		g_free(srv_host);
@@ -1153,15 +1176,8 @@ gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 	mp = remmina_protocol_widget_mpprogress(gp->cnnobj, msg, cancel_start_direct_tunnel_cb, NULL);
 	g_free(msg);
 
-	if (remmina_file_get_int(gp->priv->remmina_file, "ssh_tunnel_loopback", FALSE)) {
-		g_free(srv_host);
-		g_free(ssh_tunnel_host);
-		ssh_tunnel_host = NULL;
-		srv_host = g_strdup("127.0.0.1");
-	}
-
 	REMMINA_DEBUG("Starting tunnel to: %s, port: %d", ssh_tunnel_host, ssh_tunnel_port);
-	if (!remmina_ssh_tunnel_open(tunnel, srv_host, srv_port, remmina_pref.sshtunnel_port)) {
+	if (!remmina_ssh_tunnel_open(tunnel, srv_host, srv_port, local_port)) {
 		g_free(srv_host);
 		g_free(ssh_tunnel_host);
 		remmina_protocol_widget_set_error(gp, REMMINA_SSH(tunnel)->error);
@@ -1178,27 +1194,27 @@ gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 
 	g_ptr_array_add(gp->priv->ssh_tunnels, tunnel);
 
-
 	//try startup command
 	ssh_channel channel;
 	int rc;
-	const gchar* tunnel_command = remmina_file_get_string(gp->priv->remmina_file, "ssh_tunnel_command");
 	if (tunnel_command != NULL){
+		/* The tunnel thread does not touch the session until the first
+		 * local connection, and nobody else can attach to it yet */
 		channel = ssh_channel_new(REMMINA_SSH(tunnel)->session);
-		if (channel == NULL) return g_strdup_printf("127.0.0.1:%i", remmina_pref.sshtunnel_port);
+		if (channel == NULL) return g_strdup_printf("127.0.0.1:%i", local_port);
 
 		rc = ssh_channel_open_session(channel);
 		if (rc != SSH_OK)
 		{
 			ssh_channel_free(channel);
-			return g_strdup_printf("127.0.0.1:%i", remmina_pref.sshtunnel_port);
+			return g_strdup_printf("127.0.0.1:%i", local_port);
 		}
 		rc = ssh_channel_request_exec(channel, tunnel_command);
 		if (rc != SSH_OK)
 		{
 			ssh_channel_close(channel);
 			ssh_channel_free(channel);
-			return g_strdup_printf("127.0.0.1:%i", remmina_pref.sshtunnel_port);
+			return g_strdup_printf("127.0.0.1:%i", local_port);
 		}
 		struct timeval timeout = {10, 0};
 		ssh_channel channels[2];
@@ -1213,10 +1229,13 @@ gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gi
 		REMMINA_DEBUG("Ran startup command");
 		ssh_channel_close(channel);
 		ssh_channel_free(channel);
+	} else {
+		/* Only tunnels without a startup command are shared, see above */
+		remmina_ssh_tunnel_register(tunnel, (gpointer)gp);
 	}
 
 
-	return g_strdup_printf("127.0.0.1:%i", remmina_pref.sshtunnel_port);
+	return g_strdup_printf("127.0.0.1:%i", local_port);
 
 #else
 
@@ -1267,6 +1286,39 @@ gboolean remmina_protocol_widget_start_reverse_tunnel(RemminaProtocolWidget *gp,
 	return TRUE;
 }
 
+gboolean remmina_protocol_widget_start_dynamic_tunnel(RemminaProtocolWidget *gp, gint *local_port)
+{
+	TRACE_CALL(__func__);
+#ifdef HAVE_LIBSSH
+	RemminaSSHTunnel *tunnel;
+#endif
+
+	*local_port = 0;
+
+#ifdef HAVE_LIBSSH
+	if (!remmina_file_get_int(gp->priv->remmina_file, "ssh_tunnel_enabled", FALSE))
+		return TRUE;
+
+	if (!(tunnel = remmina_protocol_widget_init_tunnel(gp)))
+		return FALSE;
+
+	/* Any free port will do, the plugin points its proxy to it */
+	if (!remmina_ssh_tunnel_dynamic(tunnel, 0)) {
+		remmina_protocol_widget_set_error(gp, REMMINA_SSH(tunnel)->error);
+		remmina_ssh_tunnel_free(tunnel);
+		return FALSE;
+	}
+
+	tunnel->destroy_func = remmina_protocol_widget_tunnel_destroy;
+	tunnel->destroy_func_callback_data = (gpointer)gp;
+	g_ptr_array_add(gp->priv->ssh_tunnels, tunnel);
+
+	*local_port = tunnel->localport;
+#endif
+
+	return TRUE;
+}
+
 gboolean remmina_protocol_widget_ssh_exec(RemminaProtocolWidget *gp, gboolean wait, const gchar *fmt, ...)
 {
 	TRACE_CALL(__func__);
@@ -131,6 +131,9 @@ gboolean remmina_protocol_widget_ssh_exec(RemminaProtocolWidget *gp, gboolean wa
 gchar *remmina_protocol_widget_start_direct_tunnel(RemminaProtocolWidget *gp, gint default_port, gboolean port_plus);
 
 gboolean remmina_protocol_widget_start_reverse_tunnel(RemminaProtocolWidget *gp, gint local_port);
+/* Serve a SOCKS5 proxy through the SSH tunnel of the profile, if enabled.
+ * local_port is set to its port, or to 0 when there is no tunnel */
+gboolean remmina_protocol_widget_start_dynamic_tunnel(RemminaProtocolWidget *gp, gint *local_port);
 gboolean remmina_protocol_widget_start_xport_tunnel(RemminaProtocolWidget *gp, RemminaXPortTunnelInitFunc init_func);
 void remmina_protocol_widget_set_display(RemminaProtocolWidget *gp, gint display);
 
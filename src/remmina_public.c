@@ -38,6 +38,8 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -362,6 +364,155 @@ gint remmina_public_open_unix_sock(const char *unixsock)
     return fd;
 }
 
+/* RFC 8305 recommends 250 ms between two connection attempts */
+#define REMMINA_CONNECT_ATTEMPT_DELAY 250
+#define REMMINA_CONNECT_MAX_ATTEMPTS 16
+
+/* Order the addresses returned by getaddrinfo() alternating the address
+ * families, starting with the family of the first (preferred) address */
+static gint remmina_public_interleave_addrinfo(struct addrinfo *aitop, struct addrinfo **ordered, gint max)
+{
+	TRACE_CALL(__func__);
+	struct addrinfo *ai, *first[REMMINA_CONNECT_MAX_ATTEMPTS], *other[REMMINA_CONNECT_MAX_ATTEMPTS];
+	gint nfirst = 0, nother = 0, n = 0, i;
+
+	for (ai = aitop; ai; ai = ai->ai_next) {
+		if (ai->ai_family == aitop->ai_family) {
+			if (nfirst < max)
+				first[nfirst++] = ai;
+		} else if (nother < max) {
+			other[nother++] = ai;
+		}
+	}
+	for (i = 0; n < max && (i < nfirst || i < nother); i++) {
+		if (i < nfirst)
+			ordered[n++] = first[i];
+		if (i < nother && n < max)
+			ordered[n++] = other[i];
+	}
+	return n;
+}
+
+gint remmina_public_tcp_connect(const gchar *host, gint port, gint timeout_ms, gchar **error)
+{
+	TRACE_CALL(__func__);
+	struct addrinfo hints, *aitop;
+	struct addrinfo *ordered[REMMINA_CONNECT_MAX_ATTEMPTS];
+	struct pollfd pfd[REMMINA_CONNECT_MAX_ATTEMPTS];
+	gchar service[16];
+	gchar ipstr[NI_MAXHOST];
+	gint naddr, next, npending, i, rc, fd, flags, so_error, wait;
+	gint last_errno = ETIMEDOUT;
+	gint64 deadline, next_attempt, now;
+	socklen_t len;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_ADDRCONFIG;
+	g_snprintf(service, sizeof(service), "%d", port);
+	if ((rc = getaddrinfo(host, service, &hints, &aitop)) != 0) {
+		if (error)
+			*error = g_strdup_printf(_("Could not resolve hostname %s: %s"), host, gai_strerror(rc));
+		return -1;
+	}
+
+	naddr = remmina_public_interleave_addrinfo(aitop, ordered, REMMINA_CONNECT_MAX_ATTEMPTS);
+	deadline = timeout_ms > 0 ? g_get_monotonic_time() + (gint64)timeout_ms * 1000 : 0;
+	next_attempt = 0;
+	next = 0;
+	npending = 0;
+	fd = -1;
+
+	while (fd < 0 && (next < naddr || npending > 0)) {
+		now = g_get_monotonic_time();
+		if (deadline && now >= deadline)
+			break;
+
+		/* Start the next attempt when the previous one had its head start,
+		 * or right away when nothing else is pending */
+		if (next < naddr && (npending == 0 || now >= next_attempt)) {
+			struct addrinfo *ai = ordered[next++];
+			gint s;
+
+			getnameinfo(ai->ai_addr, ai->ai_addrlen, ipstr, sizeof(ipstr), NULL, 0, NI_NUMERICHOST);
+			s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+			if (s < 0) {
+				last_errno = errno;
+				continue;
+			}
+			fcntl(s, F_SETFD, FD_CLOEXEC);
+			flags = fcntl(s, F_GETFL, 0);
+			fcntl(s, F_SETFL, flags | O_NONBLOCK);
+			g_debug("Connecting to %s port %d", ipstr, port);
+			if (connect(s, ai->ai_addr, ai->ai_addrlen) == 0) {
+				fd = s;
+				break;
+			}
+			if (errno != EINPROGRESS) {
+				last_errno = errno;
+				close(s);
+				continue;
+			}
+			pfd[npending].fd = s;
+			pfd[npending].events = POLLOUT;
+			pfd[npending].revents = 0;
+			npending++;
+			next_attempt = now + REMMINA_CONNECT_ATTEMPT_DELAY * 1000;
+		}
+
+		if (next < naddr)
+			wait = (gint)MAX((next_attempt - now) / 1000, 0);
+		else
+			wait = -1;
+		if (deadline) {
+			gint left = (gint)MAX((deadline - now) / 1000, 0);
+			if (wait < 0 || left < wait)
+				wait = left;
+		}
+
+		rc = poll(pfd, npending, wait);
+		if (rc < 0 && errno != EINTR) {
+			last_errno = errno;
+			break;
+		}
+		for (i = 0; rc > 0 && i < npending; i++) {
+			if (!pfd[i].revents)
+				continue;
+			so_error = 0;
+			len = sizeof(so_error);
+			if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0)
+				so_error = errno;
+			if (so_error == 0) {
+				fd = pfd[i].fd;
+				pfd[i] = pfd[--npending];
+				break;
+			}
+			/* This one failed, give the next address its chance now */
+			last_errno = so_error;
+			close(pfd[i].fd);
+			pfd[i] = pfd[--npending];
+			next_attempt = 0;
+			i--;
+		}
+	}
+
+	/* The losers of the race */
+	for (i = 0; i < npending; i++)
+		close(pfd[i].fd);
+	freeaddrinfo(aitop);
+
+	if (fd < 0) {
+		if (error)
+			*error = g_strdup_printf(_("Could not connect to %s:%d. %s"), host, port, g_strerror(last_errno));
+		return -1;
+	}
+
+	flags = fcntl(fd, F_GETFL, 0);
+	fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+	return fd;
+}
+
 void remmina_public_get_server_port_old(const gchar *server, gint defaultport, gchar **host, gint *port)
 {
 	TRACE_CALL(__func__);
@@ -95,6 +95,16 @@ gchar *remmina_public_combine_path(const gchar *path1, const gchar *path2);
  * */
 gint remmina_public_open_unix_sock(const char *unixsock);
 
+/**
+ * Connect a TCP socket to host:port, racing the IPv6 and IPv4 addresses of
+ * host as described in RFC 8305 (Happy Eyeballs v2)
+ * @param timeout_ms overall deadline, 0 or less to rely on the kernel timeouts
+ * @param error if not NULL, set to a newly allocated message on failure
+ * @return a connected, blocking file descriptor (socket) or -1
+ *
+ * */
+gint remmina_public_tcp_connect(const gchar *host, gint port, gint timeout_ms, gchar **error);
+
 /* Parse a server entry with server name and port */
 void remmina_public_get_server_port_old(const gchar *server, gint defaultport, gchar **host, gint *port);
 void remmina_public_get_server_port(const gchar *server, gint defaultport, gchar **host, gint *port);
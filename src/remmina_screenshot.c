@@ -0,0 +1,182 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <glib/gi18n.h>
+#include "remmina_pref.h"
+#include "remmina_public.h"
+#include "remmina_screenshot.h"
+#include "remmina/remmina_trace_calls.h"
+
+typedef struct {
+	RemminaPluginScreenshotData	rpsd;
+	GdkPixbuf *			pixbuf;
+	gchar *				filename;
+	gchar *				format;
+	gint				level;
+	gboolean			to_clipboard;
+} RemminaScreenshotJob;
+
+static void remmina_screenshot_job_free(RemminaScreenshotJob *job)
+{
+	TRACE_CALL(__func__);
+	free(job->rpsd.buffer);
+	if (job->pixbuf)
+		g_object_unref(job->pixbuf);
+	g_free(job->filename);
+	g_free(job->format);
+	g_free(job);
+}
+
+const gchar *remmina_screenshot_get_extension(void)
+{
+	TRACE_CALL(__func__);
+	if (g_strcmp0(remmina_pref.screenshot_format, "jpeg") == 0)
+		return "jpg";
+	return "png";
+}
+
+static RemminaScreenshotJob *remmina_screenshot_job_new(const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	RemminaScreenshotJob *job;
+
+	job = g_new0(RemminaScreenshotJob, 1);
+	job->filename = g_strdup(filename);
+	if (g_strcmp0(remmina_pref.screenshot_format, "jpeg") == 0) {
+		job->format = g_strdup("jpeg");
+		job->level = CLAMP(remmina_pref.screenshot_jpeg_quality, 0, 100);
+	} else {
+		job->format = g_strdup("png");
+		job->level = CLAMP(remmina_pref.screenshot_png_compression, 0, 9);
+	}
+	return job;
+}
+
+/* Runs on a worker thread: only pixel data is touched here, no GTK calls */
+static void remmina_screenshot_encode(GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable)
+{
+	TRACE_CALL(__func__);
+	RemminaScreenshotJob *job = (RemminaScreenshotJob *)task_data;
+	RemminaPluginScreenshotData *rpsd = &job->rpsd;
+	cairo_surface_t *surface;
+	cairo_format_t cairo_format;
+	GError *err = NULL;
+	gchar *level;
+	gboolean ret;
+
+	if (rpsd->buffer) {
+		/* Alpha of the remote framebuffer is meaningless, RGB24 ignores it */
+		if (rpsd->bitsPerPixel == 32 || rpsd->bitsPerPixel == 24)
+			cairo_format = CAIRO_FORMAT_RGB24;
+		else
+			cairo_format = CAIRO_FORMAT_RGB16_565;
+		surface = cairo_image_surface_create_for_data(rpsd->buffer, cairo_format, rpsd->width, rpsd->height,
+							      cairo_format_stride_for_width(cairo_format, rpsd->width));
+		job->pixbuf = gdk_pixbuf_get_from_surface(surface, 0, 0, rpsd->width, rpsd->height);
+		cairo_surface_destroy(surface);
+		free(rpsd->buffer);
+		rpsd->buffer = NULL;
+	}
+
+	if (!job->pixbuf) {
+		g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED, "no image data");
+		return;
+	}
+
+	level = g_strdup_printf("%d", job->level);
+	if (g_strcmp0(job->format, "jpeg") == 0)
+		ret = gdk_pixbuf_save(job->pixbuf, job->filename, "jpeg", &err, "quality", level, NULL);
+	else
+		ret = gdk_pixbuf_save(job->pixbuf, job->filename, "png", &err, "compression", level, NULL);
+	g_free(level);
+
+	if (ret)
+		g_task_return_boolean(task, TRUE);
+	else
+		g_task_return_error(task, err);
+}
+
+static void remmina_screenshot_done(GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaScreenshotJob *job = g_task_get_task_data(G_TASK(res));
+	GError *err = NULL;
+
+	if (job->to_clipboard && job->pixbuf)
+		gtk_clipboard_set_image(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), job->pixbuf);
+
+	if (g_task_propagate_boolean(G_TASK(res), &err)) {
+		remmina_public_send_notification("remmina-screenshot-is-ready-id", _("Screenshot taken"), job->filename);
+	} else {
+		g_warning("Unable to save the screenshot to %s: %s", job->filename, err->message);
+		g_error_free(err);
+	}
+}
+
+static void remmina_screenshot_run(RemminaScreenshotJob *job)
+{
+	TRACE_CALL(__func__);
+	GTask *task;
+
+	task = g_task_new(NULL, NULL, remmina_screenshot_done, NULL);
+	g_task_set_task_data(task, job, (GDestroyNotify)remmina_screenshot_job_free);
+	g_task_run_in_thread(task, remmina_screenshot_encode);
+	g_object_unref(task);
+}
+
+void remmina_screenshot_save_buffer(RemminaPluginScreenshotData *rpsd, const gchar *filename, gboolean to_clipboard)
+{
+	TRACE_CALL(__func__);
+	RemminaScreenshotJob *job;
+
+	job = remmina_screenshot_job_new(filename);
+	/* The plugin copy of the framebuffer is the only one: the worker
+	 * converts it in place of the GTK thread and frees it */
+	job->rpsd = *rpsd;
+	rpsd->buffer = NULL;
+	job->to_clipboard = to_clipboard;
+	remmina_screenshot_run(job);
+}
+
+void remmina_screenshot_save_pixbuf(GdkPixbuf *pixbuf, const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	RemminaScreenshotJob *job;
+
+	job = remmina_screenshot_job_new(filename);
+	job->pixbuf = g_object_ref(pixbuf);
+	remmina_screenshot_run(job);
+}
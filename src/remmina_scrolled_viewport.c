@@ -61,114 +61,147 @@ static void remmina_scrolled_viewport_get_preferred_height(GtkWidget* widget, gi
 	if (natural_height != NULL) *natural_height = 100;
 }
 
-/* Event handler when mouse move on borders
- * Note that this handler may repeat itself. Zeroing out viewport_motion_handler before returning FALSE will
- * relay the fact that this specific occurrence of timeout has been cancelled.
- * A new one may be scheduled if the mouse pointer moves to the edge again.
- */
-static gboolean remmina_scrolled_viewport_motion_timeout(gpointer data)
+static gboolean remmina_scrolled_viewport_edge_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data);
+
+static void remmina_scrolled_viewport_scroll(GtkAdjustment *adj, gdouble delta, gint size)
 {
 	TRACE_CALL(__func__);
-	RemminaScrolledViewport *gsv;
-	GtkWidget *child;
-	GdkDisplay *display;
-#if GTK_CHECK_VERSION(3, 20, 0)
-	GdkSeat *seat;
-#else
-	GdkDeviceManager *device_manager;
-#endif
-	GdkDevice *pointer;
-	GdkScreen *screen;
-	GdkWindow *gsvwin;
-	gint x, y, mx, my, w, h, rootx, rooty;
-	GtkAdjustment *adj;
 	gdouble value;
 
-	gsv = REMMINA_SCROLLED_VIEWPORT(data);
-	if (!gsv || !gsv->viewport_motion_handler)
-		// Either the pointer is nullptr or the source id is already 0
-		return FALSE;
-	if (!REMMINA_IS_SCROLLED_VIEWPORT(data)) {
-		gsv->viewport_motion_handler = 0;
-		return FALSE;
+	value = gtk_adjustment_get_value(adj) + delta;
+	value = MAX(0, MIN(value, gtk_adjustment_get_upper(adj) - (gdouble)size + 2.0));
+	gtk_adjustment_set_value(adj, value);
+}
+
+/* Records on which edges the pointer at x, y (relative to gsv) is, and starts
+ * or stops the tick callback accordingly */
+static void remmina_scrolled_viewport_update_edge(RemminaScrolledViewport *gsv, gdouble x, gdouble y)
+{
+	TRACE_CALL(__func__);
+	gint w, h, mx, my;
+
+	w = gtk_widget_get_allocated_width(GTK_WIDGET(gsv));
+	h = gtk_widget_get_allocated_height(GTK_WIDGET(gsv));
+
+	mx = (x < SCROLL_BORDER_SIZE ? -1 : (x >= w - SCROLL_BORDER_SIZE ? 1 : 0));
+	my = (y < SCROLL_BORDER_SIZE ? -1 : (y >= h - SCROLL_BORDER_SIZE ? 1 : 0));
+
+	if (mx != gsv->edge_x || my != gsv->edge_y) {
+		/* Moving to another edge starts again at the initial speed */
+		gsv->edge_x = mx;
+		gsv->edge_y = my;
+		gsv->edge_since = 0;
 	}
-	if (!GTK_IS_BIN(data)) {
-		gsv->viewport_motion_handler = 0;
-		return FALSE;
+
+	if (mx == 0 && my == 0 && !gsv->pointer)
+		remmina_scrolled_viewport_remove_motion(gsv);
+	else if (!gsv->viewport_motion_handler)
+		gsv->viewport_motion_handler = gtk_widget_add_tick_callback(GTK_WIDGET(gsv),
+									   remmina_scrolled_viewport_edge_tick, NULL, NULL);
+}
+
+/* Frame clock callback scrolling the viewport while the pointer is on an edge.
+ * The speed starts at auto_scroll_step pixels every 20ms, as the old timer did,
+ * and grows up to three times that while the pointer stays on the edge. */
+static gboolean remmina_scrolled_viewport_edge_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaScrolledViewport *gsv = REMMINA_SCROLLED_VIEWPORT(widget);
+	GtkWidget *child;
+	gint64 now;
+	gdouble elapsed, speed;
+	gint w, h;
+
+	if (gsv->pointer) {
+		/* No motion events, follow the pointer while it is in the viewport */
+		gint x, y;
+
+		gdk_window_get_device_position(gtk_widget_get_window(widget), gsv->pointer, &x, &y, NULL);
+		remmina_scrolled_viewport_update_edge(gsv, x, y);
+		if (gsv->edge_x == 0 && gsv->edge_y == 0)
+			return G_SOURCE_CONTINUE;
 	}
 
 	child = gtk_bin_get_child(GTK_BIN(gsv));
 	if (!GTK_IS_VIEWPORT(child)) {
 		gsv->viewport_motion_handler = 0;
-		return FALSE;
+		return G_SOURCE_REMOVE;
 	}
 
-	gsvwin = gtk_widget_get_window(GTK_WIDGET(gsv));
-	display = gdk_display_get_default();
-	if (!display) {
-		gsv->viewport_motion_handler = 0;
-		return FALSE;
+	now = gdk_frame_clock_get_frame_time(frame_clock);
+	if (gsv->edge_since == 0) {
+		gsv->edge_since = gsv->edge_last_frame = now;
+		return G_SOURCE_CONTINUE;
 	}
+	elapsed = (gdouble)(now - gsv->edge_last_frame) / G_USEC_PER_SEC;
+	gsv->edge_last_frame = now;
+	speed = 50.0 * MIN(1.0 + (gdouble)(now - gsv->edge_since) / G_USEC_PER_SEC, 3.0);
 
-#if GTK_CHECK_VERSION(3, 20, 0)
-	seat = gdk_display_get_default_seat(display);
-	pointer = gdk_seat_get_pointer(seat);
-#else
-	device_manager = gdk_display_get_device_manager(display);
-	pointer = gdk_device_manager_get_client_pointer(device_manager);
-#endif
-	gdk_device_get_position(pointer, &screen, &x, &y);
-
-	w = gdk_window_get_width(gsvwin) + SCROLL_BORDER_SIZE;   // Add 2px of black scroll border
-	h = gdk_window_get_height(gsvwin) + SCROLL_BORDER_SIZE;  // Add 2px of black scroll border
-
-	gdk_window_get_root_origin(gsvwin, &rootx, &rooty );
+	w = gtk_widget_get_allocated_width(widget) + SCROLL_BORDER_SIZE;   // Add 2px of black scroll border
+	h = gtk_widget_get_allocated_height(widget) + SCROLL_BORDER_SIZE;  // Add 2px of black scroll border
 
-	x -= rootx;
-	y -= rooty;
-
-	mx = (x <= 0 ? -1 : (x >= w - 1 ? 1 : 0));
-	my = (y <= 0 ? -1 : (y >= h - 1 ? 1 : 0));
-	if (mx != 0) {
+	if (gsv->edge_x != 0) {
 		gint step = MAX(10, MIN(remmina_pref.auto_scroll_step, w / 5));
-		adj = gtk_scrollable_get_hadjustment(GTK_SCROLLABLE(child));
-		value = gtk_adjustment_get_value(GTK_ADJUSTMENT(adj)) + (gdouble)(mx * step);
-		value = MAX(0, MIN(value, gtk_adjustment_get_upper(GTK_ADJUSTMENT(adj)) - (gdouble)w + 2.0));
-		gtk_adjustment_set_value(GTK_ADJUSTMENT(adj), value);
+		remmina_scrolled_viewport_scroll(gtk_scrollable_get_hadjustment(GTK_SCROLLABLE(child)),
+						 gsv->edge_x * step * speed * elapsed, w);
 	}
-	if (my != 0) {
+	if (gsv->edge_y != 0) {
 		gint step = MAX(10, MIN(remmina_pref.auto_scroll_step, h / 5));
-		adj = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(child));
-		value = gtk_adjustment_get_value(GTK_ADJUSTMENT(adj)) + (gdouble)(my * step);
-		value = MAX(0, MIN(value, gtk_adjustment_get_upper(GTK_ADJUSTMENT(adj)) - (gdouble)h + 2.0));
-		gtk_adjustment_set_value(GTK_ADJUSTMENT(adj), value);
+		remmina_scrolled_viewport_scroll(gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(child)),
+						 gsv->edge_y * step * speed * elapsed, h);
 	}
-	return TRUE;
+	return G_SOURCE_CONTINUE;
 }
 
-static gboolean remmina_scrolled_viewport_enter(GtkWidget *widget, GdkEventCrossing *event, gpointer data)
+#if GTK_CHECK_VERSION(3, 24, 0)
+static void remmina_scrolled_viewport_motion(GtkEventControllerMotion *controller, gdouble x, gdouble y, gpointer data)
 {
 	TRACE_CALL(__func__);
-	remmina_scrolled_viewport_remove_motion(REMMINA_SCROLLED_VIEWPORT(widget));
-	return FALSE;
+	RemminaScrolledViewport *gsv = REMMINA_SCROLLED_VIEWPORT(data);
+	GdkDevice *device;
+	gint wx, wy;
+
+	/* x, y are relative to the window of the event, e.g. the scrolled bin
+	 * window of the viewport. Ask for the position within gsv instead */
+	device = gtk_get_current_event_device();
+	if (!device)
+		return;
+	gdk_window_get_device_position(gtk_widget_get_window(GTK_WIDGET(gsv)), device, &wx, &wy, NULL);
+
+	/* Motion is reported, no need to poll anymore */
+	gsv->pointer = NULL;
+	remmina_scrolled_viewport_update_edge(gsv, wx, wy);
 }
+#endif
 
 static gboolean remmina_scrolled_viewport_leave(GtkWidget *widget, GdkEventCrossing *event, gpointer data)
 {
 	TRACE_CALL(__func__);
 	RemminaScrolledViewport *gsv = REMMINA_SCROLLED_VIEWPORT(widget);
-        if (gsv->viewport_motion_handler) {
-           REMMINA_DEBUG("cleaning motion ...");
-           remmina_scrolled_viewport_remove_motion(gsv);
-        }
-	gsv->viewport_motion_handler = g_timeout_add(20, remmina_scrolled_viewport_motion_timeout, gsv);
+
+	if (event->detail != GDK_NOTIFY_INFERIOR) {
+		/* The pointer really left the viewport */
+		remmina_scrolled_viewport_remove_motion(gsv);
+		return FALSE;
+	}
+	/* The pointer went into a child window. Poll it until the next motion
+	 * event, which never comes for a GtkSocket or without a motion controller */
+	gsv->pointer = gdk_event_get_device((GdkEvent *)event);
+	if (!gsv->viewport_motion_handler)
+		gsv->viewport_motion_handler = gtk_widget_add_tick_callback(widget,
+									   remmina_scrolled_viewport_edge_tick, NULL, NULL);
 	return FALSE;
 }
 
 static void remmina_scrolled_viewport_destroy(GtkWidget *widget, gpointer data)
 {
 	TRACE_CALL(__func__);
-	remmina_scrolled_viewport_remove_motion(REMMINA_SCROLLED_VIEWPORT(widget));
+	RemminaScrolledViewport *gsv = REMMINA_SCROLLED_VIEWPORT(widget);
+
+	remmina_scrolled_viewport_remove_motion(gsv);
+#if GTK_CHECK_VERSION(3, 24, 0)
+	g_clear_object(&gsv->motion_controller);
+#endif
 }
 
 static void remmina_scrolled_viewport_class_init(RemminaScrolledViewportClass *klass)
@@ -193,8 +226,11 @@ void remmina_scrolled_viewport_remove_motion(RemminaScrolledViewport *gsv)
 	guint handler = gsv->viewport_motion_handler;
 	if (handler) {
 		gsv->viewport_motion_handler = 0;
-		g_source_remove(handler);
+		gtk_widget_remove_tick_callback(GTK_WIDGET(gsv), handler);
 	}
+	gsv->edge_x = gsv->edge_y = 0;
+	gsv->edge_since = 0;
+	gsv->pointer = NULL;
 }
 
 GtkWidget*
@@ -206,13 +242,20 @@ remmina_scrolled_viewport_new(void)
 	gsv = REMMINA_SCROLLED_VIEWPORT(g_object_new(REMMINA_TYPE_SCROLLED_VIEWPORT, NULL));
 
 	gsv->viewport_motion_handler = 0;
+	gsv->pointer = NULL;
 
 	gtk_widget_set_size_request(GTK_WIDGET(gsv), 1, 1);
-	gtk_widget_add_events(GTK_WIDGET(gsv), GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
+	gtk_widget_add_events(GTK_WIDGET(gsv), GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK);
 	g_signal_connect(G_OBJECT(gsv), "destroy", G_CALLBACK(remmina_scrolled_viewport_destroy), NULL);
-	g_signal_connect(G_OBJECT(gsv), "enter-notify-event", G_CALLBACK(remmina_scrolled_viewport_enter), NULL);
 	g_signal_connect(G_OBJECT(gsv), "leave-notify-event", G_CALLBACK(remmina_scrolled_viewport_leave), NULL);
 
+#if GTK_CHECK_VERSION(3, 24, 0)
+	/* Capture phase: see the pointer before the protocol widget eats its motion events */
+	gsv->motion_controller = gtk_event_controller_motion_new(GTK_WIDGET(gsv));
+	gtk_event_controller_set_propagation_phase(gsv->motion_controller, GTK_PHASE_CAPTURE);
+	g_signal_connect(gsv->motion_controller, "motion", G_CALLBACK(remmina_scrolled_viewport_motion), gsv);
+#endif
+
 	return GTK_WIDGET(gsv);
 }
 
@@ -55,8 +55,19 @@ G_BEGIN_DECLS
 typedef struct _RemminaScrolledViewport {
 	GtkEventBox	event_box;
 
-	/* Motion activates in Viewport Fullscreen mode */
+	/* Edge scrolling in Viewport Fullscreen mode. The tick callback
+	 * runs only while the pointer is on an edge */
 	guint		viewport_motion_handler;
+	gint		edge_x;
+	gint		edge_y;
+	gint64		edge_since;
+	gint64		edge_last_frame;
+#if GTK_CHECK_VERSION(3, 24, 0)
+	GtkEventController *motion_controller;
+#endif
+	/* Set while the tick callback polls the pointer, over children that
+	 * report no motion to us like a GtkSocket */
+	GdkDevice *	pointer;
 } RemminaScrolledViewport;
 
 typedef struct _RemminaScrolledViewportClass {
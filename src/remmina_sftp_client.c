@@ -537,7 +537,7 @@ remmina_sftp_client_thread_main(gpointer data)
 			(REMMINA_SSH(sftp))->tunnel_entrance_host = host;
 			(REMMINA_SSH(sftp))->tunnel_entrance_port = port;
 
-			/* Open a new connection for this subcommand */
+			/* Open a new connection for this subcommand, or take over a parked one */
 			g_debug("[SFTPCLI] %s opening ssh session to %s:%d", __func__, host, port);
 			if (!remmina_ssh_init_session(REMMINA_SSH(sftp))) {
 				g_debug("[SFTPCLI] remmina_ssh_init_session returned error %s\n", (REMMINA_SSH(sftp))->error);
@@ -50,8 +50,10 @@
 #include <errno.h>
 #define LIBSSH_STATIC 1
 #include <libssh/libssh.h>
+#include <libssh/server.h>
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -125,29 +127,51 @@ static const gchar *common_identities[] =
 	NULL
 };
 
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 9, 0)
+static enum ssh_known_hosts_e remmina_ssh_known_server(RemminaSSH *ssh);
+static void remmina_ssh_update_known_hosts(RemminaSSH *ssh);
+#endif
+
+// Session pool
+static gchar *remmina_ssh_pool_credentials(RemminaSSH *ssh, const gchar *secret);
+static void remmina_ssh_pool_forget(RemminaSSH *ssh);
+
 /*-----------------------------------------------------------------------------*
 *                           X11 Channels                                      *
 *-----------------------------------------------------------------------------*/
 #define _PATH_UNIX_X    "/tmp/.X11-unix/X%d"
 
+/* Size of the buffer used to copy from a local fd to its channel */
+#define REMMINA_SSH_CP_BUF_SIZE 0x10000
+
+/* Channel/fd tuple, registered in the channels table of its RemminaSSHShell.
+ * It is also the userdata of the fd and channel callbacks, so the data path
+ * does not need to look it up */
 typedef struct item {
 	ssh_channel channel;
 	gint fd_in;
 	gint fd_out;
 	gboolean protected;
-	pthread_t thread;
-	struct item *next;
+	RemminaSSHShell *shell;
+	gchar *buf;
+	/* Channel data read from libssh but not yet accepted by fd_out */
+	gchar *out_buf;
+	gsize out_off;
+	gsize out_len;
+	/* fd_out was full: the channel data stays in libssh until POLLOUT */
+	gboolean out_blocked;
+	/* The remote window was full: fd_in is not read until it is adjusted */
+	gboolean in_stalled;
+	/* The local end is closed once it is out of the event */
+	gboolean closing;
+	/* Events fd_in is registered with in the shell event, 0 if it is not */
+	short watched;
+	struct ssh_channel_callbacks_struct cb;
 } node_t;
 
-node_t *node = NULL;
-
-// Mutex
-pthread_mutex_t mutex;
-
-// Linked nodes to manage channel/fd tuples
-static void remmina_ssh_insert_item(ssh_channel channel, gint fd_in, gint fd_out, gboolean protected, pthread_t thread);
-static void remmina_ssh_delete_item(ssh_channel channel);
-static node_t * remmina_ssh_search_item(ssh_channel channel);
+// Per shell registry of channel/fd tuples
+static node_t * remmina_ssh_insert_item(RemminaSSHShell *shell, ssh_channel channel, gint fd_in, gint fd_out, gboolean protected);
+static void remmina_ssh_delete_item(RemminaSSHShell *shell, ssh_channel channel);
 
 // X11 Display
 const char * remmina_ssh_ssh_gai_strerror(int gaierr);
@@ -167,13 +191,16 @@ static int remmina_ssh_cp_to_fd_cb(ssh_session session, ssh_channel channel, voi
 static void remmina_ssh_ch_close_cb(ssh_session session, ssh_channel channel, void *userdata);
 
 // Close all X11 channel
-static void remmina_ssh_close_all_x11_ch(pthread_t thread);
+static void remmina_ssh_close_all_x11_ch(RemminaSSHShell *shell);
+
+// Apply the fd changes requested by the callbacks
+static void remmina_ssh_update_item_fds(RemminaSSHShell *shell);
 
 // X11 Request
 static ssh_channel remmina_ssh_x11_open_request_cb(ssh_session session, const char *shost, int sport, void *userdata);
 
-// SSH Channel Callbacks
-struct ssh_channel_callbacks_struct channel_cb =
+// SSH Channel Callbacks, copied in every node_t
+static const struct ssh_channel_callbacks_struct channel_cb =
 {
 	.channel_data_function = remmina_ssh_cp_to_fd_cb,
 	.channel_eof_function = remmina_ssh_ch_close_cb,
@@ -185,91 +212,77 @@ struct ssh_channel_callbacks_struct channel_cb =
 short events = POLLIN | POLLPRI | POLLERR | POLLHUP | POLLNVAL;
 
 // Functions
+
+/* remmina_ssh_shell_free() cancels the shell thread and then destroys
+ * channels_mutex, the thread must not be cancelled while holding it: close()
+ * and the logging done under the mutex are cancellation points */
 static void
-remmina_ssh_insert_item(ssh_channel channel, gint fd_in, gint fd_out, gboolean protected, pthread_t thread)
+remmina_ssh_lock_channels(RemminaSSHShell *shell, int *cancel_state)
 {
-	TRACE_CALL(__func__);
-
-	pthread_mutex_lock(&mutex);
-
-	REMMINA_DEBUG("insert node - fd_in: %d - fd_out: %d - protected %d", fd_in, fd_out, protected);
-
-	node_t *node_iterator, *new;
-	if (node == NULL) {
-		/* Calloc ensure that node is full of 0 */
-		node = (node_t *) calloc(1, sizeof(node_t));
-		node->channel = channel;
-		node->fd_in = fd_in;
-		node->fd_out = fd_out;
-		node->protected = protected;
-		node->thread = thread;
-		node->next = NULL;
-	} else {
-		node_iterator = node;
-		while (node_iterator->next != NULL)
-			node_iterator = node_iterator->next;
-		/* Create the new node */
-		new = (node_t *) malloc(sizeof(node_t));
-		new->channel = channel;
-		new->fd_in = fd_in;
-		new->fd_out = fd_out;
-		new->protected = protected;
-		new->thread = thread;
-		new->next = NULL;
-		node_iterator->next = new;
-	}
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, cancel_state);
+	pthread_mutex_lock(&shell->channels_mutex);
+}
 
-	pthread_mutex_unlock(&mutex);
+static void
+remmina_ssh_unlock_channels(RemminaSSHShell *shell, int cancel_state)
+{
+	pthread_mutex_unlock(&shell->channels_mutex);
+	pthread_setcancelstate(cancel_state, NULL);
 }
 
 static void
-remmina_ssh_delete_item(ssh_channel channel)
+remmina_ssh_item_free(node_t *item)
 {
 	TRACE_CALL(__func__);
-
-	REMMINA_DEBUG("delete node");
-
-	pthread_mutex_lock(&mutex);
-
-	node_t *current, *previous = NULL;
-	for (current = node; current; previous = current, current = current->next) {
-		if (current->channel != channel)
-			continue;
-
-		if (previous == NULL)
-			node = current->next;
-		else
-			previous->next = current->next;
-
-		free(current);
-		pthread_mutex_unlock(&mutex);
-		return;
-	}
-
-	pthread_mutex_unlock(&mutex);
+	g_free(item->buf);
+	g_free(item->out_buf);
+	g_free(item);
 }
 
 static node_t *
-remmina_ssh_search_item(ssh_channel channel)
+remmina_ssh_insert_item(RemminaSSHShell *shell, ssh_channel channel, gint fd_in, gint fd_out, gboolean protected)
 {
 	TRACE_CALL(__func__);
+	node_t *new;
+	int flags;
+	int cancel_state;
 
+	REMMINA_DEBUG("insert node - fd_in: %d - fd_out: %d - protected %d", fd_in, fd_out, protected);
 
-	pthread_mutex_lock(&mutex);
+	new = g_new0(node_t, 1);
+	new->channel = channel;
+	new->fd_in = fd_in;
+	new->fd_out = fd_out;
+	new->protected = protected;
+	new->shell = shell;
+	new->buf = g_malloc(REMMINA_SSH_CP_BUF_SIZE);
+	new->cb = channel_cb;
+	new->cb.userdata = new;
+	ssh_callbacks_init(&new->cb);
+
+	/* remmina_ssh_cp_to_ch_cb() reads until EAGAIN */
+	flags = fcntl(fd_in, F_GETFL, 0);
+	if (flags != -1)
+		fcntl(fd_in, F_SETFL, flags | O_NONBLOCK);
+
+	remmina_ssh_lock_channels(shell, &cancel_state);
+	g_hash_table_insert(shell->channels, channel, new);
+	remmina_ssh_unlock_channels(shell, cancel_state);
+
+	return new;
+}
 
-	node_t *current = node;
-	while (current != NULL) {
-		if (current->channel == channel) {
-			pthread_mutex_unlock(&mutex);
-			return current;
-		} else {
-			current = current->next;
-		}
-	}
+static void
+remmina_ssh_delete_item(RemminaSSHShell *shell, ssh_channel channel)
+{
+	TRACE_CALL(__func__);
+	int cancel_state;
 
-	pthread_mutex_unlock(&mutex);
+	REMMINA_DEBUG("delete node");
 
-	return NULL;
+	remmina_ssh_lock_channels(shell, &cancel_state);
+	g_hash_table_remove(shell->channels, channel);
+	remmina_ssh_unlock_channels(shell, cancel_state);
 }
 
 static void
@@ -482,60 +495,209 @@ remmina_ssh_x11_connect_display(void)
 	return sock;
 }
 
-static int
-remmina_ssh_cp_to_ch_cb(int fd, int revents, void *userdata)
+static void
+remmina_ssh_close_item_fds(node_t *item)
 {
 	TRACE_CALL(__func__);
-	ssh_channel channel = (ssh_channel)userdata;
-	gchar *buf = (gchar *) g_malloc ( sizeof(gchar) * 0x200000 );
-	if (buf ==NULL){
-		return -1;
+
+	if (item->fd_in >= 0) {
+		shutdown(item->fd_in, SHUT_RDWR);
+		close(item->fd_in);
+		REMMINA_DEBUG("fd %d closed.", item->fd_in);
+	}
+	if (item->fd_out >= 0 && item->fd_out != item->fd_in) {
+		shutdown(item->fd_out, SHUT_RDWR);
+		close(item->fd_out);
+		REMMINA_DEBUG("fd %d closed.", item->fd_out);
 	}
-	gint sz = 0, ret = 0;
+	item->fd_in = -1;
+	item->fd_out = -1;
+}
+
+/* Closes the local end of a non protected channel. Called from the callbacks
+ * of the shell event, which must not add or remove fds of the event while it
+ * dispatches them: the fd is only marked, remmina_ssh_update_item_fds() takes
+ * it out of the event and closes it. The node stays registered until the shell
+ * is freed, as libssh may still call the channel callbacks */
+static void
+remmina_ssh_close_item_fd(node_t *item)
+{
+	TRACE_CALL(__func__);
 
-	node_t *temp_node = remmina_ssh_search_item(channel);
+	if (item->protected || item->fd_in < 0)
+		return;
+	item->closing = TRUE;
+}
 
-	if (!channel) {
-		if (!temp_node->protected) {
-			shutdown(fd, SHUT_RDWR);
-			close(fd);
-			REMMINA_DEBUG("fd %d closed.", fd);
+/* Brings the registration of the local end of the item in the shell event in
+ * line with its state. libssh has no way to change the events of a fd, so it
+ * is registered again. Must be called with channels_mutex held, out of
+ * ssh_event_dopoll() */
+static void
+remmina_ssh_update_item_fd(node_t *item)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHShell *shell = item->shell;
+	short wanted = 0;
+
+	if (item->in_stalled && ssh_channel_window_size(item->channel) > 0)
+		item->in_stalled = FALSE;
+
+	if (item->fd_in >= 0 && !item->closing) {
+		wanted = events;
+		if (item->in_stalled)
+			wanted &= ~(POLLIN | POLLPRI);
+		if (item->out_blocked)
+			wanted |= POLLOUT;
+	}
+	if (wanted == item->watched && !item->closing)
+		return;
+
+	if (item->watched)
+		ssh_event_remove_fd(shell->event, item->fd_in);
+	item->watched = 0;
+	if (wanted && ssh_event_add_fd(shell->event, item->fd_in, wanted, remmina_ssh_cp_to_ch_cb, item) == SSH_OK)
+		item->watched = wanted;
+
+	if (item->closing) {
+		remmina_ssh_close_item_fds(item);
+		g_free(item->buf);
+		item->buf = NULL;
+		g_free(item->out_buf);
+		item->out_buf = NULL;
+		item->out_len = 0;
+		item->out_blocked = FALSE;
+		item->in_stalled = FALSE;
+		item->closing = FALSE;
+	}
+}
+
+static void
+remmina_ssh_update_item_fds(RemminaSSHShell *shell)
+{
+	TRACE_CALL(__func__);
+	GHashTableIter iter;
+	node_t *item;
+	int cancel_state;
+
+	remmina_ssh_lock_channels(shell, &cancel_state);
+	g_hash_table_iter_init(&iter, shell->channels);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&item))
+		remmina_ssh_update_item_fd(item);
+	remmina_ssh_unlock_channels(shell, cancel_state);
+}
+
+/* Writes the channel data libssh kept buffered while fd_out was full.
+ * Returns FALSE if fd_out is full again */
+static gboolean
+remmina_ssh_flush_item_out(node_t *item)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHShell *shell = item->shell;
+	int is_stderr;
+	int n;
+	ssize_t sz;
+
+	if (!item->out_buf)
+		item->out_buf = g_malloc(REMMINA_SSH_CP_BUF_SIZE);
+
+	for (is_stderr = 0; is_stderr <= 1; is_stderr++) {
+		for (;;) {
+			while (item->out_len > 0) {
+				sz = write(item->fd_out, item->out_buf + item->out_off, item->out_len);
+				if (sz > 0) {
+					item->out_off += sz;
+					item->out_len -= sz;
+				} else if (sz < 0 && errno == EINTR) {
+					continue;
+				} else if (sz < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					return FALSE;
+				} else {
+					REMMINA_WARNING("write on fd %d failed: %s", item->fd_out, strerror(errno));
+					item->out_len = 0;
+				}
+			}
+			/* While out_blocked is set the data callback leaves everything
+			 * in the channel buffers, so new packets handled here are kept too */
+			n = ssh_channel_poll(item->channel, is_stderr);
+			if (n <= 0)
+				break;
+			n = ssh_channel_read_nonblocking(item->channel, item->out_buf,
+							 MIN((uint32_t)n, REMMINA_SSH_CP_BUF_SIZE), is_stderr);
+			if (n <= 0)
+				break;
+			if (shell->recorder && item->channel == shell->channel)
+				remmina_ssh_recorder_feed(shell->recorder, item->out_buf, n);
+			item->out_off = 0;
+			item->out_len = n;
 		}
+	}
+	return TRUE;
+}
+
+static int
+remmina_ssh_cp_to_ch_cb(int fd, int revents, void *userdata)
+{
+	TRACE_CALL(__func__);
+	node_t *item = (node_t *)userdata;
+	ssh_channel channel = item->channel;
+	uint32_t window;
+	size_t len;
+	ssize_t sz;
+
+	if (!channel || !item->buf) {
 		REMMINA_WARNING("channel does not exist.");
 		return -1;
 	}
 
+	/* Already closed, waiting to be taken out of the event */
+	if (item->closing)
+		return 0;
+
 	if ((revents & POLLIN) || (revents & POLLPRI)) {
-		sz = read(fd, buf, sizeof(buf));
-		if (sz > 0) {
-			ret = ssh_channel_write(channel, buf, sz);
-			if (ret != sz){
-				g_free(buf);
-				return -1;
+		/* Drain the fd, or the next poll would wake up again right away */
+		for (;;) {
+			/* Do not read more than the remote window can take, so
+			 * ssh_channel_write() never waits for the peer. When it is full
+			 * fd_in is not watched until the window is adjusted, and the
+			 * local writer is slowed down by the kernel buffers */
+			window = ssh_channel_window_size(channel);
+			if (window == 0) {
+				item->in_stalled = TRUE;
+				break;
 			}
-				
-		} else if (sz < 0) {
-			g_free(buf);
-			return -1;
-		} else {
-			REMMINA_WARNING("Why the hell am I here?");
-			if (!temp_node->protected) {
-				shutdown(fd, SHUT_RDWR);
-				close(fd);
-				REMMINA_DEBUG("fd %d closed.", fd);
+			len = MIN(window, REMMINA_SSH_CP_BUF_SIZE);
+			sz = read(fd, item->buf, len);
+			if (sz > 0) {
+				if (ssh_channel_write(channel, item->buf, sz) != sz)
+					return -1;
+			} else if (sz < 0 && errno == EINTR) {
+				continue;
+			} else if (sz < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				break;
+			} else if (sz < 0) {
+				return -1;
+			} else {
+				REMMINA_DEBUG("fd %d reached end of file.", fd);
+				if (!item->protected) {
+					ssh_channel_send_eof(channel);
+					remmina_ssh_close_item_fd(item);
+					return 0;
+				}
+				return -1;
 			}
-			g_free(buf);
-			return -1;
 		}
 	}
 
+	if ((revents & POLLOUT) && item->out_blocked && remmina_ssh_flush_item_out(item))
+		item->out_blocked = FALSE;
+
 	if ((revents & POLLHUP) || (revents & POLLNVAL) || (revents & POLLERR)) {
 		REMMINA_DEBUG("Closing channel.");
 		ssh_channel_close(channel);
-		ret = -1;
+		return -1;
 	}
-	g_free(buf);
-	return ret;
+	return 0;
 }
 
 static int
@@ -544,17 +706,42 @@ remmina_ssh_cp_to_fd_cb(ssh_session session, ssh_channel channel, void *data, ui
 	TRACE_CALL(__func__);
 	(void)session;
 	(void)is_stderr;
-	// Expecting userdata to be type RemminaSSHShell *, but it is unused
-	// in this function.
-	(void)userdata;
 
-	node_t *temp_node = remmina_ssh_search_item(channel);
-	gint fd = temp_node->fd_out;
-	gint sz = 0;
+	node_t *item = (node_t *)userdata;
+	uint32_t done = 0;
+	ssize_t sz;
+
+	/* Local end already closed, just discard */
+	if (item->fd_out < 0 || item->closing)
+		return len;
+
+	/* Keep the ordering: older data is still waiting in libssh */
+	if (item->out_blocked)
+		return 0;
+
+	while (done < len) {
+		sz = write(item->fd_out, (gchar *)data + done, len - done);
+		if (sz > 0) {
+			done += sz;
+		} else if (sz < 0 && errno == EINTR) {
+			continue;
+		} else if (sz < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			/* The local reader is slower than the remote writer. Leave the
+			 * rest to libssh, the remote window is not refilled meanwhile,
+			 * and write it when the fd is writable again */
+			item->out_blocked = TRUE;
+			break;
+		} else {
+			REMMINA_WARNING("write on fd %d failed: %s", item->fd_out, strerror(errno));
+			done = len;
+			break;
+		}
+	}
 
-	sz = write(fd, data, len);
+	if (done > 0 && item->shell->recorder && channel == item->shell->channel)
+		remmina_ssh_recorder_feed(item->shell->recorder, data, done);
 
-	return sz;
+	return done;
 }
 
 static void
@@ -562,46 +749,28 @@ remmina_ssh_ch_close_cb(ssh_session session, ssh_channel channel, void *userdata
 {
 	TRACE_CALL(__func__);
 	(void)session;
+	(void)channel;
 
-	RemminaSSHShell *shell = (RemminaSSHShell *)userdata;
-
-	node_t *temp_node = remmina_ssh_search_item(channel);
-
-	if (temp_node != NULL) {
-		int fd = temp_node->fd_in;
-
-		if (!temp_node->protected) {
-			remmina_ssh_delete_item(channel);
-			ssh_event_remove_fd(shell->event, fd);
-			shutdown(fd, SHUT_RDWR);
-			close(fd);
-			REMMINA_DEBUG("fd %d closed.", fd);
-		}
-	}
+	remmina_ssh_close_item_fd((node_t *)userdata);
 	REMMINA_DEBUG("Channel closed.");
 }
 
 static void
-remmina_ssh_close_all_x11_ch(pthread_t thread)
+remmina_ssh_close_all_x11_ch(RemminaSSHShell *shell)
 {
 	TRACE_CALL(__func__);
+	GHashTableIter iter;
+	node_t *item;
+	int cancel_state;
 
 	REMMINA_DEBUG("Close all X11 channels");
 
-	node_t *current = node;
-	while (current != NULL) {
-		if (current->thread == thread && !current->protected) {
-			shutdown(current->fd_in, SHUT_RDWR);
-			close(current->fd_in);
-			REMMINA_DEBUG("thread: %d - fd %d closed.", thread, current->fd_in);
-			if (current->fd_in != current->fd_out) {
-				shutdown(current->fd_out, SHUT_RDWR);
-				close(current->fd_out);
-				REMMINA_DEBUG("thread: %d - fd %d closed.", thread, current->fd_out);
-			}
-		}
-		current = current->next;
-	}
+	remmina_ssh_lock_channels(shell, &cancel_state);
+	g_hash_table_iter_init(&iter, shell->channels);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&item))
+		if (!item->protected)
+			remmina_ssh_close_item_fds(item);
+	remmina_ssh_unlock_channels(shell, cancel_state);
 }
 
 static ssh_channel
@@ -613,17 +782,24 @@ remmina_ssh_x11_open_request_cb(ssh_session session, const char *shost, int spor
 	(void)sport;
 
 	RemminaSSHShell *shell = (RemminaSSHShell *)userdata;
-
-	ssh_channel channel = ssh_channel_new(session);
+	node_t *item;
 
 	int sock = remmina_ssh_x11_connect_display();
+	if (sock < 0) {
+		REMMINA_WARNING("Cannot connect to the local X display, refusing the X11 channel.");
+		return NULL;
+	}
+
+	ssh_channel channel = ssh_channel_new(session);
 
-	remmina_ssh_insert_item(channel, sock, sock, FALSE, shell->thread);
+	item = remmina_ssh_insert_item(shell, channel, sock, sock, FALSE);
 
-	ssh_event_add_fd(shell->event, sock, events, remmina_ssh_cp_to_ch_cb, channel);
+	/* Adding is safe while the event dispatches, unlike removing */
+	if (ssh_event_add_fd(shell->event, sock, events, remmina_ssh_cp_to_ch_cb, item) == SSH_OK)
+		item->watched = events;
 	ssh_event_add_session(shell->event, session);
 
-	ssh_add_channel_callbacks(channel, &channel_cb);
+	ssh_add_channel_callbacks(channel, &item->cb);
 
 	return channel;
 }
@@ -686,6 +862,10 @@ remmina_ssh_auth_interactive(RemminaSSH *ssh, RemminaProtocolWidget *gp)
 	ret = SSH_AUTH_ERROR;
 	if (ssh->authenticated) return REMMINA_SSH_AUTH_SUCCESS;
 
+	/* The answers are typed in by the user, possibly one time codes: nobody
+	 * else may take over a session authenticated this way */
+	remmina_ssh_pool_forget(ssh);
+
 	REMMINA_DEBUG("OTP code has been set to: %s", ssh->password);
 
 	ret = ssh_userauth_kbdint(ssh->session, NULL, NULL);
@@ -1112,7 +1292,7 @@ remmina_ssh_auth(RemminaSSH *ssh, const gchar *password, RemminaProtocolWidget *
 	 * SSH_KNOWN_HOSTS_NOT_FOUND: The known host file does not exist. The host is thus unknown. File will be created if host key is accepted.
 	 * SSH_KNOWN_HOSTS_ERROR: There had been an error checking the host.
 	 */
-	if (ssh_session_is_known_server(ssh->session) != SSH_KNOWN_HOSTS_OK) {
+	if (remmina_ssh_known_server(ssh) != SSH_KNOWN_HOSTS_OK) {
 #else
 	if (ssh_is_server_known(ssh->session) != SSH_SERVER_KNOWN_OK) {
 #endif
@@ -1130,6 +1310,15 @@ remmina_ssh_auth(RemminaSSH *ssh, const gchar *password, RemminaProtocolWidget *
 		ssh->passphrase = g_strdup(password);
 	}
 
+	/* The session is pooled and shared under the secret saved in the
+	 * profile, not under one typed in by the user */
+	if (password && ssh->pool_credentials) {
+		gchar *credentials = remmina_ssh_pool_credentials(ssh, password);
+		if (g_strcmp0(credentials, ssh->pool_credentials) != 0)
+			remmina_ssh_pool_forget(ssh);
+		g_free(credentials);
+	}
+
 	/** @todo Here we should call
 	 * gint method;
 	 * method = ssh_userauth_list(ssh->session, NULL);
@@ -1413,7 +1602,7 @@ remmina_ssh_auth_gui(RemminaSSH *ssh, RemminaProtocolWidget *gp, RemminaFile *re
 	 * SSH_KNOWN_HOSTS_NOT_FOUND: The known host file does not exist. The host is thus unknown. File will be created if host key is accepted.
 	 * SSH_KNOWN_HOSTS_ERROR: There had been an error checking the host.
 	 */
-	ret = ssh_session_is_known_server(ssh->session);
+	ret = remmina_ssh_known_server(ssh);
 	switch (ret) {
 	case SSH_KNOWN_HOSTS_OK:
 		break;                                                  /* ok */
@@ -1484,7 +1673,7 @@ remmina_ssh_auth_gui(RemminaSSH *ssh, RemminaProtocolWidget *gp, RemminaFile *re
 		ssh_clean_pubkey_hash(&pubkey);
 		if (ret != GTK_RESPONSE_YES) return REMMINA_SSH_AUTH_USERCANCEL;
 #if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 9, 0)
-		ssh_session_update_known_hosts(ssh->session);
+		remmina_ssh_update_known_hosts(ssh);
 #else
 		ssh_write_knownhost(ssh->session);
 #endif
@@ -1677,116 +1866,730 @@ remmina_ssh_log_callback(ssh_session session, int priority, const char *message,
 	REMMINA_DEBUG(message);
 }
 
-gboolean
-remmina_ssh_init_session(RemminaSSH *ssh)
-{
-	TRACE_CALL(__func__);
-	gint verbosity;
-	gint rc;
-	gchar *parsed_config;
-#ifdef HAVE_NETINET_TCP_H
-	socket_t sshsock;
-	gint optval;
-#endif
-	// Handle IPv4 / IPv6 dual stack
-	char *hostname;
-	struct addrinfo hints,*aitop,*ai;
-	char ipstr[INET6_ADDRSTRLEN];
-	void *addr4=NULL;
-	void *addr6=NULL;
-	gchar* args[100]; //Should be much smaller, but set 100 to be safe
+/*-----------------------------------------------------------------------------*
+*                           Known hosts cache                                 *
+*-----------------------------------------------------------------------------*/
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 9, 0)
 
-	ssh->callback = g_new0(struct ssh_callbacks_struct, 1);
+/* Index of the user known_hosts file, so that checking a host does not parse
+ * the whole file again. It only ever confirms a recorded key; unknown,
+ * changed or revoked keys and host patterns are left to libssh */
+typedef struct _RemminaSSHKnownHosts {
+	gchar *		filename;
+	/* Identity of the indexed file version */
+	time_t		mtime;
+	off_t		size;
+	ino_t		ino;
+	/* "host" or "[host]:port" -> GPtrArray of base64 keys */
+	GHashTable *	hosts;
+	/* Entries with hashed host names, resolved on lookup */
+	GPtrArray *	hashed;
+	/* base64 keys marked @revoked */
+	GHashTable *	revoked;
+} RemminaSSHKnownHosts;
+
+typedef struct _RemminaSSHKnownHostsHashed {
+	guchar *	salt;
+	gsize		salt_len;
+	guchar *	hash;
+	gsize		hash_len;
+	gchar *		key;
+} RemminaSSHKnownHostsHashed;
+
+static pthread_mutex_t known_hosts_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RemminaSSHKnownHosts known_hosts = { NULL };
 
-	/* Init & startup the SSH session */
-	REMMINA_DEBUG("server=%s port=%d is_tunnel=%s tunnel_entrance_host=%s tunnel_entrance_port=%d",
-		      ssh->server,
-		      ssh->port,
-		      ssh->is_tunnel ? "Yes" : "No",
-		      ssh->tunnel_entrance_host, ssh->tunnel_entrance_port);
+static void
+remmina_ssh_known_hosts_hashed_free(RemminaSSHKnownHostsHashed *entry)
+{
+	g_free(entry->salt);
+	g_free(entry->hash);
+	g_free(entry->key);
+	g_free(entry);
+}
 
-	ssh->session = ssh_new();
+static GPtrArray *
+remmina_ssh_known_hosts_keys(const gchar *host)
+{
+	GPtrArray *keys;
 
-	/* Tunnel sanity checks */
-	if (ssh->is_tunnel && ssh->tunnel_entrance_host != NULL) {
-		ssh->error = g_strdup_printf("Internal error in %s: is_tunnel and tunnel_entrance != NULL", __func__);
-		REMMINA_DEBUG(ssh->error);
-		return FALSE;
-	}
-	if (!ssh->is_tunnel && ssh->tunnel_entrance_host == NULL) {
-		ssh->error = g_strdup_printf("Internal error in %s: is_tunnel == false and tunnel_entrance == NULL", __func__);
-		REMMINA_DEBUG(ssh->error);
-		return FALSE;
+	keys = g_hash_table_lookup(known_hosts.hosts, host);
+	if (!keys) {
+		keys = g_ptr_array_new_with_free_func(g_free);
+		g_hash_table_insert(known_hosts.hosts, g_strdup(host), keys);
 	}
+	return keys;
+}
 
-	/* Set connection host/port */
-	if (ssh->is_tunnel) {
-		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->server);
-		ssh_options_set(ssh->session, SSH_OPTIONS_PORT, &ssh->port);
-		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to %s and SSH_OPTIONS_PORT to %d", ssh->server, ssh->port);
-	} else {
-		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->tunnel_entrance_host);
-		ssh_options_set(ssh->session, SSH_OPTIONS_PORT, &ssh->tunnel_entrance_port);
-		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to %s and SSH_OPTIONS_PORT to %d", ssh->tunnel_entrance_host, ssh->tunnel_entrance_port);
-	}
+static void
+remmina_ssh_known_hosts_parse_line(gchar *line)
+{
+	RemminaSSHKnownHostsHashed *entry;
+	gchar *save = NULL;
+	gchar *marker = NULL;
+	gchar *hosts, *key, **names, **parts;
+	gint i;
 
-	if (ssh->allow_ssh_rsa){
-		ssh_options_set(ssh->session, SSH_OPTIONS_PUBLICKEY_ACCEPTED_TYPES, "+ssh-rsa");
+	hosts = strtok_r(line, " \t", &save);
+	if (!hosts || hosts[0] == '#')
+		return;
+	if (hosts[0] == '@') {
+		marker = hosts;
+		hosts = strtok_r(NULL, " \t", &save);
 	}
-	
-	if (ssh->privkeyfile && *ssh->privkeyfile != 0) {
-		rc = ssh_options_set(ssh->session, SSH_OPTIONS_IDENTITY, ssh->privkeyfile);
-		if (rc == 0)
-			REMMINA_DEBUG("SSH_OPTIONS_IDENTITY is now %s", ssh->privkeyfile);
-		else
-			REMMINA_DEBUG("SSH_OPTIONS_IDENTITY is not set, by default the files “identity”, “id_dsa” and “id_rsa” are used.");
+	/* The key type is part of the base64 blob already */
+	if (!hosts || !strtok_r(NULL, " \t", &save) || !(key = strtok_r(NULL, " \t", &save)))
+		return;
+
+	if (marker) {
+		if (g_strcmp0(marker, "@revoked") == 0)
+			g_hash_table_add(known_hosts.revoked, g_strdup(key));
+		/* @cert-authority lines only ever vouch through libssh */
+		return;
 	}
+	/* Negated patterns exclude hosts from the whole line */
+	if (strchr(hosts, '!'))
+		return;
 
-#ifdef SNAP_BUILD
-	ssh_options_set(ssh->session, SSH_OPTIONS_SSH_DIR, g_strdup_printf("%s/.ssh", g_getenv("SNAP_USER_COMMON")));
-#endif
-	ssh_callbacks_init(ssh->callback);
-	if (remmina_log_running()) {
-		verbosity = remmina_pref.ssh_loglevel;
-		ssh_options_set(ssh->session, SSH_OPTIONS_LOG_VERBOSITY, &verbosity);
-		ssh->callback->log_function = remmina_ssh_log_callback;
-		/* Reset libssh legacy userdata. This is a workaround for a libssh bug */
-		ssh_set_log_userdata(ssh->session);
+	if (g_str_has_prefix(hosts, "|1|")) {
+		parts = g_strsplit(hosts + 3, "|", 2);
+		if (parts[0] && parts[1]) {
+			entry = g_new0(RemminaSSHKnownHostsHashed, 1);
+			entry->salt = g_base64_decode(parts[0], &entry->salt_len);
+			entry->hash = g_base64_decode(parts[1], &entry->hash_len);
+			entry->key = g_strdup(key);
+			g_ptr_array_add(known_hosts.hashed, entry);
+		}
+		g_strfreev(parts);
+		return;
 	}
-	ssh->callback->userdata = ssh;
-	ssh_set_callbacks(ssh->session, ssh->callback);
 
-	/* As the latest parse the ~/.ssh/config file */
-	if (g_strcmp0(ssh->tunnel_entrance_host, "127.0.0.1") == 0) {
-		REMMINA_DEBUG("SSH_OPTIONS_HOST temporary set to the destination host as ssh->tunnel_entrance_host is 127.0.0.1,");
-		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->server);
+	names = g_strsplit(hosts, ",", 0);
+	for (i = 0; names[i]; i++) {
+		if (strpbrk(names[i], "*?"))
+			continue;
+		g_ptr_array_add(remmina_ssh_known_hosts_keys(names[i]), g_strdup(key));
 	}
-	if (remmina_pref.ssh_parseconfig) {
-		if (ssh_options_parse_config(ssh->session, NULL) == 0)
-			REMMINA_DEBUG("ssh_config have been correctly parsed");
-		else
-			REMMINA_DEBUG("Cannot parse ssh_config: %s", ssh_get_error(ssh->session));
+	g_strfreev(names);
+}
+
+/* Called with known_hosts_mutex held */
+static void
+remmina_ssh_known_hosts_drop(void)
+{
+	TRACE_CALL(__func__);
+	if (known_hosts.hosts) {
+		g_hash_table_destroy(known_hosts.hosts);
+		g_ptr_array_free(known_hosts.hashed, TRUE);
+		g_hash_table_destroy(known_hosts.revoked);
+		known_hosts.hosts = NULL;
 	}
+}
 
-	if (g_strcmp0(ssh->tunnel_entrance_host, "127.0.0.1") == 0) {
-		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to ssh->tunnel_entrance_host is 127.0.0.1,");
-		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->tunnel_entrance_host);
+/* Called with known_hosts_mutex held */
+static gboolean
+remmina_ssh_known_hosts_load(const gchar *filename)
+{
+	TRACE_CALL(__func__);
+	GStatBuf st;
+	gchar *contents, *line, *next;
+
+	if (g_stat(filename, &st) != 0)
+		return FALSE;
+	if (known_hosts.hosts && g_strcmp0(known_hosts.filename, filename) == 0 &&
+	    known_hosts.mtime == st.st_mtime && known_hosts.size == st.st_size && known_hosts.ino == st.st_ino)
+		return TRUE;
+
+	if (!g_file_get_contents(filename, &contents, NULL, NULL))
+		return FALSE;
+
+	remmina_ssh_known_hosts_drop();
+	g_free(known_hosts.filename);
+	known_hosts.filename = g_strdup(filename);
+	known_hosts.mtime = st.st_mtime;
+	known_hosts.size = st.st_size;
+	known_hosts.ino = st.st_ino;
+	known_hosts.hosts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+	known_hosts.hashed = g_ptr_array_new_with_free_func((GDestroyNotify)remmina_ssh_known_hosts_hashed_free);
+	known_hosts.revoked = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+	for (line = contents; line; line = next) {
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+		remmina_ssh_known_hosts_parse_line(line);
 	}
-	if (!ssh->user || *ssh->user == 0) {
-    rc = ssh_options_get(ssh->session, SSH_OPTIONS_USER, &parsed_config);
-    if (rc == SSH_OK) {
-      if (ssh->user)
-        g_free(ssh->user);
-      ssh->user = g_strdup(parsed_config);
-      ssh_string_free_char(parsed_config);
-    } else {
-      REMMINA_DEBUG("Parsing ssh_config for SSH_OPTIONS_USER returned an error: %s", ssh_get_error(ssh->session));
-    }
-  }
-  ssh_options_set(ssh->session, SSH_OPTIONS_USER, ssh->user);
-	REMMINA_DEBUG("SSH_OPTIONS_USER is now %s", ssh->user);
+	g_free(contents);
 
-	/* SSH_OPTIONS_PROXYCOMMAND */
+	REMMINA_DEBUG("Indexed %u hosts and %u hashed entries of %s",
+		      g_hash_table_size(known_hosts.hosts), known_hosts.hashed->len, filename);
+	return TRUE;
+}
+
+/* Called with known_hosts_mutex held */
+static gboolean
+remmina_ssh_known_hosts_match(const gchar *host, const gchar *key)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHKnownHostsHashed *entry;
+	GPtrArray *keys;
+	GHmac *hmac;
+	guint8 digest[20];
+	gsize digest_len;
+	guint i;
+
+	if (g_hash_table_contains(known_hosts.revoked, key))
+		return FALSE;
+
+	keys = g_hash_table_lookup(known_hosts.hosts, host);
+	if (!keys) {
+		/* Resolve the hashed entries of this host once per file version */
+		keys = remmina_ssh_known_hosts_keys(host);
+		for (i = 0; i < known_hosts.hashed->len; i++) {
+			entry = (RemminaSSHKnownHostsHashed *)known_hosts.hashed->pdata[i];
+			hmac = g_hmac_new(G_CHECKSUM_SHA1, entry->salt, entry->salt_len);
+			g_hmac_update(hmac, (const guchar *)host, -1);
+			digest_len = sizeof(digest);
+			g_hmac_get_digest(hmac, digest, &digest_len);
+			g_hmac_unref(hmac);
+			if (digest_len == entry->hash_len && memcmp(digest, entry->hash, digest_len) == 0)
+				g_ptr_array_add(keys, g_strdup(entry->key));
+		}
+	}
+
+	for (i = 0; i < keys->len; i++)
+		if (g_strcmp0((const gchar *)keys->pdata[i], key) == 0)
+			return TRUE;
+	return FALSE;
+}
+
+/* known_hosts file, host entry and base64 key of the server of the session */
+static gboolean
+remmina_ssh_known_hosts_entry(RemminaSSH *ssh, gchar **filename, gchar **host, gchar **key)
+{
+	TRACE_CALL(__func__);
+	ssh_key server_pubkey;
+	gchar *value = NULL;
+	gchar *name;
+	guint port = 22;
+
+	if (ssh_get_server_publickey(ssh->session, &server_pubkey) != SSH_OK)
+		return FALSE;
+	if (ssh_pki_export_pubkey_base64(server_pubkey, &value) != SSH_OK) {
+		ssh_key_free(server_pubkey);
+		return FALSE;
+	}
+	ssh_key_free(server_pubkey);
+	*key = g_strdup(value);
+	ssh_string_free_char(value);
+
+	value = NULL;
+	if (ssh_options_get(ssh->session, SSH_OPTIONS_HOST, &value) != SSH_OK) {
+		g_free(*key);
+		return FALSE;
+	}
+	ssh_options_get_port(ssh->session, &port);
+	name = g_ascii_strdown(value, -1);
+	ssh_string_free_char(value);
+	if (port == 22) {
+		*host = name;
+	} else {
+		*host = g_strdup_printf("[%s]:%u", name, port);
+		g_free(name);
+	}
+
+	value = NULL;
+	if (ssh_options_get(ssh->session, SSH_OPTIONS_KNOWNHOSTS, &value) == SSH_OK && value) {
+		*filename = g_strdup(value);
+		ssh_string_free_char(value);
+	} else {
+		*filename = g_build_filename(g_get_home_dir(), ".ssh", "known_hosts", NULL);
+	}
+
+	return TRUE;
+}
+
+/* Drop-in for ssh_session_is_known_server() answering from the index when
+ * it can, the expensive parse of the file only happens once per change */
+static enum ssh_known_hosts_e
+remmina_ssh_known_server(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	gchar *filename, *host, *key;
+	gboolean known = FALSE;
+
+	if (remmina_ssh_known_hosts_entry(ssh, &filename, &host, &key)) {
+		pthread_mutex_lock(&known_hosts_mutex);
+		if (remmina_ssh_known_hosts_load(filename))
+			known = remmina_ssh_known_hosts_match(host, key);
+		pthread_mutex_unlock(&known_hosts_mutex);
+		g_free(filename);
+		g_free(host);
+		g_free(key);
+	}
+
+	if (known)
+		return SSH_KNOWN_HOSTS_OK;
+	return ssh_session_is_known_server(ssh->session);
+}
+
+/* Record the key of the server and update the index in place, if the file
+ * was still the one indexed before the write */
+static void
+remmina_ssh_update_known_hosts(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	gchar *filename, *host, *key;
+	gboolean indexed;
+	GStatBuf st;
+
+	if (!remmina_ssh_known_hosts_entry(ssh, &filename, &host, &key)) {
+		ssh_session_update_known_hosts(ssh->session);
+		return;
+	}
+
+	pthread_mutex_lock(&known_hosts_mutex);
+	indexed = known_hosts.hosts && g_strcmp0(known_hosts.filename, filename) == 0 &&
+		  g_stat(filename, &st) == 0 && known_hosts.mtime == st.st_mtime &&
+		  known_hosts.size == st.st_size && known_hosts.ino == st.st_ino;
+	if (ssh_session_update_known_hosts(ssh->session) == SSH_OK && indexed && g_stat(filename, &st) == 0) {
+		g_ptr_array_add(remmina_ssh_known_hosts_keys(host), g_strdup(key));
+		known_hosts.mtime = st.st_mtime;
+		known_hosts.size = st.st_size;
+		known_hosts.ino = st.st_ino;
+	} else {
+		/* Edited since it was indexed, e.g. by ssh-keygen -R: the next
+		 * check parses it again */
+		remmina_ssh_known_hosts_drop();
+	}
+	pthread_mutex_unlock(&known_hosts_mutex);
+
+	g_free(filename);
+	g_free(host);
+	g_free(key);
+}
+
+#endif
+
+/* Time given to the TCP connection to the SSH server, in milliseconds. libssh
+ * cannot report the ConnectTimeout of ssh_config, so it is the TCP user
+ * timeout of the preferences, the time the connection may then go unanswered */
+static gint
+remmina_ssh_connect_timeout(void)
+{
+	return remmina_pref.ssh_tcp_usrtimeout > 0 ? remmina_pref.ssh_tcp_usrtimeout : SSH_SOCKET_TCP_USER_TIMEOUT;
+}
+
+/*-----------------------------------------------------------------------------*
+*                           Session pool                                      *
+*-----------------------------------------------------------------------------*/
+
+/* OpenSSH servers refuse more than MaxSessions (10 by default) channels per
+ * connection, and channels of previous owners may still be half closed, so
+ * a pooled session is retired after that many owners */
+#define REMMINA_SSH_POOL_MAX_LEASES 10
+
+/* An authenticated session parked after its owner was freed. A later
+ * RemminaSSH with the same key takes it over and skips TCP connect, key
+ * exchange and authentication. A session only ever has one owner at a time:
+ * our consumers drive libssh from their own threads without locking */
+typedef struct _RemminaSSHPoolEntry {
+	gchar *		key;
+	ssh_session	session;
+	gboolean	authenticated;
+	gint		leases;
+	guint		expire_source;
+} RemminaSSHPoolEntry;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when a prefetch is over */
+static pthread_cond_t prefetch_cond = PTHREAD_COND_INITIALIZER;
+/* Keys of the sessions being prefetched, mapped to their RemminaSSH */
+static GHashTable *prefetch_keys = NULL;
+static GHashTable *pool_table = NULL;
+static struct ssh_callbacks_struct pool_callbacks;
+
+/* Digest of the secret ssh authenticates with, NULL if the method has no
+ * secret that can be checked before authenticating. It is salted per process,
+ * as pool keys are logged */
+static gchar *
+remmina_ssh_pool_credentials(RemminaSSH *ssh, const gchar *secret)
+{
+	TRACE_CALL(__func__);
+	static guint32 salt[8];
+	static gsize salt_set = 0;
+	guint i;
+
+	switch (ssh->auth) {
+	case SSH_AUTH_PASSWORD:
+		if (!secret || !*secret)
+			return NULL;
+		break;
+	case SSH_AUTH_PUBLICKEY:
+	case SSH_AUTH_AUTO_PUBLICKEY:
+		/* Key files without passphrase have none */
+		if (!secret)
+			secret = "";
+		break;
+	case SSH_AUTH_AGENT:
+	case SSH_AUTH_GSSAPI:
+		/* The agent and the Kerberos tickets belong to the local user */
+		secret = "";
+		break;
+	default:
+		return NULL;
+	}
+
+	if (g_once_init_enter(&salt_set)) {
+		for (i = 0; i < G_N_ELEMENTS(salt); i++)
+			salt[i] = g_random_int();
+		g_once_init_leave(&salt_set, 1);
+	}
+	return g_compute_hmac_for_string(G_CHECKSUM_SHA256, (const guchar *)salt, sizeof(salt), secret, -1);
+}
+
+static gchar *
+remmina_ssh_pool_key(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	/* Sessions connected through a local tunnel die with the tunnel */
+	if (!ssh->is_tunnel && g_strcmp0(ssh->tunnel_entrance_host, "127.0.0.1") == 0)
+		return NULL;
+	if (ssh->command_args)
+		return NULL;
+	/* A profile must never get a session it could not authenticate itself */
+	if (!ssh->pool_credentials)
+		return NULL;
+
+	return g_strdup_printf("%s@%s:%d/%s:%d|%d|%s|%s|%s",
+			       ssh->user ? ssh->user : "",
+			       ssh->server, ssh->port,
+			       ssh->is_tunnel ? "" : ssh->tunnel_entrance_host,
+			       ssh->is_tunnel ? 0 : ssh->tunnel_entrance_port,
+			       ssh->auth,
+			       ssh->privkeyfile ? ssh->privkeyfile : "",
+			       ssh->certfile ? ssh->certfile : "",
+			       ssh->pool_credentials);
+}
+
+static void
+remmina_ssh_pool_entry_free(RemminaSSHPoolEntry *entry)
+{
+	TRACE_CALL(__func__);
+	REMMINA_DEBUG("Disconnecting pooled SSH session %s", entry->key);
+	ssh_disconnect(entry->session);
+	ssh_free(entry->session);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+static gboolean
+remmina_ssh_pool_expire(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHPoolEntry *entry;
+	guint source = g_source_get_id(g_main_current_source());
+
+	/* The entry may have been taken over while this source was dispatched,
+	 * so look it up again by key */
+	pthread_mutex_lock(&pool_mutex);
+	entry = g_hash_table_lookup(pool_table, (const gchar *)data);
+	if (entry && entry->expire_source == source)
+		g_hash_table_steal(pool_table, entry->key);
+	else
+		entry = NULL;
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (entry)
+		remmina_ssh_pool_entry_free(entry);
+	return G_SOURCE_REMOVE;
+}
+
+/* Take over a parked session matching ssh, returns FALSE if there is none.
+ * A prefetch of the same session is waited for at most timeout milliseconds */
+static gboolean
+remmina_ssh_pool_acquire(RemminaSSH *ssh, gint timeout)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHPoolEntry *entry = NULL;
+	RemminaSSH *prefetcher;
+	struct timespec deadline;
+	gchar *user;
+	gint status;
+
+	if (!ssh->pool_key)
+		return FALSE;
+
+	pthread_mutex_lock(&pool_mutex);
+	/* The same session is being prefetched: wait for it to be parked,
+	 * instead of racing it with a second connection to the server */
+	if (prefetch_keys) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_nsec += (long)(timeout % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while ((prefetcher = g_hash_table_lookup(prefetch_keys, ssh->pool_key)) && prefetcher != ssh)
+			if (pthread_cond_timedwait(&prefetch_cond, &pool_mutex, &deadline) == ETIMEDOUT)
+				break;
+	}
+	if (pool_table) {
+		entry = g_hash_table_lookup(pool_table, ssh->pool_key);
+		if (entry) {
+			g_hash_table_steal(pool_table, ssh->pool_key);
+			g_source_remove(entry->expire_source);
+		}
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (!entry)
+		return FALSE;
+
+	/* The server may have dropped the connection while it was parked */
+	status = ssh_get_status(entry->session);
+	if (!ssh_is_connected(entry->session) || (status & (SSH_CLOSED | SSH_CLOSED_ERROR))) {
+		remmina_ssh_pool_entry_free(entry);
+		return FALSE;
+	}
+
+	REMMINA_DEBUG("Reusing %s SSH session %s, owner %d",
+		      entry->authenticated ? "authenticated" : "connected", entry->key, entry->leases + 1);
+	ssh->session = entry->session;
+	ssh->pool_leases = entry->leases + 1;
+	ssh->authenticated = entry->authenticated;
+	if (!ssh->user || *ssh->user == 0) {
+		if (ssh_options_get(ssh->session, SSH_OPTIONS_USER, &user) == SSH_OK) {
+			g_free(ssh->user);
+			ssh->user = g_strdup(user);
+			ssh_string_free_char(user);
+		}
+	}
+	g_free(entry->key);
+	g_free(entry);
+
+	ssh->callback->userdata = ssh;
+	ssh_set_callbacks(ssh->session, ssh->callback);
+
+	return TRUE;
+}
+
+/* Park the session of ssh, authenticated or not, returns FALSE if the
+ * caller must disconnect it */
+static gboolean
+remmina_ssh_pool_park(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHPoolEntry *entry;
+	gint timeout = remmina_pref.ssh_session_reuse_timeout;
+
+	if (timeout <= 0 || !ssh->pool_key || ssh->error)
+		return FALSE;
+	if (ssh->pool_leases >= REMMINA_SSH_POOL_MAX_LEASES)
+		return FALSE;
+	if (!ssh_is_connected(ssh->session))
+		return FALSE;
+
+	pthread_mutex_lock(&pool_mutex);
+	if (!pool_table) {
+		pool_table = g_hash_table_new(g_str_hash, g_str_equal);
+		ssh_callbacks_init(&pool_callbacks);
+		pool_callbacks.log_function = remmina_ssh_log_callback;
+	}
+	if (g_hash_table_contains(pool_table, ssh->pool_key)) {
+		pthread_mutex_unlock(&pool_mutex);
+		return FALSE;
+	}
+
+	/* Owner callbacks and their userdata go away with the owner */
+	ssh_set_callbacks(ssh->session, &pool_callbacks);
+
+	entry = g_new0(RemminaSSHPoolEntry, 1);
+	entry->key = ssh->pool_key;
+	entry->session = ssh->session;
+	entry->authenticated = ssh->authenticated;
+	entry->leases = ssh->pool_leases;
+	entry->expire_source = g_timeout_add_seconds_full(G_PRIORITY_DEFAULT, timeout, remmina_ssh_pool_expire,
+							  g_strdup(entry->key), g_free);
+	g_hash_table_insert(pool_table, entry->key, entry);
+	pthread_mutex_unlock(&pool_mutex);
+
+	REMMINA_DEBUG("Parked SSH session %s for %d seconds", entry->key, timeout);
+	ssh->pool_key = NULL;
+	ssh->session = NULL;
+	return TRUE;
+}
+
+/* Park the session of an owner being freed, returns FALSE if the caller must
+ * disconnect it */
+static gboolean
+remmina_ssh_pool_release(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	if (!ssh->authenticated)
+		return FALSE;
+	ssh->pool_leases = MAX(ssh->pool_leases, 1);
+	return remmina_ssh_pool_park(ssh);
+}
+
+/* Owners which leave the session in an unknown state, or authenticated it
+ * with other credentials than their profile, must not park or share it */
+static void
+remmina_ssh_pool_forget(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	g_free(ssh->pool_key);
+	ssh->pool_key = NULL;
+	g_free(ssh->pool_credentials);
+	ssh->pool_credentials = NULL;
+}
+
+/* A ProxyCommand or ProxyJump, from the profile or ssh_config, makes its own
+ * connection to the server */
+static gboolean
+remmina_ssh_uses_proxy(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+	gchar *jump = NULL;
+	gboolean ret;
+#endif
+
+	/* Older libssh turn ProxyJump into a ProxyCommand */
+	if (ssh->proxycommand && *ssh->proxycommand && g_ascii_strcasecmp(ssh->proxycommand, "none") != 0)
+		return TRUE;
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+	if (ssh_options_get(ssh->session, SSH_OPTIONS_PROXYJUMP, &jump) == SSH_OK) {
+		ret = jump && *jump && g_ascii_strcasecmp(jump, "none") != 0;
+		ssh_string_free_char(jump);
+		return ret;
+	}
+#endif
+	return FALSE;
+}
+
+gboolean
+remmina_ssh_init_session(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	gint verbosity;
+	gint rc;
+	gchar *parsed_config;
+#ifdef HAVE_NETINET_TCP_H
+	socket_t sshsock;
+	gint optval;
+#endif
+	char *hostname;
+	unsigned int set_port;
+	socket_t sock;
+	gchar* args[100]; //Should be much smaller, but set 100 to be safe
+	gint connect_timeout = remmina_ssh_connect_timeout();
+	gint64 start;
+
+	ssh->callback = g_new0(struct ssh_callbacks_struct, 1);
+
+	/* Init & startup the SSH session */
+	REMMINA_DEBUG("server=%s port=%d is_tunnel=%s tunnel_entrance_host=%s tunnel_entrance_port=%d",
+		      ssh->server,
+		      ssh->port,
+		      ssh->is_tunnel ? "Yes" : "No",
+		      ssh->tunnel_entrance_host, ssh->tunnel_entrance_port);
+
+	g_free(ssh->pool_key);
+	ssh->pool_key = remmina_ssh_pool_key(ssh);
+	ssh_callbacks_init(ssh->callback);
+	if (remmina_log_running())
+		ssh->callback->log_function = remmina_ssh_log_callback;
+	start = g_get_monotonic_time();
+	if (remmina_pref.ssh_session_reuse_timeout > 0 && remmina_ssh_pool_acquire(ssh, connect_timeout))
+		return TRUE;
+	/* Waiting for a prefetch counts against the connect timeout, a dead
+	 * server takes no longer to fail than without the prefetch */
+	connect_timeout = MAX(connect_timeout - (gint)((g_get_monotonic_time() - start) / 1000), 1);
+
+	ssh->session = ssh_new();
+
+	/* Tunnel sanity checks */
+	if (ssh->is_tunnel && ssh->tunnel_entrance_host != NULL) {
+		ssh->error = g_strdup_printf("Internal error in %s: is_tunnel and tunnel_entrance != NULL", __func__);
+		REMMINA_DEBUG(ssh->error);
+		return FALSE;
+	}
+	if (!ssh->is_tunnel && ssh->tunnel_entrance_host == NULL) {
+		ssh->error = g_strdup_printf("Internal error in %s: is_tunnel == false and tunnel_entrance == NULL", __func__);
+		REMMINA_DEBUG(ssh->error);
+		return FALSE;
+	}
+
+	/* Set connection host/port */
+	if (ssh->is_tunnel) {
+		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->server);
+		ssh_options_set(ssh->session, SSH_OPTIONS_PORT, &ssh->port);
+		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to %s and SSH_OPTIONS_PORT to %d", ssh->server, ssh->port);
+	} else {
+		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->tunnel_entrance_host);
+		ssh_options_set(ssh->session, SSH_OPTIONS_PORT, &ssh->tunnel_entrance_port);
+		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to %s and SSH_OPTIONS_PORT to %d", ssh->tunnel_entrance_host, ssh->tunnel_entrance_port);
+	}
+
+	if (ssh->allow_ssh_rsa){
+		ssh_options_set(ssh->session, SSH_OPTIONS_PUBLICKEY_ACCEPTED_TYPES, "+ssh-rsa");
+	}
+	
+	if (ssh->privkeyfile && *ssh->privkeyfile != 0) {
+		rc = ssh_options_set(ssh->session, SSH_OPTIONS_IDENTITY, ssh->privkeyfile);
+		if (rc == 0)
+			REMMINA_DEBUG("SSH_OPTIONS_IDENTITY is now %s", ssh->privkeyfile);
+		else
+			REMMINA_DEBUG("SSH_OPTIONS_IDENTITY is not set, by default the files “identity”, “id_dsa” and “id_rsa” are used.");
+	}
+
+#ifdef SNAP_BUILD
+	ssh_options_set(ssh->session, SSH_OPTIONS_SSH_DIR, g_strdup_printf("%s/.ssh", g_getenv("SNAP_USER_COMMON")));
+#endif
+	ssh_callbacks_init(ssh->callback);
+	if (remmina_log_running()) {
+		verbosity = remmina_pref.ssh_loglevel;
+		ssh_options_set(ssh->session, SSH_OPTIONS_LOG_VERBOSITY, &verbosity);
+		ssh->callback->log_function = remmina_ssh_log_callback;
+		/* Reset libssh legacy userdata. This is a workaround for a libssh bug */
+		ssh_set_log_userdata(ssh->session);
+	}
+	ssh->callback->userdata = ssh;
+	ssh_set_callbacks(ssh->session, ssh->callback);
+
+	/* As the latest parse the ~/.ssh/config file */
+	if (g_strcmp0(ssh->tunnel_entrance_host, "127.0.0.1") == 0) {
+		REMMINA_DEBUG("SSH_OPTIONS_HOST temporary set to the destination host as ssh->tunnel_entrance_host is 127.0.0.1,");
+		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->server);
+	}
+	if (remmina_pref.ssh_parseconfig) {
+		if (ssh_options_parse_config(ssh->session, NULL) == 0)
+			REMMINA_DEBUG("ssh_config have been correctly parsed");
+		else
+			REMMINA_DEBUG("Cannot parse ssh_config: %s", ssh_get_error(ssh->session));
+	}
+
+	if (g_strcmp0(ssh->tunnel_entrance_host, "127.0.0.1") == 0) {
+		REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to ssh->tunnel_entrance_host is 127.0.0.1,");
+		ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ssh->tunnel_entrance_host);
+	}
+	if (!ssh->user || *ssh->user == 0) {
+    rc = ssh_options_get(ssh->session, SSH_OPTIONS_USER, &parsed_config);
+    if (rc == SSH_OK) {
+      if (ssh->user)
+        g_free(ssh->user);
+      ssh->user = g_strdup(parsed_config);
+      ssh_string_free_char(parsed_config);
+    } else {
+      REMMINA_DEBUG("Parsing ssh_config for SSH_OPTIONS_USER returned an error: %s", ssh_get_error(ssh->session));
+    }
+  }
+  ssh_options_set(ssh->session, SSH_OPTIONS_USER, ssh->user);
+	REMMINA_DEBUG("SSH_OPTIONS_USER is now %s", ssh->user);
+
+	/* SSH_OPTIONS_PROXYCOMMAND */
 	rc = ssh_options_get(ssh->session, SSH_OPTIONS_PROXYCOMMAND, &parsed_config);
 	if (rc == SSH_OK) {
 		ssh->proxycommand = g_strdup(parsed_config);
@@ -1888,82 +2691,23 @@ remmina_ssh_init_session(RemminaSSH *ssh)
 	}
 
 
-	// Handle the dual IPv4 / IPv6 stack
-	// Prioritize IPv6 and fallback to IPv4
-	if (ssh_connect(ssh->session)) {
-		unsigned short int success = 0;
-
-		// Run the DNS resolution 
-		// First retrieve host from the ssh->session structure
+	/* Race the IPv6 and IPv4 addresses of the host and let libssh use the
+	 * winning socket, unless libssh connects through a proxy */
+	if (!remmina_ssh_uses_proxy(ssh)) {
 		ssh_options_get(ssh->session, SSH_OPTIONS_HOST, &hostname);
-		unsigned int set_port;
 		ssh_options_get_port(ssh->session, &set_port);
-		// Call getaddrinfo
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_family = AF_INET6;
-		hints.ai_socktype = SOCK_STREAM;
-		if ((getaddrinfo(hostname, NULL, &hints, &aitop)) != 0) {
-			ssh->error = g_strdup_printf("Could not resolve hostname %s to IPv6", hostname);
+		sock = remmina_public_tcp_connect(hostname, set_port, connect_timeout, &ssh->error);
+		ssh_string_free_char(hostname);
+		if (sock < 0) {
 			REMMINA_DEBUG(ssh->error);
-		}
-		else {
-			// We have one or more IPV6 addesses now, extract them
-			ai = aitop;
-			while (ai != NULL) {
-				struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *)ai->ai_addr;
-				addr6 = &(ipv6->sin6_addr);
-				inet_ntop(AF_INET6, addr6, ipstr, sizeof ipstr);
-				ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ipstr);
-				REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to IPv6 %s", ipstr);
-				if (ssh_connect(ssh->session)) {
-					ssh_disconnect(ssh->session);
-					REMMINA_DEBUG("IPv6 session failed");
-				} else {
-					success = 1;
-					REMMINA_DEBUG("IPv6 session success !");
-					break;
-				}
-				ai = ai->ai_next;
-			}
-			freeaddrinfo(aitop);
-		}
-		if (success == 0) {
-			// Fallback to IPv4
-			// Call getaddrinfo
-			memset(&hints, 0, sizeof(hints));
-			hints.ai_family = AF_INET;
-			hints.ai_socktype = SOCK_STREAM;
-			if ((getaddrinfo(hostname, NULL, &hints, &aitop)) != 0) {
-				ssh->error = g_strdup_printf("Could not resolve hostname %s to IPv4", hostname);
-				REMMINA_DEBUG(ssh->error);
-				return FALSE;
-			}
-			else {
-				// We have one or more IPV4 addesses now, extract them
-				ai = aitop;
-				while (ai != NULL) {
-					struct sockaddr_in *ipv4 = (struct sockaddr_in *)ai->ai_addr;
-					addr4 = &(ipv4->sin_addr);
-					inet_ntop(AF_INET, addr4, ipstr, sizeof ipstr);
-					ssh_options_set(ssh->session, SSH_OPTIONS_HOST, ipstr);
-					REMMINA_DEBUG("Setting SSH_OPTIONS_HOST to IPv4 %s", ipstr);
-					if (ssh_connect(ssh->session)) {
-						ssh_disconnect(ssh->session);
-						ssh->error = g_strdup_printf("Error connecting to %s:%d ", hostname, set_port);
-						REMMINA_DEBUG("IPv4 session failed");
-					} else {
-						success = 1;
-						REMMINA_DEBUG("IPv4 session success !");
-						break;
-					}
-					ai = ai->ai_next;
-				}
-				freeaddrinfo(aitop);
-			}
-		}
-		if (success == 0){
 			return FALSE;
 		}
+		ssh_options_set(ssh->session, SSH_OPTIONS_FD, &sock);
+	}
+	if (ssh_connect(ssh->session)) {
+		// TRANSLATORS: The placeholder %s is an error message
+		remmina_ssh_set_error(ssh, _("Could not start SSH session. %s"));
+		return FALSE;
 	}
 
  #ifdef HAVE_NETINET_TCP_H
@@ -2019,18 +2763,24 @@ remmina_ssh_init_session(RemminaSSH *ssh)
 	return TRUE;
 }
 
-gboolean
-remmina_ssh_init_from_file(RemminaSSH *ssh, RemminaFile *remminafile, gboolean is_tunnel)
+/* Without use_secrets nothing is read from the secret plugin, and the session
+ * can only be pooled if its authentication method has no secret */
+static gboolean
+remmina_ssh_init_from_file_full(RemminaSSH *ssh, RemminaFile *remminafile, gboolean is_tunnel, gboolean use_secrets)
 {
 	TRACE_CALL(__func__);
 	const gchar *username;
 	const gchar *privatekey;
 	const gchar *server;
+	const gchar *secret_key;
 	gchar *s;
 
 	ssh->session = NULL;
 	ssh->callback = NULL;
 	ssh->authenticated = FALSE;
+	ssh->pool_key = NULL;
+	ssh->pool_credentials = NULL;
+	ssh->pool_leases = 0;
 	ssh->error = NULL;
 	ssh->passphrase = NULL;
 	ssh->is_tunnel = is_tunnel;
@@ -2115,15 +2865,42 @@ remmina_ssh_init_from_file(RemminaSSH *ssh, RemminaFile *remminafile, gboolean i
 		ssh->privkeyfile = NULL;
 	}
 
+	/* The saved secret remmina_ssh_auth_gui() tries first */
+	switch (ssh->auth) {
+	case SSH_AUTH_PASSWORD:
+		secret_key = is_tunnel ? "ssh_tunnel_password" : "password";
+		break;
+	case SSH_AUTH_PUBLICKEY:
+	case SSH_AUTH_AUTO_PUBLICKEY:
+		secret_key = is_tunnel ? "ssh_tunnel_passphrase" : "ssh_passphrase";
+		break;
+	default:
+		secret_key = NULL;
+	}
+	if (!secret_key)
+		ssh->pool_credentials = remmina_ssh_pool_credentials(ssh, NULL);
+	else if (use_secrets)
+		ssh->pool_credentials = remmina_ssh_pool_credentials(ssh, remmina_file_get_string(remminafile, secret_key));
+
 	return TRUE;
 }
 
+gboolean
+remmina_ssh_init_from_file(RemminaSSH *ssh, RemminaFile *remminafile, gboolean is_tunnel)
+{
+	TRACE_CALL(__func__);
+	return remmina_ssh_init_from_file_full(ssh, remminafile, is_tunnel, TRUE);
+}
+
 static gboolean
 remmina_ssh_init_from_ssh(RemminaSSH *ssh, const RemminaSSH *ssh_src)
 {
 	TRACE_CALL(__func__);
 	ssh->session = NULL;
 	ssh->authenticated = FALSE;
+	ssh->pool_key = NULL;
+	ssh->pool_credentials = g_strdup(ssh_src->pool_credentials);
+	ssh->pool_leases = 0;
 	ssh->error = NULL;
 	pthread_mutex_init(&ssh->ssh_mutex, NULL);
 
@@ -2149,50 +2926,247 @@ remmina_ssh_init_from_ssh(RemminaSSH *ssh, const RemminaSSH *ssh_src)
 	return TRUE;
 }
 
-gchar *
-remmina_ssh_convert(RemminaSSH *ssh, const gchar *from)
+gchar *
+remmina_ssh_convert(RemminaSSH *ssh, const gchar *from)
+{
+	TRACE_CALL(__func__);
+	gchar *to = NULL;
+
+	if (ssh->charset && from)
+		to = g_convert(from, -1, "UTF-8", ssh->charset, NULL, NULL, NULL);
+	if (!to) to = g_strdup(from);
+	return to;
+}
+
+gchar *
+remmina_ssh_unconvert(RemminaSSH *ssh, const gchar *from)
+{
+	TRACE_CALL(__func__);
+	gchar *to = NULL;
+
+	if (ssh->charset && from)
+		to = g_convert(from, -1, ssh->charset, "UTF-8", NULL, NULL, NULL);
+	if (!to) to = g_strdup(from);
+	return to;
+}
+
+void
+remmina_ssh_free(RemminaSSH *ssh)
+{
+	TRACE_CALL(__func__);
+	if (ssh->session && !remmina_ssh_pool_release(ssh)) {
+		REMMINA_DEBUG("Disconnecting SSH session");
+		ssh_disconnect(ssh->session);
+		ssh_free(ssh->session);
+		ssh->session = NULL;
+	}
+	g_free(ssh->pool_key);
+	g_free(ssh->pool_credentials);
+	g_free(ssh->callback);
+	g_free(ssh->server);
+	g_free(ssh->user);
+	g_free(ssh->password);
+	g_free(ssh->privkeyfile);
+	g_free(ssh->certfile);
+	g_free(ssh->charset);
+	g_free(ssh->error);
+	pthread_mutex_destroy(&ssh->ssh_mutex);
+	g_free(ssh);
+}
+
+/*-----------------------------------------------------------------------------*
+*                           Session prefetch                                  *
+*-----------------------------------------------------------------------------*/
+
+#define REMMINA_SSH_PREFETCH_MAX_THREADS 8
+
+/* Background session setup, each job walks these states and parks its
+ * session in the pool as soon as going further would need the user */
+typedef enum {
+	REMMINA_SSH_PREFETCH_CONNECT,
+	REMMINA_SSH_PREFETCH_HOSTKEY,
+	REMMINA_SSH_PREFETCH_AUTH,
+	REMMINA_SSH_PREFETCH_PARK,
+	REMMINA_SSH_PREFETCH_DONE
+} RemminaSSHPrefetchState;
+
+typedef struct _RemminaSSHPrefetch {
+	RemminaSSH *		ssh;
+	gchar *			key;
+	/* Stored password or passphrase, read on the main thread */
+	gchar *			secret;
+	RemminaSSHPrefetchState state;
+} RemminaSSHPrefetch;
+
+static GThreadPool *prefetch_pool = NULL;
+
+/* Try the authentication method of the profile without prompting */
+static RemminaSSHPrefetchState
+remmina_ssh_prefetch_auth(RemminaSSHPrefetch *job)
+{
+	TRACE_CALL(__func__);
+	RemminaSSH *ssh = job->ssh;
+	ssh_key key = NULL;
+	gint rc;
+
+	switch (ssh->auth) {
+	case SSH_AUTH_PASSWORD:
+		if (!job->secret)
+			return REMMINA_SSH_PREFETCH_PARK;
+		rc = ssh_userauth_password(ssh->session, NULL, job->secret);
+		break;
+	case SSH_AUTH_PUBLICKEY:
+		if (!ssh->privkeyfile || (ssh->certfile && *ssh->certfile))
+			return REMMINA_SSH_PREFETCH_PARK;
+		if (ssh_pki_import_privkey_file(ssh->privkeyfile, job->secret, NULL, NULL, &key) != SSH_OK)
+			return REMMINA_SSH_PREFETCH_PARK;
+		rc = ssh_userauth_publickey(ssh->session, NULL, key);
+		ssh_key_free(key);
+		break;
+	case SSH_AUTH_AGENT:
+		rc = ssh_userauth_agent(ssh->session, NULL);
+		break;
+	case SSH_AUTH_AUTO_PUBLICKEY:
+		rc = ssh_userauth_publickey_auto(ssh->session, NULL, job->secret);
+		break;
+	default:
+		/* Keyboard-interactive and GSSAPI talk to the user */
+		return REMMINA_SSH_PREFETCH_PARK;
+	}
+
+	if (rc != SSH_AUTH_SUCCESS) {
+		/* Leave the server side attempt counter alone for the real owner,
+		 * which will start from a fresh connection */
+		REMMINA_DEBUG("Prefetch of %s could not authenticate (%d)", job->key, rc);
+		return REMMINA_SSH_PREFETCH_DONE;
+	}
+	ssh->authenticated = TRUE;
+	return REMMINA_SSH_PREFETCH_PARK;
+}
+
+static void
+remmina_ssh_prefetch_run(gpointer data, gpointer user_data)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHPrefetch *job = (RemminaSSHPrefetch *)data;
+	RemminaSSH *ssh = job->ssh;
+
+	while (job->state != REMMINA_SSH_PREFETCH_DONE) {
+		switch (job->state) {
+		case REMMINA_SSH_PREFETCH_CONNECT:
+			if (!remmina_ssh_init_session(ssh)) {
+				REMMINA_DEBUG("Prefetch of %s failed: %s", job->key, ssh->error);
+				job->state = REMMINA_SSH_PREFETCH_DONE;
+			} else {
+				/* The session may come from the pool already */
+				job->state = ssh->authenticated ? REMMINA_SSH_PREFETCH_PARK : REMMINA_SSH_PREFETCH_HOSTKEY;
+			}
+			break;
+		case REMMINA_SSH_PREFETCH_HOSTKEY:
+			/* An unknown or changed host key is for the user to accept */
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 9, 0)
+			if (remmina_ssh_known_server(ssh) == SSH_KNOWN_HOSTS_OK)
+#else
+			if (ssh_is_server_known(ssh->session) == SSH_SERVER_KNOWN_OK)
+#endif
+				job->state = REMMINA_SSH_PREFETCH_AUTH;
+			else
+				job->state = REMMINA_SSH_PREFETCH_PARK;
+			break;
+		case REMMINA_SSH_PREFETCH_AUTH:
+			job->state = remmina_ssh_prefetch_auth(job);
+			break;
+		case REMMINA_SSH_PREFETCH_PARK:
+			if (remmina_ssh_pool_park(ssh))
+				REMMINA_DEBUG("Prefetched SSH session %s is ready", job->key);
+			job->state = REMMINA_SSH_PREFETCH_DONE;
+			break;
+		default:
+			job->state = REMMINA_SSH_PREFETCH_DONE;
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	g_hash_table_remove(prefetch_keys, job->key);
+	pthread_cond_broadcast(&prefetch_cond);
+	pthread_mutex_unlock(&pool_mutex);
+
+	/* Not parked means not usable, do not let remmina_ssh_free() park it */
+	ssh->authenticated = FALSE;
+	remmina_ssh_free(ssh);
+	if (job->secret) {
+		memset(job->secret, 0, strlen(job->secret));
+		g_free(job->secret);
+	}
+	g_free(job->key);
+	g_free(job);
+}
+
+void
+remmina_ssh_prefetch(RemminaFile *remminafile, gboolean use_secrets)
 {
 	TRACE_CALL(__func__);
-	gchar *to = NULL;
+	RemminaSSHPrefetch *job;
+	RemminaSSH *ssh;
+	const gchar *protocol;
+	const gchar *secret_key = NULL;
+	gboolean is_tunnel;
+	gchar *key;
+
+	if (remmina_pref.ssh_session_reuse_timeout <= 0)
+		return;
 
-	if (ssh->charset && from)
-		to = g_convert(from, -1, "UTF-8", ssh->charset, NULL, NULL, NULL);
-	if (!to) to = g_strdup(from);
-	return to;
-}
+	protocol = remmina_file_get_string(remminafile, "protocol");
+	is_tunnel = remmina_file_get_int(remminafile, "ssh_tunnel_enabled", FALSE);
+	if (!is_tunnel && g_strcmp0(protocol, "SSH") != 0 && g_strcmp0(protocol, "SFTP") != 0)
+		return;
 
-gchar *
-remmina_ssh_unconvert(RemminaSSH *ssh, const gchar *from)
-{
-	TRACE_CALL(__func__);
-	gchar *to = NULL;
+	ssh = g_new0(RemminaSSH, 1);
+	remmina_ssh_init_from_file_full(ssh, remminafile, is_tunnel, use_secrets);
+	if (!is_tunnel) {
+		/* What remmina_protocol_widget_start_direct_tunnel() hands to the
+		 * SSH and SFTP plugins when there is no tunnel */
+		ssh->tunnel_entrance_host = g_strdup(ssh->server);
+		ssh->tunnel_entrance_port = ssh->port;
+	}
 
-	if (ssh->charset && from)
-		to = g_convert(from, -1, ssh->charset, "UTF-8", NULL, NULL, NULL);
-	if (!to) to = g_strdup(from);
-	return to;
-}
+	key = remmina_ssh_pool_key(ssh);
+	pthread_mutex_lock(&pool_mutex);
+	if (!prefetch_keys)
+		prefetch_keys = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if (!key || g_hash_table_contains(prefetch_keys, key) ||
+	    (pool_table && g_hash_table_contains(pool_table, key))) {
+		pthread_mutex_unlock(&pool_mutex);
+		g_free(key);
+		remmina_ssh_free(ssh);
+		return;
+	}
+	g_hash_table_insert(prefetch_keys, g_strdup(key), ssh);
+	if (!prefetch_pool)
+		prefetch_pool = g_thread_pool_new(remmina_ssh_prefetch_run, NULL,
+						  REMMINA_SSH_PREFETCH_MAX_THREADS, FALSE, NULL);
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (use_secrets) {
+		if (ssh->auth == SSH_AUTH_PASSWORD)
+			secret_key = is_tunnel ? "ssh_tunnel_password" : "password";
+		else if (ssh->auth == SSH_AUTH_PUBLICKEY || ssh->auth == SSH_AUTH_AUTO_PUBLICKEY)
+			secret_key = is_tunnel ? "ssh_tunnel_passphrase" : "ssh_passphrase";
+	}
 
-void
-remmina_ssh_free(RemminaSSH *ssh)
-{
-	TRACE_CALL(__func__);
-	if (ssh->session) {
-		REMMINA_DEBUG("Disconnecting SSH session");
-		ssh_disconnect(ssh->session);
-		ssh_free(ssh->session);
-		ssh->session = NULL;
+	job = g_new0(RemminaSSHPrefetch, 1);
+	job->ssh = ssh;
+	job->key = key;
+	job->secret = secret_key ? g_strdup(remmina_file_get_string(remminafile, secret_key)) : NULL;
+	if (job->secret && *job->secret == 0) {
+		g_free(job->secret);
+		job->secret = NULL;
 	}
-	g_free(ssh->callback);
-	g_free(ssh->server);
-	g_free(ssh->user);
-	g_free(ssh->password);
-	g_free(ssh->privkeyfile);
-	g_free(ssh->certfile);
-	g_free(ssh->charset);
-	g_free(ssh->error);
-	pthread_mutex_destroy(&ssh->ssh_mutex);
-	g_free(ssh);
+	job->state = REMMINA_SSH_PREFETCH_CONNECT;
+
+	REMMINA_DEBUG("Prefetching SSH session %s", key);
+	g_thread_pool_push(prefetch_pool, job, NULL);
 }
 
 /*-----------------------------------------------------------------------------*
@@ -2204,6 +3178,9 @@ struct _RemminaSSHTunnelBuffer {
 	ssize_t len;
 };
 
+typedef struct _RemminaSSHSocks5Client RemminaSSHSocks5Client;
+static void remmina_ssh_socks5_client_free(RemminaSSHSocks5Client *client);
+
 static RemminaSSHTunnelBuffer *
 remmina_ssh_tunnel_buffer_new(ssize_t len)
 {
@@ -2227,6 +3204,71 @@ remmina_ssh_tunnel_buffer_free(RemminaSSHTunnelBuffer *buffer)
 	}
 }
 
+/* A further destination forwarded by a shared OPEN tunnel */
+typedef struct _RemminaSSHTunnelForward {
+	gint		server_sock;
+	gchar *		dest;
+	gint		port;
+	gpointer	owner;
+	/* Set by the owner, the listener is closed by the tunnel thread */
+	gboolean	cancelled;
+} RemminaSSHTunnelForward;
+
+/* Registered OPEN tunnels by the key of their SSH server and credentials, see remmina_ssh_pool_key().
+ * The mutex also guards the owners, forwards and counters of every tunnel.
+ * The tunnel thread may be cancelled, it must not reach a cancellation point
+ * such as close() while holding it */
+static pthread_mutex_t tunnel_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *tunnel_registry = NULL;
+
+static void
+remmina_ssh_tunnel_forward_free(RemminaSSHTunnelForward *forward)
+{
+	TRACE_CALL(__func__);
+	if (forward->server_sock >= 0)
+		close(forward->server_sock);
+	g_free(forward->dest);
+	g_free(forward);
+}
+
+/* Called with tunnel_registry_mutex held, no tracing: g_print() is a cancellation point */
+static void
+remmina_ssh_tunnel_unregister(RemminaSSHTunnel *tunnel)
+{
+	if (tunnel->registered) {
+		g_hash_table_remove(tunnel_registry, tunnel->registry_key);
+		tunnel->registered = FALSE;
+	}
+}
+
+/* Called without tunnel_registry_mutex, frees the forwards and the array */
+static void
+remmina_ssh_tunnel_forwards_free(GPtrArray *forwards)
+{
+	TRACE_CALL(__func__);
+	g_ptr_array_foreach(forwards, (GFunc)remmina_ssh_tunnel_forward_free, NULL);
+	g_ptr_array_free(forwards, TRUE);
+}
+
+/* Called with tunnel_registry_mutex held, by the tunnel thread only. The
+ * cancelled forwards are moved to purged, to be freed once unlocked */
+static void
+remmina_ssh_tunnel_purge_forwards(RemminaSSHTunnel *tunnel, GPtrArray *purged)
+{
+	RemminaSSHTunnelForward *forward;
+	guint i = 0;
+
+	while (i < tunnel->forwards->len) {
+		forward = (RemminaSSHTunnelForward *)tunnel->forwards->pdata[i];
+		if (forward->cancelled) {
+			g_ptr_array_add(purged, forward);
+			g_ptr_array_remove_index_fast(tunnel->forwards, i);
+		} else {
+			i++;
+		}
+	}
+}
+
 RemminaSSHTunnel *
 remmina_ssh_tunnel_new_from_file(RemminaFile *remminafile)
 {
@@ -2257,6 +3299,18 @@ remmina_ssh_tunnel_new_from_file(RemminaFile *remminafile)
 	tunnel->connect_func = NULL;
 	tunnel->disconnect_func = NULL;
 	tunnel->callback_data = NULL;
+	tunnel->destroy_func = NULL;
+	tunnel->destroy_func_callback_data = NULL;
+	tunnel->registry_key = remmina_ssh_pool_key(REMMINA_SSH(tunnel));
+	tunnel->registered = FALSE;
+	tunnel->owners = g_ptr_array_new();
+	tunnel->forwards = g_ptr_array_new();
+	tunnel->bytes_sent = 0;
+	tunnel->bytes_received = 0;
+	tunnel->channels_opened = 0;
+	tunnel->accepted_channels = NULL;
+	tunnel->socks5_clients = NULL;
+	tunnel->wakeup_pipe[0] = tunnel->wakeup_pipe[1] = -1;
 
 	return tunnel;
 }
@@ -2281,106 +3335,538 @@ remmina_ssh_tunnel_close_all_channels(RemminaSSHTunnel *tunnel)
 	tunnel->sockets = NULL;
 	g_free(tunnel->socketbuffers);
 	tunnel->socketbuffers = NULL;
+	g_slist_free_full(tunnel->socks5_clients, (GDestroyNotify)remmina_ssh_socks5_client_free);
+	tunnel->socks5_clients = NULL;
 
+	pthread_mutex_lock(&tunnel_registry_mutex);
 	tunnel->num_channels = 0;
+	pthread_mutex_unlock(&tunnel_registry_mutex);
 	tunnel->max_channels = 0;
 }
 
 static void
-remmina_ssh_tunnel_remove_channel(RemminaSSHTunnel *tunnel, gint n)
+remmina_ssh_tunnel_remove_channel(RemminaSSHTunnel *tunnel, gint n)
+{
+	TRACE_CALL(__func__);
+	ssh_channel_close(tunnel->channels[n]);
+	ssh_channel_send_eof(tunnel->channels[n]);
+	ssh_channel_free(tunnel->channels[n]);
+	close(tunnel->sockets[n]);
+	remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[n]);
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	tunnel->num_channels--;
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	tunnel->channels[n] = tunnel->channels[tunnel->num_channels];
+	tunnel->channels[tunnel->num_channels] = NULL;
+	tunnel->sockets[n] = tunnel->sockets[tunnel->num_channels];
+	tunnel->socketbuffers[n] = tunnel->socketbuffers[tunnel->num_channels];
+}
+
+/* Register the new channel/socket pair */
+static void
+remmina_ssh_tunnel_add_channel(RemminaSSHTunnel *tunnel, ssh_channel channel, gint sock)
+{
+	TRACE_CALL(__func__);
+	gint flags;
+	gint i;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	i = tunnel->num_channels++;
+	tunnel->channels_opened++;
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	if (tunnel->num_channels > tunnel->max_channels) {
+		/* Allocate an extra NULL pointer in channels for ssh_select */
+		tunnel->channels = (ssh_channel *)g_realloc(tunnel->channels,
+							    sizeof(ssh_channel) * (tunnel->num_channels + 1));
+		tunnel->sockets = (gint *)g_realloc(tunnel->sockets,
+						    sizeof(gint) * tunnel->num_channels);
+		tunnel->socketbuffers = (RemminaSSHTunnelBuffer **)g_realloc(tunnel->socketbuffers,
+									     sizeof(RemminaSSHTunnelBuffer *) * tunnel->num_channels);
+		tunnel->max_channels = tunnel->num_channels;
+
+		tunnel->channels_out = (ssh_channel *)g_realloc(tunnel->channels_out,
+								sizeof(ssh_channel) * (tunnel->num_channels + 1));
+	}
+	tunnel->channels[i] = channel;
+	tunnel->channels[i + 1] = NULL;
+	tunnel->sockets[i] = sock;
+	tunnel->socketbuffers[i] = NULL;
+
+	flags = fcntl(sock, F_GETFL, 0);
+	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+static int
+remmina_ssh_tunnel_accept_local_connection(RemminaSSHTunnel *tunnel, gboolean blocking)
+{
+	gint sock, sock_flags;
+
+	sock_flags = fcntl(tunnel->server_sock, F_GETFL, 0);
+	if (blocking)
+		sock_flags &= ~O_NONBLOCK;
+	else
+		sock_flags |= O_NONBLOCK;
+	fcntl(tunnel->server_sock, F_SETFL, sock_flags);
+
+	/* Accept a local connection */
+	sock = accept(tunnel->server_sock, NULL, NULL);
+	if (sock < 0) {
+		if (blocking) {
+			g_free(REMMINA_SSH(tunnel)->error);
+			REMMINA_SSH(tunnel)->error = g_strdup("Local socket not accepted");
+		}
+	}
+
+	return sock;
+}
+
+static ssh_channel
+remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel, const gchar *dest, gint port)
+{
+	ssh_channel channel = NULL;
+
+	channel = ssh_channel_new(tunnel->ssh.session);
+	if (!channel) {
+		// TRANSLATORS: The placeholder %s is an error message
+		remmina_ssh_set_error(REMMINA_SSH(tunnel), _("Could not create channel. %s"));
+		return NULL;
+	}
+
+	/* Request the SSH server to connect to the destination */
+	REMMINA_DEBUG("SSH tunnel destination is %s:%d", dest, port);
+	if (ssh_channel_open_forward(channel, dest, port, "127.0.0.1", 0) != SSH_OK) {
+		ssh_channel_close(channel);
+		ssh_channel_send_eof(channel);
+		ssh_channel_free(channel);
+		// TRANSLATORS: The placeholder %s is an error message
+		remmina_ssh_set_error(REMMINA_SSH(tunnel), _("Could not connect to SSH tunnel. %s"));
+		return NULL;
+	}
+
+	return channel;
+}
+
+/* SOCKS5 (RFC 1928) front end of the dynamic tunnel */
+#define SOCKS5_VERSION 0x05
+#define SOCKS5_AUTH_NONE 0x00
+#define SOCKS5_AUTH_UNACCEPTABLE 0xff
+#define SOCKS5_CMD_CONNECT 0x01
+#define SOCKS5_ATYP_IPV4 0x01
+#define SOCKS5_ATYP_DOMAIN 0x03
+#define SOCKS5_ATYP_IPV6 0x04
+#define SOCKS5_REP_SUCCEEDED 0x00
+#define SOCKS5_REP_FAILURE 0x01
+#define SOCKS5_REP_TTL_EXPIRED 0x06
+#define SOCKS5_REP_CMD_UNSUPPORTED 0x07
+#define SOCKS5_REP_ATYP_UNSUPPORTED 0x08
+/* Longest message of a client: a CONNECT request with a domain name */
+#define SOCKS5_MSG_MAX (4 + 1 + 255 + 2)
+/* Local clients send their requests right away */
+#define SOCKS5_TIMEOUT 5000
+/* The server may take a while to reach the destination */
+#define SOCKS5_OPEN_TIMEOUT 15000
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* A client of the dynamic tunnel, from accept() until its channel is open.
+ * The tunnel thread moves it forward whenever its socket or the session is
+ * ready, so a slow client or destination does not hold the other streams */
+struct _RemminaSSHSocks5Client {
+	gint		sock;
+	guchar		buf[SOCKS5_MSG_MAX];
+	gsize		len;
+	gboolean	negotiated;
+	/* Destination, set once the CONNECT request is read */
+	gchar *		host;
+	gint		port;
+	ssh_channel	channel;
+	gint64		deadline;
+};
+
+static gboolean
+remmina_ssh_socks5_write(gint sock, gconstpointer buf, gsize len)
+{
+	return send(sock, buf, len, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+static void
+remmina_ssh_socks5_reply(gint sock, guchar rep)
+{
+	/* The bound address is of no use through a tunnel */
+	const guchar reply[] = { SOCKS5_VERSION, rep, 0x00, SOCKS5_ATYP_IPV4, 0, 0, 0, 0, 0, 0 };
+
+	remmina_ssh_socks5_write(sock, reply, sizeof(reply));
+}
+
+/* Answer the method negotiation of the client. Returns -1 on error, 0 while
+ * the message is incomplete and 1 once it is done with */
+static gint
+remmina_ssh_socks5_negotiate(RemminaSSHSocks5Client *client)
+{
+	guchar reply[2] = { SOCKS5_VERSION, SOCKS5_AUTH_UNACCEPTABLE };
+	gsize need;
+	gint i;
+
+	if (client->len < 2)
+		return 0;
+	if (client->buf[0] != SOCKS5_VERSION)
+		return -1;
+	need = 2 + client->buf[1];
+	if (client->len < need)
+		return 0;
+
+	for (i = 0; i < client->buf[1]; i++)
+		if (client->buf[2 + i] == SOCKS5_AUTH_NONE)
+			reply[1] = SOCKS5_AUTH_NONE;
+	if (!remmina_ssh_socks5_write(client->sock, reply, sizeof(reply)) ||
+	    reply[1] != SOCKS5_AUTH_NONE)
+		return -1;
+
+	/* The request may already follow */
+	client->len -= need;
+	memmove(client->buf, client->buf + need, client->len);
+	client->negotiated = TRUE;
+	return 1;
+}
+
+/* Read the CONNECT request of the client into host and port. Same return
+ * values as remmina_ssh_socks5_negotiate() */
+static gint
+remmina_ssh_socks5_request(RemminaSSHSocks5Client *client)
+{
+	gchar addr[INET6_ADDRSTRLEN];
+	guchar *dst = client->buf + 4;
+	gsize need;
+
+	/* VER CMD RSV ATYP */
+	if (client->len < 4)
+		return 0;
+	if (client->buf[0] != SOCKS5_VERSION)
+		return -1;
+	if (client->buf[1] != SOCKS5_CMD_CONNECT) {
+		remmina_ssh_socks5_reply(client->sock, SOCKS5_REP_CMD_UNSUPPORTED);
+		return -1;
+	}
+
+	switch (client->buf[3]) {
+	case SOCKS5_ATYP_IPV4:
+		need = 4 + 4 + 2;
+		break;
+	case SOCKS5_ATYP_IPV6:
+		need = 4 + 16 + 2;
+		break;
+	case SOCKS5_ATYP_DOMAIN:
+		if (client->len < 5)
+			return 0;
+		need = 4 + 1 + dst[0] + 2;
+		break;
+	default:
+		remmina_ssh_socks5_reply(client->sock, SOCKS5_REP_ATYP_UNSUPPORTED);
+		return -1;
+	}
+	if (client->len < need)
+		return 0;
+
+	switch (client->buf[3]) {
+	case SOCKS5_ATYP_IPV4:
+		inet_ntop(AF_INET, dst, addr, sizeof(addr));
+		client->host = g_strdup(addr);
+		break;
+	case SOCKS5_ATYP_IPV6:
+		inet_ntop(AF_INET6, dst, addr, sizeof(addr));
+		client->host = g_strdup(addr);
+		break;
+	default:
+		/* Names are resolved by the SSH server, like ssh -D does */
+		client->host = g_strndup((gchar *)dst + 1, dst[0]);
+		break;
+	}
+	client->port = (client->buf[need - 2] << 8) | client->buf[need - 1];
+	return 1;
+}
+
+static void
+remmina_ssh_socks5_client_free(RemminaSSHSocks5Client *client)
+{
+	TRACE_CALL(__func__);
+	if (client->channel)
+		ssh_channel_free(client->channel);
+	if (client->sock >= 0)
+		close(client->sock);
+	g_free(client->host);
+	g_free(client);
+}
+
+static void
+remmina_ssh_tunnel_add_socks5_client(RemminaSSHTunnel *tunnel, gint sock)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHSocks5Client *client;
+
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+	client = g_new0(RemminaSSHSocks5Client, 1);
+	client->sock = sock;
+	client->deadline = g_get_monotonic_time() + (gint64)SOCKS5_TIMEOUT * 1000;
+	tunnel->socks5_clients = g_slist_append(tunnel->socks5_clients, client);
+}
+
+/* Ask the server for a channel to the destination of the client, without
+ * waiting for its answer. Returns SSH_OK, SSH_AGAIN or SSH_ERROR */
+static gint
+remmina_ssh_tunnel_socks5_open(RemminaSSHTunnel *tunnel, RemminaSSHSocks5Client *client)
+{
+	TRACE_CALL(__func__);
+	ssh_session session = REMMINA_SSH(tunnel)->session;
+	gint rc;
+
+	if (!client->channel) {
+		REMMINA_DEBUG("SSH tunnel destination is %s:%d", client->host, client->port);
+		client->channel = ssh_channel_new(session);
+		if (!client->channel)
+			return SSH_ERROR;
+	}
+
+	/* Only the tunnel thread uses the session, and the data pump below
+	 * expects it blocking */
+	ssh_set_blocking(session, 0);
+	rc = ssh_channel_open_forward(client->channel, client->host, client->port, "127.0.0.1", 0);
+	ssh_set_blocking(session, 1);
+
+	return rc;
+}
+
+/* Read from the client until its CONNECT request is complete. Same return
+ * values as remmina_ssh_socks5_negotiate() */
+static gint
+remmina_ssh_socks5_read_request(RemminaSSHSocks5Client *client, gboolean readable)
+{
+	ssize_t sz;
+	gint rc;
+
+	if (readable) {
+		sz = recv(client->sock, client->buf + client->len, sizeof(client->buf) - client->len, 0);
+		if (sz > 0)
+			client->len += sz;
+		else if (sz == 0 || (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK))
+			return -1;
+	}
+	if (!client->negotiated && (rc = remmina_ssh_socks5_negotiate(client)) <= 0)
+		return rc;
+	return remmina_ssh_socks5_request(client);
+}
+
+/* Move a client forward, readable tells whether its socket has data. Returns
+ * FALSE once the client is done with: its channel was added, or it failed */
+static gboolean
+remmina_ssh_tunnel_socks5_step(RemminaSSHTunnel *tunnel, RemminaSSHSocks5Client *client, gboolean readable)
+{
+	TRACE_CALL(__func__);
+	gint rc;
+
+	if (!client->host) {
+		rc = remmina_ssh_socks5_read_request(client, readable);
+		if (rc < 0) {
+			REMMINA_DEBUG("Invalid or unsupported SOCKS5 request");
+			return FALSE;
+		}
+		if (rc == 0)
+			goto WAIT;
+		client->deadline = g_get_monotonic_time() + (gint64)SOCKS5_OPEN_TIMEOUT * 1000;
+	}
+
+	rc = remmina_ssh_tunnel_socks5_open(tunnel, client);
+	if (rc == SSH_AGAIN)
+		goto WAIT;
+	if (rc != SSH_OK) {
+		/* A refused destination is not an error of the tunnel */
+		REMMINA_DEBUG("Could not open a channel to %s:%d. %s", client->host, client->port,
+			      ssh_get_error(REMMINA_SSH(tunnel)->session));
+		remmina_ssh_socks5_reply(client->sock, SOCKS5_REP_FAILURE);
+		return FALSE;
+	}
+
+	remmina_ssh_socks5_reply(client->sock, SOCKS5_REP_SUCCEEDED);
+	remmina_ssh_tunnel_add_channel(tunnel, client->channel, client->sock);
+	client->channel = NULL;
+	client->sock = -1;
+	return FALSE;
+
+WAIT:
+	if (g_get_monotonic_time() < client->deadline)
+		return TRUE;
+	REMMINA_DEBUG("SOCKS5 client timed out");
+	if (client->host)
+		remmina_ssh_socks5_reply(client->sock, SOCKS5_REP_TTL_EXPIRED);
+	return FALSE;
+}
+
+/* Add what the SOCKS5 clients wait for to the select() set: their socket
+ * while they talk, the session while their channel opens */
+static void
+remmina_ssh_tunnel_watch_socks5_clients(RemminaSSHTunnel *tunnel, fd_set *set, gint *maxfd)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHSocks5Client *client;
+	GSList *l;
+	gint fd;
+
+	for (l = tunnel->socks5_clients; l; l = l->next) {
+		client = (RemminaSSHSocks5Client *)l->data;
+		fd = client->host ? ssh_get_fd(REMMINA_SSH(tunnel)->session) : client->sock;
+		if (fd < 0)
+			continue;
+		if (fd > *maxfd)
+			*maxfd = fd;
+		FD_SET(fd, set);
+	}
+}
+
+static void
+remmina_ssh_tunnel_serve_socks5_clients(RemminaSSHTunnel *tunnel, fd_set *set)
 {
 	TRACE_CALL(__func__);
-	ssh_channel_close(tunnel->channels[n]);
-	ssh_channel_send_eof(tunnel->channels[n]);
-	ssh_channel_free(tunnel->channels[n]);
-	close(tunnel->sockets[n]);
-	remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[n]);
-	tunnel->num_channels--;
-	tunnel->channels[n] = tunnel->channels[tunnel->num_channels];
-	tunnel->channels[tunnel->num_channels] = NULL;
-	tunnel->sockets[n] = tunnel->sockets[tunnel->num_channels];
-	tunnel->socketbuffers[n] = tunnel->socketbuffers[tunnel->num_channels];
+	RemminaSSHSocks5Client *client;
+	GSList *l, *next;
+
+	for (l = tunnel->socks5_clients; l; l = next) {
+		next = l->next;
+		client = (RemminaSSHSocks5Client *)l->data;
+		if (!remmina_ssh_tunnel_socks5_step(tunnel, client, !client->host && FD_ISSET(client->sock, set))) {
+			remmina_ssh_socks5_client_free(client);
+			tunnel->socks5_clients = g_slist_delete_link(tunnel->socks5_clients, l);
+		}
+	}
 }
 
-/* Register the new channel/socket pair */
-static void
-remmina_ssh_tunnel_add_channel(RemminaSSHTunnel *tunnel, ssh_channel channel, gint sock)
+/* Called by libssh while the tunnel thread polls the session, as soon as the
+ * server opens a channel for one of our remote forwards */
+static int
+remmina_ssh_tunnel_forward_message_cb(ssh_session session, ssh_message message, void *userdata)
 {
 	TRACE_CALL(__func__);
-	gint flags;
-	gint i;
+	RemminaSSHTunnel *tunnel = (RemminaSSHTunnel *)userdata;
+	ssh_channel channel;
 
-	i = tunnel->num_channels++;
-	if (tunnel->num_channels > tunnel->max_channels) {
-		/* Allocate an extra NULL pointer in channels for ssh_select */
-		tunnel->channels = (ssh_channel *)g_realloc(tunnel->channels,
-							    sizeof(ssh_channel) * (tunnel->num_channels + 1));
-		tunnel->sockets = (gint *)g_realloc(tunnel->sockets,
-						    sizeof(gint) * tunnel->num_channels);
-		tunnel->socketbuffers = (RemminaSSHTunnelBuffer **)g_realloc(tunnel->socketbuffers,
-									     sizeof(RemminaSSHTunnelBuffer *) * tunnel->num_channels);
-		tunnel->max_channels = tunnel->num_channels;
+	if (ssh_message_type(message) != SSH_REQUEST_CHANNEL_OPEN ||
+	    ssh_message_subtype(message) != SSH_CHANNEL_FORWARDED_TCPIP)
+		/* Let libssh send the default reply */
+		return 1;
 
-		tunnel->channels_out = (ssh_channel *)g_realloc(tunnel->channels_out,
-								sizeof(ssh_channel) * (tunnel->num_channels + 1));
-	}
-	tunnel->channels[i] = channel;
-	tunnel->channels[i + 1] = NULL;
-	tunnel->sockets[i] = sock;
-	tunnel->socketbuffers[i] = NULL;
+	channel = ssh_message_channel_request_open_reply_accept(message);
+	if (!channel)
+		return 0;
 
-	flags = fcntl(sock, F_GETFL, 0);
-	fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+	tunnel->port = ssh_message_channel_request_open_destination_port(message);
+	/* Only added to the channel list once ssh_select() has returned */
+	tunnel->accepted_channels = g_slist_append(tunnel->accepted_channels, channel);
+	if (write(tunnel->wakeup_pipe[1], "", 1) < 0)
+		REMMINA_DEBUG("Could not wake up the SSH tunnel thread");
+
+	return 0;
 }
 
-static int
-remmina_ssh_tunnel_accept_local_connection(RemminaSSHTunnel *tunnel, gboolean blocking)
+static gboolean
+remmina_ssh_tunnel_watch_forwards(RemminaSSHTunnel *tunnel)
 {
-	gint sock, sock_flags;
-
-	sock_flags = fcntl(tunnel->server_sock, F_GETFL, 0);
-	if (blocking)
-		sock_flags &= ~O_NONBLOCK;
-	else
-		sock_flags |= O_NONBLOCK;
-	fcntl(tunnel->server_sock, F_SETFL, sock_flags);
-
-	/* Accept a local connection */
-	sock = accept(tunnel->server_sock, NULL, NULL);
-	if (sock < 0) {
-		if (blocking) {
-			g_free(REMMINA_SSH(tunnel)->error);
-			REMMINA_SSH(tunnel)->error = g_strdup("Local socket not accepted");
-		}
+	TRACE_CALL(__func__);
+	if (tunnel->wakeup_pipe[0] < 0) {
+		if (pipe(tunnel->wakeup_pipe) < 0)
+			return FALSE;
+		fcntl(tunnel->wakeup_pipe[0], F_SETFL, fcntl(tunnel->wakeup_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+		fcntl(tunnel->wakeup_pipe[1], F_SETFL, fcntl(tunnel->wakeup_pipe[1], F_GETFL, 0) | O_NONBLOCK);
 	}
-
-	return sock;
+	ssh_set_message_callback(REMMINA_SSH(tunnel)->session, remmina_ssh_tunnel_forward_message_cb, tunnel);
+	return TRUE;
 }
 
-static ssh_channel
-remmina_ssh_tunnel_create_forward_channel(RemminaSSHTunnel *tunnel)
+/* Process the session until the server opens the first forwarded channel */
+static gboolean
+remmina_ssh_tunnel_wait_forward(RemminaSSHTunnel *tunnel, gint timeout_ms)
 {
-	ssh_channel channel = NULL;
+	TRACE_CALL(__func__);
+	ssh_session session = REMMINA_SSH(tunnel)->session;
+	ssh_event event;
+	gint64 deadline, left;
+
+	event = ssh_event_new();
+	if (!event || ssh_event_add_session(event, session) != SSH_OK) {
+		if (event)
+			ssh_event_free(event);
+		return FALSE;
+	}
 
-	channel = ssh_channel_new(tunnel->ssh.session);
-	if (!channel) {
-		// TRANSLATORS: The placeholder %s is an error message
-		remmina_ssh_set_error(REMMINA_SSH(tunnel), _("Could not create channel. %s"));
-		return NULL;
+	deadline = g_get_monotonic_time() + (gint64)timeout_ms * 1000;
+	while (tunnel->running && !tunnel->accepted_channels) {
+		left = (deadline - g_get_monotonic_time()) / 1000;
+		if (left <= 0)
+			break;
+		if (ssh_event_dopoll(event, (int)left) == SSH_ERROR)
+			break;
 	}
 
-	/* Request the SSH server to connect to the destination */
-	REMMINA_DEBUG("SSH tunnel destination is %s", tunnel->dest);
-	if (ssh_channel_open_forward(channel, tunnel->dest, tunnel->port, "127.0.0.1", 0) != SSH_OK) {
-		ssh_channel_close(channel);
-		ssh_channel_send_eof(channel);
-		ssh_channel_free(channel);
-		// TRANSLATORS: The placeholder %s is an error message
-		remmina_ssh_set_error(REMMINA_SSH(tunnel), _("Could not connect to SSH tunnel. %s"));
-		return NULL;
+	ssh_event_remove_session(event, session);
+	ssh_event_free(event);
+
+	return tunnel->accepted_channels != NULL;
+}
+
+/* Open a channel for every pending connection to the forwards of a shared tunnel */
+static void
+remmina_ssh_tunnel_accept_forwards(RemminaSSHTunnel *tunnel)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnelForward *forward;
+	GPtrArray *forwards, *purged;
+	ssh_channel channel;
+	gint sock;
+	guint i;
+
+	/* Only this thread frees the forwards, the copy stays valid unlocked */
+	forwards = g_ptr_array_new();
+	purged = g_ptr_array_new();
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_purge_forwards(tunnel, purged);
+	for (i = 0; i < tunnel->forwards->len; i++)
+		g_ptr_array_add(forwards, tunnel->forwards->pdata[i]);
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_forwards_free(purged);
+
+	for (i = 0; i < forwards->len; i++) {
+		forward = (RemminaSSHTunnelForward *)forwards->pdata[i];
+		while ((sock = accept(forward->server_sock, NULL, NULL)) >= 0) {
+			channel = remmina_ssh_tunnel_create_forward_channel(tunnel, forward->dest, forward->port);
+			if (!channel) {
+				/* The other destinations of the session are still fine */
+				REMMINA_DEBUG("Could not open new SSH connection. %s", REMMINA_SSH(tunnel)->error);
+				close(sock);
+				continue;
+			}
+			remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
+		}
 	}
+	g_ptr_array_free(forwards, TRUE);
+}
 
-	return channel;
+/* A registered tunnel stays up while a connection may still come in. When it
+ * gives up, it leaves the registry in the same step so nobody attaches late */
+static gboolean
+remmina_ssh_tunnel_keep_listening(RemminaSSHTunnel *tunnel)
+{
+	TRACE_CALL(__func__);
+	GPtrArray *purged;
+	gboolean listening;
+
+	purged = g_ptr_array_new();
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_purge_forwards(tunnel, purged);
+	listening = tunnel->registered && (tunnel->server_sock >= 0 || tunnel->forwards->len > 0);
+	if (!listening)
+		remmina_ssh_tunnel_unregister(tunnel);
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_forwards_free(purged);
+
+	return listening;
 }
 
 static gpointer
@@ -2392,21 +3878,19 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 	ssize_t len = 0, lenw = 0;
 	fd_set set;
 	struct timeval timeout;
-	g_autoptr(GDateTime) t1 = NULL;
-	g_autoptr(GDateTime) t2 = NULL;
-	GTimeSpan diff;                                                 // microseconds
 	ssh_channel channel = NULL;
 	gboolean first = TRUE;
+	gboolean reverse_connected = FALSE;
+	gchar wakeup[64];
 	gboolean disconnected;
 	gint sock;
 	gint maxfd;
 	gint i;
+	guint j;
 	gint ret;
+	guint64 sent, received;
 	struct sockaddr_in sin;
 
-	t1 = g_date_time_new_now_local();
-	t2 = g_date_time_new_now_local();
-
 	switch (tunnel->tunnel_type) {
 	case REMMINA_SSH_TUNNEL_OPEN:
 		sock = remmina_ssh_tunnel_accept_local_connection(tunnel, TRUE);
@@ -2416,7 +3900,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 			return NULL;
 		}
 
-		channel = remmina_ssh_tunnel_create_forward_channel(tunnel);
+		channel = remmina_ssh_tunnel_create_forward_channel(tunnel, tunnel->dest, tunnel->port);
 		if (!tunnel) {
 			close(sock);
 			tunnel->thread = 0;
@@ -2426,7 +3910,23 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
 		break;
 
+	case REMMINA_SSH_TUNNEL_DYNAMIC:
+		sock = remmina_ssh_tunnel_accept_local_connection(tunnel, TRUE);
+		if (sock < 0) {
+			tunnel->thread = 0;
+			return NULL;
+		}
+		remmina_ssh_tunnel_add_socks5_client(tunnel, sock);
+		break;
+
 	case REMMINA_SSH_TUNNEL_XPORT:
+		if (!remmina_ssh_tunnel_watch_forwards(tunnel)) {
+			remmina_ssh_set_application_error(REMMINA_SSH(tunnel), "%s", g_strerror(errno));
+			if (tunnel->disconnect_func)
+				(*tunnel->disconnect_func)(tunnel, tunnel->callback_data);
+			tunnel->thread = 0;
+			return NULL;
+		}
 		/* Detect the next available port starting from 6010 on the server */
 		for (i = 10; i <= MAX_X_DISPLAY_NUMBER; i++) {
 #if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 7, 0)
@@ -2465,6 +3965,13 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		break;
 
 	case REMMINA_SSH_TUNNEL_REVERSE:
+		if (!remmina_ssh_tunnel_watch_forwards(tunnel)) {
+			remmina_ssh_set_application_error(REMMINA_SSH(tunnel), "%s", g_strerror(errno));
+			if (tunnel->disconnect_func)
+				(*tunnel->disconnect_func)(tunnel, tunnel->callback_data);
+			tunnel->thread = 0;
+			return NULL;
+		}
 #if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 7, 0)
 		if (ssh_channel_listen_forward(REMMINA_SSH(tunnel)->session, NULL, tunnel->port, NULL)) {
 			// TRANSLATORS: The placeholder %s is an error message
@@ -2496,8 +4003,10 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		break;
 	}
 
-	tunnel->buffer_len = 10240;
-	tunnel->buffer = g_malloc(tunnel->buffer_len);
+	if (!tunnel->buffer) {
+		tunnel->buffer_len = 10240;
+		tunnel->buffer = g_malloc(tunnel->buffer_len);
+	}
 
 	/* Start the tunnel data transmission */
 	while (tunnel->running) {
@@ -2505,8 +4014,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 		    tunnel->tunnel_type == REMMINA_SSH_TUNNEL_REVERSE) {
 			if (first) {
 				first = FALSE;
-				channel = ssh_channel_accept_forward(REMMINA_SSH(tunnel)->session, 15000, &tunnel->port);
-				if (!channel) {
+				if (!remmina_ssh_tunnel_wait_forward(tunnel, 15000)) {
 					remmina_ssh_set_application_error(REMMINA_SSH(tunnel), _("The server did not respond."));
 					if (tunnel->disconnect_func)
 						(*tunnel->disconnect_func)(tunnel, tunnel->callback_data);
@@ -2523,38 +4031,34 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 					ssh_forward_cancel(REMMINA_SSH(tunnel)->session, NULL, tunnel->port);
 #endif
 				}
-			} else if (tunnel->tunnel_type != REMMINA_SSH_TUNNEL_REVERSE) {
-				/* Poll once per some period of time if no incoming connections.
-				 * Don’t try to poll continuously as it will significantly slow down the loop */
-				t1 = g_date_time_new_now_local();
-				diff = g_date_time_difference(t1, t2) * 10000000
-				       + g_date_time_difference(t1, t2) / 100000;
-				if (diff > 1) {
-					REMMINA_DEBUG("Polling tunnel channels");
-						channel = ssh_channel_accept_forward(REMMINA_SSH(tunnel)->session, 0, &tunnel->port);
-					if (channel == NULL)
-						t2 = g_date_time_new_now_local();
-				}
 			}
 
-			if (channel) {
+			/* Channels accepted by remmina_ssh_tunnel_forward_message_cb() */
+			while (tunnel->accepted_channels) {
+				channel = (ssh_channel)tunnel->accepted_channels->data;
+				tunnel->accepted_channels = g_slist_delete_link(tunnel->accepted_channels, tunnel->accepted_channels);
+
+				sock = -1;
 				if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_REVERSE) {
-					sin.sin_family = AF_INET;
-					sin.sin_port = htons(tunnel->localport);
-					sin.sin_addr.s_addr = inet_addr("127.0.0.1");
-					sock = socket(AF_INET, SOCK_STREAM, 0);
-					if (connect(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
-						remmina_ssh_set_application_error(REMMINA_SSH(tunnel),
-										  _("Cannot connect to local port %i."), tunnel->localport);
-						close(sock);
-						sock = -1;
+					if (!reverse_connected) {
+						reverse_connected = TRUE;
+						sin.sin_family = AF_INET;
+						sin.sin_port = htons(tunnel->localport);
+						sin.sin_addr.s_addr = inet_addr("127.0.0.1");
+						sock = socket(AF_INET, SOCK_STREAM, 0);
+						if (connect(sock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+							remmina_ssh_set_application_error(REMMINA_SSH(tunnel),
+											  _("Cannot connect to local port %i."), tunnel->localport);
+							close(sock);
+							sock = -1;
+						}
 					}
 				} else
 					sock = remmina_public_open_xdisplay(tunnel->localdisplay);
 				if (sock >= 0)
 					remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
 				else {
-					/* Failed to create unix socket. Will this happen? */
+					/* Failed to create unix socket, or a late reverse connection */
 					ssh_channel_close(channel);
 					ssh_channel_send_eof(channel);
 					ssh_channel_free(channel);
@@ -2563,7 +4067,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 			}
 		}
 
-		if (tunnel->num_channels <= 0)
+		if (tunnel->num_channels <= 0 && !tunnel->socks5_clients && !remmina_ssh_tunnel_keep_listening(tunnel))
 			/* No more connections. We should quit */
 			break;
 
@@ -2577,12 +4081,46 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 				maxfd = tunnel->sockets[i];
 			FD_SET(tunnel->sockets[i], &set);
 		}
+		/* Wake up for new SOCKS clients too */
+		if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_DYNAMIC && tunnel->server_sock >= 0) {
+			if (tunnel->server_sock > maxfd)
+				maxfd = tunnel->server_sock;
+			FD_SET(tunnel->server_sock, &set);
+		}
+		remmina_ssh_tunnel_watch_socks5_clients(tunnel, &set, &maxfd);
+		/* for channels opened by the server on our remote forwards */
+		if (tunnel->wakeup_pipe[0] >= 0) {
+			if (tunnel->wakeup_pipe[0] > maxfd)
+				maxfd = tunnel->wakeup_pipe[0];
+			FD_SET(tunnel->wakeup_pipe[0], &set);
+		}
+		/* and for the forwards of a shared tunnel, these are not closed under our feet */
+		pthread_mutex_lock(&tunnel_registry_mutex);
+		for (j = 0; j < tunnel->forwards->len; j++) {
+			RemminaSSHTunnelForward *forward = (RemminaSSHTunnelForward *)tunnel->forwards->pdata[j];
+			if (forward->server_sock > maxfd)
+				maxfd = forward->server_sock;
+			FD_SET(forward->server_sock, &set);
+		}
+		pthread_mutex_unlock(&tunnel_registry_mutex);
 
-		ret = ssh_select(tunnel->channels, tunnel->channels_out, maxfd + 1, &set, &timeout);
+		if (tunnel->num_channels > 0) {
+			ret = ssh_select(tunnel->channels, tunnel->channels_out, maxfd + 1, &set, &timeout);
+		} else {
+			/* A shared tunnel waiting for its next connection */
+			ret = select(maxfd + 1, &set, NULL, NULL, &timeout);
+			if (ret < 0 && errno == EINTR)
+				ret = SSH_EINTR;
+		}
 		if (!tunnel->running) break;
 		if (ret == SSH_EINTR) continue;
 		if (ret == -1) break;
 
+		if (tunnel->wakeup_pipe[0] >= 0 && FD_ISSET(tunnel->wakeup_pipe[0], &set))
+			while (read(tunnel->wakeup_pipe[0], wakeup, sizeof(wakeup)) > 0);
+
+		sent = received = 0;
+
 		i = 0;
 		while (tunnel->running && i < tunnel->num_channels) {
 			disconnected = FALSE;
@@ -2597,6 +4135,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 							remmina_ssh_set_error(REMMINA_SSH(tunnel), _("Could not write to SSH channel. %s"));
 							break;
 						}
+						sent += lenw;
 					}
 				}
 				if (len == 0) {
@@ -2651,6 +4190,7 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 						disconnected = TRUE;
 						break;
 					}
+					received += lenw;
 				}
 				if (tunnel->socketbuffers[i]->len <= 0) {
 					remmina_ssh_tunnel_buffer_free(tunnel->socketbuffers[i]);
@@ -2665,13 +4205,27 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 			}
 			i++;
 		}
+
+		if (sent > 0 || received > 0) {
+			pthread_mutex_lock(&tunnel_registry_mutex);
+			tunnel->bytes_sent += sent;
+			tunnel->bytes_received += received;
+			pthread_mutex_unlock(&tunnel_registry_mutex);
+		}
+
+		remmina_ssh_tunnel_serve_socks5_clients(tunnel, &set);
+
 		/**
 		 * Some protocols may open new connections during the session.
 		 * e.g: SPICE opens a new connection for some channels.
 		 */
 		sock = remmina_ssh_tunnel_accept_local_connection(tunnel, FALSE);
-		if (sock > 0) {
-			channel = remmina_ssh_tunnel_create_forward_channel(tunnel);
+		if (sock > 0 && tunnel->tunnel_type == REMMINA_SSH_TUNNEL_DYNAMIC) {
+			do
+				remmina_ssh_tunnel_add_socks5_client(tunnel, sock);
+			while ((sock = remmina_ssh_tunnel_accept_local_connection(tunnel, FALSE)) > 0);
+		} else if (sock > 0) {
+			channel = remmina_ssh_tunnel_create_forward_channel(tunnel, tunnel->dest, tunnel->port);
 			if (!channel) {
 				REMMINA_DEBUG("Could not open new SSH connection. %s", REMMINA_SSH(tunnel)->error);
 				close(sock);
@@ -2681,6 +4235,8 @@ remmina_ssh_tunnel_main_thread_proc(gpointer data)
 				remmina_ssh_tunnel_add_channel(tunnel, channel, sock);
 			}
 		}
+		if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_OPEN && tunnel->running)
+			remmina_ssh_tunnel_accept_forwards(tunnel);
 	}
 
 	remmina_ssh_tunnel_close_all_channels(tunnel);
@@ -2698,10 +4254,25 @@ static gboolean remmina_ssh_notify_tunnel_main_thread_end(gpointer data)
 {
 	TRACE_CALL(__func__);
 	RemminaSSHTunnel *tunnel = (RemminaSSHTunnel *)data;
+	RemminaSSHTunnelCallback destroy_func = tunnel->destroy_func;
+	GPtrArray *owners;
+	guint i;
+
+	if (!destroy_func)
+		return FALSE;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	owners = g_ptr_array_sized_new(tunnel->owners->len);
+	for (i = 0; i < tunnel->owners->len; i++)
+		g_ptr_array_add(owners, tunnel->owners->pdata[i]);
+	pthread_mutex_unlock(&tunnel_registry_mutex);
 
-	/* Ask tunnel owner to destroy tunnel object */
-	if (tunnel->destroy_func)
-		(*tunnel->destroy_func)(tunnel, tunnel->destroy_func_callback_data);
+	/* Ask tunnel owners to destroy tunnel object, the last one frees it */
+	if (owners->len == 0)
+		(*destroy_func)(tunnel, tunnel->destroy_func_callback_data);
+	for (i = 0; i < owners->len; i++)
+		(*destroy_func)(tunnel, owners->pdata[i]);
+	g_ptr_array_free(owners, TRUE);
 
 	return FALSE;
 }
@@ -2711,6 +4282,7 @@ remmina_ssh_tunnel_main_thread(gpointer data)
 {
 	TRACE_CALL(__func__);
 	RemminaSSHTunnel *tunnel = (RemminaSSHTunnel *)data;
+	GPtrArray *forwards;
 
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
 
@@ -2718,6 +4290,15 @@ remmina_ssh_tunnel_main_thread(gpointer data)
 		remmina_ssh_tunnel_main_thread_proc(data);
 		if (tunnel->server_sock < 0 || tunnel->thread == 0 || !tunnel->running) break;
 	}
+
+	/* Nobody serves the forwards anymore, refuse their connections */
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_unregister(tunnel);
+	forwards = tunnel->forwards;
+	tunnel->forwards = g_ptr_array_new();
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_forwards_free(forwards);
+
 	tunnel->thread = 0;
 
 	/* Do after tunnel thread cleanup */
@@ -2728,36 +4309,42 @@ remmina_ssh_tunnel_main_thread(gpointer data)
 
 
 void
-remmina_ssh_tunnel_cancel_accept(RemminaSSHTunnel *tunnel)
+remmina_ssh_tunnel_cancel_accept(RemminaSSHTunnel *tunnel, gpointer owner)
 {
 	TRACE_CALL(__func__);
-	if (tunnel->server_sock >= 0) {
+	guint i;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	/* The first listener belongs to whoever opened the tunnel. A SOCKS
+	 * proxy keeps getting new connections for the whole session */
+	if (tunnel->server_sock >= 0 && tunnel->tunnel_type != REMMINA_SSH_TUNNEL_DYNAMIC &&
+	    (tunnel->owners->len == 0 || owner == tunnel->destroy_func_callback_data)) {
 		close(tunnel->server_sock);
 		tunnel->server_sock = -1;
 	}
+	for (i = 0; i < tunnel->forwards->len; i++) {
+		RemminaSSHTunnelForward *forward = (RemminaSSHTunnelForward *)tunnel->forwards->pdata[i];
+		if (forward->owner == owner)
+			forward->cancelled = TRUE;
+	}
+	pthread_mutex_unlock(&tunnel_registry_mutex);
 }
 
-gboolean
-remmina_ssh_tunnel_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port, gint local_port)
+/* Create the server socket that listens on the local port, errors are
+ * reported to ssh when given */
+static gint
+remmina_ssh_tunnel_listen(RemminaSSH *ssh, gint local_port, gint backlog)
 {
 	TRACE_CALL(__func__);
 	gint sock;
 	gint sockopt = 1;
 	struct sockaddr_in sin;
 
-	tunnel->tunnel_type = REMMINA_SSH_TUNNEL_OPEN;
-	tunnel->dest = g_strdup(host);
-	tunnel->port = port;
-	if (tunnel->port == 0) {
-		REMMINA_SSH(tunnel)->error = g_strdup(_("Assign a destination port."));
-		return FALSE;
-	}
-
-	/* Create the server socket that listens on the local port */
 	sock = socket(AF_INET, SOCK_STREAM, 0);
 	if (sock < 0) {
-		REMMINA_SSH(tunnel)->error = g_strdup(_("Could not create socket."));
-		return FALSE;
+		if (ssh)
+			ssh->error = g_strdup(_("Could not create socket."));
+		return -1;
 	}
 	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &sockopt, sizeof(sockopt));
 
@@ -2766,18 +4353,74 @@ remmina_ssh_tunnel_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port,
 	sin.sin_addr.s_addr = inet_addr("127.0.0.1");
 
 	if (bind(sock, (struct sockaddr *)&sin, sizeof(sin))) {
-		REMMINA_SSH(tunnel)->error = g_strdup(_("Could not bind server socket to local port."));
+		if (ssh)
+			ssh->error = g_strdup(_("Could not bind server socket to local port."));
 		close(sock);
-		return FALSE;
+		return -1;
 	}
 
-	if (listen(sock, 1)) {
-		REMMINA_SSH(tunnel)->error = g_strdup(_("Could not listen to local port."));
+	if (listen(sock, backlog)) {
+		if (ssh)
+			ssh->error = g_strdup(_("Could not listen to local port."));
 		close(sock);
+		return -1;
+	}
+
+	return sock;
+}
+
+gboolean
+remmina_ssh_tunnel_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port, gint local_port)
+{
+	TRACE_CALL(__func__);
+
+	tunnel->tunnel_type = REMMINA_SSH_TUNNEL_OPEN;
+	tunnel->dest = g_strdup(host);
+	tunnel->port = port;
+	if (tunnel->port == 0) {
+		REMMINA_SSH(tunnel)->error = g_strdup(_("Assign a destination port."));
+		return FALSE;
+	}
+
+	tunnel->server_sock = remmina_ssh_tunnel_listen(REMMINA_SSH(tunnel), local_port, 1);
+	if (tunnel->server_sock < 0)
+		return FALSE;
+
+	tunnel->running = TRUE;
+
+	if (pthread_create(&tunnel->thread, NULL, remmina_ssh_tunnel_main_thread, tunnel)) {
+		// TRANSLATORS: Do not translate pthread
+		remmina_ssh_set_application_error(REMMINA_SSH(tunnel), _("Could not start pthread."));
+		tunnel->thread = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+gboolean
+remmina_ssh_tunnel_dynamic(RemminaSSHTunnel *tunnel, gint local_port)
+{
+	TRACE_CALL(__func__);
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+
+	tunnel->tunnel_type = REMMINA_SSH_TUNNEL_DYNAMIC;
+	tunnel->localport = local_port;
+
+	/* Browsers open many connections at once */
+	tunnel->server_sock = remmina_ssh_tunnel_listen(REMMINA_SSH(tunnel), local_port, SOMAXCONN);
+	if (tunnel->server_sock < 0)
 		return FALSE;
+	if (local_port == 0) {
+		if (getsockname(tunnel->server_sock, (struct sockaddr *)&sin, &sinlen) != 0) {
+			REMMINA_SSH(tunnel)->error = g_strdup(_("Could not listen to local port."));
+			close(tunnel->server_sock);
+			tunnel->server_sock = -1;
+			return FALSE;
+		}
+		tunnel->localport = ntohs(sin.sin_port);
 	}
 
-	tunnel->server_sock = sock;
 	tunnel->running = TRUE;
 
 	if (pthread_create(&tunnel->thread, NULL, remmina_ssh_tunnel_main_thread, tunnel)) {
@@ -2789,6 +4432,98 @@ remmina_ssh_tunnel_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port,
 	return TRUE;
 }
 
+void
+remmina_ssh_tunnel_register(RemminaSSHTunnel *tunnel, gpointer owner)
+{
+	TRACE_CALL(__func__);
+	if (tunnel->tunnel_type != REMMINA_SSH_TUNNEL_OPEN || !tunnel->registry_key)
+		return;
+	/* Authenticated with something else than the saved secret its key was
+	 * made from, see remmina_ssh_auth() */
+	if (!REMMINA_SSH(tunnel)->pool_credentials)
+		return;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	if (!tunnel_registry)
+		tunnel_registry = g_hash_table_new(g_str_hash, g_str_equal);
+	if (tunnel->running && !g_hash_table_contains(tunnel_registry, tunnel->registry_key)) {
+		g_hash_table_insert(tunnel_registry, tunnel->registry_key, tunnel);
+		tunnel->registered = TRUE;
+	}
+	g_ptr_array_add(tunnel->owners, owner);
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+}
+
+RemminaSSHTunnel *
+remmina_ssh_tunnel_attach(RemminaFile *remminafile, const gchar *host, gint port,
+			  gpointer owner, gint *local_port)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHTunnel *tunnel = NULL;
+	RemminaSSHTunnelForward *forward;
+	RemminaSSH *ssh;
+	struct sockaddr_in sin;
+	socklen_t sinlen = sizeof(sin);
+	gchar *key;
+	gint sock;
+
+	if (port == 0)
+		return NULL;
+
+	ssh = g_new0(RemminaSSH, 1);
+	remmina_ssh_init_from_file(ssh, remminafile, TRUE);
+	key = remmina_ssh_pool_key(ssh);
+	remmina_ssh_free(ssh);
+	if (!key)
+		return NULL;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	if (tunnel_registry)
+		tunnel = g_hash_table_lookup(tunnel_registry, key);
+	if (tunnel) {
+		/* Each destination gets its own listener on a port picked by the system */
+		sock = remmina_ssh_tunnel_listen(NULL, 0, 1);
+		if (sock >= 0 && getsockname(sock, (struct sockaddr *)&sin, &sinlen) == 0) {
+			fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+			forward = g_new0(RemminaSSHTunnelForward, 1);
+			forward->server_sock = sock;
+			forward->dest = g_strdup(host);
+			forward->port = port;
+			forward->owner = owner;
+			g_ptr_array_add(tunnel->forwards, forward);
+			g_ptr_array_add(tunnel->owners, owner);
+			*local_port = ntohs(sin.sin_port);
+			REMMINA_DEBUG("Reusing SSH tunnel %s for %s:%d on local port %d",
+				      key, host, port, *local_port);
+		} else {
+			if (sock >= 0)
+				close(sock);
+			tunnel = NULL;
+		}
+	}
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+	g_free(key);
+
+	return tunnel;
+}
+
+void
+remmina_ssh_tunnel_get_stats(RemminaSSHTunnel *tunnel, guint64 *bytes_sent, guint64 *bytes_received,
+			     guint *channels_open, guint *channels_opened)
+{
+	TRACE_CALL(__func__);
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	if (bytes_sent)
+		*bytes_sent = tunnel->bytes_sent;
+	if (bytes_received)
+		*bytes_received = tunnel->bytes_received;
+	if (channels_open)
+		*channels_open = tunnel->num_channels;
+	if (channels_opened)
+		*channels_opened = tunnel->channels_opened;
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+}
+
 gboolean
 remmina_ssh_tunnel_xport(RemminaSSHTunnel *tunnel, gboolean bindlocalhost)
 {
@@ -2831,6 +4566,39 @@ remmina_ssh_tunnel_terminated(RemminaSSHTunnel *tunnel)
 	return tunnel->thread == 0;
 }
 
+void
+remmina_ssh_tunnel_release(RemminaSSHTunnel *tunnel, gpointer owner)
+{
+	TRACE_CALL(__func__);
+	guint remaining;
+	guint i;
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	g_ptr_array_remove(tunnel->owners, owner);
+	for (i = 0; i < tunnel->forwards->len; i++) {
+		RemminaSSHTunnelForward *forward = (RemminaSSHTunnelForward *)tunnel->forwards->pdata[i];
+		if (forward->owner == owner)
+			forward->cancelled = TRUE;
+	}
+	remaining = tunnel->owners->len;
+	if (remaining == 0) {
+		remmina_ssh_tunnel_unregister(tunnel);
+	} else if (owner == tunnel->destroy_func_callback_data) {
+		/* The remaining owners are notified through their own entries */
+		if (tunnel->server_sock >= 0) {
+			close(tunnel->server_sock);
+			tunnel->server_sock = -1;
+		}
+		tunnel->destroy_func_callback_data = NULL;
+	}
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+
+	if (remaining == 0)
+		remmina_ssh_tunnel_free(tunnel);
+	else
+		REMMINA_DEBUG("SSH tunnel %s is still used by %u connections", tunnel->registry_key, remaining);
+}
+
 void
 remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel)
 {
@@ -2841,12 +4609,25 @@ remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel)
 
 	thread = tunnel->thread;
 	if (thread != 0) {
+		/* A cancelled thread may leave a half written packet behind */
+		remmina_ssh_pool_forget(REMMINA_SSH(tunnel));
 		tunnel->running = FALSE;
 		pthread_cancel(thread);
 		pthread_join(thread, NULL);
 		tunnel->thread = 0;
 	}
 
+	REMMINA_DEBUG("SSH tunnel closed after %u channels, %" G_GUINT64_FORMAT " bytes sent, %" G_GUINT64_FORMAT " bytes received",
+		      tunnel->channels_opened, tunnel->bytes_sent, tunnel->bytes_received);
+
+	pthread_mutex_lock(&tunnel_registry_mutex);
+	remmina_ssh_tunnel_unregister(tunnel);
+	pthread_mutex_unlock(&tunnel_registry_mutex);
+
+	/* Remote forwardings stay bound to the session */
+	if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_XPORT || tunnel->tunnel_type == REMMINA_SSH_TUNNEL_REVERSE)
+		remmina_ssh_pool_forget(REMMINA_SSH(tunnel));
+
 	if (tunnel->tunnel_type == REMMINA_SSH_TUNNEL_XPORT && tunnel->remotedisplay > 0) {
 #if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 7, 0)
 		ssh_channel_cancel_forward(REMMINA_SSH(tunnel)->session, NULL, 6000 + tunnel->remotedisplay);
@@ -2859,12 +4640,25 @@ remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel)
 		tunnel->server_sock = -1;
 	}
 
+	if (tunnel->wakeup_pipe[0] >= 0) {
+		if (REMMINA_SSH(tunnel)->session)
+			ssh_set_message_callback(REMMINA_SSH(tunnel)->session, NULL, NULL);
+		close(tunnel->wakeup_pipe[0]);
+		close(tunnel->wakeup_pipe[1]);
+		tunnel->wakeup_pipe[0] = tunnel->wakeup_pipe[1] = -1;
+	}
+	g_slist_free_full(tunnel->accepted_channels, (GDestroyNotify)ssh_channel_free);
+	tunnel->accepted_channels = NULL;
+
 	remmina_ssh_tunnel_close_all_channels(tunnel);
 
 	g_free(tunnel->buffer);
 	g_free(tunnel->channels_out);
 	g_free(tunnel->dest);
 	g_free(tunnel->localdisplay);
+	remmina_ssh_tunnel_forwards_free(tunnel->forwards);
+	g_ptr_array_free(tunnel->owners, TRUE);
+	g_free(tunnel->registry_key);
 
 	remmina_ssh_free((RemminaSSH *)tunnel);
 }
@@ -2946,6 +4740,8 @@ remmina_ssh_shell_new_from_file(RemminaFile *remminafile)
 
 	shell->master = -1;
 	shell->slave = -1;
+	shell->channels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)remmina_ssh_item_free);
+	pthread_mutex_init(&shell->channels_mutex, NULL);
 	shell->exec = g_strdup(remmina_file_get_string(remminafile, "exec"));
 	shell->run_line = g_strdup(remmina_file_get_string(remminafile, "run_line"));
 
@@ -2964,6 +4760,8 @@ remmina_ssh_shell_new_from_ssh(RemminaSSH *ssh)
 
 	shell->master = -1;
 	shell->slave = -1;
+	shell->channels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)remmina_ssh_item_free);
+	pthread_mutex_init(&shell->channels_mutex, NULL);
 
 	return shell;
 }
@@ -2996,7 +4794,7 @@ remmina_ssh_shell_thread(gpointer data)
 	gchar *filename;
 	const gchar *dir;
 	const gchar *sshlogname;
-	FILE *fp = NULL;
+	node_t *shell_item;
 
 	//gint screen;
 
@@ -3078,10 +4876,11 @@ remmina_ssh_shell_thread(gpointer data)
 	sshlogname = remmina_file_format_properties(remminafile, sshlogname);
 	filename = g_strconcat(dir, "/", sshlogname, NULL);
 
-	if (remmina_file_get_int (remminafile, "sshsavesession", FALSE)) {
-		REMMINA_DEBUG("Saving session log to %s", filename);
-		fp = fopen(filename, "w");
-	}
+	if (remmina_file_get_int (remminafile, "sshsavesession", FALSE))
+		shell->recorder = remmina_ssh_recorder_new(filename,
+							   remmina_file_get_int(remminafile, "sshlogformat", REMMINA_SSH_RECORDER_PLAIN),
+							   remmina_file_get_int(remminafile, "sshlogcompress", FALSE),
+							   (goffset)remmina_file_get_int(remminafile, "sshlogmaxsize", 0) * 1024 * 1024);
 
 	g_free(filename);
 
@@ -3106,11 +4905,14 @@ remmina_ssh_shell_thread(gpointer data)
 
 	REMMINA_DEBUG("shell->slave: %d", shell->slave);
 
+	shell_item = remmina_ssh_insert_item(shell, shell->channel, shell->slave, shell->slave, TRUE);
+
 	// Add the fd to the event and assign it the callback.
-	if (ssh_event_add_fd(shell->event, shell->slave, events, remmina_ssh_cp_to_ch_cb, channel) != SSH_OK) {
+	if (ssh_event_add_fd(shell->event, shell->slave, events, remmina_ssh_cp_to_ch_cb, shell_item) != SSH_OK) {
 		REMMINA_WARNING("Internal error in %s: Couldn't add an fd to the event.", __func__);
 		return NULL;
 	}
+	shell_item->watched = events;
 
 	// Remove the poll handle from session and assign them to the event.
 	if (ssh_event_add_session(shell->event, REMMINA_SSH(shell)->session) != SSH_OK) {
@@ -3118,28 +4920,25 @@ remmina_ssh_shell_thread(gpointer data)
 		return NULL;
 	}
 
-	remmina_ssh_insert_item(shell->channel, shell->slave, shell->slave, TRUE, shell->thread);
-
-	// Initializes the ssh_callbacks_struct.
-	channel_cb.userdata = &shell;
-	ssh_callbacks_init(&channel_cb);
 	// Set the channel callback functions.
-	ssh_set_channel_callbacks(shell->channel, &channel_cb);
+	ssh_set_channel_callbacks(shell->channel, &shell_item->cb);
 	UNLOCK_SSH(shell)
 
 	do {
 		ssh_event_dopoll(shell->event, 1000);
+		/* The callbacks cannot change the fds of the event themselves */
+		remmina_ssh_update_item_fds(shell);
 	} while(!ssh_channel_is_closed(shell->channel));
 
 	// Close all OPENED X11 channel
-	remmina_ssh_close_all_x11_ch(shell->thread);
+	remmina_ssh_close_all_x11_ch(shell);
 
 	shell->closed = TRUE;
 
 	LOCK_SSH(shell)
 
 	// Remove socket fd from event context.
-	ret = ssh_event_remove_fd(shell->event, shell->slave);
+	ret = shell_item->watched ? ssh_event_remove_fd(shell->event, shell->slave) : SSH_OK;
 	REMMINA_DEBUG("Remove socket fd from event context: %d", ret);
 
 	// Remove session object from event context.
@@ -3151,11 +4950,14 @@ remmina_ssh_shell_thread(gpointer data)
 	REMMINA_DEBUG("Free event context");
 
 	// Remove channel callback.
-	ret = ssh_remove_channel_callbacks(shell->channel, &channel_cb);
+	ret = ssh_remove_channel_callbacks(shell->channel, &shell_item->cb);
 	REMMINA_DEBUG("Remove channel callback: %d", ret);
+	remmina_ssh_delete_item(shell, shell->channel);
 
-	if (remmina_file_get_int (remminafile, "sshsavesession", FALSE))
-		fclose(fp);
+	if (shell->recorder) {
+		remmina_ssh_recorder_free(shell->recorder);
+		shell->recorder = NULL;
+	}
 	shell->channel = NULL;
 	ssh_channel_close(channel);
 	ssh_channel_send_eof(channel);
@@ -3220,12 +5022,14 @@ remmina_ssh_shell_free(RemminaSSHShell *shell)
 	TRACE_CALL(__func__);
 
 	// Close all OPENED X11 channel
-	remmina_ssh_close_all_x11_ch(shell->thread);
+	remmina_ssh_close_all_x11_ch(shell);
 
 	shell->exit_callback = NULL;
 	shell->closed = TRUE;
 	REMMINA_DEBUG("Cancelling the shell thread if needed");
 	if (shell->thread) {
+		/* A cancelled thread may leave a half written packet behind */
+		remmina_ssh_pool_forget(REMMINA_SSH(shell));
 		pthread_cancel(shell->thread);
 		if (shell->thread) pthread_join(shell->thread, NULL);
 	}
@@ -3238,6 +5042,13 @@ remmina_ssh_shell_free(RemminaSSHShell *shell)
 		g_free(shell->run_line);
 		shell->run_line = NULL;
 	}
+	/* The shell thread is gone, nobody uses the channels anymore */
+	if (shell->recorder) {
+		remmina_ssh_recorder_free(shell->recorder);
+		shell->recorder = NULL;
+	}
+	g_hash_table_destroy(shell->channels);
+	pthread_mutex_destroy(&shell->channels_mutex);
 	/* It’s not necessary to close shell->slave since the other end (vte) will close it */
 	remmina_ssh_free(REMMINA_SSH(shell));
 }
@@ -46,6 +46,7 @@
 #include <libssh/sftp.h>
 #include <pthread.h>
 #include "remmina_file.h"
+#include "remmina_ssh_recorder.h"
 #include "rcw.h"
 
 G_BEGIN_DECLS
@@ -90,6 +91,13 @@ typedef struct _RemminaSSH {
 	gchar *		tunnel_entrance_host;
 	gint		tunnel_entrance_port;
 
+	/* Session pool key, NULL when the session must not be reused */
+	gchar *		pool_key;
+	/* Digest of the saved secret of the profile, part of pool_key */
+	gchar *		pool_credentials;
+	/* Number of owners the pooled session had, this one included */
+	gint		pool_leases;
+
 } RemminaSSH;
 
 gchar *remmina_ssh_identity_path(const gchar *id);
@@ -133,6 +141,11 @@ gchar *remmina_ssh_unconvert(RemminaSSH *ssh, const gchar *from);
 
 void remmina_ssh_free(RemminaSSH *ssh);
 
+/* Connect and, when no prompt is needed, authenticate the SSH session of a
+ * profile in the background, for remmina_ssh_init_session() to take over.
+ * Stored passwords are only used if use_secrets is TRUE */
+void remmina_ssh_prefetch(RemminaFile *remminafile, gboolean use_secrets);
+
 /*-----------------------------------------------------------------------------*
 *                           SSH Tunnel                                        *
 *-----------------------------------------------------------------------------*/
@@ -144,7 +157,8 @@ typedef gboolean (*RemminaSSHTunnelCallback) (RemminaSSHTunnel *, gpointer);
 enum {
 	REMMINA_SSH_TUNNEL_OPEN,
 	REMMINA_SSH_TUNNEL_XPORT,
-	REMMINA_SSH_TUNNEL_REVERSE
+	REMMINA_SSH_TUNNEL_REVERSE,
+	REMMINA_SSH_TUNNEL_DYNAMIC
 };
 
 
@@ -183,6 +197,24 @@ struct _RemminaSSHTunnel {
 	RemminaSSHTunnelCallback	destroy_func;
 	gpointer	destroy_func_callback_data;
 
+	/* Sharing of OPEN tunnels between connections, see remmina_ssh_tunnel_attach() */
+	gchar *				registry_key;
+	gboolean			registered;
+	GPtrArray *			owners;
+	GPtrArray *			forwards;
+
+	/* Channels opened by the server on XPORT and REVERSE forwards, waiting
+	 * to be added by the tunnel thread which gets woken up through the pipe */
+	GSList *			accepted_channels;
+	gint				wakeup_pipe[2];
+
+	/* SOCKS5 clients of a DYNAMIC tunnel whose channel is not open yet */
+	GSList *			socks5_clients;
+
+	/* Traffic counters, see remmina_ssh_tunnel_get_stats() */
+	guint64				bytes_sent;
+	guint64				bytes_received;
+	guint				channels_opened;
 };
 
 /* Create a new SSH Tunnel session and connects to the SSH server */
@@ -194,10 +226,35 @@ RemminaSSHTunnel *remmina_ssh_tunnel_new_from_file(RemminaFile *remminafile);
  */
 gboolean remmina_ssh_tunnel_open(RemminaSSHTunnel *tunnel, const gchar *host, gint port, gint local_port);
 
-/* Cancel accepting any incoming tunnel request.
+/* Open a dynamic tunnel (ssh -D). A new thread will be started and serve a
+ * SOCKS5 proxy on the local port, every CONNECT request gets its own
+ * direct-tcpip channel.
+ * local_port: The listening local port for the proxy, 0 lets the system pick
+ *             one, which is then stored in tunnel->localport
+ */
+gboolean remmina_ssh_tunnel_dynamic(RemminaSSHTunnel *tunnel, gint local_port);
+
+/* Publish an opened tunnel so that other connections through the same SSH
+ * server reuse its authenticated session. owner is the first user of the
+ * tunnel, it is notified through destroy_func like the later ones.
+ */
+void remmina_ssh_tunnel_register(RemminaSSHTunnel *tunnel, gpointer owner);
+
+/* Look for a registered tunnel to the SSH server of remminafile and add a
+ * forward of an ephemeral local port to host:port on it. On success the
+ * tunnel is referenced for owner and local_port is set.
+ */
+RemminaSSHTunnel *remmina_ssh_tunnel_attach(RemminaFile *remminafile, const gchar *host, gint port,
+					    gpointer owner, gint *local_port);
+
+/* Cancel accepting any incoming tunnel request on the forwards of owner.
  * Typically called after the connection has already been establish.
  */
-void remmina_ssh_tunnel_cancel_accept(RemminaSSHTunnel *tunnel);
+void remmina_ssh_tunnel_cancel_accept(RemminaSSHTunnel *tunnel, gpointer owner);
+
+/* Traffic forwarded by the tunnel so far, over all its channels */
+void remmina_ssh_tunnel_get_stats(RemminaSSHTunnel *tunnel, guint64 *bytes_sent, guint64 *bytes_received,
+				  guint *channels_open, guint *channels_opened);
 
 /* start X Port Forwarding */
 gboolean remmina_ssh_tunnel_xport(RemminaSSHTunnel *tunnel, gboolean bindlocalhost);
@@ -213,6 +270,9 @@ gboolean remmina_ssh_tunnel_reverse(RemminaSSHTunnel *tunnel, gint port, gint lo
 /* Tells if the tunnel is terminated after start */
 gboolean remmina_ssh_tunnel_terminated(RemminaSSHTunnel *tunnel);
 
+/* Drop the reference of owner, the tunnel is freed with its last owner */
+void remmina_ssh_tunnel_release(RemminaSSHTunnel *tunnel, gpointer owner);
+
 /* Free the tunnel */
 void remmina_ssh_tunnel_free(RemminaSSHTunnel *tunnel);
 
@@ -256,6 +316,11 @@ typedef struct _RemminaSSHShell {
 	RemminaSSHExitFunc	exit_callback;
 	gpointer		user_data;
 	ssh_event		event;
+	/* Channels forwarded by this shell (X11 and the shell itself) by ssh_channel */
+	GHashTable *		channels;
+	pthread_mutex_t		channels_mutex;
+	/* Session log fed with the output of the shell channel */
+	RemminaSSHRecorder *	recorder;
 } RemminaSSHShell;
 
 /* Create a new SSH Shell session object from RemminaFile */
@@ -536,41 +536,68 @@ remmina_plugin_ssh_vte_paste_clipboard(GtkMenuItem *menuitem, gpointer vte)
 }
 
 static void
-remmina_plugin_ssh_vte_save_session(GtkMenuItem *menuitem, RemminaProtocolWidget *gp)
+remmina_plugin_ssh_vte_session_saved(GObject *source, GAsyncResult *res, gpointer user_data)
 {
 	TRACE_CALL(__func__);
-	RemminaPluginSshData *gpdata = GET_PLUGIN_DATA(gp);
-
+	GFile *file = G_FILE(source);
 	GtkWidget *widget;
 	GError *err = NULL;
+	gchar *path;
 
-	GFileOutputStream *stream = g_file_replace(gpdata->vte_session_file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &err);
-
-	if (err != NULL) {
+	if (!g_file_replace_contents_finish(file, res, NULL, &err)) {
 		// TRANSLATORS: %s is a placeholder for an error message
 		widget = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, _("Error: %s"), err->message);
 		g_signal_connect(G_OBJECT(widget), "response", G_CALLBACK(gtk_widget_destroy), NULL);
 		gtk_widget_show(widget);
+		g_error_free(err);
 		return;
 	}
 
-	if (stream != NULL)
+	path = g_file_get_path(file);
+	remmina_public_send_notification("remmina-terminal-saved",
+					 _("Terminal content saved in"),
+					 path);
+	g_free(path);
+}
+
+/* The scrollback is serialized in memory, which is quick, and written to
+ * disk asynchronously: the terminal may be gone by the time it is done */
+static void
+remmina_plugin_ssh_vte_save_session(GtkMenuItem *menuitem, RemminaProtocolWidget *gp)
+{
+	TRACE_CALL(__func__);
+	RemminaPluginSshData *gpdata = GET_PLUGIN_DATA(gp);
+
+	GtkWidget *widget;
+	GError *err = NULL;
+	GOutputStream *stream;
+	GBytes *contents;
+
+	stream = g_memory_output_stream_new_resizable();
 #if VTE_CHECK_VERSION(0, 38, 0)
-		vte_terminal_write_contents_sync(VTE_TERMINAL(gpdata->vte), G_OUTPUT_STREAM(stream),
-						 VTE_WRITE_DEFAULT, NULL, &err);
+	vte_terminal_write_contents_sync(VTE_TERMINAL(gpdata->vte), stream,
+					 VTE_WRITE_DEFAULT, NULL, &err);
 #else
-		vte_terminal_write_contents(VTE_TERMINAL(gpdata->vte), G_OUTPUT_STREAM(stream),
-					    VTE_TERMINAL_WRITE_DEFAULT, NULL, &err);
+	vte_terminal_write_contents(VTE_TERMINAL(gpdata->vte), stream,
+				    VTE_TERMINAL_WRITE_DEFAULT, NULL, &err);
 #endif
-
-	if (err == NULL) {
-		remmina_public_send_notification("remmina-terminal-saved",
-						 _("Terminal content saved in"),
-						 g_file_get_path(gpdata->vte_session_file));
+	if (err != NULL) {
+		// TRANSLATORS: %s is a placeholder for an error message
+		widget = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, _("Error: %s"), err->message);
+		g_signal_connect(G_OBJECT(widget), "response", G_CALLBACK(gtk_widget_destroy), NULL);
+		gtk_widget_show(widget);
+		g_error_free(err);
+		g_object_unref(stream);
+		return;
 	}
 
+	g_output_stream_close(stream, NULL, NULL);
+	contents = g_memory_output_stream_steal_as_bytes(G_MEMORY_OUTPUT_STREAM(stream));
 	g_object_unref(stream);
-	g_free(err);
+
+	g_file_replace_contents_bytes_async(gpdata->vte_session_file, contents, NULL, FALSE, G_FILE_CREATE_NONE,
+					    NULL, remmina_plugin_ssh_vte_session_saved, NULL);
+	g_bytes_unref(contents);
 }
 
 /** Send a keystroke to the plugin window */
@@ -1502,6 +1529,14 @@ static gpointer ssh_auth[] =
 	NULL
 };
 
+/** Asynchronous session log formats, see RemminaSSHRecorderFormat */
+static gpointer ssh_log_format[] =
+{
+	"0", N_("Plain text"),
+	"1", N_("ttyrec (with timing)"),
+	NULL
+};
+
 /** Charset list */
 static gpointer ssh_charset_list[] =
 {
@@ -1648,7 +1683,10 @@ static const RemminaProtocolSetting remmina_ssh_advanced_settings[] =
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,   "sshlogfolder",		  N_("Folder for SSH session log"),	      FALSE, NULL,		   N_("Full path of an existing folder")					 },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_TEXT,	"sshlogname",		  N_("Filename for SSH session log"),	      FALSE, NULL,		   log_tips									 },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshlogenabled",	  N_("Log SSH session when exiting Remmina"), FALSE, NULL,		   NULL										 },
-	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshsavesession",	  N_("Log SSH session asynchronously"),	      TRUE,  NULL,		   N_("Saving the session asynchronously may have a notable performance impact") },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshsavesession",	  N_("Log SSH session asynchronously"),	      TRUE,  NULL,		   N_("Terminal output is queued and written by a background thread") },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_SELECT, "sshlogformat",		  N_("SSH session log format"),		      FALSE, ssh_log_format,	   NULL										 },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"sshlogcompress",	  N_("Compress SSH session log (gzip)"),      TRUE,  NULL,		   NULL										 },
+	{ REMMINA_PROTOCOL_SETTING_TYPE_INT,	"sshlogmaxsize",	  N_("Rotate SSH session log after (MiB)"),   FALSE, NULL,		   N_("0 never rotates the log")						 },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"audiblebell",		  N_("Audible terminal bell"),		      FALSE, NULL,		   NULL										 },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"ssh_forward_x11",	  N_("SSH X11 Forwarding"),			      TRUE,  NULL,		   NULL										 },
 	{ REMMINA_PROTOCOL_SETTING_TYPE_CHECK,	"ssh_compression",	  N_("SSH compression"),		      FALSE, NULL,		   NULL										 },
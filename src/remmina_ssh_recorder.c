@@ -0,0 +1,281 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include "remmina_log.h"
+#include "remmina_ssh_recorder.h"
+#include "remmina/remmina_trace_calls.h"
+
+/* Single producer, single consumer ring: the shell thread only moves head,
+ * the writer thread only moves tail. Both are free running counters, the
+ * ring size must be a power of 2 */
+#define REMMINA_SSH_RECORDER_RING_SIZE (1 << 20)
+#define REMMINA_SSH_RECORDER_RING_MASK (REMMINA_SSH_RECORDER_RING_SIZE - 1)
+/* Largest chunk queued as one record */
+#define REMMINA_SSH_RECORDER_MAX_CHUNK (REMMINA_SSH_RECORDER_RING_SIZE / 8)
+/* How long the writer sleeps when there is nothing to write, in µs */
+#define REMMINA_SSH_RECORDER_IDLE_WAIT 100000
+/* Rotated files kept next to the current one */
+#define REMMINA_SSH_RECORDER_KEEP 5
+
+typedef struct {
+	gint64	time;
+	guint32 len;
+} RemminaSSHRecorderHeader;
+
+struct _RemminaSSHRecorder {
+	gchar *				path;
+	RemminaSSHRecorderFormat	format;
+	gboolean			compress;
+	goffset				max_size;
+	goffset				size;
+
+	guchar *			ring;
+	gint				head;
+	gint				tail;
+	gint				stop;
+	gint				dropped;
+
+	GOutputStream *			out;
+	GByteArray *			batch;
+	GThread *			thread;
+};
+
+static void remmina_ssh_recorder_ring_put(RemminaSSHRecorder *rec, guint pos, const void *data, gsize len)
+{
+	guint off = pos & REMMINA_SSH_RECORDER_RING_MASK;
+	gsize first = MIN(len, REMMINA_SSH_RECORDER_RING_SIZE - off);
+
+	memcpy(rec->ring + off, data, first);
+	memcpy(rec->ring, (const guchar *)data + first, len - first);
+}
+
+static void remmina_ssh_recorder_ring_get(RemminaSSHRecorder *rec, guint pos, void *data, gsize len)
+{
+	guint off = pos & REMMINA_SSH_RECORDER_RING_MASK;
+	gsize first = MIN(len, REMMINA_SSH_RECORDER_RING_SIZE - off);
+
+	memcpy(data, rec->ring + off, first);
+	memcpy((guchar *)data + first, rec->ring, len - first);
+}
+
+void remmina_ssh_recorder_feed(RemminaSSHRecorder *rec, const void *data, gsize len)
+{
+	RemminaSSHRecorderHeader hdr;
+	guint head, tail;
+	gsize chunk;
+
+	hdr.time = g_get_real_time();
+	while (len > 0) {
+		chunk = MIN(len, REMMINA_SSH_RECORDER_MAX_CHUNK);
+		head = (guint)rec->head;
+		tail = (guint)g_atomic_int_get(&rec->tail);
+		if (REMMINA_SSH_RECORDER_RING_SIZE - (head - tail) < sizeof(hdr) + chunk) {
+			/* The disk cannot keep up, the terminal must not wait for it */
+			g_atomic_int_add(&rec->dropped, (gint)len);
+			return;
+		}
+		hdr.len = (guint32)chunk;
+		remmina_ssh_recorder_ring_put(rec, head, &hdr, sizeof(hdr));
+		remmina_ssh_recorder_ring_put(rec, head + sizeof(hdr), data, chunk);
+		/* Publish the record only once it is complete */
+		g_atomic_int_set(&rec->head, (gint)(head + sizeof(hdr) + chunk));
+		data = (const guchar *)data + chunk;
+		len -= chunk;
+	}
+}
+
+static gboolean remmina_ssh_recorder_open(RemminaSSHRecorder *rec)
+{
+	TRACE_CALL(__func__);
+	GFile *file;
+	GFileOutputStream *stream;
+	GZlibCompressor *compressor;
+	GError *error = NULL;
+
+	file = g_file_new_for_path(rec->path);
+	stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+	g_object_unref(file);
+	if (!stream) {
+		REMMINA_WARNING("Could not open SSH session log %s: %s", rec->path, error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	if (rec->compress) {
+		compressor = g_zlib_compressor_new(G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		rec->out = g_converter_output_stream_new(G_OUTPUT_STREAM(stream), G_CONVERTER(compressor));
+		g_object_unref(compressor);
+		g_object_unref(stream);
+	} else {
+		rec->out = G_OUTPUT_STREAM(stream);
+	}
+	rec->size = 0;
+	return TRUE;
+}
+
+static void remmina_ssh_recorder_close(RemminaSSHRecorder *rec)
+{
+	TRACE_CALL(__func__);
+	if (!rec->out)
+		return;
+	g_output_stream_close(rec->out, NULL, NULL);
+	g_object_unref(rec->out);
+	rec->out = NULL;
+}
+
+/* log → log.1 → … → log.REMMINA_SSH_RECORDER_KEEP */
+static void remmina_ssh_recorder_rotate(RemminaSSHRecorder *rec)
+{
+	TRACE_CALL(__func__);
+	gchar *from, *to;
+	gint i;
+
+	remmina_ssh_recorder_close(rec);
+	for (i = REMMINA_SSH_RECORDER_KEEP - 1; i >= 0; i--) {
+		from = i ? g_strdup_printf("%s.%d", rec->path, i) : g_strdup(rec->path);
+		to = g_strdup_printf("%s.%d", rec->path, i + 1);
+		if (g_rename(from, to) < 0 && errno != ENOENT)
+			REMMINA_WARNING("Could not rotate SSH session log %s: %s", from, g_strerror(errno));
+		g_free(from);
+		g_free(to);
+	}
+	remmina_ssh_recorder_open(rec);
+}
+
+static void remmina_ssh_recorder_write_batch(RemminaSSHRecorder *rec)
+{
+	TRACE_CALL(__func__);
+	GError *error = NULL;
+
+	if (rec->batch->len == 0)
+		return;
+	if (rec->out && !g_output_stream_write_all(rec->out, rec->batch->data, rec->batch->len, NULL, NULL, &error)) {
+		REMMINA_WARNING("Could not write SSH session log %s: %s", rec->path, error->message);
+		g_error_free(error);
+		remmina_ssh_recorder_close(rec);
+	}
+	g_byte_array_set_size(rec->batch, 0);
+}
+
+static gpointer remmina_ssh_recorder_thread(gpointer data)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHRecorder *rec = (RemminaSSHRecorder *)data;
+	RemminaSSHRecorderHeader hdr;
+	guint32 ttyrec[3];
+	guint head, tail;
+	gboolean stopping;
+
+	tail = (guint)rec->tail;
+	while (TRUE) {
+		stopping = g_atomic_int_get(&rec->stop);
+		head = (guint)g_atomic_int_get(&rec->head);
+		if (head == tail) {
+			if (stopping)
+				break;
+			g_usleep(REMMINA_SSH_RECORDER_IDLE_WAIT);
+			continue;
+		}
+
+		/* Gather everything queued so far into one write */
+		while (tail != head) {
+			remmina_ssh_recorder_ring_get(rec, tail, &hdr, sizeof(hdr));
+			if (rec->format == REMMINA_SSH_RECORDER_TTYREC) {
+				ttyrec[0] = GUINT32_TO_LE((guint32)(hdr.time / G_USEC_PER_SEC));
+				ttyrec[1] = GUINT32_TO_LE((guint32)(hdr.time % G_USEC_PER_SEC));
+				ttyrec[2] = GUINT32_TO_LE(hdr.len);
+				g_byte_array_append(rec->batch, (const guint8 *)ttyrec, sizeof(ttyrec));
+			}
+			g_byte_array_set_size(rec->batch, rec->batch->len + hdr.len);
+			remmina_ssh_recorder_ring_get(rec, tail + sizeof(hdr),
+						      rec->batch->data + rec->batch->len - hdr.len, hdr.len);
+			rec->size += hdr.len;
+			tail += sizeof(hdr) + hdr.len;
+		}
+		g_atomic_int_set(&rec->tail, (gint)tail);
+
+		remmina_ssh_recorder_write_batch(rec);
+		if (rec->max_size > 0 && rec->size >= rec->max_size)
+			remmina_ssh_recorder_rotate(rec);
+	}
+
+	return NULL;
+}
+
+RemminaSSHRecorder *remmina_ssh_recorder_new(const gchar *filename, RemminaSSHRecorderFormat format, gboolean compress, goffset max_size)
+{
+	TRACE_CALL(__func__);
+	RemminaSSHRecorder *rec;
+
+	rec = g_new0(RemminaSSHRecorder, 1);
+	rec->path = compress ? g_strconcat(filename, ".gz", NULL) : g_strdup(filename);
+	rec->format = format;
+	rec->compress = compress;
+	rec->max_size = max_size;
+
+	if (!remmina_ssh_recorder_open(rec)) {
+		g_free(rec->path);
+		g_free(rec);
+		return NULL;
+	}
+
+	REMMINA_DEBUG("Saving session log to %s", rec->path);
+	rec->ring = g_malloc(REMMINA_SSH_RECORDER_RING_SIZE);
+	rec->batch = g_byte_array_sized_new(REMMINA_SSH_RECORDER_RING_SIZE);
+	rec->thread = g_thread_new("remmina-ssh-log", remmina_ssh_recorder_thread, rec);
+	return rec;
+}
+
+void remmina_ssh_recorder_free(RemminaSSHRecorder *rec)
+{
+	TRACE_CALL(__func__);
+	gint dropped;
+
+	g_atomic_int_set(&rec->stop, 1);
+	g_thread_join(rec->thread);
+	remmina_ssh_recorder_close(rec);
+
+	dropped = g_atomic_int_get(&rec->dropped);
+	if (dropped > 0)
+		REMMINA_WARNING("%d bytes of terminal output could not be saved to %s", dropped, rec->path);
+
+	g_byte_array_unref(rec->batch);
+	g_free(rec->ring);
+	g_free(rec->path);
+	g_free(rec);
+}
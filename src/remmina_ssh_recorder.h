@@ -0,0 +1,59 @@
+/*
+ * Remmina - The GTK+ Remote Desktop Client
+ * Copyright (C) 2016-2023 Antenore Gatta, Giovanni Panozzo
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU General Public License in all respects
+ *  for all of the code used other than OpenSSL. *  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so. *  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version. *  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	REMMINA_SSH_RECORDER_PLAIN,
+	/* ttyrec: every chunk is preceded by its time and length */
+	REMMINA_SSH_RECORDER_TTYREC
+} RemminaSSHRecorderFormat;
+
+typedef struct _RemminaSSHRecorder RemminaSSHRecorder;
+
+/* Records a terminal stream to filename from a writer thread. A gzip
+ * compressed file gets a ".gz" suffix. When max_size is not 0 the file is
+ * rotated after max_size bytes of terminal output. */
+RemminaSSHRecorder *remmina_ssh_recorder_new(const gchar *filename, RemminaSSHRecorderFormat format, gboolean compress, goffset max_size);
+/* Queue data for the writer, never blocks. It must always be called from
+ * the same thread. */
+void remmina_ssh_recorder_feed(RemminaSSHRecorder *rec, const void *data, gsize len);
+/* Flush what is queued and close the file */
+void remmina_ssh_recorder_free(RemminaSSHRecorder *rec);
+
+G_END_DECLS